@@ -0,0 +1,68 @@
+#include "debouncer.h"
+#include "soc/soc.h"
+#include "soc/gpio_reg.h"
+#include <string.h>
+
+/**
+ * Initialize the debouncer for a set of pins.
+ * 
+ * @param db Pointer to the debouncer structure
+ * @param pin_mask Bit n set to debounce GPIO n
+ * @param initial_levels Stable levels to start from, usually one debouncer_read_inputs()
+ */
+void debouncer_init(debouncer_t *db, uint64_t pin_mask, uint64_t initial_levels) {
+    memset(db, 0, sizeof(*db));
+    db->pin_mask = pin_mask;
+    db->levels = initial_levels & pin_mask;
+}
+
+/**
+ * Debounce every configured pin in parallel from one input snapshot.
+ * Each pin owns one bit in every counter plane. Pins whose raw level matches
+ * the stable level have their counter cleared; the others count up, and a
+ * carry out of the top plane means the new level held long enough to flip.
+ * 
+ * @param db Pointer to the debouncer structure
+ * @param raw_levels Raw input levels, bit n = GPIO n
+ */
+void debouncer_update(debouncer_t *db, uint64_t raw_levels) {
+    uint64_t delta = (raw_levels ^ db->levels) & db->pin_mask;
+    uint64_t carry = delta;
+
+    for (int i = 0; i < DEBOUNCE_COUNTER_BITS; i++) {
+        uint64_t plane = db->counter[i];
+        db->counter[i] = (plane ^ carry) & delta;
+        carry &= plane;
+    }
+
+    db->levels ^= carry;
+    db->rose = carry & db->levels;
+    db->fell = carry & ~db->levels;
+}
+
+/**
+ * Read GPIO 0-31 and, where the chip has them, GPIO 32+ from the input registers.
+ * 
+ * @return Raw input levels, bit n = GPIO n
+ */
+uint64_t debouncer_read_inputs(void) {
+    uint64_t levels = REG_READ(GPIO_IN_REG);
+#ifdef GPIO_IN1_REG
+    levels |= (uint64_t)REG_READ(GPIO_IN1_REG) << 32;
+#endif
+    return levels;
+}
+
+/**
+ * Check whether any pin is still counting towards a level change.
+ * 
+ * @param db Pointer to the debouncer structure
+ * @return True if every counter is zero
+ */
+bool debouncer_is_settled(const debouncer_t *db) {
+    uint64_t pending = 0;
+    for (int i = 0; i < DEBOUNCE_COUNTER_BITS; i++) {
+        pending |= db->counter[i];
+    }
+    return pending == 0;
+}
@@ -0,0 +1,45 @@
+#ifndef DEBOUNCER_H
+#define DEBOUNCER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Width of each per-pin vertical counter; a pin must read the new level
+// 2^DEBOUNCE_COUNTER_BITS samples in a row before its stable level flips
+#define DEBOUNCE_COUNTER_BITS 4
+
+// Multi-channel debouncer, one bit lane per GPIO number
+typedef struct {
+    uint64_t pin_mask;                          // Pins being debounced
+    uint64_t levels;                            // Stable (debounced) levels
+    uint64_t counter[DEBOUNCE_COUNTER_BITS];    // Vertical counter bit planes, LSB first
+    uint64_t rose;                              // Pins that went low -> high on the last update
+    uint64_t fell;                              // Pins that went high -> low on the last update
+} debouncer_t;
+
+// Start debouncing pin_mask with the given initial stable levels
+void debouncer_init(debouncer_t *db, uint64_t pin_mask, uint64_t initial_levels);
+
+// Feed one raw snapshot of all input levels (bit n = GPIO n)
+void debouncer_update(debouncer_t *db, uint64_t raw_levels);
+
+// Snapshot the GPIO input registers in one read per register
+uint64_t debouncer_read_inputs(void);
+
+// Check if no pin is in the middle of a transition
+bool debouncer_is_settled(const debouncer_t *db);
+
+// Per-pin stable level and edge events from the last update
+static inline bool debouncer_level(const debouncer_t *db, uint8_t pin) {
+    return (db->levels >> pin) & 1;
+}
+
+static inline bool debouncer_rose(const debouncer_t *db, uint8_t pin) {
+    return (db->rose >> pin) & 1;
+}
+
+static inline bool debouncer_fell(const debouncer_t *db, uint8_t pin) {
+    return (db->fell >> pin) & 1;
+}
+
+#endif // DEBOUNCER_H
@@ -0,0 +1,194 @@
+#include "multipart.h"
+#include <string.h>
+
+/// RFC 2046 bchars; in particular never CR or LF
+static bool boundary_char(char c) {
+    return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+           strchr("'()+_,-./:=? ", c) != NULL;
+}
+
+bool multipart_boundary_from_content_type(const char *content_type, char *boundary, size_t size) {
+    const char *start = strstr(content_type, "boundary=");
+    if (start == NULL) {
+        return false;
+    }
+    start += strlen("boundary=");
+    const char *end;
+    if (*start == '"') {
+        start++;
+        end = strchr(start, '"');
+        if (end == NULL) {
+            return false;
+        }
+    } else {
+        end = start;
+        while (*end != '\0' && *end != ';' && *end != ' ' && *end != '\t') {
+            end++;
+        }
+    }
+    size_t len = (size_t)(end - start);
+    if (len == 0 || len > MULTIPART_BOUNDARY_MAX || len >= size) {
+        return false;
+    }
+    memcpy(boundary, start, len);
+    boundary[len] = '\0';
+    return true;
+}
+
+bool multipart_init(multipart_parser_t *p, const char *boundary, multipart_data_cb_t on_data, void *ctx) {
+    size_t len = strlen(boundary);
+    if (len == 0 || len > MULTIPART_BOUNDARY_MAX) {
+        return false;
+    }
+    for (size_t i = 0; i < len; i++) {
+        if (!boundary_char(boundary[i])) {
+            return false;
+        }
+    }
+    memset(p, 0, sizeof(*p));
+    memcpy(p->delim, "\r\n--", 4);
+    memcpy(p->delim + 4, boundary, len);
+    p->delim_len = (uint8_t)(len + 4);
+    memset(p->skip, p->delim_len, sizeof(p->skip));
+    for (uint8_t i = 0; i + 1 < p->delim_len; i++) {
+        p->skip[p->delim[i]] = (uint8_t)(p->delim_len - 1 - i);
+    }
+    p->state = MULTIPART_PREAMBLE;
+    p->matched = 2;     // The first delimiter may open the body without its CR LF
+    p->on_data = on_data;
+    p->ctx = ctx;
+    return true;
+}
+
+/// Hands body bytes to the callback; preamble bytes are dropped
+static bool emit(multipart_parser_t *p, const uint8_t *data, size_t len) {
+    if (p->state != MULTIPART_BODY || len == 0) {
+        return true;
+    }
+    if (!p->on_data(p->ctx, p->parts - 1, data, len)) {
+        p->state = MULTIPART_ERROR;
+        return false;
+    }
+    return true;
+}
+
+static void delimiter_found(multipart_parser_t *p) {
+    p->matched = 0;
+    p->progress = 0;
+    p->state = MULTIPART_DELIM_TAIL;
+}
+
+/// Preamble or body: everything up to the next delimiter, which may run past
+/// the end of the chunk. Returns the bytes consumed.
+static size_t scan(multipart_parser_t *p, const uint8_t *data, size_t len) {
+    size_t dlen = p->delim_len;
+
+    // Finish a delimiter the last chunk ended in, or give its bytes back
+    if (p->matched > 0) {
+        size_t want = dlen - p->matched;
+        size_t n = len < want ? len : want;
+        if (memcmp(data, p->delim + p->matched, n) == 0) {
+            if (n < want) {
+                p->matched += (uint8_t)n;
+                return len;
+            }
+            delimiter_found(p);
+            return n;
+        }
+        uint8_t held = p->matched;
+        p->matched = 0;
+        if (!emit(p, p->delim, held)) {
+            return len;
+        }
+    }
+
+    size_t pos = 0;
+    while (pos + dlen <= len) {
+        uint8_t last = data[pos + dlen - 1];
+        if (last == p->delim[dlen - 1] && memcmp(data + pos, p->delim, dlen - 1) == 0) {
+            if (emit(p, data, pos)) {
+                delimiter_found(p);
+            }
+            return pos + dlen;
+        }
+        pos += p->skip[last];
+    }
+
+    // Hold back a delimiter prefix at the end; the skips above never passed one
+    size_t hold = len;
+    size_t from = len >= dlen ? len - dlen + 1 : 0;
+    for (size_t i = from > pos ? from : pos; i < len; i++) {
+        if (data[i] == '\r' && memcmp(data + i, p->delim, len - i) == 0) {
+            hold = i;
+            break;
+        }
+    }
+    if (emit(p, data, hold)) {
+        p->matched = (uint8_t)(len - hold);
+    }
+    return len;
+}
+
+/// After a delimiter: "--" closes the body, optional padding then CR LF opens a part
+static void delim_tail_byte(multipart_parser_t *p, uint8_t c) {
+    if (p->progress == 1) {
+        p->state = c == '-' ? MULTIPART_DONE : MULTIPART_ERROR;
+    } else if (p->progress == 2) {
+        if (c != '\n') {
+            p->state = MULTIPART_ERROR;
+            return;
+        }
+        p->state = MULTIPART_HEADERS;
+        p->progress = 2;    // That CR LF also ends a part with no headers
+        p->header_bytes = 0;
+    } else if (c == '-') {
+        p->progress = 1;
+    } else if (c == '\r') {
+        p->progress = 2;
+    } else if (c != ' ' && c != '\t') {
+        p->state = MULTIPART_ERROR;
+    }
+}
+
+/// Part headers are skipped up to the empty line
+static void header_byte(multipart_parser_t *p, uint8_t c) {
+    static const char crlfcrlf[] = "\r\n\r\n";
+    if (++p->header_bytes > MULTIPART_HEADERS_MAX) {
+        p->state = MULTIPART_ERROR;
+        return;
+    }
+    if (c == (uint8_t)crlfcrlf[p->progress]) {
+        p->progress++;
+    } else {
+        p->progress = c == '\r' ? 1 : 0;
+    }
+    if (p->progress == 4) {
+        p->state = MULTIPART_BODY;
+        p->parts++;
+    }
+}
+
+size_t multipart_held(const multipart_parser_t *p) {
+    return p->state == MULTIPART_BODY ? p->matched : 0;
+}
+
+multipart_state_t multipart_feed(multipart_parser_t *p, const uint8_t *data, size_t len) {
+    size_t pos = 0;
+    while (pos < len && p->state < MULTIPART_DONE) {
+        switch (p->state) {
+            case MULTIPART_PREAMBLE:
+            case MULTIPART_BODY:
+                pos += scan(p, data + pos, len - pos);
+                break;
+            case MULTIPART_DELIM_TAIL:
+                delim_tail_byte(p, data[pos++]);
+                break;
+            case MULTIPART_HEADERS:
+                header_byte(p, data[pos++]);
+                break;
+            default:
+                break;
+        }
+    }
+    return p->state;
+}
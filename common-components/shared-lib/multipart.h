@@ -0,0 +1,64 @@
+#ifndef MULTIPART_H
+#define MULTIPART_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+// Incremental multipart/form-data parser for uploads received in chunks of
+// any size. Body bytes are handed to a callback as pointers into the chunk
+// being fed, so nothing is buffered or copied; the only state carried between
+// chunks is how much of a delimiter the last chunk ended with. The delimiter
+// is found with a Horspool skip table, and since it is CR LF "--" boundary and
+// a boundary cannot contain CR, a partial match can only start at a CR: bytes
+// held back that turn out not to be a delimiter are handed over from the
+// parser's own copy of it.
+
+#define MULTIPART_BOUNDARY_MAX  70                          // RFC 2046
+#define MULTIPART_DELIM_MAX     (MULTIPART_BOUNDARY_MAX + 4) // CR LF "--" boundary
+#define MULTIPART_HEADERS_MAX   1024                        // Part header bytes before the upload is rejected
+
+typedef enum {
+    MULTIPART_PREAMBLE,     // Before the first delimiter
+    MULTIPART_DELIM_TAIL,   // After a delimiter: "--" ends the body, CR LF starts a part
+    MULTIPART_HEADERS,      // Part headers, up to the empty line
+    MULTIPART_BODY,
+    MULTIPART_DONE,         // Closing delimiter seen, the rest is ignored
+    MULTIPART_ERROR,        // Malformed, or the callback stopped it
+} multipart_state_t;
+
+// Body bytes of a part, parts numbered from 0 in upload order. Return false
+// to stop parsing.
+typedef bool (*multipart_data_cb_t)(void *ctx, uint32_t part, const uint8_t *data, size_t len);
+
+typedef struct {
+    uint8_t delim[MULTIPART_DELIM_MAX];
+    uint8_t delim_len;
+    uint8_t skip[256];          // Horspool shift for the byte under the delimiter's last position
+    multipart_state_t state;
+    uint8_t matched;            // Delimiter bytes at the end of the last chunk
+    uint8_t progress;           // DELIM_TAIL: '-' seen, HEADERS: bytes of CR LF CR LF matched
+    uint16_t header_bytes;
+    uint32_t parts;             // Parts whose body has started
+    multipart_data_cb_t on_data;
+    void *ctx;
+} multipart_parser_t;
+
+// Copy the boundary parameter of a Content-Type header value, quoted or not.
+// Returns false if there is none or it is not a valid boundary.
+bool multipart_boundary_from_content_type(const char *content_type, char *boundary, size_t size);
+
+// Start before the first delimiter. Returns false for an empty, overlong or
+// invalid boundary.
+bool multipart_init(multipart_parser_t *p, const char *boundary, multipart_data_cb_t on_data, void *ctx);
+
+// Parse the next chunk; returns the state after it. Chunks may split the
+// delimiter, the part headers or the body anywhere.
+multipart_state_t multipart_feed(multipart_parser_t *p, const uint8_t *data, size_t len);
+
+// Bytes held back from the last chunk that may still turn out to be body. The
+// next chunk's body output is at most this much longer than the chunk, so a
+// chunk received this far past the body kept so far can be compacted in place.
+size_t multipart_held(const multipart_parser_t *p);
+
+#endif // MULTIPART_H
@@ -2,13 +2,21 @@
 #include "esp_wifi.h"
 #include "esp_now.h"
 #include "esp_log.h"
+#include "esp_timer.h"
 #include "esp_ota_ops.h"
 #include "esp_http_server.h"
 #include "esp_heap_caps.h"
+#include "nvs.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "driver/gpio.h"
 #include "state_machine.h"
+#include "multipart.h"
+#include "ota_pipeline.h"
+#include "ota_signature.h"
+#include "ota_resume.h"
+#include "ota_stream.h"
+#include <stdio.h>
 #include <string.h>
 
 static const char *TAG = "OTA_MODULE";
@@ -21,150 +29,319 @@ static const char* OTA_PASSWORD = "12345678";
 /* OTA button pin */
 static const uint8_t OTA_BUTTON_PIN_INPUT = 0;
 
-/* Global OTA GPIO ring buffer */
-ringbuf_t ota_gpio_ringbuf = {0};
-
-/* Forward declaration of receive callback */
-void receive_cb(const esp_now_recv_info_t *recv_info, const uint8_t *data, int len);
-
 static esp_err_t upload_page_handler(httpd_req_t *req) {
     const char* html = "<!DOCTYPE html><html><head><title>ESP32 OTA Update</title></head><body>"
         "<h2>ESP32 OTA Update</h2>"
         "<form method='POST' action='/update' enctype='multipart/form-data'>"
-        "<input type='file' name='firmware' accept='.bin'><br><br>"
+        "<input type='file' name='firmware' accept='.bin,.gota'><br><br>"
+        "Signature: <input type='file' name='signature' accept='.sig'><br><br>"
         "<input type='submit' value='Upload Firmware'>"
         "</form></body></html>";
     httpd_resp_send(req, html, strlen(html));
     return ESP_OK;
 }
 
-static esp_err_t update_handler_func(httpd_req_t *req) {
-    esp_ota_handle_t ota_handle = 0;
-    const esp_partition_t *ota_partition = NULL;
-    esp_err_t err;
-    
-    ESP_LOGI(TAG, "Starting OTA update...");
-    
+/* One upload at a time: the server runs handlers on its single task */
+static multipart_parser_t ota_parser;
+static uint8_t ota_signature[OTA_SIGNATURE_MAX];
+static size_t ota_signature_len = 0;
+static bool ota_signature_overflow = false;
+
+/* Receive timeouts in a row (HTTPD_DEFAULT_CONFIG waits 5 s each) before the client is given up on */
+#define OTA_RECV_TIMEOUTS   3
+#define OTA_RX_BUF_SIZE     2048
+#define OTA_PLAIN_MAGIC     0xE9    // ESP_IMAGE_HEADER_MAGIC: first byte of a .bin
+
+typedef enum {
+    OTA_IMAGE_UNKNOWN,          // No image byte seen yet
+    OTA_IMAGE_PLAIN,            // A .bin, received in place into the pipeline buffers
+    OTA_IMAGE_STREAM,           // Compressed or delta (ota_stream.h), decoded into them
+} ota_image_kind_t;
+
+/* Image in progress, kept across requests so a dropped upload can resume */
+static ota_resume_t ota_session;
+static esp_ota_handle_t ota_handle = 0;
+static bool ota_handle_open = false;
+static const esp_partition_t *ota_partition = NULL;
+static const esp_partition_t *ota_base_partition = NULL;
+static ota_image_kind_t ota_image_kind = OTA_IMAGE_UNKNOWN;
+static bool ota_store_only = false;     // ?target=sender: keep the image for the sender, do not boot it
+static ota_stream_t ota_decoder;
+
+/* Receive buffer for anything not received in place */
+static uint8_t ota_rx[OTA_RX_BUF_SIZE];
+
+typedef struct {
+    uint8_t *buf;               // Pipeline buffer being filled
+    size_t fill;                // Image bytes at its start
+    bool started;               // Pipeline running for this request
+    esp_err_t err;              // Opening the partition or starting the writer failed
+    size_t erase_size;          // Upload size, what a plain image erases up front
+    int written;                // Upload bytes of the image taken, plain or stream
+} ota_upload_t;
+
+static ota_upload_t ota_upload;
+
+static void ota_session_abort(void);
+static esp_err_t ota_session_open(size_t erase_size);
+
+/**
+ * @brief Answer with the resume status, under an HTTP status line other than 200 if given
+ */
+static esp_err_t ota_send_status(httpd_req_t *req, const char *status) {
+    char json[96];
+    int len = ota_resume_status_json(&ota_session, ota_signature_len > 0 && !ota_signature_overflow,
+                                     json, sizeof(json));
+    if (status != NULL) {
+        httpd_resp_set_status(req, status);
+    }
+    httpd_resp_set_type(req, "application/json");
+    return httpd_resp_send(req, json, len);
+}
+
+/* --------------------------------------------------------------------------
+ * Image bytes: upload -> (stream decoder) -> pipeline buffers
+ * -------------------------------------------------------------------------- */
+
+/**
+ * @brief Open the partition if this is the image's first byte, and start the writer
+ * Deferred to the first byte out so a stream's header can say how much to erase.
+ */
+static bool ota_output_start(ota_upload_t *upload) {
+    bool resume = ota_handle_open;
+    if (!ota_handle_open) {
+        size_t erase_size = ota_image_kind == OTA_IMAGE_STREAM ? ota_decoder.header.image_size : upload->erase_size;
+        upload->err = ota_session_open(erase_size);
+        if (upload->err != ESP_OK) {
+            return false;
+        }
+        ota_handle_open = true;
+    }
+    upload->err = ota_pipeline_start(ota_handle, resume);
+    if (upload->err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to start the OTA writer (%s)", esp_err_to_name(upload->err));
+        return false;
+    }
+    upload->started = true;
+    upload->buf = ota_pipeline_acquire();
+    return upload->buf != NULL;
+}
+
+/**
+ * @brief Image bytes into the pipeline buffers, queueing each one as it fills
+ * In-place bytes already sit at or past the fill, so moving them down never
+ * overwrites bytes yet to be read.
+ */
+static bool ota_output(ota_upload_t *upload, const uint8_t *data, size_t len) {
+    if (upload->buf == NULL && (upload->started || !ota_output_start(upload))) {
+        return false;
+    }
+    while (len > 0) {
+        size_t n = OTA_PIPELINE_BUF_SIZE - upload->fill < len ? OTA_PIPELINE_BUF_SIZE - upload->fill : len;
+        if (data != upload->buf + upload->fill) {
+            memmove(upload->buf + upload->fill, data, n);
+        }
+        upload->fill += n;
+        data += n;
+        len -= n;
+        if (upload->fill == OTA_PIPELINE_BUF_SIZE) {
+            ota_pipeline_submit(upload->buf, upload->fill);
+            upload->buf = ota_pipeline_acquire();
+            upload->fill = 0;
+            if (upload->buf == NULL) {
+                return false;   // A write failed
+            }
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief Check a stream against the partitions before anything is erased
+ * A delta must have been made against the very image that is running.
+ */
+static bool ota_stream_header_cb(void *ctx, const ota_stream_header_t *header) {
+    const esp_partition_t *next = esp_ota_get_next_update_partition(NULL);
+    if (next == NULL || header->image_size > next->size) {
+        ESP_LOGE(TAG, "Image of %lu bytes does not fit the OTA partition", (unsigned long)header->image_size);
+        return false;
+    }
+    if (!(header->flags & OTA_STREAM_FLAG_DELTA)) {
+        ESP_LOGI(TAG, "Compressed image of %lu bytes", (unsigned long)header->image_size);
+        return true;
+    }
+    ota_base_partition = esp_ota_get_running_partition();
+    if (ota_base_partition == NULL || header->base_size > ota_base_partition->size) {
+        ESP_LOGE(TAG, "Delta base of %lu bytes is larger than the running partition",
+                 (unsigned long)header->base_size);
+        return false;
+    }
+    uint8_t chunk[512];
+    uint8_t digest[SHA256_DIGEST_LEN];
+    sha256_ctx_t sha;
+    sha256_init(&sha);
+    for (uint32_t offset = 0; offset < header->base_size; offset += sizeof(chunk)) {
+        size_t n = header->base_size - offset < sizeof(chunk) ? header->base_size - offset : sizeof(chunk);
+        if (esp_partition_read(ota_base_partition, offset, chunk, n) != ESP_OK) {
+            sha256_final(&sha, digest);
+            return false;
+        }
+        sha256_update(&sha, chunk, n);
+    }
+    sha256_final(&sha, digest);
+    if (memcmp(digest, header->base_sha256, SHA256_DIGEST_LEN) != 0) {
+        ESP_LOGE(TAG, "Delta was made against another image than the one running");
+        return false;
+    }
+    ESP_LOGI(TAG, "Delta image of %lu bytes against the running %lu", (unsigned long)header->image_size,
+             (unsigned long)header->base_size);
+    return true;
+}
+
+static bool ota_stream_data_cb(void *ctx, const uint8_t *data, size_t len) {
+    return ota_output(ctx, data, len);
+}
+
+static bool ota_stream_base_cb(void *ctx, uint32_t offset, uint8_t *data, size_t len) {
+    return esp_partition_read(ota_base_partition, offset, data, len) == ESP_OK;
+}
+
+/**
+ * @brief Bytes of the uploaded file in order; the first one says plain or stream
+ */
+static bool ota_image_bytes(ota_upload_t *upload, const uint8_t *data, size_t len) {
+    if (ota_image_kind == OTA_IMAGE_UNKNOWN) {
+        ota_image_kind = data[0] == OTA_PLAIN_MAGIC ? OTA_IMAGE_PLAIN : OTA_IMAGE_STREAM;
+        if (ota_image_kind == OTA_IMAGE_STREAM) {
+            ota_stream_init(&ota_decoder, ota_stream_header_cb, ota_stream_data_cb, ota_stream_base_cb, upload);
+        }
+    }
+    upload->written += len;
+    if (ota_image_kind == OTA_IMAGE_STREAM) {
+        return ota_stream_feed(&ota_decoder, data, len) != OTA_STREAM_ERROR;
+    }
+    return ota_output(upload, data, len);
+}
+
+/**
+ * @brief Multipart body bytes: the firmware part is the image, the second file its signature
+ * Any later part is ignored.
+ */
+static bool ota_collect_part(void *ctx, uint32_t part, const uint8_t *data, size_t len) {
+    if (part == 1) {
+        if (ota_signature_len + len > sizeof(ota_signature)) {
+            ota_signature_overflow = true;
+        } else {
+            memcpy(ota_signature + ota_signature_len, data, len);
+            ota_signature_len += len;
+        }
+        return true;
+    }
+    if (part != 0) {
+        return true;
+    }
+    return ota_image_bytes(ctx, data, len);
+}
+
+/* --------------------------------------------------------------------------
+ * Image in progress
+ * -------------------------------------------------------------------------- */
+
+/**
+ * @brief Drop the image in progress, if any
+ */
+static void ota_session_abort(void) {
+    if (ota_handle_open) {
+        esp_ota_abort(ota_handle);
+        ESP_LOGW(TAG, "Dropped the image in progress at %lu bytes", (unsigned long)ota_session.offset);
+    }
+    ota_handle_open = false;
+    ota_image_kind = OTA_IMAGE_UNKNOWN;
+    ota_resume_reset(&ota_session);
+}
+
+/**
+ * @brief Open the next update partition for a new image
+ * @param erase_size Bytes to erase up front, or OTA_WITH_SEQUENTIAL_WRITES
+ */
+static esp_err_t ota_session_open(size_t erase_size) {
     ota_partition = esp_ota_get_next_update_partition(NULL);
     if (ota_partition == NULL) {
         ESP_LOGE(TAG, "No OTA partition found");
-        httpd_resp_send_500(req);
-        return ESP_FAIL;
+        return ESP_ERR_NOT_FOUND;
     }
     
     ESP_LOGI(TAG, "Writing to partition subtype %d at offset 0x%x", 
              ota_partition->subtype, ota_partition->address);
     
-    err = esp_ota_begin(ota_partition, OTA_WITH_SEQUENTIAL_WRITES, &ota_handle);
+    // Told the size, esp_ota_begin() erases it up front in 64 KB blocks, several times faster
+    // than the sector by sector erase of sequential writes
+    if (erase_size == 0 || erase_size > ota_partition->size) {
+        erase_size = OTA_WITH_SEQUENTIAL_WRITES;
+    }
+    esp_err_t err = esp_ota_begin(ota_partition, erase_size, &ota_handle);
     if (err != ESP_OK) {
         ESP_LOGE(TAG, "esp_ota_begin failed (%s)", esp_err_to_name(err));
-        httpd_resp_send_500(req);
-        return ESP_FAIL;
     }
-    
-    char boundary[128];
-    size_t boundary_len = 0;
-    
-    // Get boundary from Content-Type header
-    size_t hdr_len = httpd_req_get_hdr_value_len(req, "Content-Type");
-    if (hdr_len > 0) {
-        char *content_type = malloc(hdr_len + 1);
-        httpd_req_get_hdr_value_str(req, "Content-Type", content_type, hdr_len + 1);
-        
-        char *boundary_start = strstr(content_type, "boundary=");
-        if (boundary_start) {
-            boundary_start += 9; // length of "boundary="
-            strncpy(boundary, boundary_start, sizeof(boundary) - 1);
-            boundary[sizeof(boundary) - 1] = '\0';
-            boundary_len = strlen(boundary);
-        }
-        free(content_type);
+    return err;
+}
+
+/**
+ * @brief Keep a sender image's signature for sender_ota.c to send with it
+ * Saved with the image digest, so a signature left from an older image is never sent.
+ */
+static esp_err_t ota_store_sender_signature(const uint8_t digest[SHA256_DIGEST_LEN]) {
+    static uint8_t blob[SHA256_DIGEST_LEN + OTA_SIGNATURE_MAX];
+    size_t sig_len = ota_signature_overflow ? 0 : ota_signature_len;
+    memcpy(blob, digest, SHA256_DIGEST_LEN);
+    memcpy(blob + SHA256_DIGEST_LEN, ota_signature, sig_len);
+    nvs_handle_t nvs;
+    esp_err_t err = nvs_open(OTA_SENDER_SIG_NAMESPACE, NVS_READWRITE, &nvs);
+    if (err != ESP_OK) {
+        return err;
     }
-    
-    char *buf = malloc(4096);
-    if (!buf) {
-        ESP_LOGE(TAG, "Failed to allocate buffer");
-        esp_ota_abort(ota_handle);
-        httpd_resp_send_500(req);
-        return ESP_FAIL;
+    err = nvs_set_blob(nvs, OTA_SENDER_SIG_KEY, blob, SHA256_DIGEST_LEN + sig_len);
+    if (err == ESP_OK) {
+        err = nvs_commit(nvs);
+    }
+    nvs_close(nvs);
+    return err;
+}
+
+/**
+ * @brief Check the completed image and boot it
+ */
+static esp_err_t ota_session_finish(httpd_req_t *req, const uint8_t digest[SHA256_DIGEST_LEN]) {
+    char digest_hex[2 * SHA256_DIGEST_LEN + 1];
+    for (int i = 0; i < SHA256_DIGEST_LEN; i++) {
+        sprintf(digest_hex + 2 * i, "%02x", digest[i]);
+    }
+    if (ota_image_kind == OTA_IMAGE_STREAM) {
+        ESP_LOGI(TAG, "Image of %lu bytes from a %lu byte %s stream, SHA-256 %s",
+                 (unsigned long)ota_decoder.out_pos, (unsigned long)ota_session.offset,
+                 (ota_decoder.header.flags & OTA_STREAM_FLAG_DELTA) ? "delta" : "compressed", digest_hex);
+    } else {
+        ESP_LOGI(TAG, "Image of %lu bytes, SHA-256 %s", (unsigned long)ota_session.offset, digest_hex);
     }
     
-    int total_received = 0;
-    int binary_start = -1;
-    bool headers_parsed = false;
-    
-    while (1) {
-        int received = httpd_req_recv(req, buf, 4096);
-        if (received <= 0) {
-            break;
-        }
-        
-        if (!headers_parsed) {
-            // Look for the end of multipart headers (double CRLF)
-            for (int i = 0; i < received - 3; i++) {
-                if (buf[i] == '\r' && buf[i+1] == '\n' && buf[i+2] == '\r' && buf[i+3] == '\n') {
-                    binary_start = i + 4;
-                    headers_parsed = true;
-                    break;
-                }
-            }
-            
-            if (headers_parsed && binary_start < received) {
-                // Write the binary data after headers
-                int binary_len = received - binary_start;
-                err = esp_ota_write(ota_handle, buf + binary_start, binary_len);
-                if (err != ESP_OK) {
-                    ESP_LOGE(TAG, "esp_ota_write failed (%s)", esp_err_to_name(err));
-                    esp_ota_abort(ota_handle);
-                    free(buf);
-                    httpd_resp_send_500(req);
-                    return ESP_FAIL;
-                }
-                total_received += binary_len;
-            }
-        } else {
-            // Check if this chunk contains the boundary (end of file)
-            if (boundary_len > 0) {
-                char boundary_pattern[132];
-                snprintf(boundary_pattern, sizeof(boundary_pattern), "\r\n--%s", boundary);
-                
-                char *boundary_pos = strstr(buf, boundary_pattern);
-                if (boundary_pos) {
-                    // Only write data up to the boundary
-                    int data_len = boundary_pos - buf;
-                    if (data_len > 0) {
-                        err = esp_ota_write(ota_handle, buf, data_len);
-                        if (err != ESP_OK) {
-                            ESP_LOGE(TAG, "esp_ota_write failed (%s)", esp_err_to_name(err));
-                            esp_ota_abort(ota_handle);
-                            free(buf);
-                            httpd_resp_send_500(req);
-                            return ESP_FAIL;
-                        }
-                        total_received += data_len;
-                    }
-                    break; // End of file reached
-                }
-            }
-            
-            // Write the entire chunk
-            err = esp_ota_write(ota_handle, buf, received);
-            if (err != ESP_OK) {
-                ESP_LOGE(TAG, "esp_ota_write failed (%s)", esp_err_to_name(err));
-                esp_ota_abort(ota_handle);
-                free(buf);
-                httpd_resp_send_500(req);
-                return ESP_FAIL;
-            }
-            total_received += received;
+    // Checked before esp_ota_end() so a refused image never gets near the boot partition
+    if (ota_signature_required()) {
+        if (ota_signature_len == 0 || ota_signature_overflow ||
+            ota_signature_verify(digest, ota_signature, ota_signature_len) != ESP_OK) {
+            ESP_LOGE(TAG, "Image refused: %s", ota_signature_len == 0 ? "not signed" : "bad signature");
+            ota_session_abort();
+            httpd_resp_send_err(req, HTTPD_403_FORBIDDEN, "Image signature did not verify");
+            return ESP_FAIL;
         }
+        ESP_LOGI(TAG, "Signature verified");
+    } else if (ota_signature_len > 0) {
+        ESP_LOGW(TAG, "No signing key built in, signature not checked");
     }
     
-    free(buf);
-    
-    ESP_LOGI(TAG, "Total binary data length: %d", total_received);
-    
-    err = esp_ota_end(ota_handle);
+    // esp_ota_end() releases the handle whatever it returns
+    esp_err_t err = esp_ota_end(ota_handle);
+    ota_handle_open = false;
+    ota_session_abort();
     if (err != ESP_OK) {
         if (err == ESP_ERR_OTA_VALIDATE_FAILED) {
             ESP_LOGE(TAG, "Image validation failed, image is corrupted");
@@ -173,6 +350,18 @@ static esp_err_t update_handler_func(httpd_req_t *req) {
         httpd_resp_send_500(req);
         return ESP_FAIL;
     }
+    if (ota_store_only) {
+        // The sender checks the signature itself before it installs the image
+        err = ota_store_sender_signature(digest);
+        if (err != ESP_OK) {
+            ESP_LOGE(TAG, "Failed to keep the sender image signature (%s)", esp_err_to_name(err));
+            httpd_resp_send_500(req);
+            return ESP_FAIL;
+        }
+        ESP_LOGI(TAG, "Image stored in partition subtype %d for the sender", ota_partition->subtype);
+        httpd_resp_sendstr(req, "Stored for the sender, turn on the sender OTA switch to send it");
+        return ESP_OK;
+    }
     
     err = esp_ota_set_boot_partition(ota_partition);
     if (err != ESP_OK) {
@@ -190,6 +379,204 @@ static esp_err_t update_handler_func(httpd_req_t *req) {
     return ESP_OK;
 }
 
+/**
+ * @brief Firmware upload: the page's form, or raw image bytes with an optional Content-Range
+ * A form upload or a range from 0 starts a new image; a range from the committed
+ * offset continues it. Whatever was written before a connection dropped is kept.
+ * The file is a .bin or a compressed or delta stream made by host/tools/ota_pack.
+ * With ?target=sender the image is only stored, for the receiver to pass on to
+ * the sender over ESP-NOW.
+ */
+static esp_err_t update_handler_func(httpd_req_t *req) {
+    ota_upload_t *upload = &ota_upload;
+    esp_err_t err;
+    int64_t start_us = esp_timer_get_time();
+    
+    memset(upload, 0, sizeof(*upload));
+    
+    // A Content-Range or a non-form body is raw image bytes, a form carries them in a part
+    char header[128];
+    char boundary[MULTIPART_BOUNDARY_MAX + 1];
+    ota_range_t range = {0};
+    bool form = false;
+    if (httpd_req_get_hdr_value_str(req, "Content-Range", header, sizeof(header)) == ESP_OK) {
+        if (!ota_resume_parse_range(header, &range) || req->content_len != range.last - range.first + 1) {
+            httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Bad Content-Range");
+            return ESP_FAIL;
+        }
+    } else if (httpd_req_get_hdr_value_str(req, "Content-Type", header, sizeof(header)) == ESP_OK &&
+               strncmp(header, "multipart/", 10) == 0) {
+        if (!multipart_boundary_from_content_type(header, boundary, sizeof(boundary)) ||
+            !multipart_init(&ota_parser, boundary, ota_collect_part, upload)) {
+            ESP_LOGE(TAG, "Not a multipart/form-data upload");
+            httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Expected multipart/form-data");
+            return ESP_FAIL;
+        }
+        form = true;
+    } else if (req->content_len > 0) {
+        range = (ota_range_t){.first = 0, .last = req->content_len - 1, .total = req->content_len};
+    } else {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Empty upload");
+        return ESP_FAIL;
+    }
+    
+    if (form || range.first == 0) {
+        ota_session_abort();    // A new image replaces any in progress
+        if (form) {
+            ota_signature_len = 0;
+            ota_signature_overflow = false;
+        }
+        char query[32];
+        char target[16];
+        ota_store_only = httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK &&
+                         httpd_query_key_value(query, "target", target, sizeof(target)) == ESP_OK &&
+                         strcmp(target, "sender") == 0;
+    }
+    if (ota_resume_begin(&ota_session, form ? NULL : &range) == OTA_RESUME_CONFLICT) {
+        ESP_LOGW(TAG, "Range %lu-%lu/%lu does not continue the image at %lu of %lu",
+                 (unsigned long)range.first, (unsigned long)range.last, (unsigned long)range.total,
+                 (unsigned long)ota_session.offset, (unsigned long)ota_session.total);
+        return ota_send_status(req, "416 Range Not Satisfiable");
+    }
+    if (ota_session.offset == 0) {
+        ESP_LOGI(TAG, "Starting OTA update...");
+    } else {
+        ESP_LOGI(TAG, "Resuming OTA update at %lu of %lu bytes", (unsigned long)ota_session.offset,
+                 (unsigned long)ota_session.total);
+    }
+    // A form upload is the image plus a few hundred bytes of multipart framing
+    upload->erase_size = form ? req->content_len : range.total;
+    if (ota_image_kind == OTA_IMAGE_STREAM) {
+        ota_decoder.ctx = upload;
+    }
+    
+    // A .bin is received straight into sector-sized buffers while the writer task flashes the
+    // full ones; a stream, and the bytes before the kind is known, go through ota_rx. Chunks may
+    // split the boundary, the part headers or a stream op anywhere; the parsers carry that over
+    multipart_state_t state = MULTIPART_PREAMBLE;
+    size_t remaining = form ? 0 : req->content_len;
+    int timeouts = 0;
+    bool ok = true;
+    while (ok && (form ? state < MULTIPART_DONE : remaining > 0)) {
+        uint8_t *dst = ota_rx;
+        size_t want = sizeof(ota_rx);
+        if (ota_image_kind == OTA_IMAGE_PLAIN && upload->buf != NULL) {
+            size_t offset = upload->fill + (form ? multipart_held(&ota_parser) : 0);
+            if (offset >= OTA_PIPELINE_BUF_SIZE) {
+                ota_pipeline_submit(upload->buf, upload->fill);
+                upload->buf = ota_pipeline_acquire();
+                upload->fill = 0;
+                ok = upload->buf != NULL;
+                continue;
+            }
+            dst = upload->buf + offset;
+            want = OTA_PIPELINE_BUF_SIZE - offset;
+        }
+        if (!form && want > remaining) {
+            want = remaining;
+        }
+        int received = httpd_req_recv(req, (char *)dst, want);
+        if (received == HTTPD_SOCK_ERR_TIMEOUT && ++timeouts < OTA_RECV_TIMEOUTS) {
+            continue;
+        }
+        if (received <= 0) {
+            break;
+        }
+        timeouts = 0;
+        if (form) {
+            state = multipart_feed(&ota_parser, dst, received);
+            ok = state != MULTIPART_ERROR;
+        } else {
+            remaining -= received;
+            ok = ota_image_bytes(upload, dst, received);
+        }
+    }
+    // Bytes received before a drop are image bytes too, and are kept for the resume
+    if (upload->buf != NULL) {
+        ota_pipeline_submit(upload->buf, ok ? upload->fill : 0);
+    }
+    
+    bool received_all = form ? state == MULTIPART_DONE : remaining == 0;
+    bool last = ok && received_all && (form || range.last + 1 == range.total);
+    if (last && (!upload->started || (ota_image_kind == OTA_IMAGE_STREAM && ota_decoder.state != OTA_STREAM_DONE))) {
+        ESP_LOGE(TAG, "Upload ends before the image does");
+        ok = false;
+        last = false;
+    }
+    ota_pipeline_stats_t stats = {0};
+    uint8_t digest[SHA256_DIGEST_LEN];
+    err = upload->err;
+    if (upload->started) {
+        esp_err_t finish_err = ota_pipeline_finish(&stats, last ? digest : NULL);
+        err = err != ESP_OK ? err : finish_err;
+    }
+    
+    // End to end includes the erase; the stalls are per stage after it
+    int64_t elapsed_ms = (esp_timer_get_time() - start_us) / 1000;
+    ESP_LOGI(TAG, "Wrote %lu bytes from %d uploaded in %lld ms (%lld KB/s), erase %lld ms, receive stalled "
+             "%lld ms, flash write %lld ms, hash %lld ms, writer idle %lld ms", (unsigned long)stats.bytes,
+             upload->written, elapsed_ms, elapsed_ms > 0 ? (int64_t)stats.bytes * 1000 / 1024 / elapsed_ms : 0,
+             elapsed_ms - stats.elapsed_us / 1000, stats.recv_stall_us / 1000, stats.write_us / 1000,
+             stats.hash_us / 1000, stats.write_stall_us / 1000);
+    
+    if (err != ESP_OK || !ok) {
+        ESP_LOGE(TAG, "Upload failed after %d bytes", upload->written);
+        ota_session_abort();
+        if (err == ESP_OK) {
+            httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Malformed upload or image stream");
+        } else {
+            httpd_resp_send_500(req);
+        }
+        return ESP_FAIL;
+    }
+    ota_resume_commit(&ota_session, upload->written);
+    if (!received_all) {
+        ESP_LOGW(TAG, "Upload interrupted, resume from byte %lu of %lu", (unsigned long)ota_session.offset,
+                 (unsigned long)ota_session.total);
+        return ESP_FAIL;
+    }
+    if (form) {
+        ota_resume_set_total(&ota_session, ota_session.offset);
+    }
+    if (!ota_resume_complete(&ota_session)) {
+        return ota_send_status(req, NULL);      // A range short of the end: send the next one
+    }
+    return ota_session_finish(req, digest);
+}
+
+/**
+ * @brief Progress of the image in progress, for a client about to resume
+ */
+static esp_err_t update_status_handler(httpd_req_t *req) {
+    return ota_send_status(req, NULL);
+}
+
+/**
+ * @brief Detached signature for a raw or resumed upload, raw DER in the body
+ */
+static esp_err_t signature_handler(httpd_req_t *req) {
+    if (req->content_len == 0 || req->content_len > sizeof(ota_signature)) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Bad signature length");
+        return ESP_FAIL;
+    }
+    ota_signature_len = 0;
+    ota_signature_overflow = false;
+    size_t got = 0;
+    int timeouts = 0;
+    while (got < req->content_len) {
+        int received = httpd_req_recv(req, (char *)ota_signature + got, req->content_len - got);
+        if (received == HTTPD_SOCK_ERR_TIMEOUT && ++timeouts < OTA_RECV_TIMEOUTS) {
+            continue;
+        }
+        if (received <= 0) {
+            return ESP_FAIL;
+        }
+        got += received;
+    }
+    ota_signature_len = got;
+    return ota_send_status(req, NULL);
+}
+
 void ota_setup(void) {
     esp_now_deinit();
 
@@ -219,6 +606,7 @@ void ota_setup(void) {
 
 void ota_teardown(void) {
     http_server_stop();
+    ota_session_abort();
     
     esp_wifi_stop();
     esp_wifi_deinit();
@@ -228,8 +616,7 @@ void ota_teardown(void) {
     esp_wifi_set_mode(WIFI_MODE_STA);
     esp_wifi_start();
 
-    esp_now_init();
-    esp_now_register_recv_cb(receive_cb);
+    espnow_attach();
     set_state(STATE_IDLE);
 }
 
@@ -256,6 +643,23 @@ void http_server_setup(void) {
     
         httpd_register_uri_handler(ota_http_server, &update_handler);
         
+        // Resume support: committed offset of the image in progress, and its signature
+        httpd_uri_t status_handler = {
+            .uri = "/update/status",
+            .method = HTTP_GET,
+            .handler = update_status_handler
+        };
+        
+        httpd_register_uri_handler(ota_http_server, &status_handler);
+        
+        httpd_uri_t signature_upload = {
+            .uri = "/update/signature",
+            .method = HTTP_POST,
+            .handler = signature_handler
+        };
+        
+        httpd_register_uri_handler(ota_http_server, &signature_upload);
+        
         ESP_LOGI(TAG, "OTA HTTP server started on 192.168.4.1");
     } else {
         ESP_LOGE(TAG, "Failed to start HTTP server");
@@ -268,4 +672,8 @@ void http_server_stop(void) {
         ota_http_server = NULL;
         ESP_LOGI(TAG, "OTA HTTP server stopped");
     }
+}
+
+httpd_handle_t ota_http_server_handle(void) {
+    return ota_http_server;
 }
\ No newline at end of file
@@ -1,13 +1,17 @@
 #ifndef OTA_MODULE_H
 #define OTA_MODULE_H
 
-#include "ring_buffer.h"
+#include "esp_http_server.h"
 
 void ota_setup(void);
 void ota_teardown(void);
 void http_server_setup(void);
 void http_server_stop(void);
+httpd_handle_t ota_http_server_handle(void);
 
-extern ringbuf_t ota_gpio_ringbuf;
+// Provided by each firmware: start ESP-NOW with its callbacks and peers.
+// ota_teardown() calls it once the soft-AP is down, since ota_setup()'s
+// esp_now_deinit() dropped all of them.
+void espnow_attach(void);
 
 #endif // OTA_MODULE_H
@@ -0,0 +1,153 @@
+#include "ota_pipeline.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/task.h"
+#include <string.h>
+
+static const char *TAG = "OTA_PIPELINE";
+
+typedef struct {
+    uint8_t *buf;
+    size_t len;                 // 0 with a NULL buf stops the writer
+} ota_pipeline_item_t;
+
+/* Word-aligned so the flash driver writes from them directly, without a bounce buffer */
+static uint8_t pool[OTA_PIPELINE_BUFFERS][OTA_PIPELINE_BUF_SIZE] __attribute__((aligned(4)));
+
+static QueueHandle_t free_queue = NULL;
+static QueueHandle_t full_queue = NULL;
+static TaskHandle_t finisher = NULL;
+static esp_ota_handle_t ota_handle = 0;
+static volatile esp_err_t write_err = ESP_OK;
+static ota_pipeline_stats_t stats;
+static sha256_ctx_t image_sha;
+static int64_t started_us = 0;
+
+/* --------------------------------------------------------------------------
+ * Write stage
+ * -------------------------------------------------------------------------- */
+
+/**
+ * @brief Write filled buffers in order and hand them back
+ * After a failed write the rest are only handed back, so the receive stage
+ * never waits on a writer that has given up.
+ */
+static void writer_task(void *arg) {
+    ota_pipeline_item_t item;
+    while (1) {
+        int64_t wait_us = esp_timer_get_time();
+        xQueueReceive(full_queue, &item, portMAX_DELAY);
+        int64_t now = esp_timer_get_time();
+        if (stats.buffers > 0) {
+            stats.write_stall_us += now - wait_us;      // Not the wait for the first one
+        }
+        if (item.buf == NULL) {
+            break;
+        }
+        if (item.len > 0 && write_err == ESP_OK) {
+            esp_err_t err = esp_ota_write(ota_handle, item.buf, item.len);
+            int64_t done_us = esp_timer_get_time();
+            stats.write_us += done_us - now;
+            stats.elapsed_us = done_us - started_us;
+            if (err != ESP_OK) {
+                ESP_LOGE(TAG, "esp_ota_write failed (%s)", esp_err_to_name(err));
+                write_err = err;
+            } else {
+                stats.bytes += item.len;
+                stats.buffers++;
+            }
+        }
+        xQueueSend(free_queue, &item.buf, portMAX_DELAY);
+    }
+    xTaskNotifyGive(finisher);
+    vTaskDelete(NULL);
+}
+
+/* --------------------------------------------------------------------------
+ * Receive stage, called from the upload handler
+ * -------------------------------------------------------------------------- */
+
+/**
+ * @brief Fill the pool's free list and start the writer for one request
+ * @param resume Continue the image digest of the previous request instead of starting one
+ */
+esp_err_t ota_pipeline_start(esp_ota_handle_t handle, bool resume) {
+    if (free_queue == NULL) {
+        free_queue = xQueueCreate(OTA_PIPELINE_BUFFERS, sizeof(uint8_t *));
+        full_queue = xQueueCreate(OTA_PIPELINE_BUFFERS + 1, sizeof(ota_pipeline_item_t));
+        if (free_queue == NULL || full_queue == NULL) {
+            return ESP_ERR_NO_MEM;
+        }
+    }
+    xQueueReset(free_queue);
+    xQueueReset(full_queue);
+    for (int i = 0; i < OTA_PIPELINE_BUFFERS; i++) {
+        uint8_t *buf = pool[i];
+        xQueueSend(free_queue, &buf, 0);
+    }
+    memset(&stats, 0, sizeof(stats));
+    if (!resume) {
+        sha256_init(&image_sha);
+    }
+    ota_handle = handle;
+    write_err = ESP_OK;
+    finisher = xTaskGetCurrentTaskHandle();
+    started_us = esp_timer_get_time();
+    if (xTaskCreate(writer_task, "ota_writer", OTA_PIPELINE_TASK_STACK, NULL,
+                    OTA_PIPELINE_TASK_PRIO, NULL) != pdPASS) {
+        return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
+}
+
+/**
+ * @brief Next empty buffer of OTA_PIPELINE_BUF_SIZE bytes, waiting for the writer if need be
+ * @return NULL once a write has failed
+ */
+uint8_t *ota_pipeline_acquire(void) {
+    uint8_t *buf = NULL;
+    int64_t wait_us = esp_timer_get_time();
+    xQueueReceive(free_queue, &buf, portMAX_DELAY);
+    stats.recv_stall_us += esp_timer_get_time() - wait_us;
+    if (write_err != ESP_OK) {
+        xQueueSend(free_queue, &buf, 0);
+        return NULL;
+    }
+    return buf;
+}
+
+/**
+ * @brief Hash and queue an acquired buffer holding len bytes of image; 0 just returns it
+ * Hashed here rather than by the writer: flash is the slower stage, and the
+ * receive stage would otherwise spend the time waiting for a free buffer.
+ */
+void ota_pipeline_submit(uint8_t *buf, size_t len) {
+    ota_pipeline_item_t item = {.buf = buf, .len = len};
+    if (len > 0) {
+        int64_t hash_start_us = esp_timer_get_time();
+        sha256_update(&image_sha, buf, len);
+        stats.hash_us += esp_timer_get_time() - hash_start_us;
+    }
+    xQueueSend(full_queue, &item, portMAX_DELAY);
+}
+
+/**
+ * @brief Wait for the queued buffers to be written and stop the writer
+ * @param digest SHA-256 of the image bytes queued, valid when ESP_OK is returned;
+ *               NULL leaves the digest open for a resumed request
+ * @return The first write error, ESP_OK if every write succeeded
+ */
+esp_err_t ota_pipeline_finish(ota_pipeline_stats_t *out, uint8_t digest[SHA256_DIGEST_LEN]) {
+    ota_pipeline_item_t stop = {.buf = NULL, .len = 0};
+    xQueueSend(full_queue, &stop, portMAX_DELAY);
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    if (digest != NULL) {
+        sha256_final(&image_sha, digest);
+    }
+    if (out != NULL) {
+        *out = stats;
+    }
+    return write_err;
+}
@@ -0,0 +1,42 @@
+#ifndef OTA_PIPELINE_H
+#define OTA_PIPELINE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "esp_err.h"
+#include "esp_ota_ops.h"
+#include "sha256.h"
+
+/* --------------------------------------------------------------------------
+ * Pipelined OTA writes
+ * The upload handler receives into one buffer of a small pool while a writer
+ * task passes the previous ones to esp_ota_write(), so the socket keeps
+ * reading while flash erases and programs. Each buffer holds one flash sector
+ * of image, so every write starts and ends on a sector boundary. Buffers are
+ * hashed as they are queued, giving the image digest for signature checks
+ * without reading the partition back.
+ * -------------------------------------------------------------------------- */
+
+#define OTA_PIPELINE_BUF_SIZE   4096    // One flash sector
+#define OTA_PIPELINE_BUFFERS    3       // One receiving, one writing, one queued between
+#define OTA_PIPELINE_TASK_STACK 3072
+#define OTA_PIPELINE_TASK_PRIO  5       // Same as the HTTP server task
+
+typedef struct {
+    uint32_t bytes;             // Image bytes written
+    uint32_t buffers;           // Buffers written
+    int64_t elapsed_us;         // Start to the last write done
+    int64_t recv_stall_us;      // Receive stage waiting for a free buffer
+    int64_t write_stall_us;     // Write stage waiting for a filled buffer
+    int64_t write_us;           // Time in esp_ota_write()
+    int64_t hash_us;            // Receive stage hashing queued buffers
+} ota_pipeline_stats_t;
+
+/* Function declarations */
+esp_err_t ota_pipeline_start(esp_ota_handle_t handle, bool resume);
+uint8_t *ota_pipeline_acquire(void);
+void ota_pipeline_submit(uint8_t *buf, size_t len);
+esp_err_t ota_pipeline_finish(ota_pipeline_stats_t *stats, uint8_t digest[SHA256_DIGEST_LEN]);
+
+#endif // OTA_PIPELINE_H
@@ -0,0 +1,76 @@
+#include "ota_resume.h"
+#include <stdio.h>
+#include <string.h>
+
+/// Decimal without sign or overflow; advances *p past the digits
+static bool parse_u32(const char **p, uint32_t *out) {
+    const char *s = *p;
+    uint64_t value = 0;
+    if (*s < '0' || *s > '9') {
+        return false;
+    }
+    while (*s >= '0' && *s <= '9') {
+        value = value * 10 + (uint64_t)(*s++ - '0');
+        if (value > UINT32_MAX) {
+            return false;
+        }
+    }
+    *out = (uint32_t)value;
+    *p = s;
+    return true;
+}
+
+bool ota_resume_parse_range(const char *value, ota_range_t *range) {
+    const char *p = value;
+    while (*p == ' ') {
+        p++;
+    }
+    if (strncmp(p, "bytes ", 6) != 0) {
+        return false;
+    }
+    p += 6;
+    if (!parse_u32(&p, &range->first) || *p++ != '-' || !parse_u32(&p, &range->last) ||
+        *p++ != '/' || !parse_u32(&p, &range->total)) {
+        return false;
+    }
+    while (*p == ' ') {
+        p++;
+    }
+    return *p == '\0' && range->first <= range->last && range->last < range->total;
+}
+
+ota_resume_action_t ota_resume_begin(ota_resume_t *s, const ota_range_t *range) {
+    if (range == NULL || range->first == 0) {
+        s->active = true;
+        s->offset = 0;
+        s->total = range != NULL ? range->total : 0;
+        return OTA_RESUME_START;
+    }
+    if (!s->active || range->first != s->offset || (s->total != 0 && range->total != s->total)) {
+        return OTA_RESUME_CONFLICT;
+    }
+    s->total = range->total;    // A form upload continued by range learns its size here
+    return OTA_RESUME_APPEND;
+}
+
+void ota_resume_commit(ota_resume_t *s, uint32_t bytes) {
+    s->offset += bytes;
+}
+
+void ota_resume_set_total(ota_resume_t *s, uint32_t total) {
+    s->total = total;
+}
+
+bool ota_resume_complete(const ota_resume_t *s) {
+    return s->active && s->total > 0 && s->offset == s->total;
+}
+
+void ota_resume_reset(ota_resume_t *s) {
+    memset(s, 0, sizeof(*s));
+}
+
+int ota_resume_status_json(const ota_resume_t *s, bool signed_upload, char *buf, size_t size) {
+    return snprintf(buf, size, "{\"active\":%s,\"offset\":%lu,\"total\":%lu,\"signature\":%s}",
+                    s->active ? "true" : "false", (unsigned long)s->offset, (unsigned long)s->total,
+                    signed_upload ? "true" : "false");
+}
@@ -0,0 +1,54 @@
+#ifndef OTA_RESUME_H
+#define OTA_RESUME_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+// Bookkeeping for OTA uploads that survive a dropped connection. An image is
+// written in order, so everything the writer has flashed is kept and the
+// committed offset is all a client needs to continue: it reads the offset
+// from the status endpoint and sends the rest as
+//   Content-Range: bytes <offset>-<total - 1>/<total>
+// A request starting at 0 always begins a new image. The offset lives in RAM
+// only: after a reboot esp_ota_begin() has to erase the partition again.
+
+typedef struct {
+    uint32_t first;
+    uint32_t last;              // Inclusive
+    uint32_t total;
+} ota_range_t;
+
+typedef enum {
+    OTA_RESUME_START,           // Begin a new image at offset 0
+    OTA_RESUME_APPEND,          // Continue the image in progress
+    OTA_RESUME_CONFLICT,        // Not at the committed offset, or another image size
+} ota_resume_action_t;
+
+typedef struct {
+    bool active;                // An image is in progress and its OTA handle open
+    uint32_t offset;            // Image bytes written and hashed
+    uint32_t total;             // Image size; 0 until a Content-Range gives it
+} ota_resume_t;
+
+// Parse a Content-Range value "bytes first-last/total". Returns false if it is
+// malformed, unsatisfiable or has an unknown ("*") total.
+bool ota_resume_parse_range(const char *value, ota_range_t *range);
+
+// Decide what a request does; range is NULL for a form upload, which always
+// starts over. Updates the session for START and APPEND, leaves it for CONFLICT.
+ota_resume_action_t ota_resume_begin(ota_resume_t *s, const ota_range_t *range);
+
+// Bytes the writer flashed for the current request
+void ota_resume_commit(ota_resume_t *s, uint32_t bytes);
+
+// The last byte of a form upload has been written; fixes the image size
+void ota_resume_set_total(ota_resume_t *s, uint32_t total);
+
+bool ota_resume_complete(const ota_resume_t *s);
+void ota_resume_reset(ota_resume_t *s);
+
+// Status endpoint body, JSON. Returns the length, as snprintf().
+int ota_resume_status_json(const ota_resume_t *s, bool signed_upload, char *buf, size_t size);
+
+#endif // OTA_RESUME_H
@@ -0,0 +1,46 @@
+#include "ota_signature.h"
+#include "esp_log.h"
+#include "mbedtls/pk.h"
+
+static const char *TAG = "OTA_SIGNATURE";
+
+/* Public half of the release key, PEM, ECDSA P-256 or RSA:
+ *   openssl ecparam -name prime256v1 -genkey -noout -out release_key.pem
+ *   openssl ec -in release_key.pem -pubout
+ * Left empty, signatures are not checked and any image esp_ota_end() accepts boots. */
+static const char OTA_SIGNING_KEY_PEM[] = "";
+
+/**
+ * @brief Whether a key is built in, so unsigned uploads are refused
+ */
+bool ota_signature_required(void) {
+    return OTA_SIGNING_KEY_PEM[0] != '\0';
+}
+
+/**
+ * @brief Check a DER signature over an image digest against the built-in key
+ * @return ESP_OK if it verifies, ESP_ERR_INVALID_STATE without a key,
+ *         ESP_ERR_INVALID_CRC if the signature is wrong
+ */
+esp_err_t ota_signature_verify(const uint8_t digest[SHA256_DIGEST_LEN], const uint8_t *sig, size_t len) {
+    if (!ota_signature_required()) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    mbedtls_pk_context key;
+    mbedtls_pk_init(&key);
+    // The PEM parser wants the terminating NUL counted
+    int ret = mbedtls_pk_parse_public_key(&key, (const unsigned char *)OTA_SIGNING_KEY_PEM,
+                                          sizeof(OTA_SIGNING_KEY_PEM));
+    if (ret != 0) {
+        ESP_LOGE(TAG, "Built-in signing key does not parse (-0x%04x)", -ret);
+        mbedtls_pk_free(&key);
+        return ESP_ERR_INVALID_STATE;
+    }
+    ret = mbedtls_pk_verify(&key, MBEDTLS_MD_SHA256, digest, SHA256_DIGEST_LEN, sig, len);
+    mbedtls_pk_free(&key);
+    if (ret != 0) {
+        ESP_LOGE(TAG, "Signature check failed (-0x%04x)", -ret);
+        return ESP_ERR_INVALID_CRC;
+    }
+    return ESP_OK;
+}
@@ -0,0 +1,31 @@
+#ifndef OTA_SIGNATURE_H
+#define OTA_SIGNATURE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "esp_err.h"
+#include "sha256.h"
+
+/* --------------------------------------------------------------------------
+ * Detached firmware signatures
+ * The upload form carries the image and, as a second file, a signature over
+ * its SHA-256 made with the release key, e.g.
+ *   openssl dgst -sha256 -sign release_key.pem -out gate.sig gate.bin
+ * The digest is taken while the image is written (ota_pipeline.c), so
+ * checking it costs one public key operation and no flash reads.
+ * -------------------------------------------------------------------------- */
+
+#define OTA_SIGNATURE_MAX   512     // RSA-4096; a DER ECDSA P-256 signature is at most 72
+
+/* A sender image uploaded to the receiver (?target=sender) leaves its
+ * signature in NVS, after the image SHA-256 it belongs to; the receiver
+ * sends it on after the image (ota_xfer.h) and the sender checks it there. */
+#define OTA_SENDER_SIG_NAMESPACE    "ota"
+#define OTA_SENDER_SIG_KEY          "sender_sig"
+
+/* Function declarations */
+bool ota_signature_required(void);
+esp_err_t ota_signature_verify(const uint8_t digest[SHA256_DIGEST_LEN], const uint8_t *sig, size_t len);
+
+#endif // OTA_SIGNATURE_H
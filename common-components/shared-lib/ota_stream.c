@@ -0,0 +1,228 @@
+#include "ota_stream.h"
+#include <string.h>
+
+#define WINDOW_MASK (OTA_STREAM_WINDOW - 1)
+
+static uint32_t load_le32(const uint8_t *p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+bool ota_stream_parse_header(const uint8_t raw[OTA_STREAM_HEADER_LEN], ota_stream_header_t *header) {
+    if (memcmp(raw, OTA_STREAM_MAGIC, 4) != 0 || raw[4] != OTA_STREAM_VERSION ||
+        (raw[5] & ~OTA_STREAM_FLAG_DELTA) != 0 || raw[6] == 0 || raw[6] > OTA_STREAM_WINDOW_LOG || raw[7] != 0) {
+        return false;
+    }
+    header->flags = raw[5];
+    header->window_log = raw[6];
+    header->image_size = load_le32(raw + 8);
+    header->base_size = load_le32(raw + 12);
+    memcpy(header->base_sha256, raw + 16, sizeof(header->base_sha256));
+    return (header->flags & OTA_STREAM_FLAG_DELTA) ? header->base_size > 0 : header->base_size == 0;
+}
+
+void ota_stream_init(ota_stream_t *s, ota_stream_header_cb_t on_header, ota_stream_data_cb_t on_data,
+                     ota_stream_base_cb_t read_base, void *ctx) {
+    s->state = OTA_STREAM_HEADER;
+    s->header_fill = 0;
+    s->len = 0;
+    s->base_pos = 0;
+    s->out_pos = 0;
+    s->on_header = on_header;
+    s->on_data = on_data;
+    s->read_base = read_base;
+    s->ctx = ctx;
+}
+
+/// Bytes already in the window go to the callback
+static bool deliver(ota_stream_t *s, const uint8_t *data, size_t len) {
+    s->out_pos += (uint32_t)len;
+    if (!s->on_data(s->ctx, data, len)) {
+        s->state = OTA_STREAM_ERROR;
+        return false;
+    }
+    return true;
+}
+
+/// New bytes: into the window, then to the callback
+static bool emit(ota_stream_t *s, const uint8_t *data, size_t len) {
+    size_t at = s->out_pos & WINDOW_MASK;
+    if (len >= OTA_STREAM_WINDOW) {
+        const uint8_t *tail = data + len - OTA_STREAM_WINDOW;
+        at = (s->out_pos + len - OTA_STREAM_WINDOW) & WINDOW_MASK;
+        memcpy(s->window + at, tail, OTA_STREAM_WINDOW - at);
+        memcpy(s->window, tail + OTA_STREAM_WINDOW - at, at);
+    } else {
+        size_t first = OTA_STREAM_WINDOW - at < len ? OTA_STREAM_WINDOW - at : len;
+        memcpy(s->window + at, data, first);
+        memcpy(s->window, data + first, len - first);
+    }
+    return deliver(s, data, len);
+}
+
+static void next_op(ota_stream_t *s) {
+    s->state = s->out_pos == s->header.image_size ? OTA_STREAM_DONE : OTA_STREAM_OP;
+}
+
+/// Back-reference into the output; may overlap the bytes it produces
+static void window_copy(ota_stream_t *s) {
+    if (s->dist > s->out_pos || s->dist > (1u << s->header.window_log)) {
+        s->state = OTA_STREAM_ERROR;
+        return;
+    }
+    while (s->len > 0) {
+        size_t n = s->len < OTA_STREAM_SCRATCH ? s->len : OTA_STREAM_SCRATCH;
+        uint32_t p = s->out_pos;
+        for (size_t i = 0; i < n; i++, p++) {
+            uint8_t b = s->window[(p - s->dist) & WINDOW_MASK];
+            s->window[p & WINDOW_MASK] = b;
+            s->scratch[i] = b;
+        }
+        s->len -= (uint32_t)n;
+        if (!deliver(s, s->scratch, n)) {
+            return;
+        }
+    }
+    next_op(s);
+}
+
+/// Bytes of the running image, offset by a zigzag delta from the last base copy's end
+static void base_copy(ota_stream_t *s, uint32_t zigzag) {
+    int64_t delta = (int64_t)(zigzag >> 1) ^ -(int64_t)(zigzag & 1);
+    int64_t from = (int64_t)s->base_pos + delta;
+    if (s->read_base == NULL || from < 0 || from + s->len > s->header.base_size) {
+        s->state = OTA_STREAM_ERROR;
+        return;
+    }
+    uint32_t offset = (uint32_t)from;
+    while (s->len > 0) {
+        size_t n = s->len < OTA_STREAM_SCRATCH ? s->len : OTA_STREAM_SCRATCH;
+        if (!s->read_base(s->ctx, offset, s->scratch, n)) {
+            s->state = OTA_STREAM_ERROR;
+            return;
+        }
+        offset += (uint32_t)n;
+        s->len -= (uint32_t)n;
+        if (!emit(s, s->scratch, n)) {
+            return;
+        }
+    }
+    s->base_pos = offset;
+    next_op(s);
+}
+
+/// The op's length is known: check it fits the image and read what follows
+static void op_length(ota_stream_t *s, uint32_t len) {
+    if (len == 0 || len > s->header.image_size - s->out_pos) {
+        s->state = OTA_STREAM_ERROR;
+        return;
+    }
+    s->len = len;
+    s->varint = 0;
+    s->varint_shift = 0;
+    switch (s->op & 0xc0) {
+        case OTA_STREAM_OP_LITERAL:
+            s->state = OTA_STREAM_LITERAL;
+            break;
+        case OTA_STREAM_OP_WINDOW:
+            s->state = OTA_STREAM_DIST;
+            break;
+        default:
+            s->state = OTA_STREAM_DELTA;
+            break;
+    }
+}
+
+static uint32_t min_length(uint8_t op) {
+    return (op & 0xc0) == OTA_STREAM_OP_LITERAL ? 1 : OTA_STREAM_MIN_MATCH;
+}
+
+static void op_byte(ota_stream_t *s, uint8_t op) {
+    uint8_t type = op & 0xc0;
+    if (type == 0xc0 || (type == OTA_STREAM_OP_BASE && !(s->header.flags & OTA_STREAM_FLAG_DELTA))) {
+        s->state = OTA_STREAM_ERROR;
+        return;
+    }
+    s->op = op;
+    uint32_t field = op & 0x3f;
+    if (field == OTA_STREAM_OP_LEN_EXT) {
+        s->varint = 0;
+        s->varint_shift = 0;
+        s->state = OTA_STREAM_LEN;
+        return;
+    }
+    op_length(s, field + min_length(op));
+}
+
+/// One LEB128 byte; returns true when the varint is complete
+static bool varint_byte(ota_stream_t *s, uint8_t b) {
+    if (s->varint_shift > 28 || (s->varint_shift == 28 && (b & 0x70) != 0)) {
+        s->state = OTA_STREAM_ERROR;    // Over 32 bits
+        return false;
+    }
+    s->varint |= (uint32_t)(b & 0x7f) << s->varint_shift;
+    s->varint_shift += 7;
+    return (b & 0x80) == 0;
+}
+
+ota_stream_state_t ota_stream_feed(ota_stream_t *s, const uint8_t *data, size_t len) {
+    size_t pos = 0;
+    while (pos < len && s->state < OTA_STREAM_DONE) {
+        switch (s->state) {
+            case OTA_STREAM_HEADER: {
+                size_t n = OTA_STREAM_HEADER_LEN - s->header_fill;
+                n = n < len - pos ? n : len - pos;
+                memcpy(s->raw_header + s->header_fill, data + pos, n);
+                s->header_fill += (uint8_t)n;
+                pos += n;
+                if (s->header_fill < OTA_STREAM_HEADER_LEN) {
+                    break;
+                }
+                if (!ota_stream_parse_header(s->raw_header, &s->header) ||
+                    (s->on_header != NULL && !s->on_header(s->ctx, &s->header))) {
+                    s->state = OTA_STREAM_ERROR;
+                    break;
+                }
+                next_op(s);
+                break;
+            }
+            case OTA_STREAM_OP:
+                op_byte(s, data[pos++]);
+                break;
+            case OTA_STREAM_LEN:
+                if (varint_byte(s, data[pos++])) {
+                    uint32_t extra = OTA_STREAM_OP_LEN_EXT + min_length(s->op);
+                    op_length(s, s->varint > UINT32_MAX - extra ? 0 : s->varint + extra);
+                }
+                break;
+            case OTA_STREAM_DIST:
+                if (varint_byte(s, data[pos++])) {
+                    s->dist = s->varint == UINT32_MAX ? UINT32_MAX : s->varint + 1;
+                    window_copy(s);
+                }
+                break;
+            case OTA_STREAM_DELTA:
+                if (varint_byte(s, data[pos++])) {
+                    base_copy(s, s->varint);
+                }
+                break;
+            case OTA_STREAM_LITERAL: {
+                size_t n = s->len < len - pos ? s->len : len - pos;
+                if (!emit(s, data + pos, n)) {
+                    break;
+                }
+                s->len -= (uint32_t)n;
+                pos += n;
+                if (s->len == 0) {
+                    next_op(s);
+                }
+                break;
+            }
+            default:
+                break;
+        }
+    }
+    if (pos < len && s->state == OTA_STREAM_DONE) {
+        s->state = OTA_STREAM_ERROR;    // Bytes past the end of the image
+    }
+    return s->state;
+}
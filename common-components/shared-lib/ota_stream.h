@@ -0,0 +1,101 @@
+#ifndef OTA_STREAM_H
+#define OTA_STREAM_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+// Compressed and delta firmware images, decoded as they arrive. A stream is a
+// 48-byte header and a run of ops that rebuild the image front to back:
+//   literal      bytes carried in the stream
+//   window copy  repeat bytes from the last OTA_STREAM_WINDOW of output (LZ77)
+//   base copy    bytes of the image the device is running (delta images only)
+// Each op is one byte, type in bits 7-6 and length in bits 5-0; a length
+// field of 63 is followed by a varint with the rest of the length. A window
+// copy is then followed by varint distance - 1, a base copy by a zigzag varint
+// from where the last base copy ended, so code that only moved costs a byte
+// or two. Varints are LEB128, integers in the header little-endian.
+//
+// A plain ESP image starts with 0xE9; the stream magic never does, so an
+// upload's first byte says which one it is.
+//
+// Header:
+//   0   "GOTA"
+//   4   version (1)
+//   5   flags (OTA_STREAM_FLAG_*)
+//   6   window log2, at most OTA_STREAM_WINDOW_LOG
+//   7   0
+//   8   image size
+//   12  base size, 0 without OTA_STREAM_FLAG_DELTA
+//   16  base SHA-256, zeros without OTA_STREAM_FLAG_DELTA
+
+#define OTA_STREAM_MAGIC        "GOTA"
+#define OTA_STREAM_VERSION      1
+#define OTA_STREAM_HEADER_LEN   48
+#define OTA_STREAM_FLAG_DELTA   0x01
+#define OTA_STREAM_WINDOW_LOG   12
+#define OTA_STREAM_WINDOW       (1u << OTA_STREAM_WINDOW_LOG)
+#define OTA_STREAM_MIN_MATCH    4                           // Shortest copy the encoder emits
+#define OTA_STREAM_SCRATCH      256                         // Bytes produced per output callback
+
+#define OTA_STREAM_OP_LITERAL   0x00
+#define OTA_STREAM_OP_WINDOW    0x40
+#define OTA_STREAM_OP_BASE      0x80
+#define OTA_STREAM_OP_LEN_EXT   63                          // Length field: varint follows
+
+typedef struct {
+    uint8_t flags;
+    uint8_t window_log;
+    uint32_t image_size;
+    uint32_t base_size;
+    uint8_t base_sha256[32];
+} ota_stream_header_t;
+
+typedef enum {
+    OTA_STREAM_HEADER,
+    OTA_STREAM_OP,
+    OTA_STREAM_LEN,             // Length varint
+    OTA_STREAM_DIST,            // Window distance varint
+    OTA_STREAM_DELTA,           // Base offset varint
+    OTA_STREAM_LITERAL,         // Inside a literal run
+    OTA_STREAM_DONE,            // Image complete; any further byte is an error
+    OTA_STREAM_ERROR,
+} ota_stream_state_t;
+
+// Header parsed: return false to refuse the image (wrong base, too large)
+typedef bool (*ota_stream_header_cb_t)(void *ctx, const ota_stream_header_t *header);
+// Image bytes in order. Return false to stop decoding.
+typedef bool (*ota_stream_data_cb_t)(void *ctx, const uint8_t *data, size_t len);
+// Read len bytes of the running image at offset; never past base_size
+typedef bool (*ota_stream_base_cb_t)(void *ctx, uint32_t offset, uint8_t *data, size_t len);
+
+typedef struct {
+    ota_stream_state_t state;
+    ota_stream_header_t header;
+    uint8_t raw_header[OTA_STREAM_HEADER_LEN];
+    uint8_t header_fill;
+    uint8_t op;
+    uint8_t varint_shift;
+    uint32_t varint;
+    uint32_t len;               // Bytes left of the op
+    uint32_t dist;
+    uint32_t base_pos;          // Where the next base copy reads, before its delta
+    uint32_t out_pos;           // Image bytes produced
+    uint8_t window[OTA_STREAM_WINDOW];
+    uint8_t scratch[OTA_STREAM_SCRATCH];
+    ota_stream_header_cb_t on_header;
+    ota_stream_data_cb_t on_data;
+    ota_stream_base_cb_t read_base;
+    void *ctx;
+} ota_stream_t;
+
+void ota_stream_init(ota_stream_t *s, ota_stream_header_cb_t on_header, ota_stream_data_cb_t on_data,
+                     ota_stream_base_cb_t read_base, void *ctx);
+
+// Decode the next chunk of the stream, split anywhere; returns the state after it
+ota_stream_state_t ota_stream_feed(ota_stream_t *s, const uint8_t *data, size_t len);
+
+// Parse and check a header: magic, version, window, and a base for delta images
+bool ota_stream_parse_header(const uint8_t raw[OTA_STREAM_HEADER_LEN], ota_stream_header_t *header);
+
+#endif // OTA_STREAM_H
@@ -0,0 +1,371 @@
+#include "ota_xfer.h"
+#include <string.h>
+
+/// Window bitmap with the low n bits set
+static uint32_t low_bits(uint32_t n) {
+    return n >= 32 ? UINT32_MAX : (1u << n) - 1;
+}
+
+static uint32_t shift_down(uint32_t bits, uint32_t n) {
+    return n >= 32 ? 0 : bits >> n;
+}
+
+/* Sizes are of what the chunks carry: the image, then its signature */
+static uint32_t chunk_count(uint32_t size) {
+    return (size + OTA_XFER_CHUNK - 1) / OTA_XFER_CHUNK;
+}
+
+static uint32_t chunk_len(uint32_t size, uint32_t index) {
+    uint32_t offset = index * OTA_XFER_CHUNK;
+    return size - offset < OTA_XFER_CHUNK ? size - offset : OTA_XFER_CHUNK;
+}
+
+uint16_t ota_xfer_session(const uint8_t sha256[SHA256_DIGEST_LEN]) {
+    return (uint16_t)(sha256[0] | (sha256[1] << 8));
+}
+
+bool ota_xfer_is_packet(const uint8_t *pkt, size_t len) {
+    if (len == 0) {
+        return false;
+    }
+    switch (pkt[0]) {
+        case OTA_XFER_OFFER:
+            return len == sizeof(ota_xfer_offer_t);
+        case OTA_XFER_DATA:
+            return len > OTA_XFER_DATA_HEADER_LEN && len <= sizeof(ota_xfer_data_t);
+        case OTA_XFER_ACK:
+            return len == sizeof(ota_xfer_ack_t);
+        default:
+            return false;
+    }
+}
+
+/* --------------------------------------------------------------------------
+ * Source
+ * -------------------------------------------------------------------------- */
+
+void ota_xfer_tx_init(ota_xfer_tx_t *tx, uint32_t image_size, const uint8_t sha256[SHA256_DIGEST_LEN],
+                      const uint8_t *sig, size_t sig_len, ota_xfer_send_cb_t send, ota_xfer_read_cb_t read,
+                      void *ctx, int64_t now_us) {
+    memset(tx, 0, sizeof(*tx));
+    tx->state = image_size > 0 && sig_len <= OTA_XFER_SIG_MAX ? OTA_XFER_TX_OFFERING : OTA_XFER_TX_FAILED;
+    tx->session = ota_xfer_session(sha256);
+    tx->image_size = image_size;
+    memcpy(tx->sha256, sha256, SHA256_DIGEST_LEN);
+    if (sig_len > 0 && sig_len <= OTA_XFER_SIG_MAX) {
+        memcpy(tx->sig, sig, sig_len);
+        tx->sig_len = (uint16_t)sig_len;
+    }
+    tx->chunks = chunk_count(image_size + tx->sig_len);
+    tx->window = OTA_XFER_WINDOW;
+    tx->rto_us = OTA_XFER_RTO_US;
+    tx->last_offer_us = now_us - OTA_XFER_OFFER_US;
+    tx->last_progress_us = now_us;
+    tx->send = send;
+    tx->read = read;
+    tx->ctx = ctx;
+}
+
+void ota_xfer_tx_on_ack(ota_xfer_tx_t *tx, const ota_xfer_ack_t *ack, int64_t now_us) {
+    if (ack->type != OTA_XFER_ACK || ack->session != tx->session ||
+        tx->state == OTA_XFER_TX_DONE || tx->state == OTA_XFER_TX_FAILED) {
+        return;
+    }
+    tx->stats.acks++;
+    if (ack->status == OTA_XFER_STATUS_FAILED) {
+        tx->state = OTA_XFER_TX_FAILED;
+        return;
+    }
+    if (tx->state == OTA_XFER_TX_OFFERING) {
+        // The sink may already hold the start of this image
+        tx->base = ack->next < tx->chunks ? ack->next : tx->chunks;
+        tx->next_new = tx->base;
+        tx->state = OTA_XFER_TX_SENDING;
+        tx->last_progress_us = now_us;
+    } else if (ack->next > tx->base && ack->next <= tx->next_new) {
+        uint32_t advance = ack->next - tx->base;
+        tx->acked = shift_down(tx->acked, advance);
+        tx->resend = shift_down(tx->resend, advance);
+        tx->base = ack->next;
+        tx->last_progress_us = now_us;
+    }
+    if (ack->next == tx->base) {
+        uint32_t held = ack->held & low_bits(tx->next_new - tx->base);
+        if (held & ~tx->acked) {
+            tx->acked |= held;
+            tx->last_progress_us = now_us;
+        }
+    }
+    if (tx->base == tx->chunks) {
+        tx->state = ack->status == OTA_XFER_STATUS_COMPLETE ? OTA_XFER_TX_DONE : OTA_XFER_TX_SENDING;
+        return;
+    }
+
+    // Chunks go out in order and ESP-NOW does not reorder, so a hole sent
+    // before a chunk the sink holds was lost
+    if (tx->acked != 0) {
+        uint32_t top = 31 - (uint32_t)__builtin_clz(tx->acked);
+        int64_t top_sent = tx->sent_us[(tx->base + top) % OTA_XFER_WINDOW];
+        for (uint32_t i = 0; i < top; i++) {
+            if (!(tx->acked & (1u << i)) && tx->sent_us[(tx->base + i) % OTA_XFER_WINDOW] <= top_sent) {
+                tx->resend |= 1u << i;
+            }
+        }
+    }
+}
+
+static bool tx_send_chunk(ota_xfer_tx_t *tx, uint32_t index, int64_t now_us) {
+    uint32_t offset = index * OTA_XFER_CHUNK;
+    uint32_t len = chunk_len(tx->image_size + tx->sig_len, index);
+    // Image bytes through the read callback, then any of the signature
+    uint32_t image_len = offset < tx->image_size ? tx->image_size - offset : 0;
+    if (image_len > len) {
+        image_len = len;
+    }
+    tx->frame.type = OTA_XFER_DATA;
+    tx->frame.session = tx->session;
+    tx->frame.index = index;
+    if (image_len > 0 && !tx->read(tx->ctx, offset, tx->frame.data, image_len)) {
+        tx->state = OTA_XFER_TX_FAILED;
+        return false;
+    }
+    if (image_len < len) {
+        memcpy(tx->frame.data + image_len, tx->sig + (offset + image_len - tx->image_size), len - image_len);
+    }
+    if (!tx->send(tx->ctx, &tx->frame, OTA_XFER_DATA_HEADER_LEN + len)) {
+        return false;
+    }
+    tx->sent_us[index % OTA_XFER_WINDOW] = now_us;
+    tx->stats.data_frames++;
+    return true;
+}
+
+ota_xfer_tx_state_t ota_xfer_tx_poll(ota_xfer_tx_t *tx, int64_t now_us) {
+    if (tx->state == OTA_XFER_TX_DONE || tx->state == OTA_XFER_TX_FAILED) {
+        return tx->state;
+    }
+    if (now_us - tx->last_progress_us > OTA_XFER_GIVE_UP_US) {
+        tx->state = OTA_XFER_TX_FAILED;
+        return tx->state;
+    }
+    if (tx->state == OTA_XFER_TX_OFFERING) {
+        if (now_us - tx->last_offer_us >= OTA_XFER_OFFER_US) {
+            ota_xfer_offer_t offer = {
+                .type = OTA_XFER_OFFER,
+                .session = tx->session,
+                .image_size = tx->image_size,
+                .sig_len = tx->sig_len,
+            };
+            memcpy(offer.sha256, tx->sha256, SHA256_DIGEST_LEN);
+            if (tx->send(tx->ctx, &offer, sizeof(offer))) {
+                tx->last_offer_us = now_us;
+                tx->stats.offers++;
+            }
+        }
+        return tx->state;
+    }
+
+    // Holes and timed out chunks first, oldest first, then new chunks
+    for (uint32_t i = 0; tx->base + i < tx->next_new; i++) {
+        uint32_t bit = 1u << i;
+        if (tx->acked & bit) {
+            continue;
+        }
+        bool hole = (tx->resend & bit) != 0;
+        if (!hole && now_us - tx->sent_us[(tx->base + i) % OTA_XFER_WINDOW] < tx->rto_us) {
+            continue;
+        }
+        if (!tx_send_chunk(tx, tx->base + i, now_us)) {
+            return tx->state;
+        }
+        tx->resend &= ~bit;
+        if (hole) {
+            tx->stats.fast_resends++;
+        } else {
+            tx->stats.timeout_resends++;
+        }
+    }
+    while (tx->next_new < tx->chunks && tx->next_new < tx->base + tx->window) {
+        if (!tx_send_chunk(tx, tx->next_new, now_us)) {
+            return tx->state;
+        }
+        tx->next_new++;
+    }
+    return tx->state;
+}
+
+int64_t ota_xfer_tx_deadline(const ota_xfer_tx_t *tx) {
+    int64_t deadline = tx->last_progress_us + OTA_XFER_GIVE_UP_US + 1;
+    switch (tx->state) {
+        case OTA_XFER_TX_OFFERING: {
+            int64_t offer = tx->last_offer_us + OTA_XFER_OFFER_US;
+            return offer < deadline ? offer : deadline;
+        }
+        case OTA_XFER_TX_SENDING:
+            if (tx->resend != 0 || (tx->next_new < tx->chunks && tx->next_new < tx->base + tx->window)) {
+                return 0;
+            }
+            for (uint32_t i = 0; tx->base + i < tx->next_new; i++) {
+                int64_t due = tx->sent_us[(tx->base + i) % OTA_XFER_WINDOW] + tx->rto_us;
+                if (!(tx->acked & (1u << i)) && due < deadline) {
+                    deadline = due;
+                }
+            }
+            return deadline;
+        default:
+            return INT64_MAX;
+    }
+}
+
+/* --------------------------------------------------------------------------
+ * Sink
+ * -------------------------------------------------------------------------- */
+
+void ota_xfer_rx_init(ota_xfer_rx_t *rx, ota_xfer_begin_cb_t begin, ota_xfer_write_cb_t write,
+                      ota_xfer_send_cb_t send, void *ctx) {
+    memset(rx, 0, sizeof(*rx));
+    rx->begin = begin;
+    rx->write = write;
+    rx->send = send;
+    rx->ctx = ctx;
+}
+
+static void rx_send_ack(ota_xfer_rx_t *rx) {
+    ota_xfer_ack_t ack = {
+        .type = OTA_XFER_ACK,
+        .session = rx->session,
+        .status = (uint8_t)rx->status,
+        .next = rx->next,
+        .held = rx->held,
+    };
+    // A lost ack is made up for by the next one or the source's timeout
+    if (rx->send(rx->ctx, &ack, sizeof(ack))) {
+        rx->stats.acks++;
+    }
+    rx->unacked = 0;
+}
+
+static void rx_offer(ota_xfer_rx_t *rx, const ota_xfer_offer_t *offer) {
+    if (rx->active && offer->session == rx->session && offer->sig_len == rx->sig_len &&
+        memcmp(offer->sha256, rx->sha256, SHA256_DIGEST_LEN) == 0) {
+        rx_send_ack(rx);    // Offered again: carry on from what is written
+        return;
+    }
+    rx->active = true;
+    rx->status = OTA_XFER_STATUS_RECEIVING;
+    rx->session = offer->session;
+    rx->image_size = offer->image_size;
+    rx->sig_len = offer->sig_len;
+    rx->chunks = chunk_count(offer->image_size + offer->sig_len);
+    memcpy(rx->sha256, offer->sha256, SHA256_DIGEST_LEN);
+    rx->next = 0;
+    rx->held = 0;
+    rx->unacked = 0;
+    rx->gap_acked = false;
+    sha256_init(&rx->sha);
+    if (offer->image_size == 0 || offer->sig_len > OTA_XFER_SIG_MAX || !rx->begin(rx->ctx, offer->image_size)) {
+        rx->status = OTA_XFER_STATUS_FAILED;
+    }
+    rx_send_ack(rx);
+}
+
+/// Write the chunks that now continue the image, keeping the signature after it; false if a write failed
+static bool rx_drain(ota_xfer_rx_t *rx) {
+    while (rx->held & 1) {
+        uint32_t offset = rx->next * OTA_XFER_CHUNK;
+        uint32_t len = chunk_len(rx->image_size + rx->sig_len, rx->next);
+        uint32_t image_len = offset < rx->image_size ? rx->image_size - offset : 0;
+        if (image_len > len) {
+            image_len = len;
+        }
+        const uint8_t *data = rx->buf[rx->next % OTA_XFER_WINDOW];
+        if (image_len > 0 && !rx->write(rx->ctx, data, image_len)) {
+            return false;
+        }
+        sha256_update(&rx->sha, data, image_len);
+        if (image_len < len) {
+            memcpy(rx->sig + (offset + image_len - rx->image_size), data + image_len, len - image_len);
+        }
+        rx->held >>= 1;
+        rx->next++;
+        rx->unacked++;
+    }
+    return true;
+}
+
+static void rx_data(ota_xfer_rx_t *rx, const ota_xfer_data_t *pkt, size_t len, int64_t now_us) {
+    if (!rx->active || pkt->session != rx->session) {
+        return;
+    }
+    rx->stats.chunks++;
+    if (rx->status != OTA_XFER_STATUS_RECEIVING) {
+        rx_send_ack(rx);    // The source missed the final status
+        return;
+    }
+    uint32_t index = pkt->index;
+    if (index >= rx->chunks || len - OTA_XFER_DATA_HEADER_LEN != chunk_len(rx->image_size + rx->sig_len, index)) {
+        return;
+    }
+    uint32_t offset = index - rx->next;
+    if (index < rx->next || (offset < OTA_XFER_WINDOW && (rx->held & (1u << offset)))) {
+        rx->stats.duplicates++;
+        rx_send_ack(rx);    // Our ack was lost
+        return;
+    }
+    if (offset >= OTA_XFER_WINDOW) {
+        return;
+    }
+    memcpy(rx->buf[index % OTA_XFER_WINDOW], pkt->data, len - OTA_XFER_DATA_HEADER_LEN);
+    rx->held |= 1u << offset;
+    if (offset > 0) {
+        // Past a hole: say so once, the source resends the hole right away
+        rx->stats.out_of_order++;
+        if (!rx->gap_acked) {
+            rx->gap_acked = true;
+            rx_send_ack(rx);
+        }
+        return;
+    }
+
+    bool first = rx->unacked == 0;
+    if (!rx_drain(rx)) {
+        rx->status = OTA_XFER_STATUS_FAILED;
+        rx_send_ack(rx);
+        return;
+    }
+    rx->gap_acked = false;
+    if (rx->next == rx->chunks) {
+        uint8_t digest[SHA256_DIGEST_LEN];
+        sha256_final(&rx->sha, digest);
+        rx->status = memcmp(digest, rx->sha256, SHA256_DIGEST_LEN) == 0 ? OTA_XFER_STATUS_COMPLETE
+                                                                          : OTA_XFER_STATUS_FAILED;
+        rx_send_ack(rx);
+    } else if (rx->unacked >= OTA_XFER_ACK_EVERY || rx->held != 0) {
+        rx_send_ack(rx);
+    } else if (first) {
+        rx->unacked_since_us = now_us;
+    }
+}
+
+void ota_xfer_rx_feed(ota_xfer_rx_t *rx, const uint8_t *pkt, size_t len, int64_t now_us) {
+    if (!ota_xfer_is_packet(pkt, len)) {
+        return;
+    }
+    if (pkt[0] == OTA_XFER_OFFER) {
+        ota_xfer_offer_t offer;
+        memcpy(&offer, pkt, sizeof(offer));
+        rx_offer(rx, &offer);
+    } else if (pkt[0] == OTA_XFER_DATA) {
+        rx_data(rx, (const ota_xfer_data_t *)pkt, len, now_us);
+    }
+}
+
+void ota_xfer_rx_poll(ota_xfer_rx_t *rx, int64_t now_us) {
+    if (rx->unacked > 0 && now_us - rx->unacked_since_us >= OTA_XFER_ACK_DELAY_US) {
+        rx_send_ack(rx);
+    }
+}
+
+int64_t ota_xfer_rx_deadline(const ota_xfer_rx_t *rx) {
+    return rx->unacked > 0 ? rx->unacked_since_us + OTA_XFER_ACK_DELAY_US : INT64_MAX;
+}
@@ -0,0 +1,181 @@
+#ifndef OTA_XFER_H
+#define OTA_XFER_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#include "sha256.h"
+
+// Firmware transfer over ESP-NOW, receiver to sender. The source offers an
+// image (size and SHA-256) until a sink answers, then sends it in
+// OTA_XFER_CHUNK byte chunks, at most a window of them unacknowledged. The
+// sink writes chunks in order as they complete the front of the image and
+// buffers up to a window of later ones; its acks carry the first chunk it
+// is missing and a bitmap of the chunks after it that it holds, so the
+// source resends only the holes: at once for a hole below a chunk sent
+// later and acknowledged, otherwise after OTA_XFER_RTO_US.
+//
+// Both ends are transport agnostic: packets go out through a send callback
+// and come in through *_feed()/*_on_ack(), time is passed in, and each has
+// a poll function to call by its deadline. The session is taken from the
+// image SHA-256, so offering the same image again resumes where the sink is.
+//
+// The chunks carry the image followed by its detached signature, if the
+// offer gives it a length (ota_signature.h). The sink hands only image
+// bytes to its write callback, hashes only those, and keeps the signature
+// for the caller to check against the digest before installing.
+//
+// Packets start with their type; no other packet of the gate protocol
+// starts with 0xA0-0xA2.
+
+#define OTA_XFER_CHUNK          240             // Image bytes per data packet; ESP-NOW carries 250
+#define OTA_XFER_WINDOW         32              // Chunks unacknowledged at most, and buffered by the sink
+#define OTA_XFER_ACK_EVERY      8               // In-order chunks per ack
+#define OTA_XFER_ACK_DELAY_US   10000           // Longest an in-order chunk waits for its ack
+#define OTA_XFER_RTO_US         60000           // Resend a chunk not acknowledged by then
+#define OTA_XFER_OFFER_US       100000          // Offer repeat period
+#define OTA_XFER_GIVE_UP_US     5000000LL       // No progress for this long ends the transfer
+#define OTA_XFER_SIG_MAX        512             // Signature bytes at most, as OTA_SIGNATURE_MAX
+
+typedef enum {
+    OTA_XFER_OFFER = 0xA0,      // Source: image on offer
+    OTA_XFER_DATA = 0xA1,       // Source: one chunk
+    OTA_XFER_ACK = 0xA2,        // Sink: progress, also the answer to an offer
+} ota_xfer_type_t;
+
+typedef enum {
+    OTA_XFER_STATUS_RECEIVING,
+    OTA_XFER_STATUS_COMPLETE,   // Every chunk written and the SHA-256 matches
+    OTA_XFER_STATUS_FAILED,     // Refused, a write failed or the SHA-256 differs
+} ota_xfer_status_t;
+
+typedef struct __attribute__((packed)) {
+    uint8_t type;
+    uint16_t session;
+    uint32_t image_size;
+    uint16_t sig_len;           // Signature bytes sent after the image, 0 if unsigned
+    uint8_t sha256[SHA256_DIGEST_LEN];
+} ota_xfer_offer_t;
+
+typedef struct __attribute__((packed)) {
+    uint8_t type;
+    uint16_t session;
+    uint32_t index;             // Chunk number over image and signature; the last may be shorter
+    uint8_t data[OTA_XFER_CHUNK];
+} ota_xfer_data_t;
+
+#define OTA_XFER_DATA_HEADER_LEN    (sizeof(ota_xfer_data_t) - OTA_XFER_CHUNK)
+
+typedef struct __attribute__((packed)) {
+    uint8_t type;
+    uint16_t session;
+    uint8_t status;             // ota_xfer_status_t
+    uint32_t next;              // Every chunk below is written
+    uint32_t held;              // Bit i: chunk next + i is buffered
+} ota_xfer_ack_t;
+
+// Returns false when the packet could not be queued; it is tried again later
+typedef bool (*ota_xfer_send_cb_t)(void *ctx, const void *pkt, size_t len);
+// Read image bytes at offset, source side; the signature is not read through it
+typedef bool (*ota_xfer_read_cb_t)(void *ctx, uint32_t offset, uint8_t *data, size_t len);
+// New image offered, sink side: prepare to write image_size bytes
+typedef bool (*ota_xfer_begin_cb_t)(void *ctx, uint32_t image_size);
+// Image bytes in order, sink side
+typedef bool (*ota_xfer_write_cb_t)(void *ctx, const uint8_t *data, size_t len);
+
+typedef enum {
+    OTA_XFER_TX_OFFERING,
+    OTA_XFER_TX_SENDING,
+    OTA_XFER_TX_DONE,           // Sink reported COMPLETE
+    OTA_XFER_TX_FAILED,         // Sink reported FAILED, a read failed, or no progress
+} ota_xfer_tx_state_t;
+
+typedef struct {
+    uint32_t offers;
+    uint32_t data_frames;       // Chunks sent, first sends and resends
+    uint32_t fast_resends;      // Holes below an acknowledged chunk
+    uint32_t timeout_resends;   // Chunks past OTA_XFER_RTO_US
+    uint32_t acks;
+} ota_xfer_tx_stats_t;
+
+typedef struct {
+    ota_xfer_tx_state_t state;
+    uint16_t session;
+    uint32_t image_size;
+    uint32_t chunks;
+    uint8_t sha256[SHA256_DIGEST_LEN];
+    uint8_t sig[OTA_XFER_SIG_MAX];
+    uint16_t sig_len;
+    uint32_t window;            // Chunks in flight at most, up to OTA_XFER_WINDOW
+    int64_t rto_us;
+    uint32_t base;              // First chunk not acknowledged
+    uint32_t next_new;          // First chunk never sent
+    uint32_t acked;             // Bit i: chunk base + i held by the sink
+    uint32_t resend;            // Bit i: chunk base + i is a hole to resend now
+    int64_t sent_us[OTA_XFER_WINDOW];   // Last send of each chunk in the window, by chunk % window
+    int64_t last_offer_us;
+    int64_t last_progress_us;
+    ota_xfer_send_cb_t send;
+    ota_xfer_read_cb_t read;
+    void *ctx;
+    ota_xfer_tx_stats_t stats;
+    ota_xfer_data_t frame;
+} ota_xfer_tx_t;
+
+typedef struct {
+    uint32_t chunks;            // Data packets taken, duplicates included
+    uint32_t duplicates;
+    uint32_t out_of_order;
+    uint32_t acks;
+} ota_xfer_rx_stats_t;
+
+typedef struct {
+    bool active;                // An image has been offered and begun
+    ota_xfer_status_t status;
+    uint16_t session;
+    uint32_t image_size;
+    uint32_t chunks;
+    uint8_t sha256[SHA256_DIGEST_LEN];
+    uint8_t sig[OTA_XFER_SIG_MAX];  // Signature sent after the image, whole once COMPLETE
+    uint16_t sig_len;
+    uint32_t next;              // First chunk not written
+    uint32_t held;              // Bit i: chunk next + i is in buf
+    uint32_t unacked;           // In-order chunks since the last ack
+    int64_t unacked_since_us;
+    bool gap_acked;             // Acked since the first chunk past a hole
+    sha256_ctx_t sha;
+    ota_xfer_begin_cb_t begin;
+    ota_xfer_write_cb_t write;
+    ota_xfer_send_cb_t send;
+    void *ctx;
+    ota_xfer_rx_stats_t stats;
+    uint8_t buf[OTA_XFER_WINDOW][OTA_XFER_CHUNK];
+} ota_xfer_rx_t;
+
+// Session number for an image
+uint16_t ota_xfer_session(const uint8_t sha256[SHA256_DIGEST_LEN]);
+
+// True if the packet is one of ours, by type and length
+bool ota_xfer_is_packet(const uint8_t *pkt, size_t len);
+
+// sig may be NULL with sig_len 0 for an unsigned image
+void ota_xfer_tx_init(ota_xfer_tx_t *tx, uint32_t image_size, const uint8_t sha256[SHA256_DIGEST_LEN],
+                      const uint8_t *sig, size_t sig_len, ota_xfer_send_cb_t send, ota_xfer_read_cb_t read,
+                      void *ctx, int64_t now_us);
+void ota_xfer_tx_on_ack(ota_xfer_tx_t *tx, const ota_xfer_ack_t *ack, int64_t now_us);
+// Send what is due, until the send callback refuses a packet
+ota_xfer_tx_state_t ota_xfer_tx_poll(ota_xfer_tx_t *tx, int64_t now_us);
+// When ota_xfer_tx_poll() has something to do next if no ack comes first
+int64_t ota_xfer_tx_deadline(const ota_xfer_tx_t *tx);
+
+void ota_xfer_rx_init(ota_xfer_rx_t *rx, ota_xfer_begin_cb_t begin, ota_xfer_write_cb_t write,
+                      ota_xfer_send_cb_t send, void *ctx);
+// An offer or data packet from the source
+void ota_xfer_rx_feed(ota_xfer_rx_t *rx, const uint8_t *pkt, size_t len, int64_t now_us);
+// Send a delayed ack once it is due
+void ota_xfer_rx_poll(ota_xfer_rx_t *rx, int64_t now_us);
+// When ota_xfer_rx_poll() has something to do, INT64_MAX if nothing
+int64_t ota_xfer_rx_deadline(const ota_xfer_rx_t *rx);
+
+#endif // OTA_XFER_H
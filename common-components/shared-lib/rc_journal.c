@@ -0,0 +1,376 @@
+#include "rc_journal.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include <string.h>
+
+static const char *TAG = "RC_JOURNAL";
+
+/* --------------------------------------------------------------------------
+ * Flash access
+ * -------------------------------------------------------------------------- */
+
+static uint32_t sector_offset(uint32_t sector) {
+    return sector * RC_JOURNAL_SECTOR_SIZE;
+}
+
+static uint32_t slot_offset(uint32_t sector, uint32_t slot) {
+    return sector_offset(sector) + sizeof(rc_journal_header_t) + slot * sizeof(rc_journal_record_t);
+}
+
+/* Header checks out, the caller tells the formats apart by its magic */
+static bool read_header(rc_journal_t *journal, uint32_t sector, rc_journal_header_t *hdr) {
+    journal->stats.flash_reads++;
+    if (esp_partition_read(journal->partition, sector_offset(sector), hdr, sizeof(*hdr)) != ESP_OK) {
+        return false;
+    }
+    return hdr->sequence == ~hdr->sequence_check && hdr->sequence != 0;
+}
+
+static void read_record(rc_journal_t *journal, uint32_t sector, uint32_t slot, rc_journal_record_t *rec) {
+    journal->stats.flash_reads++;
+    if (esp_partition_read(journal->partition, slot_offset(sector, slot), rec, sizeof(*rec)) != ESP_OK) {
+        memset(rec, 0, sizeof(*rec)); // Unreadable counts as written but invalid
+    }
+}
+
+static inline bool record_erased(const rc_journal_record_t *rec) {
+    return rec->value == UINT32_MAX && rec->check == UINT32_MAX &&
+           rec->key == UINT16_MAX && rec->key_check == UINT16_MAX;
+}
+
+static inline bool record_valid(const rc_journal_record_t *rec) {
+    return rec->value == ~rec->check && (uint16_t)(rec->key ^ rec->key_check) == UINT16_MAX &&
+           rec->key < RC_JOURNAL_MAX_KEYS;
+}
+
+static inline rc_journal_record_t make_record(uint8_t key, uint32_t value) {
+    rc_journal_record_t rec = {
+        .value = value,
+        .check = ~value,
+        .key = key,
+        .key_check = (uint16_t)~key,
+    };
+    return rec;
+}
+
+/* --------------------------------------------------------------------------
+ * Recovery
+ * -------------------------------------------------------------------------- */
+
+#define REPLAY_BATCH 32     // Records per flash read when replaying a sector
+
+/**
+ * @brief Number of written slots in a sector
+ * Records are written front to back, and a slot whose write failed is marked
+ * (mark_slot_used()), so written slots form a prefix and the boundary is
+ * found with a binary search instead of a linear scan.
+ */
+static uint32_t count_written(rc_journal_t *journal, uint32_t sector) {
+    uint32_t lo = 0;
+    uint32_t hi = RC_JOURNAL_SLOTS;
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        rc_journal_record_t rec;
+        read_record(journal, sector, mid, &rec);
+        if (record_erased(&rec)) {
+            hi = mid;
+        } else {
+            lo = mid + 1;
+        }
+    }
+    return lo;
+}
+
+/**
+ * @brief Apply the written records of a sector in order, skipping records torn by a power cut
+ * The sector starts with a snapshot of every key, so it alone holds the newest values.
+ */
+static void replay_sector(rc_journal_t *journal, uint32_t sector, uint32_t written) {
+    rc_journal_record_t batch[REPLAY_BATCH];
+    for (uint32_t slot = 0; slot < written; slot += REPLAY_BATCH) {
+        uint32_t n = written - slot < REPLAY_BATCH ? written - slot : REPLAY_BATCH;
+        journal->stats.flash_reads++;
+        if (esp_partition_read(journal->partition, slot_offset(sector, slot), batch, n * sizeof(batch[0])) != ESP_OK) {
+            continue;
+        }
+        for (uint32_t i = 0; i < n; i++) {
+            if (record_valid(&batch[i])) {
+                journal->values[batch[i].key] = batch[i].value;
+                journal->known |= 1ULL << batch[i].key;
+            }
+        }
+    }
+}
+
+/* --------------------------------------------------------------------------
+ * Journals from before records had keys
+ * Same header with another magic, then 8-byte records of one counter. Read
+ * once, on the first boot after the upgrade: the first append then starts a
+ * new-format sector, which is newer whatever the old sequences were.
+ * -------------------------------------------------------------------------- */
+
+#define RC_JOURNAL_V1_MAGIC 0x4A435252UL    // "RRCJ"
+
+typedef struct {
+    uint32_t value;
+    uint32_t check;
+} rc_journal_v1_record_t;
+
+#define RC_JOURNAL_V1_SLOTS ((RC_JOURNAL_SECTOR_SIZE - sizeof(rc_journal_header_t)) / sizeof(rc_journal_v1_record_t))
+
+/**
+ * @brief Newest valid record of an old-format sector
+ */
+static bool v1_newest_valid(rc_journal_t *journal, uint32_t sector, uint32_t *value) {
+    rc_journal_v1_record_t batch[REPLAY_BATCH];
+    bool found = false;
+    for (uint32_t slot = 0; slot < RC_JOURNAL_V1_SLOTS; slot += REPLAY_BATCH) {
+        uint32_t n = RC_JOURNAL_V1_SLOTS - slot < REPLAY_BATCH ? RC_JOURNAL_V1_SLOTS - slot : REPLAY_BATCH;
+        journal->stats.flash_reads++;
+        if (esp_partition_read(journal->partition, sector_offset(sector) + sizeof(rc_journal_header_t) +
+                               slot * sizeof(batch[0]), batch, n * sizeof(batch[0])) != ESP_OK) {
+            continue;
+        }
+        for (uint32_t i = 0; i < n; i++) {
+            if (batch[i].value == UINT32_MAX && batch[i].check == UINT32_MAX) {
+                return found;   // Written front to back, the rest is erased
+            }
+            if (batch[i].value == ~batch[i].check) {
+                *value = batch[i].value;
+                found = true;
+            }
+        }
+    }
+    return found;
+}
+
+/**
+ * @brief Take an old-format journal's value as key RC_JOURNAL_KEY_OWN
+ * Its newest sector with a valid record wins, as the old format recovered it;
+ * appends go on in the sector after it, the oldest one.
+ * @param sequences Old-format sequence per sector, 0 where there is none
+ */
+static void recover_v1(rc_journal_t *journal, const uint32_t *sequences) {
+    uint32_t limit = UINT32_MAX;
+    while (1) {
+        uint32_t best = UINT32_MAX;
+        for (uint32_t s = 0; s < journal->sector_count; s++) {
+            if (sequences[s] != 0 && sequences[s] < limit &&
+                (best == UINT32_MAX || sequences[s] > sequences[best])) {
+                best = s;
+            }
+        }
+        if (best == UINT32_MAX) {
+            return;
+        }
+        if (v1_newest_valid(journal, best, &journal->values[RC_JOURNAL_KEY_OWN])) {
+            journal->known |= 1ULL << RC_JOURNAL_KEY_OWN;
+            journal->active_sector = best;
+            ESP_LOGI(TAG, "Carried %lu over from an old-format journal",
+                     (unsigned long)journal->values[RC_JOURNAL_KEY_OWN]);
+            return;
+        }
+        limit = sequences[best];
+    }
+}
+
+/* --------------------------------------------------------------------------
+ * Opening
+ * -------------------------------------------------------------------------- */
+
+/**
+ * @brief Find the partition and recover the newest persisted value of every key
+ * A sector only gets its header once its snapshot is complete, so the newest
+ * sector with a valid header is the only one that needs reading.
+ */
+esp_err_t rc_journal_open(rc_journal_t *journal, const char *label) {
+    int64_t start_us = esp_timer_get_time();
+    memset(journal, 0, sizeof(*journal));
+
+    journal->partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA,
+                                                  RC_JOURNAL_PARTITION_SUBTYPE, label);
+    if (journal->partition == NULL) {
+        ESP_LOGW(TAG, "No '%s' partition", label);
+        return ESP_ERR_NOT_FOUND;
+    }
+    journal->sector_count = journal->partition->size / RC_JOURNAL_SECTOR_SIZE;
+    if (journal->sector_count > RC_JOURNAL_MAX_SECTORS) {
+        journal->sector_count = RC_JOURNAL_MAX_SECTORS;
+    }
+    if (journal->sector_count < 2) {
+        ESP_LOGE(TAG, "Partition '%s' needs at least 2 sectors", label);
+        journal->partition = NULL;
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    /* Newest sector with a valid header */
+    uint32_t v1_sequences[RC_JOURNAL_MAX_SECTORS] = {0};
+    journal->active_sector = journal->sector_count - 1;
+    journal->next_slot = RC_JOURNAL_SLOTS; // First append starts sector 0
+    for (uint32_t s = 0; s < journal->sector_count; s++) {
+        rc_journal_header_t hdr;
+        if (!read_header(journal, s, &hdr)) {
+            continue;
+        }
+        if (hdr.magic == RC_JOURNAL_MAGIC && hdr.sequence > journal->sequence) {
+            journal->sequence = hdr.sequence;
+            journal->active_sector = s;
+        } else if (hdr.magic == RC_JOURNAL_V1_MAGIC) {
+            v1_sequences[s] = hdr.sequence;
+        }
+    }
+
+    if (journal->sequence != 0) {
+        /* Appends continue after the last written slot, even if that record is torn */
+        journal->next_slot = count_written(journal, journal->active_sector);
+        replay_sector(journal, journal->active_sector, journal->next_slot);
+    } else {
+        recover_v1(journal, v1_sequences);
+    }
+
+    journal->stats.open_us = esp_timer_get_time() - start_us;
+    if (journal->known == 0) {
+        ESP_LOGI(TAG, "Journal empty (%u sectors)", (unsigned)journal->sector_count);
+    } else {
+        ESP_LOGI(TAG, "Recovered %u keys from sector %u slot %u in %u reads, %lld us",
+                 (unsigned)__builtin_popcountll(journal->known), (unsigned)journal->active_sector,
+                 (unsigned)journal->next_slot, (unsigned)journal->stats.flash_reads,
+                 (long long)journal->stats.open_us);
+    }
+    return ESP_OK;
+}
+
+/**
+ * @brief Newest persisted value of a key
+ * @return false if nothing was persisted for it
+ */
+bool rc_journal_get(const rc_journal_t *journal, uint8_t key, uint32_t *value) {
+    if (key >= RC_JOURNAL_MAX_KEYS || !(journal->known & (1ULL << key))) {
+        return false;
+    }
+    *value = journal->values[key];
+    return true;
+}
+
+/* --------------------------------------------------------------------------
+ * Appending
+ * -------------------------------------------------------------------------- */
+
+/**
+ * @brief Move to the next sector: erase it, write a snapshot of every key, then the header
+ * Writing the header last means a header always comes with a complete snapshot.
+ */
+static esp_err_t start_sector(rc_journal_t *journal, uint8_t key, uint32_t value) {
+    uint32_t sector = (journal->active_sector + 1) % journal->sector_count;
+    esp_err_t err = esp_partition_erase_range(journal->partition, sector_offset(sector), RC_JOURNAL_SECTOR_SIZE);
+    if (err != ESP_OK) {
+        return err;
+    }
+    journal->stats.sector_erases++;
+
+    uint64_t known = journal->known | (1ULL << key);
+    uint32_t slot = 0;
+    for (uint8_t k = 0; k < RC_JOURNAL_MAX_KEYS; k++) {
+        if (!(known & (1ULL << k))) {
+            continue;
+        }
+        rc_journal_record_t rec = make_record(k, k == key ? value : journal->values[k]);
+        err = esp_partition_write(journal->partition, slot_offset(sector, slot), &rec, sizeof(rec));
+        if (err != ESP_OK) {
+            return err;
+        }
+        journal->stats.flash_writes++;
+        slot++;
+    }
+
+    rc_journal_header_t hdr = {
+        .magic = RC_JOURNAL_MAGIC,
+        .sequence = journal->sequence + 1,
+        .sequence_check = ~(journal->sequence + 1),
+        .reserved = UINT32_MAX,
+    };
+    err = esp_partition_write(journal->partition, sector_offset(sector), &hdr, sizeof(hdr));
+    if (err != ESP_OK) {
+        return err;
+    }
+    journal->stats.flash_writes++;
+
+    journal->active_sector = sector;
+    journal->sequence = hdr.sequence;
+    journal->next_slot = slot;
+    return ESP_OK;
+}
+
+/**
+ * @brief Make a slot whose write failed read as written, so written slots stay a prefix
+ * A still erased slot followed by later records would end count_written()'s
+ * binary search early after a reboot, losing those records. Zeros make an
+ * invalid record whatever the failed write left (NOR bits only go 1 -> 0).
+ * @return false if the slot is still erased, it is then used by the next append
+ */
+static bool mark_slot_used(rc_journal_t *journal, uint32_t sector, uint32_t slot) {
+    rc_journal_record_t rec;
+    memset(&rec, 0, sizeof(rec));
+    if (esp_partition_write(journal->partition, slot_offset(sector, slot), &rec, sizeof(rec)) == ESP_OK) {
+        journal->stats.flash_writes++;
+        return true;
+    }
+    read_record(journal, sector, slot, &rec);
+    return !record_erased(&rec);
+}
+
+/**
+ * @brief Whether code a comes after code b, in serial-number order as in replay_window.c
+ * Rolling codes wrap at 2^32, so a plain compare would refuse every value past the wrap.
+ */
+static inline bool code_after(uint32_t a, uint32_t b) {
+    return (int32_t)(a - b) > 0;
+}
+
+/**
+ * @brief Persist a value of a key, ahead of its current one
+ */
+esp_err_t rc_journal_append(rc_journal_t *journal, uint8_t key, uint32_t value) {
+    if (journal->partition == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    uint32_t current;
+    if (key >= RC_JOURNAL_MAX_KEYS || (rc_journal_get(journal, key, &current) && !code_after(value, current))) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    esp_err_t err;
+    if (journal->next_slot >= RC_JOURNAL_SLOTS) {
+        err = start_sector(journal, key, value);
+    } else {
+        rc_journal_record_t rec = make_record(key, value);
+        err = esp_partition_write(journal->partition, slot_offset(journal->active_sector, journal->next_slot),
+                                  &rec, sizeof(rec));
+        if (err == ESP_OK) {
+            journal->stats.flash_writes++;
+            journal->next_slot++;
+        } else if (mark_slot_used(journal, journal->active_sector, journal->next_slot)) {
+            journal->next_slot++;  // Torn or zeroed, never reused
+        }
+    }
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Append of %lu to key %u failed: %s", (unsigned long)value, key, esp_err_to_name(err));
+        return err;
+    }
+
+    journal->values[key] = value;
+    journal->known |= 1ULL << key;
+    return ESP_OK;
+}
+
+/**
+ * @brief Make sure `code` is covered by the key's persisted value before it is used
+ * The reservation wraps with the codes, modulo 2^32.
+ */
+esp_err_t rc_journal_reserve(rc_journal_t *journal, uint8_t key, uint32_t code) {
+    uint32_t current;
+    if (rc_journal_get(journal, key, &current) && !code_after(code, current)) {
+        return ESP_OK;
+    }
+    return rc_journal_append(journal, key, code + RC_JOURNAL_RESERVE);
+}
@@ -0,0 +1,80 @@
+#ifndef RC_JOURNAL_H
+#define RC_JOURNAL_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+#include "esp_partition.h"
+
+// Append-only rolling code journal on a raw data partition. Each sector holds a
+// header and a run of 12-byte records written front to back; when a sector is
+// full the next one (round-robin, so erases are spread evenly) is erased and
+// starts with a snapshot of every key's value. Values are reserved
+// RC_JOURNAL_RESERVE codes ahead, so the journal only grows once per block of
+// codes and a recovered value is never below a code used before a power cut.
+// Each record carries a key, so one partition holds the counters of up to
+// RC_JOURNAL_MAX_KEYS senders (the sender itself only uses key 0).
+
+#define RC_JOURNAL_PARTITION_LABEL   "rcjournal"
+#define RC_JOURNAL_PARTITION_SUBTYPE 0x40          // Custom data subtype, see partitions.csv
+#define RC_JOURNAL_SECTOR_SIZE       4096
+#define RC_JOURNAL_MAX_SECTORS       16
+#define RC_JOURNAL_RESERVE           64            // Codes covered by one record
+#define RC_JOURNAL_MAX_KEYS          64            // Independent counters per partition
+#define RC_JOURNAL_KEY_OWN           0             // Key of a device's own counter
+#define RC_JOURNAL_MAGIC             0x4B435252UL  // "RRCK"
+
+// Sector header, written after the sector's snapshot records
+typedef struct {
+    uint32_t magic;
+    uint32_t sequence;          // Increments per sector used, highest is the newest
+    uint32_t sequence_check;    // ~sequence, catches a torn header
+    uint32_t reserved;
+} rc_journal_header_t;
+
+// One journal entry, erased flash reads as all ones
+typedef struct {
+    uint32_t value;
+    uint32_t check;             // ~value, catches a torn record
+    uint16_t key;
+    uint16_t key_check;         // ~key
+} rc_journal_record_t;
+
+#define RC_JOURNAL_SLOTS ((RC_JOURNAL_SECTOR_SIZE - sizeof(rc_journal_header_t)) / sizeof(rc_journal_record_t))
+
+// Flash traffic since the journal was opened
+typedef struct {
+    uint32_t flash_reads;       // Reads while recovering at open
+    uint32_t flash_writes;      // Records and headers written
+    uint32_t sector_erases;
+    int64_t open_us;            // Time spent recovering at open
+} rc_journal_stats_t;
+
+typedef struct {
+    const esp_partition_t *partition;
+    uint32_t sector_count;
+    uint32_t active_sector;     // Sector holding the newest record
+    uint32_t next_slot;         // Next free record slot in active_sector
+    uint32_t sequence;          // Sequence of active_sector, 0 while empty
+    uint64_t known;             // Bit k set: values[k] holds a persisted value
+    uint32_t values[RC_JOURNAL_MAX_KEYS]; // Newest persisted value per key
+    rc_journal_stats_t stats;
+} rc_journal_t;
+
+// Find the partition and recover the newest value of every key
+// (binary search for the end of the newest sector, then one pass over it).
+// A journal written before records had keys is read as key RC_JOURNAL_KEY_OWN.
+esp_err_t rc_journal_open(rc_journal_t *journal, const char *label);
+
+// Newest persisted value of a key, false if the key has none (caller should seed one)
+bool rc_journal_get(const rc_journal_t *journal, uint8_t key, uint32_t *value);
+
+// Persist a value of a key, ahead of its current one (serial-number order, so
+// codes keep working across the 32-bit wrap)
+esp_err_t rc_journal_append(rc_journal_t *journal, uint8_t key, uint32_t value);
+
+// Make sure `code` is covered by the key's persisted value before it is used,
+// appending code + RC_JOURNAL_RESERVE when it is not
+esp_err_t rc_journal_reserve(rc_journal_t *journal, uint8_t key, uint32_t code);
+
+#endif // RC_JOURNAL_H
@@ -0,0 +1,41 @@
+#include "replay_window.h"
+
+/// Starts the window at a persisted code with the whole bitmap marked seen
+void replay_window_init(replay_window_t *w, uint32_t highest) {
+    w->highest = highest;
+    w->seen = UINT64_MAX;
+}
+
+/// Constant-time check: one subtraction, one compare and one bit test
+bool replay_window_check(const replay_window_t *w, uint32_t code) {
+    int32_t ahead = (int32_t)(code - w->highest);
+    if (ahead > 0) {
+        return true;
+    }
+    uint32_t behind = w->highest - code;   // Unsigned: -ahead overflows at 2^31
+    if (behind >= REPLAY_WINDOW_BITS) {
+        return false;  // Too old to tell apart from a replay
+    }
+    return !((w->seen >> behind) & 1);
+}
+
+/// Records a code that passed replay_window_check()
+void replay_window_update(replay_window_t *w, uint32_t code) {
+    int32_t ahead = (int32_t)(code - w->highest);
+    if (ahead > 0) {
+        // Slide forward; codes skipped over stay unseen and can still arrive late
+        w->seen = (uint32_t)ahead < REPLAY_WINDOW_BITS ? (w->seen << ahead) | 1 : 1;
+        w->highest = code;
+    } else if (w->highest - code < REPLAY_WINDOW_BITS) {
+        w->seen |= 1ULL << (w->highest - code);
+    }
+}
+
+/// Accepts a code at most once
+bool replay_window_accept(replay_window_t *w, uint32_t code) {
+    if (!replay_window_check(w, code)) {
+        return false;
+    }
+    replay_window_update(w, code);
+    return true;
+}
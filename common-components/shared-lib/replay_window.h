@@ -0,0 +1,31 @@
+#ifndef REPLAY_WINDOW_H
+#define REPLAY_WINDOW_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Anti-replay window in the style of IPsec (RFC 4303): the highest accepted
+// code plus a bitmap of the REPLAY_WINDOW_BITS codes at and below it, so a
+// packet that arrives late or twice is accepted exactly once. Codes are
+// compared with serial-number arithmetic, which keeps working across the
+// 32-bit wrap.
+#define REPLAY_WINDOW_BITS 64
+
+typedef struct {
+    uint32_t highest;           // Highest accepted code
+    uint64_t seen;              // Bit i set: code highest - i was accepted
+} replay_window_t;
+
+// Start from a persisted code, treating it and everything before it as seen
+void replay_window_init(replay_window_t *w, uint32_t highest);
+
+// Check if code is new: ahead of highest, or inside the window and not yet seen
+bool replay_window_check(const replay_window_t *w, uint32_t code);
+
+// Mark a checked code as seen, sliding the window forward if it is ahead
+void replay_window_update(replay_window_t *w, uint32_t code);
+
+// Check and update in one go, returns true if the code was accepted
+bool replay_window_accept(replay_window_t *w, uint32_t code);
+
+#endif // REPLAY_WINDOW_H
@@ -1,14 +1,22 @@
 #include "ring_buffer.h"
 
+/* Compiles to a single instruction on targets that have one, libgcc otherwise */
+#define RINGBUF_POPCOUNT(x) ((uint8_t)__builtin_popcount(x))
+
 /**
  * Add a sample to the ring buffer at the current index and advance the pointer.
+ * The bit being overwritten leaves the running high count and the new one enters it.
  * When the buffer reaches capacity, wrap around to the beginning and mark as full.
  * 
  * @param rb Pointer to the ring buffer structure
  * @param sample Boolean value to store
  */
 void ringbuf_add_sample(ringbuf_t *rb, bool sample) {
-    rb->samples[rb->index] = sample;
+    uint32_t mask = 1UL << rb->index;
+    bool old_sample = (rb->samples & mask) != 0;
+
+    rb->high_count += (uint8_t)sample - (uint8_t)old_sample;
+    rb->samples = (rb->samples & ~mask) | (sample ? mask : 0);
     rb->index++;
 
     if (rb->index >= WINDOW_SIZE) {
@@ -19,22 +27,26 @@ void ringbuf_add_sample(ringbuf_t *rb, bool sample) {
 
 /**
  * Count the number of high (true) samples in the ring buffer.
+ * O(1): returns the count maintained by ringbuf_add_sample().
  * 
  * @param rb Pointer to the ring buffer structure
  * @return Number of high samples
  */
 uint8_t ringbuf_count_high(ringbuf_t *rb) {
-    uint8_t count = 0;
-    /* Determine the number of valid samples: all if full, otherwise up to current index */
-    uint8_t limit = rb->full ? WINDOW_SIZE : rb->index;
-
-    for (uint8_t i = 0; i < limit; i++) {
-        if (rb->samples[i]) {
-            count++;
-        }
-    }
+    return rb->high_count;
+}
 
-    return count;
+/**
+ * Recount the high samples from the sample bits and resync the running count.
+ * Only needed if the structure was modified without ringbuf_add_sample().
+ * Bits past the write index are always zero until the buffer is full.
+ * 
+ * @param rb Pointer to the ring buffer structure
+ * @return Number of high samples
+ */
+uint8_t ringbuf_recount_high(ringbuf_t *rb) {
+    rb->high_count = RINGBUF_POPCOUNT(rb->samples);
+    return rb->high_count;
 }
 
 /**
@@ -51,6 +63,5 @@ bool ringbuf_is_majority_high(ringbuf_t *rb) {
         return false;
     }
 
-    uint8_t high_count = ringbuf_count_high(rb);
-    return (high_count > (total_count / 2));
-}
\ No newline at end of file
+    return (rb->high_count > (total_count / 2));
+}
@@ -7,11 +7,16 @@
 // Size of the ring buffer window
 #define WINDOW_SIZE 32
 
-// Ring buffer structure for storing boolean samples
+#if WINDOW_SIZE > 32
+#error "WINDOW_SIZE must fit in the 32-bit sample word"
+#endif
+
+// Ring buffer structure for storing boolean samples, one bit per sample
 typedef struct {
-    bool samples[WINDOW_SIZE];  // Array of boolean samples
+    uint32_t samples;           // Sample bits, bit i holds the sample at position i
     uint8_t index;              // Current write position in the buffer
     bool full;                  // Flag indicating if buffer has wrapped around
+    uint8_t high_count;         // Running number of high samples in the window
 } ringbuf_t;
 
 // Add a new sample to the ring buffer
@@ -20,7 +25,10 @@ void ringbuf_add_sample(ringbuf_t *rb, bool sample);
 // Count the number of high (true) samples in the buffer
 uint8_t ringbuf_count_high(ringbuf_t *rb);
 
+// Recount the high samples with popcount and resync the running count
+uint8_t ringbuf_recount_high(ringbuf_t *rb);
+
 // Check if the majority of samples in the buffer are high
 bool ringbuf_is_majority_high(ringbuf_t *rb);
 
-#endif // RING_BUFFER_H
\ No newline at end of file
+#endif // RING_BUFFER_H
@@ -37,10 +37,20 @@ void load_rolling_code(rolling_code_t *rc) {
     rc->last_save_timestamp = esp_timer_get_time();  // Record load time
 }
 
-/// Initializes rolling code structure with values from NVS
+/// Initializes rolling code structure from the journal, or from NVS without one
 void rolling_code_init(rolling_code_t *rc) {
-    load_rolling_code(rc);  // Load from persistent storage
-    rc->code;  // NOTE: This line has no effect; consider removing
+    if (rc_journal_open(&rc->journal, RC_JOURNAL_PARTITION_LABEL) == ESP_OK &&
+        rc_journal_get(&rc->journal, RC_JOURNAL_KEY_OWN, &rc->code)) {
+        // Reserved ahead of every code used before reboot
+        rc->last_saved_code = rc->code;
+        rc->last_save_timestamp = esp_timer_get_time();
+    } else {
+        load_rolling_code(rc);  // Load from persistent storage
+        if (rc->journal.partition != NULL) {
+            rc_journal_append(&rc->journal, RC_JOURNAL_KEY_OWN, rc->code);  // First boot with a journal: carry NVS value over
+        }
+    }
+    replay_window_init(&rc->window, rc->code);  // Nothing at or below the loaded code is accepted
 }
 
 /// Persists current rolling code to NVS flash storage
@@ -59,12 +69,17 @@ static inline bool is_newer(uint32_t new_code, uint32_t current_code) {
     return (int32_t)(new_code - current_code) > 0;  // Handles wraparound correctly
 }
 
-/// Validates received code is within rolling window and newer than current code
+/// Validates received code is not too far ahead and not seen before, late arrivals included
 bool rolling_code_authenticate(rolling_code_t *rc, uint32_t received_code) {
-    // Check if code is newer AND not too far ahead (within rolling window)
-    if (is_newer(received_code, rc->code) && 
-        is_newer(rc->code, received_code - ROLLING_WINDOW)) {
-        rc->code = received_code;  // Accept and update to new code
+    // Check if code is not too far ahead (within rolling window) AND not replayed
+    if (is_newer(rc->code, received_code - ROLLING_WINDOW) &&
+        replay_window_check(&rc->window, received_code)) {
+        // Journal ahead before accepting so a power cut cannot reopen the replay window
+        if (rc->journal.partition != NULL && rc_journal_reserve(&rc->journal, RC_JOURNAL_KEY_OWN, received_code) != ESP_OK) {
+            return false;
+        }
+        replay_window_update(&rc->window, received_code);
+        rc->code = rc->window.highest;  // Highest accepted code
         return true;
     }
     return false;  // Reject invalid or replayed code
@@ -72,11 +87,18 @@ bool rolling_code_authenticate(rolling_code_t *rc, uint32_t received_code) {
 
 /// Increments and returns the next rolling code
 uint32_t rolling_code_get_and_increment(rolling_code_t *rc) {
+    // Journal ahead before the code goes out so it is never repeated after a reboot
+    if (rc->journal.partition != NULL && rc_journal_reserve(&rc->journal, RC_JOURNAL_KEY_OWN, rc->code + 1) != ESP_OK) {
+        ESP_LOGW(TAG, "Rolling code %lu used without reservation", rc->code + 1);
+    }
     return ++rc->code;  // Pre-increment and return new value
 }
 
 /// Periodically saves rolling code to NVS to reduce flash wear while preventing desync
 void rolling_code_periodic_save(rolling_code_t *rc, int64_t save_delay_us) {
+    if (rc->journal.partition != NULL) {
+        return;  // Journal already persists ahead of every code
+    }
     uint64_t current_time = esp_timer_get_time();  // Get current timestamp
     
     // Save only if enough time has passed since last save to reduce flash wear
@@ -2,11 +2,16 @@
 #define ROLLING_CODE_H
 
 #include <stdint.h>
+#include <stdbool.h>
+#include "rc_journal.h"
+#include "replay_window.h"
 
 typedef struct {
     uint32_t code;
     uint32_t last_saved_code;
     int64_t last_save_timestamp; 
+    rc_journal_t journal;           // Replaces the NVS key when the partition exists
+    replay_window_t window;         // Codes accepted at and below code
 } rolling_code_t;
 
 /* Function declarations */
@@ -0,0 +1,35 @@
+#ifndef SHA256_H
+#define SHA256_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Incremental SHA-256. On the device this is mbedtls, which drives the SHA
+// peripheral when CONFIG_MBEDTLS_HARDWARE_SHA is set (the IDF default); the
+// host build, or a firmware build with SHA256_SOFTWARE defined, uses the
+// portable FIPS 180-4 code in sha256.c.
+
+#define SHA256_DIGEST_LEN   32
+#define SHA256_BLOCK_LEN    64
+
+#if defined(ESP_PLATFORM) && !defined(SHA256_SOFTWARE)
+#include "mbedtls/sha256.h"
+
+typedef struct {
+    mbedtls_sha256_context mbedtls;
+} sha256_ctx_t;
+#else
+typedef struct {
+    uint32_t state[8];
+    uint64_t bytes;                     // Message length so far
+    uint8_t block[SHA256_BLOCK_LEN];    // Partial block, bytes % SHA256_BLOCK_LEN of it used
+} sha256_ctx_t;
+#endif
+
+void sha256_init(sha256_ctx_t *ctx);
+void sha256_update(sha256_ctx_t *ctx, const void *data, size_t len);
+
+// Writes the digest and releases the context; sha256_init() before reuse.
+void sha256_final(sha256_ctx_t *ctx, uint8_t digest[SHA256_DIGEST_LEN]);
+
+#endif // SHA256_H
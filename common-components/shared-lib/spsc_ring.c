@@ -0,0 +1,54 @@
+#include "spsc_ring.h"
+#include <string.h>
+
+bool spsc_ring_init(spsc_ring_t *r, void *slab, uint32_t slot_size, uint32_t slot_count) {
+    if (slot_count == 0 || (slot_count & (slot_count - 1)) != 0) {
+        return false;
+    }
+    memset(r, 0, sizeof(*r));
+    r->slab = slab;
+    r->slot_size = slot_size;
+    r->mask = slot_count - 1;
+    return true;
+}
+
+/// Only the producer writes head, so it is read plainly; tail needs acquire so
+/// the consumer is done with a slot before it is handed out again
+void *spsc_ring_claim(spsc_ring_t *r) {
+    uint32_t head = r->head;
+    uint32_t used = head - __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE);
+    if (used > r->mask) {
+        r->stats.overflows++;
+        return NULL;
+    }
+    if (used + 1 > r->stats.high_water) {
+        r->stats.high_water = used + 1;
+    }
+    return r->slab + (head & r->mask) * r->slot_size;
+}
+
+/// Release store: the slot contents are visible before the new head
+void spsc_ring_publish(spsc_ring_t *r) {
+    r->stats.published++;
+    __atomic_store_n(&r->head, r->head + 1, __ATOMIC_RELEASE);
+}
+
+void *spsc_ring_peek(spsc_ring_t *r) {
+    return spsc_ring_peek_at(r, 0);
+}
+
+void *spsc_ring_peek_at(spsc_ring_t *r, uint32_t index) {
+    uint32_t tail = r->tail;
+    if (__atomic_load_n(&r->head, __ATOMIC_ACQUIRE) - tail <= index) {
+        return NULL;
+    }
+    return r->slab + ((tail + index) & r->mask) * r->slot_size;
+}
+
+void spsc_ring_release(spsc_ring_t *r) {
+    __atomic_store_n(&r->tail, r->tail + 1, __ATOMIC_RELEASE);
+}
+
+uint32_t spsc_ring_count(const spsc_ring_t *r) {
+    return __atomic_load_n(&r->head, __ATOMIC_ACQUIRE) - __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE);
+}
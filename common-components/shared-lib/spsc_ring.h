@@ -0,0 +1,61 @@
+#ifndef SPSC_RING_H
+#define SPSC_RING_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Lock-free ring for handing fixed-size items from exactly one producer task
+// to exactly one consumer task. Items live in a slab of slots preallocated by
+// the caller: the producer claims the next free slot, fills it in place and
+// publishes it, the consumer peeks at the oldest slot, uses it in place and
+// releases it. Nothing is copied in or out and no critical section is taken;
+// head and tail are free-running counters, each written by one side only and
+// read by the other with acquire/release ordering.
+
+#define SPSC_RING_CACHE_LINE 64     // Keeps the producer and consumer fields apart
+
+// Producer side counters, cumulative and only written by the producer
+typedef struct {
+    uint32_t published;         // Slots handed to the consumer
+    uint32_t overflows;         // Claims refused because every slot was in use
+    uint32_t high_water;        // Most slots in use at once
+} spsc_ring_stats_t;
+
+typedef struct {
+    // Producer line
+    uint32_t head __attribute__((aligned(SPSC_RING_CACHE_LINE))); // Slots claimed and published
+    spsc_ring_stats_t stats;
+    // Consumer line
+    uint32_t tail __attribute__((aligned(SPSC_RING_CACHE_LINE))); // Slots released
+    // Read-only after init
+    uint8_t *slab __attribute__((aligned(SPSC_RING_CACHE_LINE)));
+    uint32_t slot_size;
+    uint32_t mask;              // Slot count - 1
+} spsc_ring_t;
+
+// Start empty over a caller-owned slab of slot_count slots of slot_size bytes,
+// slot_count a power of two. Returns false if it is not.
+bool spsc_ring_init(spsc_ring_t *r, void *slab, uint32_t slot_size, uint32_t slot_count);
+
+// Producer: next free slot to fill, NULL (and an overflow counted) if the ring is full.
+// A claimed slot must be published before the next claim.
+void *spsc_ring_claim(spsc_ring_t *r);
+
+// Producer: hand the claimed slot to the consumer
+void spsc_ring_publish(spsc_ring_t *r);
+
+// Consumer: oldest published slot, NULL if the ring is empty. It stays
+// valid and in place until spsc_ring_release().
+void *spsc_ring_peek(spsc_ring_t *r);
+
+// Consumer: published slot index places after the oldest, NULL if there is none
+// yet; spsc_ring_peek_at(r, 0) is spsc_ring_peek(r)
+void *spsc_ring_peek_at(spsc_ring_t *r, uint32_t index);
+
+// Consumer: give the peeked slot back to the producer
+void spsc_ring_release(spsc_ring_t *r);
+
+// Slots published and not yet released, from either side
+uint32_t spsc_ring_count(const spsc_ring_t *r);
+
+#endif // SPSC_RING_H
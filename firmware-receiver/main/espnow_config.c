@@ -1,49 +1,226 @@
 #include "espnow_config.h"
+#include "event_loop.h"
+#include "sender_table.h"
+#include "sender_ota.h"
+#include "ota_xfer.h"
 #include "esp_log.h"
 #include "esp_timer.h"
+#include <string.h>
 
 static const char *TAG = "ESPNOW";
 
-QueueHandle_t rx_queue;
+spsc_ring_t rx_rings[EVENT_LANE_COUNT];
+static event_t rx_slabs[EVENT_LANE_COUNT][RX_RING_SLOTS];
+espnow_rx_stats_t espnow_rx_stats = {0};
+bool espnow_rx_prefilter = true; // Cleared to queue every well-formed packet
+uint32_t espnow_replies = 0;
+
+/* Senders registered as ESP-NOW peers for replies; a full list replaces them in turn */
+static uint8_t reply_peers[ESPNOW_REPLY_PEERS];
+static uint8_t reply_peer_count = 0;
+static uint8_t reply_peer_next = 0;
+
+static espnow_rx_stats_t reported_stats = {0};
+static uint32_t reported_replies = 0;
+static uint32_t reported_overflows[EVENT_LANE_COUNT] = {0};
+static int64_t stats_window_start_us = 0;
+
+/**
+ * @brief Drop packets the main loop would reject before they take a ring slot
+ * Each sender keeps a second replay window of the codes queued so far, owned
+ * by the Wi-Fi task. A code it rejects was queued before, or is too far
+ * behind one that was, so process_event() would reject this copy as well.
+ */
+static bool prefilter_drop(const rx_event_t *evnt) {
+    if (evnt->sender == SENDER_ID_NONE) {
+        /* Unpaired senders only get through with a force open while pairing is active */
+        if (evnt->command != CMD_FORCE_OPEN || !sender_pairing_active(evnt->timestamp_us)) {
+            espnow_rx_stats.unknown_sender++;
+            return true;
+        }
+        return false;
+    }
+    if (espnow_rx_prefilter &&
+        !replay_window_check(&sender_table_get(evnt->sender)->queued, evnt->rolling_code)) {
+        espnow_rx_stats.replayed++;
+        return true;
+    }
+    return false;
+}
 
 void receive_cb(const esp_now_recv_info_t *recv_info,
                 const uint8_t *data,
                 int len) {
-    if (len != sizeof(espnow_data_t)) {
-        ESP_LOGW(TAG, "Invalid packet size: %d", len);
+    /* No logging here, a flood would stall the Wi-Fi task; espnow_report_stats() has the counts */
+    if (ota_xfer_is_packet(data, len)) {
+        sender_ota_on_packet(recv_info->src_addr, data, len);
         return;
     }
-    if (((espnow_data_t *)data)->version != SUPPORTED_PROTOCOL_VERSION) {
-        ESP_LOGW(TAG, "Unsupported protocol version: %d",
-                 ((espnow_data_t *)data)->version);
+    const espnow_data_t *pkt = (const espnow_data_t *)data;
+    bool v1 = len == ESPNOW_DATA_V1_LEN && pkt->version == 1;
+    if (!v1 && (len != sizeof(espnow_data_t) || pkt->version != SUPPORTED_PROTOCOL_VERSION)) {
+        espnow_rx_stats.bad_format++;
         return;
     }
-    rx_event_t evnt = {
-        .command = ((espnow_data_t *)data)->command,
-        .rolling_code = ((espnow_data_t *)data)->rolling_code,
+    rx_event_t rx = {
+        .command = pkt->command,
+        .sender = sender_table_find(recv_info->src_addr),
+        .rolling_code = pkt->rolling_code,
         .rssi = recv_info->rx_ctrl->rssi,
+        .sender_rssi = v1 ? ESPNOW_RSSI_NONE : pkt->reply_rssi,
         .timestamp_us = esp_timer_get_time(),
     };
-    xQueueSendFromISR(rx_queue, &evnt, NULL);
+    if (prefilter_drop(&rx)) {
+        return;
+    }
+    /* Built straight into the slot app_main will process it from; pings
+     * get their own lane so a burst of them never delays a force open */
+    spsc_ring_t *ring = &rx_rings[rx.command == CMD_PING ? EVENT_LANE_PING : EVENT_LANE_COMMAND];
+    event_t *evnt = spsc_ring_claim(ring);
+    if (evnt == NULL) {
+        return;     // Counted in the ring's overflow statistics
+    }
+    evnt->type = EVNT_RX_PACKET;
+    evnt->rx = rx;
+    memcpy(evnt->rx.mac, recv_info->src_addr, ESP_NOW_ETH_ALEN);
+    spsc_ring_publish(ring);
+    if (rx.sender != SENDER_ID_NONE) {
+        replay_window_update(&sender_table_get(rx.sender)->queued, rx.rolling_code);
+    }
+    espnow_rx_stats.queued++;
+    event_loop_notify(WAKE_RX_PACKET);
 }
 
-void espnow_setup(void) {
-    /* Create event queue */
-    rx_queue = xQueueCreate(8, sizeof(rx_event_t));
-    if (rx_queue == NULL) {
-        ESP_LOGE(TAG, "Failed to create queue");
+/**
+ * @brief Log what receive_cb queued and dropped, once per ESPNOW_STATS_PERIOD_US
+ */
+void espnow_report_stats(void) {
+    int64_t now = esp_timer_get_time();
+    if (now - stats_window_start_us < ESPNOW_STATS_PERIOD_US) {
         return;
     }
+    static const char *const lane_names[EVENT_LANE_COUNT] = {"command", "ping"};
+    espnow_rx_stats_t s = espnow_rx_stats;
+    for (int lane = 0; lane < EVENT_LANE_COUNT; lane++) {
+        const spsc_ring_t *ring = &rx_rings[lane];
+        uint32_t overflows = ring->stats.overflows;
+        if (overflows != reported_overflows[lane]) {
+            ESP_LOGW(TAG, "%s ring overflowed %lu times, %lu of %d slots used at most", lane_names[lane],
+                     overflows - reported_overflows[lane], ring->stats.high_water, RX_RING_SLOTS);
+        }
+        reported_overflows[lane] = overflows;
+    }
+    ESP_LOGI(TAG, "queued %lu, dropped: format %lu, unknown %lu, replayed %lu, replies %lu",
+             s.queued - reported_stats.queued, s.bad_format - reported_stats.bad_format,
+             s.unknown_sender - reported_stats.unknown_sender, s.replayed - reported_stats.replayed,
+             espnow_replies - reported_replies);
+    reported_stats = s;
+    reported_replies = espnow_replies;
+    stats_window_start_us = now;
+}
+
+/**
+ * @brief ESP-NOW send callback, paces the sender firmware transfer
+ */
+static void send_cb(const uint8_t *mac_addr, esp_now_send_status_t status) {
+    sender_ota_on_send_done();
+}
 
-    /* ESP-NOW setup */
+void espnow_setup(void) {
+    /* Packet rings between the Wi-Fi task and app_main, one per lane */
+    memset(&espnow_rx_stats, 0, sizeof(espnow_rx_stats));
+    memset(&reported_stats, 0, sizeof(reported_stats));
+    memset(reported_overflows, 0, sizeof(reported_overflows));
+    espnow_replies = 0;
+    reported_replies = 0;
+    for (int lane = 0; lane < EVENT_LANE_COUNT; lane++) {
+        if (!spsc_ring_init(&rx_rings[lane], rx_slabs[lane], sizeof(event_t), RX_RING_SLOTS)) {
+            ESP_LOGE(TAG, "Failed to create packet ring");
+            return;
+        }
+    }
+
+    espnow_attach();
+}
+
+/**
+ * @brief Start ESP-NOW with our callbacks and no peers
+ * Also after OTA mode: esp_now_deinit() dropped the callbacks and every
+ * reply peer, so the peers are registered again as senders are answered,
+ * and a sender firmware transfer whose send callback was lost starts over
+ * (the sender resumes it).
+ */
+void espnow_attach(void) {
+    reply_peer_count = 0;
+    reply_peer_next = 0;
+    sender_ota_stop();
     esp_now_init();
     esp_now_register_recv_cb(receive_cb);
+    esp_now_register_send_cb(send_cb);
 }
 
-void espnow_send_packet(uint8_t command){
-    receiver_send_packet_t pkt = {
-        .command = command
+/**
+ * @brief Register a sender as an ESP-NOW peer so it can be sent replies
+ * @return false if ESP-NOW refused the peer
+ */
+static bool reply_peer_add(uint8_t sender_id, const uint8_t *mac) {
+    for (uint8_t i = 0; i < reply_peer_count; i++) {
+        if (reply_peers[i] == sender_id) {
+            return true;
+        }
+    }
+    uint8_t slot = reply_peer_count;
+    if (reply_peer_count == ESPNOW_REPLY_PEERS) {
+        slot = reply_peer_next;
+        reply_peer_next = (reply_peer_next + 1) % ESPNOW_REPLY_PEERS;
+        const sender_t *evicted = sender_table_get(reply_peers[slot]);
+        if (evicted != NULL) {
+            esp_now_del_peer(evicted->mac);
+        }
+    } else {
+        reply_peer_count++;
+    }
+    esp_now_peer_info_t peer = {0};
+    memcpy(peer.peer_addr, mac, ESP_NOW_ETH_ALEN);
+    peer.channel = 0;       // Current channel
+    peer.encrypt = false;
+    if (esp_now_add_peer(&peer) != ESP_OK) {
+        reply_peers[slot] = SENDER_ID_NONE;
+        return false;
+    }
+    reply_peers[slot] = sender_id;
+    return true;
+}
+
+/**
+ * @brief Answer an accepted packet, so the sender can stop repeating it
+ * @param gate_state GATE_CLOSED, GATE_MOVING or GATE_OPEN once the packet was handled
+ */
+void espnow_send_reply(uint8_t sender_id, const rx_event_t *rx, uint8_t gate_state) {
+    if (!reply_peer_add(sender_id, rx->mac)) {
+        return;
+    }
+    espnow_reply_t pkt = {
+        .version = SUPPORTED_PROTOCOL_VERSION,
+        .rolling_code = rx->rolling_code,
+        .command = rx->command,
+        .gate_state = gate_state,
+        .rssi = rx->rssi,
     };
-    //TODO GET SENDER MAC
-    esp_now_send(NULL, (uint8_t *)&pkt, sizeof(pkt)); // Broadcast to sender
-}
\ No newline at end of file
+    esp_now_send(rx->mac, (uint8_t *)&pkt, sizeof(pkt));
+    espnow_replies++;
+}
+
+/**
+ * @brief Send a command to every registered peer: the senders replied to lately
+ * Same layout as the packets senders send, so their receive_cb takes it.
+ */
+void espnow_send_packet(uint8_t command) {
+    espnow_data_t pkt = {
+        .version = SUPPORTED_PROTOCOL_VERSION,
+        .rolling_code = 0,
+        .command = command,
+        .reply_rssi = ESPNOW_RSSI_NONE,
+    };
+    esp_now_send(NULL, (uint8_t *)&pkt, sizeof(pkt));
+}
@@ -2,28 +2,57 @@
 #define ESPNOW_CONFIG_H
 
 #include "esp_now.h"
-#include "freertos/FreeRTOS.h"
-#include "freertos/queue.h"
 #include "event_processing.h"
+#include "event_loop.h"
+#include "spsc_ring.h"
 
-#define SUPPORTED_PROTOCOL_VERSION 1
+#define SUPPORTED_PROTOCOL_VERSION 2     // Replies go out with this version
+#define ESPNOW_DATA_V1_LEN 6              // Version 1 packets end before reply_rssi
 
 /* Packet format received over ESP-NOW */
 typedef struct __attribute__((packed)) {
     uint8_t version;        // Protocol version
     uint32_t rolling_code;   // Monotonic counter for replay protection
     uint8_t  command;        // 0 = ping, 1 = bypass / force open if sent 2 to sender ota request
+    int8_t   reply_rssi;     // RSSI the sender measured on our reply to its previous packet (version 2)
 } espnow_data_t;
 
-// Packet sent to receiver to trigger OTA update mode
-typedef struct __attribute__((packed)) {
-    uint8_t command;
-} receiver_send_packet_t;
+/* Gate as seen by the receiver, carried in replies */
+#define GATE_CLOSED  0      // GATE_STATUS_PIN_INPUT reports closed
+#define GATE_MOVING  1      // Receiver is driving GATE_CMD_PIN_OUT
+#define GATE_OPEN    2
 
+/* Reply to an accepted packet, sent to the sender it came from */
+typedef struct __attribute__((packed)) {
+    uint8_t version;
+    uint32_t rolling_code;  // Code of the packet being answered
+    uint8_t command;        // Its command
+    uint8_t gate_state;     // GATE_CLOSED, GATE_MOVING or GATE_OPEN, after the packet was handled
+    int8_t rssi;            // RSSI the receiver measured on it, dBm
+} espnow_reply_t;
+
+/* receive_cb drop counters, cumulative and only written from the Wi-Fi task */
+typedef struct {
+    uint32_t queued;
+    uint32_t bad_format;        // Wrong size or protocol version
+    uint32_t unknown_sender;    // Unpaired MAC while pairing is closed
+    uint32_t replayed;          // Code already queued from that sender, or older than its window
+} espnow_rx_stats_t;
+
+#define ESPNOW_STATS_PERIOD_US 60000000LL // 1 minute
+#define RX_RING_SLOTS 8                   // Packets per lane receive_cb can hand over between main loop passes, power of two
+#define ESPNOW_REPLY_PEERS 16             // Senders kept registered for replies; ESP-NOW allows 20 peers
 
 void receive_cb(const esp_now_recv_info_t *recv_info, const uint8_t *data, int len);
 void espnow_setup(void);
-
-extern QueueHandle_t rx_queue;
+void espnow_attach(void);
+void espnow_report_stats(void);
+void espnow_send_reply(uint8_t sender_id, const rx_event_t *rx, uint8_t gate_state);
+void espnow_send_packet(uint8_t command);
+
+extern spsc_ring_t rx_rings[EVENT_LANE_COUNT]; // event_t slots per lane, filled by receive_cb and drained by app_main
+extern espnow_rx_stats_t espnow_rx_stats;
+extern bool espnow_rx_prefilter;
+extern uint32_t espnow_replies;     // Replies sent, from app_main
 
 #endif // ESPNOW_CONFIG_H
@@ -0,0 +1,208 @@
+#include "estimator.h"
+#include "esp_log.h"
+#include <string.h>
+
+static const char *TAG = "ESTIMATOR";
+
+/* Noise model, Q.16 */
+#define MEAS_NOISE_DB       4                                   // Multipath fading, 1 sigma
+#define ACCEL_NOISE_Q16     (2LL << ESTIMATOR_COV_FRAC_BITS)     // (1.4 m/s²)² changes in speed
+#define INITIAL_SPEED_VAR_Q16 (100LL << ESTIMATOR_COV_FRAC_BITS)  // (10 m/s)² before the first trend
+
+#define ONE_Q16 (1LL << ESTIMATOR_COV_FRAC_BITS)
+
+/* log2(10) / (10·n): binary orders of distance per dB, Q.16 */
+#define OCTAVES_PER_DB_Q16  ((217706LL * 10 + ESTIMATOR_PATH_LOSS_X10 * 5) / (ESTIMATOR_PATH_LOSS_X10 * 10))
+
+/* ln(10) / (10·n) · MEAS_NOISE_DB: relative distance error of one ping, Q.8 */
+#define DISTANCE_NOISE_Q8   (MEAS_NOISE_DB * 2303LL * 256 / (ESTIMATOR_PATH_LOSS_X10 * 1000))
+
+#define ARRIVAL_DISTANCE_Q8 ((int32_t)ESTIMATOR_ARRIVAL_DISTANCE_M << ESTIMATOR_STATE_FRAC_BITS)
+
+/* 2^(i/16) in Q.16 */
+static const uint32_t exp2_frac_q16[16] = {
+    65536, 68438, 71468, 74632, 77936, 81386, 84990, 88752,
+    92682, 96785, 101070, 105545, 110218, 115098, 120194, 125515,
+};
+
+estimator_stats_t estimator_stats = {.gate_travel_us = ESTIMATOR_DEFAULT_TRAVEL_US};
+bool estimator_early_open = true; // Cleared to open on the RSSI window trend instead
+
+/**
+ * @brief Forget the learned travel time and any pending arrival measurement
+ */
+void estimator_init(void) {
+    memset(&estimator_stats, 0, sizeof(estimator_stats));
+    estimator_stats.gate_travel_us = ESTIMATOR_DEFAULT_TRAVEL_US;
+}
+
+/**
+ * @brief Distance for an RSSI under the log-distance path loss model
+ * d = 10^((P0 - rssi) / (10·n)), evaluated as a power of two
+ * @return Q.8 m, at least 1 m
+ */
+int32_t estimator_rssi_to_distance_q8(int8_t rssi_dbm) {
+    int32_t loss_db = ESTIMATOR_RSSI_AT_1M_DBM - rssi_dbm;
+    if (loss_db <= 0) {
+        return 1 << ESTIMATOR_STATE_FRAC_BITS;
+    }
+    int32_t octaves_q8 = (int32_t)(((int64_t)loss_db * 256 * OCTAVES_PER_DB_Q16) >> ESTIMATOR_COV_FRAC_BITS);
+    int32_t whole = octaves_q8 >> 8;
+    if (whole > 16) {
+        whole = 16;
+    }
+    return (int32_t)(((int64_t)exp2_frac_q16[(octaves_q8 >> 4) & 15] << whole)
+                     >> (ESTIMATOR_COV_FRAC_BITS - ESTIMATOR_STATE_FRAC_BITS));
+}
+
+/**
+ * @brief Measurement variance at a given distance
+ * A fixed dB error is a fixed relative distance error, so R grows with d².
+ * Averaging both directions of the link halves it.
+ */
+static int64_t measurement_noise_q16(int32_t distance_q8, bool two_sided) {
+    int64_t sigma_q8 = ((int64_t)distance_q8 * DISTANCE_NOISE_Q8) >> ESTIMATOR_STATE_FRAC_BITS;
+    return (sigma_q8 * sigma_q8) >> (two_sided ? 1 : 0);
+}
+
+/**
+ * @brief Start the filter from a single measurement
+ */
+static void filter_start(estimator_filter_t *f, int32_t z_q8, bool two_sided, int64_t timestamp_us) {
+    f->distance_q8 = z_q8;
+    f->speed_q8 = 0;
+    f->p00 = measurement_noise_q16(z_q8, two_sided);
+    f->p01 = 0;
+    f->p11 = INITIAL_SPEED_VAR_Q16;
+    f->last_update_us = timestamp_us;
+    f->samples = 1;
+}
+
+/**
+ * @brief Feed one ping into the filter
+ * Predict with x' = F·x, P' = F·P·Fᵀ + Q for F = [1 -dt; 0 1] and white
+ * acceleration noise, then correct with the distance the RSSI maps to.
+ */
+void estimator_update(estimator_filter_t *f, int8_t rssi_dbm, bool two_sided, int64_t timestamp_us) {
+    int32_t z_q8 = estimator_rssi_to_distance_q8(rssi_dbm);
+    int64_t dt_us = timestamp_us - f->last_update_us;
+
+    if (f->samples == 0 || dt_us <= 0 || dt_us > ESTIMATOR_RESET_GAP_US) {
+        filter_start(f, z_q8, two_sided, timestamp_us);
+        return;
+    }
+
+    /* Predict */
+    int64_t dt = dt_us * ONE_Q16 / 1000000;     // Q.16 seconds
+    int64_t dt2 = (dt * dt) >> ESTIMATOR_COV_FRAC_BITS;
+    int64_t dt3 = (dt2 * dt) >> ESTIMATOR_COV_FRAC_BITS;
+    f->distance_q8 -= (int32_t)(((int64_t)f->speed_q8 * dt) >> ESTIMATOR_COV_FRAC_BITS);
+    if (f->distance_q8 < (1 << ESTIMATOR_STATE_FRAC_BITS)) {
+        f->distance_q8 = 1 << ESTIMATOR_STATE_FRAC_BITS;
+    }
+    f->p00 += ((dt * (((dt * f->p11) >> ESTIMATOR_COV_FRAC_BITS) - 2 * f->p01)) >> ESTIMATOR_COV_FRAC_BITS)
+              + ((ACCEL_NOISE_Q16 * dt3 / 3) >> ESTIMATOR_COV_FRAC_BITS);
+    f->p01 -= ((dt * f->p11) >> ESTIMATOR_COV_FRAC_BITS)
+              + ((ACCEL_NOISE_Q16 * dt2 / 2) >> ESTIMATOR_COV_FRAC_BITS);
+    f->p11 += (ACCEL_NOISE_Q16 * dt) >> ESTIMATOR_COV_FRAC_BITS;
+
+    /* Correct: K = P·Hᵀ / (H·P·Hᵀ + R) with H = [1 0] */
+    int64_t s = f->p00 + measurement_noise_q16(f->distance_q8, two_sided);
+    int64_t k0 = (f->p00 << ESTIMATOR_COV_FRAC_BITS) / s;
+    int64_t k1 = f->p01 * ONE_Q16 / s;     // p01 goes negative, so no shift
+    int64_t innovation = z_q8 - f->distance_q8;
+    f->distance_q8 += (int32_t)((k0 * innovation) >> ESTIMATOR_COV_FRAC_BITS);
+    f->speed_q8 += (int32_t)((k1 * innovation) >> ESTIMATOR_COV_FRAC_BITS);
+
+    int64_t p01 = f->p01;
+    f->p00 -= (k0 * f->p00) >> ESTIMATOR_COV_FRAC_BITS;
+    f->p01 -= (k0 * p01) >> ESTIMATOR_COV_FRAC_BITS;
+    f->p11 -= (k1 * p01) >> ESTIMATOR_COV_FRAC_BITS;
+
+    f->last_update_us = timestamp_us;
+    f->samples++;
+
+    /* First ping at the gate from the sender that got the early open closes the measurement */
+    estimator_stats_t *st = &estimator_stats;
+    if (st->open_command_us != 0 && st->actual_arrival_us == 0 && st->open_filter == f &&
+        f->distance_q8 <= ARRIVAL_DISTANCE_Q8) {
+        st->actual_arrival_us = timestamp_us;
+        ESP_LOGI(TAG, "Arrival %lld ms after open (predicted %lld ms), gate open %lld ms before arrival",
+                 (st->actual_arrival_us - st->open_command_us) / 1000,
+                 (st->predicted_arrival_us - st->open_command_us) / 1000,
+                 (st->actual_arrival_us - st->open_command_us - st->gate_travel_us) / 1000);
+    }
+}
+
+/**
+ * @brief Time from the last ping until the bike reaches the arrival distance
+ * @return Microseconds, 0 if already there, -1 if not approaching or not converged
+ */
+int64_t estimator_time_to_arrival_us(const estimator_filter_t *f) {
+    if (f->samples < ESTIMATOR_MIN_SAMPLES || f->speed_q8 < ESTIMATOR_MIN_SPEED_Q8) {
+        return -1;
+    }
+    /* Speed not yet known to within 1 / ESTIMATOR_SPEED_CONFIDENCE of itself */
+    int64_t speed_sq_q16 = (int64_t)f->speed_q8 * f->speed_q8;
+    if (f->p11 * ESTIMATOR_SPEED_CONFIDENCE * ESTIMATOR_SPEED_CONFIDENCE > speed_sq_q16) {
+        return -1;
+    }
+    int64_t remaining_q8 = f->distance_q8 - ARRIVAL_DISTANCE_Q8;
+    if (remaining_q8 <= 0) {
+        return 0;
+    }
+    return remaining_q8 * 1000000 / f->speed_q8;
+}
+
+/**
+ * @brief Check whether opening now gets the gate fully open before arrival
+ */
+bool estimator_should_open(const estimator_filter_t *f) {
+    int64_t tta_us = estimator_time_to_arrival_us(f);
+    return tta_us >= 0 && tta_us <= estimator_stats.gate_travel_us + ESTIMATOR_OPEN_MARGIN_US;
+}
+
+/**
+ * @brief Note that a command to move the gate was issued
+ * @param f Filter of the sender the command came from
+ * @param early True when the estimator triggered it, to track the arrival prediction
+ */
+void estimator_on_open_command(const estimator_filter_t *f, int64_t now_us, bool early) {
+    estimator_stats_t *st = &estimator_stats;
+    st->last_command_us = now_us;
+    if (early) {
+        st->open_command_us = now_us;
+        st->open_filter = f;
+        st->predicted_arrival_us = f->last_update_us + estimator_time_to_arrival_us(f);
+        st->actual_arrival_us = 0;
+    }
+}
+
+/**
+ * @brief Learn the gate travel time from debounced GATE_STATUS_PIN_INPUT edges
+ * Only the closed switch is wired, so travel is timed from a command issued
+ * while the gate was open until the switch reports closed again.
+ */
+void estimator_on_gate_status(bool closed, int64_t now_us) {
+    estimator_stats_t *st = &estimator_stats;
+    if (!closed) {
+        st->last_opened_us = now_us;
+        return;
+    }
+    if (st->last_command_us <= st->last_opened_us) {
+        return; // Closed on its own, no command to time from
+    }
+
+    int64_t travel_us = now_us - st->last_command_us;
+    if (travel_us < ESTIMATOR_MIN_TRAVEL_US || travel_us > ESTIMATOR_MAX_TRAVEL_US) {
+        return;
+    }
+    if (st->travel_samples == 0) {
+        st->gate_travel_us = travel_us;
+    } else {
+        st->gate_travel_us += (travel_us - st->gate_travel_us) / 4;
+    }
+    st->travel_samples++;
+    st->last_command_us = 0;
+    ESP_LOGI(TAG, "Gate travel %lld ms, learned %lld ms", travel_us / 1000, st->gate_travel_us / 1000);
+}
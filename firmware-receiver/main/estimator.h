@@ -0,0 +1,69 @@
+#ifndef ESTIMATOR_H
+#define ESTIMATOR_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/* --------------------------------------------------------------------------
+ * Approach estimator
+ * Fixed-point Kalman filter over ping RSSI and arrival times. Each RSSI is
+ * mapped to a distance with the log-distance path loss model, and the filter
+ * tracks distance (Q.8 m) and approach speed (Q.8 m/s) with a constant-speed
+ * model, so the time to reach ESTIMATOR_ARRIVAL_DISTANCE_M follows directly.
+ * A ping that also carries the sender's RSSI on our reply is the average of
+ * two independently faded measurements, with half the variance.
+ * That is compared with the gate travel time learned from
+ * GATE_STATUS_PIN_INPUT so the open command goes out early enough.
+ * Each paired sender has its own filter, the gate statistics are shared.
+ * -------------------------------------------------------------------------- */
+
+#define ESTIMATOR_STATE_FRAC_BITS 8     // Distance and speed are Q.8
+#define ESTIMATOR_COV_FRAC_BITS   16    // Covariance entries are Q.16
+
+#define ESTIMATOR_RSSI_AT_1M_DBM    -40             // Path loss model: RSSI = P0 - 10·n·log10(d)
+#define ESTIMATOR_PATH_LOSS_X10     22              // n = 2.2
+#define ESTIMATOR_ARRIVAL_DISTANCE_M 5              // Bike is at the gate
+#define ESTIMATOR_MIN_SAMPLES       4               // Pings before a prediction is trusted
+#define ESTIMATOR_MIN_SPEED_Q8      (1 << 8)        // Slower than 1 m/s is not an approach
+#define ESTIMATOR_SPEED_CONFIDENCE  1               // Speed must be at least one standard deviation above 0
+#define ESTIMATOR_RESET_GAP_US      3000000LL       // Restart the filter after 3 s without pings
+#define ESTIMATOR_OPEN_MARGIN_US    1000000LL       // Gate should be fully open 1 s before arrival
+#define ESTIMATOR_DEFAULT_TRAVEL_US 15000000LL      // Gate travel time until one has been measured
+#define ESTIMATOR_MIN_TRAVEL_US     1000000LL       // Plausible travel times to learn from
+#define ESTIMATOR_MAX_TRAVEL_US     60000000LL
+
+typedef struct {
+    int32_t distance_q8;        // Filtered distance, Q.8 m
+    int32_t speed_q8;           // Approach speed, Q.8 m/s, positive when closing in
+    int64_t p00;                // Covariance, Q.16 (m², m²/s, m²/s²)
+    int64_t p01;
+    int64_t p11;
+    int64_t last_update_us;
+    uint32_t samples;           // Pings since the filter was (re)started
+} estimator_filter_t;
+
+typedef struct {
+    int64_t gate_travel_us;         // Learned gate travel time
+    int64_t last_command_us;        // Last open/toggle command issued
+    int64_t last_opened_us;         // Last time the gate left the closed position
+    uint32_t travel_samples;        // Travel times learned so far
+
+    int64_t open_command_us;        // Early open issued by the estimator, 0 if none pending
+    const estimator_filter_t *open_filter; // Sender whose approach triggered it
+    int64_t predicted_arrival_us;   // Arrival predicted when the open was issued
+    int64_t actual_arrival_us;      // Arrival observed afterwards, 0 until then
+} estimator_stats_t;
+
+/* Function declarations */
+void estimator_init(void);
+void estimator_update(estimator_filter_t *f, int8_t rssi_dbm, bool two_sided, int64_t timestamp_us);
+int32_t estimator_rssi_to_distance_q8(int8_t rssi_dbm);
+int64_t estimator_time_to_arrival_us(const estimator_filter_t *f);
+bool estimator_should_open(const estimator_filter_t *f);
+void estimator_on_open_command(const estimator_filter_t *f, int64_t now_us, bool early);
+void estimator_on_gate_status(bool closed, int64_t now_us);
+
+extern estimator_stats_t estimator_stats;
+extern bool estimator_early_open;
+
+#endif // ESTIMATOR_H
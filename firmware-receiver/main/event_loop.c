@@ -0,0 +1,112 @@
+#include "event_loop.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include <string.h>
+
+static const char *TAG = "EVENT_LOOP";
+
+/* Task blocked in event_loop_wait() */
+static TaskHandle_t main_task = NULL;
+
+event_loop_stats_t event_loop_stats = {0};
+
+/**
+ * @brief Register the calling task as the one woken by all event sources
+ */
+void event_loop_init(void) {
+    main_task = xTaskGetCurrentTaskHandle();
+    memset(&event_loop_stats, 0, sizeof(event_loop_stats));
+    event_loop_stats.window_start_us = esp_timer_get_time();
+}
+
+/**
+ * @brief Wake the main task from task context (e.g. the Wi-Fi task)
+ */
+void event_loop_notify(uint32_t bits) {
+    if (main_task != NULL) {
+        xTaskNotify(main_task, bits, eSetBits);
+    }
+}
+
+/**
+ * @brief Wake the main task from an interrupt handler
+ */
+void event_loop_notify_from_isr(uint32_t bits) {
+    BaseType_t higher_prio_task_woken = pdFALSE;
+    if (main_task != NULL) {
+        xTaskNotifyFromISR(main_task, bits, eSetBits, &higher_prio_task_woken);
+        portYIELD_FROM_ISR(higher_prio_task_woken);
+    }
+}
+
+/**
+ * @brief Work out how long the main loop may sleep
+ * @param polling True while inputs are still debouncing or a state needs servicing
+ * @param deadline_us Next timer deadline in esp_timer time, 0 if none
+ * @return Ticks to block for, portMAX_DELAY when only events can wake us
+ */
+TickType_t event_loop_timeout_ticks(bool polling, int64_t deadline_us) {
+    if (polling) {
+        return pdMS_TO_TICKS(EVENT_LOOP_POLL_MS);
+    }
+    if (deadline_us <= 0) {
+        return portMAX_DELAY;
+    }
+
+    int64_t remaining_us = deadline_us - esp_timer_get_time();
+    if (remaining_us <= 0) {
+        return 0;
+    }
+    /* Round up so we never wake just before the deadline */
+    TickType_t ticks = pdMS_TO_TICKS((remaining_us + 999) / 1000);
+    return ticks > 0 ? ticks : 1;
+}
+
+/**
+ * @brief Block until an event source fires or the timeout expires
+ * @return Wake bits that were set, 0 on timeout
+ */
+uint32_t event_loop_wait(TickType_t timeout_ticks) {
+    uint32_t bits = 0;
+    xTaskNotifyWait(0, UINT32_MAX, &bits, timeout_ticks);
+    event_loop_stats.wakeups++;
+    return bits;
+}
+
+/**
+ * @brief Account the delay between packet arrival and its dispatch
+ */
+void event_loop_record_dispatch(event_lane_t lane, int64_t rx_timestamp_us) {
+    event_lane_stats_t *stats = &event_loop_stats.lanes[lane];
+    int64_t latency_us = esp_timer_get_time() - rx_timestamp_us;
+    stats->dispatched++;
+    stats->latency_sum_us += latency_us;
+    if (latency_us > stats->latency_max_us) {
+        stats->latency_max_us = latency_us;
+    }
+}
+
+/**
+ * @brief Log and reset the statistics window once it has elapsed
+ * Called from the loop itself so reporting never adds a wake-up of its own.
+ */
+void event_loop_report_stats(void) {
+    static const char *const lane_names[EVENT_LANE_COUNT] = {"commands", "pings"};
+    int64_t now = esp_timer_get_time();
+    int64_t elapsed_us = now - event_loop_stats.window_start_us;
+    if (elapsed_us < EVENT_LOOP_STATS_PERIOD_US) {
+        return;
+    }
+
+    uint32_t wakeups_per_s_x10 = (uint32_t)((int64_t)event_loop_stats.wakeups * 10000000LL / elapsed_us);
+    ESP_LOGI(TAG, "wakeups/s %lu.%lu", wakeups_per_s_x10 / 10, wakeups_per_s_x10 % 10);
+    for (int lane = 0; lane < EVENT_LANE_COUNT; lane++) {
+        const event_lane_stats_t *stats = &event_loop_stats.lanes[lane];
+        int64_t avg_latency_us = stats->dispatched ? stats->latency_sum_us / stats->dispatched : 0;
+        ESP_LOGI(TAG, "%s %lu, dispatch latency avg %lld us max %lld us",
+                 lane_names[lane], stats->dispatched, avg_latency_us, stats->latency_max_us);
+    }
+
+    memset(&event_loop_stats, 0, sizeof(event_loop_stats));
+    event_loop_stats.window_start_us = now;
+}
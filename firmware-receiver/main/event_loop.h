@@ -0,0 +1,53 @@
+#ifndef EVENT_LOOP_H
+#define EVENT_LOOP_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+/* --------------------------------------------------------------------------
+ * Main loop wake-up sources
+ * The main task blocks on its notification value; each source sets a bit.
+ * -------------------------------------------------------------------------- */
+#define WAKE_RX_PACKET  (1UL << 0)  // Packet queued by receive_cb
+#define WAKE_GPIO_EDGE  (1UL << 1)  // Edge on gate status / OTA inputs
+#define WAKE_SENDER_OTA (1UL << 2)  // Firmware transfer ack or send completion
+
+/* Sampling period while an input is debouncing or a state is active */
+#define EVENT_LOOP_POLL_MS 5
+
+/* Wake-up statistics, reported once per EVENT_LOOP_STATS_PERIOD_US */
+#define EVENT_LOOP_STATS_PERIOD_US 60000000LL // 1 minute
+
+/* Packet intake lanes, drained in this order */
+typedef enum {
+    EVENT_LANE_COMMAND,             // Force opens and pairing requests
+    EVENT_LANE_PING,                // Telemetry pings
+    EVENT_LANE_COUNT,
+} event_lane_t;
+
+typedef struct {
+    uint32_t dispatched;            // Packets dispatched in the current window
+    int64_t latency_sum_us;         // Arrival to dispatch
+    int64_t latency_max_us;
+} event_lane_stats_t;
+
+typedef struct {
+    uint32_t wakeups;               // Loop passes in the current window
+    event_lane_stats_t lanes[EVENT_LANE_COUNT];
+    int64_t window_start_us;
+} event_loop_stats_t;
+
+/* Function declarations */
+void event_loop_init(void);
+void event_loop_notify(uint32_t bits);
+void event_loop_notify_from_isr(uint32_t bits);
+TickType_t event_loop_timeout_ticks(bool polling, int64_t deadline_us);
+uint32_t event_loop_wait(TickType_t timeout_ticks);
+void event_loop_record_dispatch(event_lane_t lane, int64_t rx_timestamp_us);
+void event_loop_report_stats(void);
+
+extern event_loop_stats_t event_loop_stats;
+
+#endif // EVENT_LOOP_H
@@ -1,83 +1,273 @@
 #include "event_processing.h"
+#include "sender_table.h"
 #include "state_machine.h"
+#include "estimator.h"
 #include "main.h"
-#include "ring_buffer.h"
+#include "gpio_config.h"
+#include "debouncer.h"
+#include "nvs_config.h"
+#include "espnow_config.h"
+#include "event_loop.h"
+#include "trace.h"
 #include "esp_timer.h"
 #include "esp_log.h"
-#include <string.h>
 
-/* Timing variables */
-int64_t last_rx_time = 0; // Timestamp of last packet
+static const char *TAG = "EVENTS";
 
-/* Signal tracking */
-signal_data_t signal_history[8] = {0};
-int16_t signal_index = 0; // Circular buffer index
-int16_t signal_count = 0; // Number of valid entries in buffer
+#define LINK_OFFSET_PAIRS 8         // Two-sided pings averaged before the sender's RSSI is used,
+                                    // then the weight of each new one
 
-/* Rolling code state */
-uint32_t expected_rolling_code = 0;
+bool rssi_two_sided = true; // Cleared to use only the RSSI measured here
 
-bool is_getting_closer(void) {
-    signed int lower_average = 0;
-    signed int higher_average = 0;
-    signed int total_delay_us = 0;
-    signed int64_t current_time_us = esp_timer_get_time();
-    
-    /* First half vs second half comparison */
-    for (int i = 0; i < 4; i++) {
-        lower_average  += signal_history[i].rssi;
-        higher_average += signal_history[i + 4].rssi;
-        total_delay_us += (current_time_us - signal_history[i].timestamp_us) + (current_time_us - signal_history[i+4].timestamp_us);
-    }
+static uint8_t auto_open_sender = SENDER_ID_NONE;  // Sender of the auto open in progress
 
-    bool getting_closer = higher_average > lower_average;
-    bool signals_us_recent = total_delay_us < 3000000; //3 seconds
+bool is_getting_closer(const rssi_window_t *w) {
+    /* Least-squares trend over the whole window, positive while the signal gets stronger */
+    bool getting_closer = rssi_window_slope_q(w) > 0;
+    bool signals_us_recent = rssi_window_span_us(w) < 3000000; //3 seconds
     
     return (signals_us_recent && getting_closer);
 }
 
-void update_rssi_history(uint8_t current_rssi, int64_t timestamp_us) {
-    signal_history[signal_index].rssi = current_rssi;
-    signal_history[signal_index].timestamp_us = timestamp_us;
-    
-    signal_index++;
-    if (signal_index >= 8) {  // Use actual array size
-        signal_index = 0; // Wrap around for circular buffer
+/**
+ * @brief Sender of a packet, pairing it on a force open while pairing is active
+ * @return NULL if the packet has to be dropped
+ */
+static sender_t *event_sender(const rx_event_t *rx) {
+    sender_t *sender = sender_table_get(rx->sender);
+    if (sender != NULL || rx->command != CMD_FORCE_OPEN || !sender_pairing_active(rx->timestamp_us)) {
+        return sender;
+    }
+
+    /* Trust the sender from its current code on, like a first boot did with one sender */
+    uint32_t highest = rx->rolling_code - 1;
+    uint32_t legacy;
+    if (sender_pairing_legacy_code(&legacy)) {
+        /* After an upgrade the first sender takes over the single sender's code,
+         * so a packet recorded from it before the upgrade is still a replay */
+        if ((int32_t)(rx->rolling_code - legacy) <= 0) {
+            ESP_LOGW(TAG, "Code %lu not after the upgraded sender's %lu, not pairing",
+                     (unsigned long)rx->rolling_code, (unsigned long)legacy);
+            return NULL;
+        }
+        highest = legacy;
+    }
+    uint8_t count = sender_table_count();
+    uint8_t id = sender_table_add(rx->mac, highest);
+    if (id == SENDER_ID_NONE) {
+        ESP_LOGW(TAG, "Sender table full, not pairing");
+        return NULL;
+    }
+    if (sender_table_count() != count) {
+        save_paired_senders();
+        ESP_LOGI(TAG, "Paired sender %u: %02x:%02x:%02x:%02x:%02x:%02x", id,
+                 rx->mac[0], rx->mac[1], rx->mac[2], rx->mac[3], rx->mac[4], rx->mac[5]);
+    }
+    return sender_table_get(id);
+}
+
+/**
+ * @brief Replay check and journal for a packet from either lane
+ * @return Sender of an accepted packet, NULL if it has to be dropped
+ */
+static sender_t *accept_packet(const rx_event_t *rx) {
+    sender_t *sender = event_sender(rx);
+    if (sender == NULL) {
+        return NULL;
+    }
+    /* Late or repeated copies are accepted once, as long as they are inside the window */
+    if (!replay_window_check(&sender->replay, rx->rolling_code)) {
+        return NULL;
+    }
+    /* Journal ahead of the code, so a power cut never reopens the replay window */
+    if (!reserve_rolling_code(sender->id, rx->rolling_code)) {
+        return NULL;
+    }
+    replay_window_update(&sender->replay, rx->rolling_code);
+    return sender;
+}
+
+/**
+ * @brief Gate state for replies: driven by this receiver, else from the status input
+ */
+static uint8_t reply_gate_state(void) {
+    State state = state_machine_get_current_state();
+    if (state == STATE_OPEN || state == STATE_TOGGLE) {
+        return GATE_MOVING;
+    }
+    return debouncer_level(&input_debouncer, GATE_STATUS_PIN_INPUT) ? GATE_CLOSED : GATE_OPEN;
+}
+
+static void handle_force_open(sender_t *sender, const rx_event_t *rx) {
+    state_machine_set_state(STATE_TOGGLE);
+    last_gate_state = debouncer_level(&input_debouncer, GATE_STATUS_PIN_INPUT);
+    estimator_on_open_command(&sender->filter, rx->timestamp_us, false);
+}
+
+/**
+ * @brief Nearest whole dBm to a Q.4 value, halves rounded up
+ * Floor division spelled out: >> on a negative value is implementation-defined.
+ */
+static int32_t q4_round(int32_t q4) {
+    int32_t n = q4 + (1 << (RSSI_FRAC_BITS - 1));
+    int32_t one = 1 << RSSI_FRAC_BITS;
+    return n >= 0 ? n / one : -((one - 1 - n) / one);
+}
+
+/**
+ * @brief The sender's RSSI on our last reply, on our scale
+ * Both ends see the same path, but transmit power and antennas differ, so the
+ * sender's side is shifted by the average difference seen so far. The first
+ * LINK_OFFSET_PAIRS two-sided pings only learn that difference.
+ * @return dBm, ESPNOW_RSSI_NONE if there is nothing to use yet
+ */
+static int8_t reply_rssi(sender_t *sender, const rx_event_t *rx) {
+    if (!rssi_two_sided || rx->sender_rssi == ESPNOW_RSSI_NONE) {
+        return ESPNOW_RSSI_NONE;
+    }
+    // Q.4 by multiplying: both values are negative dBm, and shifting a negative value is not defined
+    int16_t diff_q4 = (int16_t)((rx->rssi - rx->sender_rssi) * (1 << RSSI_FRAC_BITS));
+    if (sender->link_pairs < LINK_OFFSET_PAIRS) {
+        sender->link_pairs++;
+        sender->link_offset_q4 += (diff_q4 - sender->link_offset_q4) / sender->link_pairs;
+        return ESPNOW_RSSI_NONE;
     }
-    if (signal_count < 8) {
-        signal_count++;
+    int32_t corrected_q4 = (int32_t)rx->sender_rssi * (1 << RSSI_FRAC_BITS) + sender->link_offset_q4;
+    sender->link_offset_q4 += (diff_q4 - sender->link_offset_q4) / LINK_OFFSET_PAIRS;
+    int32_t dbm = q4_round(corrected_q4);
+    if (dbm > -1) {
+        dbm = -1;
     }
+    return (int8_t)(dbm < INT8_MIN ? INT8_MIN : dbm);
+}
+
+/**
+ * @brief Add a ping's RSSI to its sender's window and approach filter
+ * With the sender's RSSI on our last reply, two independently faded samples
+ * go into the window (the older one first) and the filter gets their average.
+ */
+static void add_ping(sender_t *sender, const rx_event_t *rx) {
+    if (sender->last_rx_us + RSSI_HISTORY_GAP_US < (int64_t)rx->timestamp_us) {
+        rssi_window_reset(&sender->rssi);
+    }
+    int8_t reply = reply_rssi(sender, rx);
+    if (reply != ESPNOW_RSSI_NONE) {
+        rssi_window_add(&sender->rssi, reply, rx->timestamp_us);
+        rssi_window_add(&sender->rssi, rx->rssi, rx->timestamp_us);
+        estimator_update(&sender->filter, (int8_t)((rx->rssi + reply) / 2), true, rx->timestamp_us);
+    } else {
+        rssi_window_add(&sender->rssi, rx->rssi, rx->timestamp_us);
+        estimator_update(&sender->filter, rx->rssi, false, rx->timestamp_us);
+    }
+    sender->last_rx_us = rx->timestamp_us;
+}
+
+/**
+ * @brief Decide on an auto open from the sender's latest pings
+ */
+static void check_auto_open(sender_t *sender) {
+    /* Each sender has its own cooldown, so a second vehicle is not locked out */
+    if (state_machine_get_current_state() == STATE_OPEN ||
+        (esp_timer_get_time() - sender->last_auto_open_us) <= AUTO_OPEN_COOLDOWN_US) {
+        return;
+    }
+    /* Open once the predicted arrival leaves just enough time for the gate,
+     * or on the RSSI trend alone when early open is disabled */
+    bool open = estimator_early_open
+        ? estimator_should_open(&sender->filter)
+        : sender->rssi.count >= sender->rssi.length && is_getting_closer(&sender->rssi);
+    if (open) {
+        state_machine_set_state(STATE_OPEN);
+        auto_open_sender = sender->id;
+        estimator_on_open_command(&sender->filter, sender->last_rx_us, estimator_early_open);
+    }
+}
+
+/**
+ * @brief Start the cooldown of the sender whose auto open command just ended
+ * Called by state_open() once the closed switch releases, i.e. when the gate
+ * starts moving, as the single-sender firmware timed it. The gate's travel
+ * time therefore counts against AUTO_OPEN_COOLDOWN_US.
+ */
+void auto_open_command_ended(int64_t now_us) {
+    sender_t *sender = sender_table_get(auto_open_sender);
+    if (sender != NULL) {
+        sender->last_auto_open_us = now_us;
+    }
+    auto_open_sender = SENDER_ID_NONE;
 }
 
 void process_event(const event_t *evnt) {
     switch (evnt->type) {
-        case EVNT_RX_PACKET:
-            if (evnt->rx.rolling_code <= expected_rolling_code) {
+        case EVNT_RX_PACKET: {
+            sender_t *sender = accept_packet(&evnt->rx);
+            if (sender == NULL) {
                 return;
             }
-            
-            expected_rolling_code = evnt->rx.rolling_code;
-
             if (evnt->rx.command == CMD_FORCE_OPEN) {
-                state_machine_set_state(STATE_TOGGLE);
-                last_gate_state = ringbuf_is_majority_high(&gpio_ringbuf);
+                handle_force_open(sender, &evnt->rx);
             } else {
-                if ((last_rx_time + 300000) < evnt->rx.timestamp_us) {
-                    memset(signal_history, 0, sizeof(signal_history));
-                    signal_index = 0;
-                }
-                update_rssi_history(evnt->rx.rssi, evnt->rx.timestamp_us);
-                last_rx_time = evnt->rx.timestamp_us;
-
-                if (signal_count >= 8) { // if buffer has enough samples, check for proximity
-                    if (is_getting_closer() && (esp_timer_get_time() - last_auto_open_time) > AUTO_OPEN_COOLDOWN_US) {
-                        state_machine_set_state(STATE_OPEN);
-                    }
-                }
+                add_ping(sender, &evnt->rx);
+                check_auto_open(sender);
             }
+            espnow_send_reply(sender->id, &evnt->rx, reply_gate_state());
             break;
+        }
 
         default:
             break;
     }
 }
+
+/**
+ * @brief Account and trace a packet as it leaves its lane
+ */
+static void dispatch(event_lane_t lane, const event_t *evnt) {
+    event_loop_record_dispatch(lane, evnt->rx.timestamp_us);
+    trace_record_rx(&evnt->rx);
+}
+
+/**
+ * @brief Drain every packet receive_cb has handed over
+ * The command lane always goes first, also between pings, so a force open
+ * never waits behind telemetry. Consecutive pings from one sender are one
+ * RSSI update: each sample goes into the window and filter, and the
+ * auto-open decision runs once on the newest of them. Every accepted packet
+ * is answered once it has been handled.
+ * @return Packets dispatched
+ */
+uint32_t process_pending_events(void) {
+    spsc_ring_t *commands = &rx_rings[EVENT_LANE_COMMAND];
+    spsc_ring_t *pings = &rx_rings[EVENT_LANE_PING];
+    sender_t *pending = NULL;   // Sender with pings added since its last decision
+    uint32_t dispatched = 0;
+    const event_t *evnt;
+
+    while (true) {
+        if ((evnt = spsc_ring_peek(commands)) != NULL) {
+            dispatch(EVENT_LANE_COMMAND, evnt);
+            process_event(evnt);
+            spsc_ring_release(commands);
+        } else if ((evnt = spsc_ring_peek(pings)) != NULL) {
+            dispatch(EVENT_LANE_PING, evnt);
+            sender_t *sender = accept_packet(&evnt->rx);
+            if (sender != NULL) {
+                add_ping(sender, &evnt->rx);
+                pending = sender;
+            }
+            const event_t *next = spsc_ring_peek_at(pings, 1);
+            if (pending != NULL && (next == NULL || next->rx.sender != evnt->rx.sender)) {
+                check_auto_open(pending);
+                pending = NULL;
+            }
+            if (sender != NULL) {
+                espnow_send_reply(sender->id, &evnt->rx, reply_gate_state());
+            }
+            spsc_ring_release(pings);
+        } else {
+            break;
+        }
+        dispatched++;
+    }
+    return dispatched;
+}
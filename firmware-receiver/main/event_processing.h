@@ -3,16 +3,32 @@
 
 #include <stdint.h>
 #include <stdbool.h>
+#include "esp_now.h"
+#include "rssi_window.h"
+
+/* RSSI samples needed before the proximity check runs (at most RSSI_WINDOW_MAX):
+ * one per ping, two when the sender reports the RSSI of our reply */
+#define RSSI_WINDOW_LENGTH 8
+
+/* A longer silence between pings restarts the window */
+#define RSSI_HISTORY_GAP_US 300000LL
+
+/* Sender reports no RSSI: version 1, or our last reply did not reach it */
+#define ESPNOW_RSSI_NONE 0
 
 /* Command definitions */
 #define CMD_PING       0
 #define CMD_FORCE_OPEN 1
+#define CMD_SENDER_OTA 2     // Receiver to sender: listen for a firmware offer
 
 /* Event definitions */
 typedef struct {
     uint8_t command;
+    uint8_t sender;         // Sender table id, SENDER_ID_NONE for a pairing request
+    uint8_t mac[ESP_NOW_ETH_ALEN];
     uint32_t rolling_code;
-    uint8_t rssi;
+    int8_t rssi;            // dBm as reported by rx_ctrl
+    int8_t sender_rssi;     // dBm the sender measured on our reply to its previous packet, or ESPNOW_RSSI_NONE
     uint64_t timestamp_us;
 } rx_event_t;
 
@@ -30,18 +46,11 @@ typedef struct {
     };
 } event_t;
 
-typedef struct {
-    uint8_t rssi;
-    int64_t timestamp_us;
-} signal_data_t;
-
 void process_event(const event_t *evnt);
-void update_rssi_history(uint8_t current_rssi, int64_t timestamp_us);
-bool is_getting_closer(void);
+uint32_t process_pending_events(void);
+bool is_getting_closer(const rssi_window_t *w);
+void auto_open_command_ended(int64_t now_us);
 
-extern uint32_t expected_rolling_code;
-extern int64_t last_rx_time;
-extern signal_data_t signal_history[8];
-extern int16_t signal_count;
+extern bool rssi_two_sided;
 
 #endif // EVENT_PROCESSING_H
@@ -1,5 +1,12 @@
 #include "gpio_config.h"
+#include "event_loop.h"
 #include "driver/gpio.h"
+#include "esp_attr.h"
+
+/* Any edge on a monitored input wakes the main loop so it can start debouncing */
+static void IRAM_ATTR gpio_edge_isr(void *arg) {
+    event_loop_notify_from_isr(WAKE_GPIO_EDGE);
+}
 
 void gpio_setup(void) {
     /* Output GPIO configuration */
@@ -13,6 +20,7 @@ void gpio_setup(void) {
     gpio_config(&io_conf);
 
     /* Input GPIO configuration for gate status */
+    io_conf.intr_type = GPIO_INTR_ANYEDGE;
     io_conf.mode = GPIO_MODE_INPUT;
     io_conf.pin_bit_mask = (1ULL << GATE_STATUS_PIN_INPUT);
     io_conf.pull_up_en = 1;
@@ -25,4 +33,10 @@ void gpio_setup(void) {
     /* Input GPIO configuration for sender OTA status */
     io_conf.pin_bit_mask = (1ULL << SENDER_OTA_PIN_INPUT);
     gpio_config(&io_conf);
+
+    /* Edge interrupts replace the fixed 5 ms polling of the inputs */
+    gpio_install_isr_service(0);
+    gpio_isr_handler_add(GATE_STATUS_PIN_INPUT, gpio_edge_isr, NULL);
+    gpio_isr_handler_add(OTA_BUTTON_PIN_INPUT, gpio_edge_isr, NULL);
+    gpio_isr_handler_add(SENDER_OTA_PIN_INPUT, gpio_edge_isr, NULL);
 }
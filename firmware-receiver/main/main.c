@@ -12,27 +12,30 @@
 #include "esp_ota_ops.h"
 
 #include "main.h"
-#include "ring_buffer.h"
+#include "debouncer.h"
 #include "ota_module.h"
 #include "state_machine.h"
 #include "event_processing.h"
+#include "estimator.h"
 #include "gpio_config.h"
 #include "nvs_config.h"
+#include "sender_table.h"
 #include "espnow_config.h"
+#include "event_loop.h"
+#include "trace.h"
+#include "trace_http.h"
 
 static const char *TAG = "RECEIVER";
 
-/* Flash write timing */
+/* Flash write timing, NVS fallback when there is no rolling code journal */
 static const int64_t FLASH_WRITE_DELAY_US = 43200000000LL; // 12 hours
 static int64_t last_flash_write_time = 0; // Last NVS write time
 
-/* Global GPIO ring buffers */
-ringbuf_t gpio_ringbuf = {0};
-ringbuf_t sender_ota_gpio_ringbuf = {0};
+/* Debounced inputs: gate status, OTA button and sender OTA switch */
+debouncer_t input_debouncer = {0};
 
 /* Shared variables defined here */
 bool last_gate_state = false;
-int64_t last_auto_open_time = 0;
 int64_t last_toggle_time = 0;
 
 /* Timing constants */
@@ -40,7 +43,33 @@ const int64_t AUTO_OPEN_COOLDOWN_US = 120000000LL; // 2 minutes cooldown in micr
 const int64_t TOGGLE_COOLDOWN_US = 5000000LL; // 5 seconds cooldown in microseconds
 static int64_t ota_cooldown = 0; // Cooldown timer for OTA button
 
+/**
+ * @brief Persist the senders' rolling codes at most once per FLASH_WRITE_DELAY_US
+ */
+static void periodic_save_rolling_codes(void) {
+    int64_t now = esp_timer_get_time();
+    if (!rolling_codes_journaled() &&
+        (now - last_flash_write_time) > FLASH_WRITE_DELAY_US &&
+        rolling_codes_unsaved()) {
+        save_rolling_codes();
+        last_flash_write_time = now;
+    }
+}
 
+/**
+ * @brief Earliest timer deadline the main loop has to wake up for, 0 if none
+ */
+static int64_t next_deadline_us(void) {
+    int64_t deadline_us = 0;
+    if (!rolling_codes_journaled() && rolling_codes_unsaved()) {
+        deadline_us = last_flash_write_time + FLASH_WRITE_DELAY_US;
+    }
+    /* Re-check a held OTA button once its cooldown ends */
+    if (ota_cooldown > esp_timer_get_time() && (deadline_us == 0 || ota_cooldown < deadline_us)) {
+        deadline_us = ota_cooldown;
+    }
+    return deadline_us;
+}
 
 /* Main application entry point */
 void app_main(void) {
@@ -85,33 +114,49 @@ void app_main(void) {
     esp_wifi_start();
 
     /* Setup modules */
+    event_loop_init();
+    trace_init();
     gpio_setup();
+
+    /* Paired senders and their rolling codes, before the first packet can arrive */
+    load_paired_senders();
+    sender_pairing_open_until(esp_timer_get_time() + SENDER_PAIRING_WINDOW_US);
+
     espnow_setup();
     state_machine_init();
 
-    /* Load rolling code once at boot */
-    load_expected_rolling_code();
-
-    ESP_LOGI(TAG, "Receiver initialized, expected rolling code: %lu", expected_rolling_code);
+    ESP_LOGI(TAG, "Receiver initialized, %u paired senders, pairing open for %lld s",
+             sender_table_count(), SENDER_PAIRING_WINDOW_US / 1000000);
 
     bool ota_update_mode = false;
     
-    // Fill OTA ring buffer with initial samples
-    for (int i = 0; i < WINDOW_SIZE; i++) {
-        ringbuf_add_sample(&ota_gpio_ringbuf, gpio_get_level(OTA_BUTTON_PIN_INPUT));
-        
-    }
-
-    /* Main loop */
+    // Start the debouncer from the current input levels
+    uint64_t input_pin_mask = (1ULL << GATE_STATUS_PIN_INPUT) |
+                              (1ULL << OTA_BUTTON_PIN_INPUT) |
+                              (1ULL << SENDER_OTA_PIN_INPUT);
+    debouncer_init(&input_debouncer, input_pin_mask, debouncer_read_inputs());
+
+    /* Main loop: sleeps until a packet, an input edge or a deadline needs attention */
+    bool polling = true;
     while (1) {
-        ringbuf_add_sample(&gpio_ringbuf, gpio_get_level(GATE_STATUS_PIN_INPUT));
-        ringbuf_add_sample(&ota_gpio_ringbuf, gpio_get_level(OTA_BUTTON_PIN_INPUT));
+        event_loop_wait(event_loop_timeout_ticks(polling, next_deadline_us()));
+
+        /* One register snapshot debounces every input */
+        debouncer_update(&input_debouncer, debouncer_read_inputs());
+
+        /* Gate status edges time the gate travel for the approach estimator */
+        if (debouncer_rose(&input_debouncer, GATE_STATUS_PIN_INPUT) ||
+            debouncer_fell(&input_debouncer, GATE_STATUS_PIN_INPUT)) {
+            estimator_on_gate_status(debouncer_level(&input_debouncer, GATE_STATUS_PIN_INPUT),
+                                     esp_timer_get_time());
+        }
         
-        bool ota_pressed = ringbuf_is_majority_high(&ota_gpio_ringbuf);
+        bool ota_pressed = debouncer_level(&input_debouncer, OTA_BUTTON_PIN_INPUT);
         if (ota_pressed && !ota_update_mode && (esp_timer_get_time() > ota_cooldown)) {
             ESP_LOGI(TAG, "OTA button pressed, entering OTA update mode...");
             ota_update_mode = true;
             ota_setup();
+            trace_http_register(ota_http_server_handle());
             ota_cooldown = esp_timer_get_time() + 5000000; // 5 seconds cooldown
         }
         
@@ -123,22 +168,28 @@ void app_main(void) {
         }
 
 
-        event_t evnt = {.type = EVNT_RX_PACKET};
-        if (xQueueReceive(rx_queue, &evnt.rx, 0) == pdTRUE) {
-            process_event(&evnt);
-        }
+        /* Drain everything that arrived while we were asleep */
+        process_pending_events();
         
-        if(ringbuf_is_majority_high(&ota_gpio_ringbuf)){
+        if(debouncer_level(&input_debouncer, SENDER_OTA_PIN_INPUT)){
             state_machine_set_state(STATE_SENDER_OTA);
         }else{
-            if(state_machine_get_state() == STATE_SENDER_OTA){
+            if(state_machine_get_current_state() == STATE_SENDER_OTA){
                 state_machine_set_state(STATE_IDLE);
             }
         }
 
         state_machine_run();
-        vTaskDelay(pdMS_TO_TICKS(5));
+
+        /* Encode the trace once the packets have been handled */
+        trace_flush();
         
-        rolling_code_periodic_save(expected_rolling_code);
+        periodic_save_rolling_codes();
+        event_loop_report_stats();
+        espnow_report_stats();
+
+        /* Keep sampling while an input is debouncing or a state drives the gate */
+        polling = !debouncer_is_settled(&input_debouncer) ||
+                  state_machine_get_current_state() != STATE_IDLE;
     }
 }
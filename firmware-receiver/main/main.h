@@ -3,12 +3,11 @@
 
 #include <stdint.h>
 #include <stdbool.h>
-#include "ring_buffer.h"
+#include "debouncer.h"
 
 /* Shared global variables */
-extern ringbuf_t gpio_ringbuf;
+extern debouncer_t input_debouncer;
 extern bool last_gate_state;
-extern int64_t last_auto_open_time;
 extern int64_t last_toggle_time;
 
 /* Timing constants */
@@ -1,31 +1,127 @@
 #include "nvs_config.h"
-#include "event_processing.h"
+#include "sender_table.h"
 #include "nvs_flash.h"
 #include "nvs.h"
+#include <stdio.h>
+#include <string.h>
 
-uint32_t last_saved_rolling_code = 0; // Check if code changed before saving
+rc_journal_t rolling_code_journal = {0}; // Replaces the NVS keys when the partition exists
+
+/* Rolling code of the single sender, before senders had ids */
+#define LEGACY_ROLLING_CODE_KEY "exp_roll"
+
+/* NVS fallback key of a sender's rolling code */
+static void rolling_code_key(uint8_t sender_id, char *key, size_t len) {
+    snprintf(key, len, "roll_%u", sender_id);
+}
+
+/**
+ * @brief Load the paired sender list and each sender's rolling code
+ * The list is an NVS blob of MACs in pairing order, so a sender's position is
+ * its id and its journal key. Codes come from the journal, or from the NVS
+ * fallback keys without a journal partition.
+ * Without a list, the code of the single sender of an older firmware (journal
+ * key 0 or its NVS key) is kept for the first sender to pair, which becomes
+ * sender 0 and carries on with that key.
+ */
+void load_paired_senders(void) {
+    uint8_t macs[SENDER_TABLE_MAX][ESP_NOW_ETH_ALEN];
+    size_t len = sizeof(macs);
+
+    sender_table_init();
+    rc_journal_open(&rolling_code_journal, RC_JOURNAL_PARTITION_LABEL);
 
-void load_expected_rolling_code(void) {
     nvs_handle_t nvs;
     if (nvs_open("sec", NVS_READWRITE, &nvs) != ESP_OK) {
-        expected_rolling_code = 0;
         return;
     }
-
-    if (nvs_get_u32(nvs, "exp_roll", &expected_rolling_code) == ESP_ERR_NVS_NOT_FOUND) {
-        expected_rolling_code = 1;
-        nvs_set_u32(nvs, "exp_roll", expected_rolling_code);
-        nvs_commit(nvs);
+    if (nvs_get_blob(nvs, "senders", macs, &len) != ESP_OK) {
+        len = 0;
+        uint32_t code;
+        if (rc_journal_get(&rolling_code_journal, RC_JOURNAL_KEY_OWN, &code) ||
+            nvs_get_u32(nvs, LEGACY_ROLLING_CODE_KEY, &code) == ESP_OK) {
+            sender_pairing_set_legacy_code(code);
+        }
+    }
+    for (uint8_t id = 0; id < len / ESP_NOW_ETH_ALEN; id++) {
+        uint32_t code = 0;
+        if (!rc_journal_get(&rolling_code_journal, id, &code)) {
+            char key[NVS_KEY_NAME_MAX_SIZE];
+            rolling_code_key(id, key, sizeof(key));
+            if (nvs_get_u32(nvs, key, &code) != ESP_OK && id == 0) {
+                nvs_get_u32(nvs, LEGACY_ROLLING_CODE_KEY, &code);   // Upgraded, not saved since
+            }
+        }
+        sender_table_add(macs[id], code);
     }
-
     nvs_close(nvs);
 }
 
-void save_expected_rolling_code(void) {
+/**
+ * @brief Persist the paired sender list after a sender was added
+ */
+void save_paired_senders(void) {
+    uint8_t macs[SENDER_TABLE_MAX][ESP_NOW_ETH_ALEN];
+    uint8_t count = sender_table_count();
+    for (uint8_t id = 0; id < count; id++) {
+        memcpy(macs[id], sender_table_get(id)->mac, ESP_NOW_ETH_ALEN);
+    }
+
     nvs_handle_t nvs;
     if (nvs_open("sec", NVS_READWRITE, &nvs) == ESP_OK) {
-        nvs_set_u32(nvs, "exp_roll", expected_rolling_code);
+        nvs_set_blob(nvs, "senders", macs, (size_t)count * ESP_NOW_ETH_ALEN);
         nvs_commit(nvs);
         nvs_close(nvs);
     }
 }
+
+/**
+ * @brief Check if a sender accepted codes since the last NVS save
+ */
+bool rolling_codes_unsaved(void) {
+    uint8_t count = sender_table_count();
+    for (uint8_t id = 0; id < count; id++) {
+        const sender_t *sender = sender_table_get(id);
+        if (sender->replay.highest != sender->saved_code) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief Periodic NVS save, only used without a journal partition
+ */
+void save_rolling_codes(void) {
+    nvs_handle_t nvs;
+    if (nvs_open("sec", NVS_READWRITE, &nvs) != ESP_OK) {
+        return;
+    }
+    uint8_t count = sender_table_count();
+    for (uint8_t id = 0; id < count; id++) {
+        sender_t *sender = sender_table_get(id);
+        if (sender->replay.highest != sender->saved_code) {
+            char key[NVS_KEY_NAME_MAX_SIZE];
+            rolling_code_key(id, key, sizeof(key));
+            nvs_set_u32(nvs, key, sender->replay.highest);
+            sender->saved_code = sender->replay.highest;
+        }
+    }
+    nvs_commit(nvs);
+    nvs_close(nvs);
+}
+
+/**
+ * @brief Persist ahead of an accepted code before acting on it
+ * @return false if the journal could not be written, the code must then be dropped
+ */
+bool reserve_rolling_code(uint8_t sender_id, uint32_t code) {
+    if (!rolling_codes_journaled()) {
+        return true; // NVS fallback saves periodically
+    }
+    return rc_journal_reserve(&rolling_code_journal, sender_id, code) == ESP_OK;
+}
+
+bool rolling_codes_journaled(void) {
+    return rolling_code_journal.partition != NULL;
+}
@@ -2,10 +2,16 @@
 #define NVS_CONFIG_H
 
 #include <stdint.h>
+#include <stdbool.h>
+#include "rc_journal.h"
 
-void load_expected_rolling_code(void);
-void save_expected_rolling_code(void);
+void load_paired_senders(void);
+void save_paired_senders(void);
+void save_rolling_codes(void);
+bool rolling_codes_unsaved(void);
+bool reserve_rolling_code(uint8_t sender_id, uint32_t code);
+bool rolling_codes_journaled(void);
 
-extern uint32_t last_saved_rolling_code;
+extern rc_journal_t rolling_code_journal;
 
 #endif // NVS_CONFIG_H
@@ -0,0 +1,111 @@
+#include "rssi_window.h"
+#include <string.h>
+
+/* Advance a ring position without a division */
+static inline uint8_t wrap_index(const rssi_window_t *w, uint16_t index) {
+    return (uint8_t)(index >= w->length ? index - w->length : index);
+}
+
+/**
+ * @brief Initialize an empty window
+ * @param length Window length in samples, clamped to 2..RSSI_WINDOW_MAX
+ */
+void rssi_window_init(rssi_window_t *w, uint8_t length) {
+    if (length < 2) {
+        length = 2;
+    }
+    if (length > RSSI_WINDOW_MAX) {
+        length = RSSI_WINDOW_MAX;
+    }
+    w->length = length;
+    rssi_window_reset(w);
+}
+
+/**
+ * @brief Drop all samples, keeping the configured length
+ */
+void rssi_window_reset(rssi_window_t *w) {
+    w->count = 0;
+    w->head = 0;
+    w->sum = 0;
+    w->sum_sq = 0;
+    w->sum_xy = 0;
+}
+
+/**
+ * @brief Append a sample, evicting the oldest one when the window is full
+ * With x counted from the oldest sample, evicting y0 shifts every remaining
+ * x down by one, so Σ x·y loses (Σ y - y0) and the new sample adds (n-1)·y.
+ */
+void rssi_window_add(rssi_window_t *w, int8_t rssi_dbm, int64_t timestamp_us) {
+    int32_t y = (int32_t)rssi_dbm * (1 << RSSI_FRAC_BITS);     // Q.4; dBm is negative, so no shift
+    uint8_t tail;
+
+    if (w->count == w->length) {
+        int32_t oldest = w->samples[w->head];
+        w->sum -= oldest;
+        w->sum_sq -= (int64_t)oldest * oldest;
+        w->sum_xy -= w->sum; // Σ y of the survivors, each x drops by one
+        tail = w->head;
+        w->head = wrap_index(w, w->head + 1);
+    } else {
+        tail = wrap_index(w, w->head + w->count);
+        w->count++;
+    }
+
+    w->samples[tail] = (int16_t)y;
+    w->times_ms[tail] = (uint32_t)(timestamp_us / 1000);
+    w->sum += y;
+    w->sum_sq += (int64_t)y * y;
+    w->sum_xy += (int64_t)(w->count - 1) * y;
+}
+
+/**
+ * @brief Mean RSSI
+ * @return Q.4 dBm, 0 when empty
+ */
+int32_t rssi_window_mean_q(const rssi_window_t *w) {
+    if (w->count == 0) {
+        return 0;
+    }
+    return w->sum / w->count;
+}
+
+/**
+ * @brief Population variance of the RSSI
+ * @return Q.8 dB², 0 with fewer than two samples
+ */
+int32_t rssi_window_variance_q(const rssi_window_t *w) {
+    int64_t n = w->count;
+    if (n < 2) {
+        return 0;
+    }
+    return (int32_t)((n * w->sum_sq - (int64_t)w->sum * w->sum) / (n * n));
+}
+
+/**
+ * @brief Least-squares slope of RSSI against arrival order
+ * Σx and Σx² over x = 0..n-1 have closed forms, so only Σy and Σxy are tracked.
+ * @return Q.4 dB per sample, positive while the signal gets stronger
+ */
+int32_t rssi_window_slope_q(const rssi_window_t *w) {
+    int64_t n = w->count;
+    if (n < 2) {
+        return 0;
+    }
+    int64_t sum_x = n * (n - 1) / 2;
+    int64_t sum_xx = (n - 1) * n * (2 * n - 1) / 6;
+    int64_t denominator = n * sum_xx - sum_x * sum_x;
+    return (int32_t)((n * w->sum_xy - sum_x * w->sum) / denominator);
+}
+
+/**
+ * @brief Time between the oldest and newest sample in the window
+ */
+int64_t rssi_window_span_us(const rssi_window_t *w) {
+    if (w->count < 2) {
+        return 0;
+    }
+    uint8_t newest = wrap_index(w, w->head + w->count - 1);
+    return (int64_t)(uint32_t)(w->times_ms[newest] - w->times_ms[w->head]) * 1000;
+}
@@ -0,0 +1,38 @@
+#ifndef RSSI_WINDOW_H
+#define RSSI_WINDOW_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/* --------------------------------------------------------------------------
+ * Sliding-window RSSI statistics
+ * Running sums give mean, variance and least-squares slope over the last
+ * `length` samples in arrival order, each in O(1) per added sample.
+ * -------------------------------------------------------------------------- */
+
+#ifndef RSSI_WINDOW_MAX
+#define RSSI_WINDOW_MAX 32      // Largest supported window length, one window per paired sender
+#endif
+#define RSSI_FRAC_BITS  4       // Samples are stored as Q.4 dBm (1/16 dB steps)
+
+typedef struct {
+    int16_t samples[RSSI_WINDOW_MAX];   // Q.4 dBm, ring buffer in arrival order
+    uint32_t times_ms[RSSI_WINDOW_MAX]; // Arrival time of each sample (ms, wraps)
+    uint8_t length;                     // Configured window length
+    uint8_t count;                      // Valid samples, up to length
+    uint8_t head;                       // Position of the oldest sample
+    int32_t sum;                        // Σ y
+    int64_t sum_sq;                     // Σ y²
+    int64_t sum_xy;                     // Σ x·y with x = 0 for the oldest sample
+} rssi_window_t;
+
+/* Function declarations */
+void rssi_window_init(rssi_window_t *w, uint8_t length);
+void rssi_window_reset(rssi_window_t *w);
+void rssi_window_add(rssi_window_t *w, int8_t rssi_dbm, int64_t timestamp_us);
+int32_t rssi_window_mean_q(const rssi_window_t *w);
+int32_t rssi_window_variance_q(const rssi_window_t *w);
+int32_t rssi_window_slope_q(const rssi_window_t *w);
+int64_t rssi_window_span_us(const rssi_window_t *w);
+
+#endif // RSSI_WINDOW_H
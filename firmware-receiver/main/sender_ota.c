@@ -0,0 +1,238 @@
+#include "sender_ota.h"
+#include "event_loop.h"
+#include "ota_xfer.h"
+#include "ota_signature.h"
+#include "spsc_ring.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_now.h"
+#include "esp_mac.h"
+#include "esp_ota_ops.h"
+#include "esp_app_desc.h"
+#include "esp_image_format.h"
+#include "nvs.h"
+#include <string.h>
+
+static const char *TAG = "SENDER_OTA";
+
+#define SENDER_OTA_HASH_CHUNK 512
+
+typedef enum {
+    SENDER_OTA_OFF,             // Not started since the switch went on
+    SENDER_OTA_SENDING,         // Offering, or sending to the sender that answered
+    SENDER_OTA_FINISHED,        // Done, failed or nothing to send; wait for the switch to go off
+} sender_ota_state_t;
+
+/* Ack with the MAC it came from, as receive_cb hands it over */
+typedef struct {
+    uint8_t mac[ESP_NOW_ETH_ALEN];
+    ota_xfer_ack_t ack;
+} sender_ota_ack_t;
+
+static sender_ota_state_t state = SENDER_OTA_OFF;
+static ota_xfer_tx_t xfer;
+static const esp_partition_t *image_partition = NULL;
+static uint8_t image_sig[OTA_SIGNATURE_MAX];
+static size_t image_sig_len = 0;
+static uint8_t target_mac[ESP_NOW_ETH_ALEN];
+static bool target_known = false;
+static int64_t start_us = 0;
+
+/* Acks from the Wi-Fi task; listening is set once the ring is ready */
+static spsc_ring_t ack_ring;
+static sender_ota_ack_t ack_slab[SENDER_OTA_ACK_SLOTS];
+static volatile bool listening = false;
+static volatile bool frame_pending = false;     // A frame is with the ESP-NOW driver
+
+/**
+ * @brief Hand a chunk or offer to ESP-NOW, one at a time
+ * Offers go to every registered peer, i.e. the senders replied to lately;
+ * chunks only to the sender that answered.
+ */
+static bool sender_ota_send(void *ctx, const void *pkt, size_t len) {
+    if (frame_pending) {
+        return false;
+    }
+    frame_pending = true;
+    if (esp_now_send(target_known ? target_mac : NULL, pkt, len) != ESP_OK) {
+        frame_pending = false;
+        return false;
+    }
+    return true;
+}
+
+static bool sender_ota_read(void *ctx, uint32_t offset, uint8_t *data, size_t len) {
+    return esp_partition_read(image_partition, offset, data, len) == ESP_OK;
+}
+
+/**
+ * @brief Load the signature uploaded with the image, if it is this image's
+ * @return Signature length, 0 if there is none for this digest
+ */
+static size_t sender_ota_load_signature(const uint8_t digest[SHA256_DIGEST_LEN]) {
+    static uint8_t blob[SHA256_DIGEST_LEN + OTA_SIGNATURE_MAX];
+    size_t len = sizeof(blob);
+    nvs_handle_t nvs;
+    if (nvs_open(OTA_SENDER_SIG_NAMESPACE, NVS_READONLY, &nvs) != ESP_OK) {
+        return 0;
+    }
+    esp_err_t err = nvs_get_blob(nvs, OTA_SENDER_SIG_KEY, blob, &len);
+    nvs_close(nvs);
+    if (err != ESP_OK || len < SHA256_DIGEST_LEN || memcmp(blob, digest, SHA256_DIGEST_LEN) != 0) {
+        return 0;
+    }
+    memcpy(image_sig, blob + SHA256_DIGEST_LEN, len - SHA256_DIGEST_LEN);
+    return len - SHA256_DIGEST_LEN;
+}
+
+/**
+ * @brief Find the image to send and offer it
+ * @return false if the spare partition holds no valid sender image
+ */
+static bool sender_ota_start(int64_t now) {
+    image_partition = esp_ota_get_next_update_partition(NULL);
+    if (image_partition == NULL) {
+        ESP_LOGE(TAG, "No spare OTA partition");
+        return false;
+    }
+    esp_partition_pos_t pos = {.offset = image_partition->address, .size = image_partition->size};
+    esp_image_metadata_t meta;
+    esp_app_desc_t desc;
+    if (esp_image_verify(ESP_IMAGE_VERIFY_SILENT, &pos, &meta) != ESP_OK ||
+        esp_ota_get_partition_description(image_partition, &desc) != ESP_OK) {
+        ESP_LOGW(TAG, "No valid image in the spare partition, upload one with POST /update?target=sender");
+        return false;
+    }
+    /* The spare partition also holds our own previous firmware after an update */
+    if (strncmp(desc.project_name, esp_app_get_description()->project_name, sizeof(desc.project_name)) == 0) {
+        ESP_LOGW(TAG, "Spare partition holds receiver firmware %s, not sending it", desc.version);
+        return false;
+    }
+
+    uint8_t chunk[SENDER_OTA_HASH_CHUNK];
+    uint8_t digest[SHA256_DIGEST_LEN];
+    sha256_ctx_t sha;
+    sha256_init(&sha);
+    for (uint32_t offset = 0; offset < meta.image_len; offset += sizeof(chunk)) {
+        size_t n = meta.image_len - offset < sizeof(chunk) ? meta.image_len - offset : sizeof(chunk);
+        if (esp_partition_read(image_partition, offset, chunk, n) != ESP_OK) {
+            sha256_final(&sha, digest);
+            ESP_LOGE(TAG, "Failed to read the sender image");
+            return false;
+        }
+        sha256_update(&sha, chunk, n);
+    }
+    sha256_final(&sha, digest);
+    image_sig_len = sender_ota_load_signature(digest);
+    if (image_sig_len == 0) {
+        ESP_LOGW(TAG, "No signature for this image, a sender with a signing key will refuse it");
+    }
+
+    target_known = false;
+    frame_pending = false;
+    spsc_ring_init(&ack_ring, ack_slab, sizeof(sender_ota_ack_t), SENDER_OTA_ACK_SLOTS);
+    ota_xfer_tx_init(&xfer, meta.image_len, digest, image_sig, image_sig_len, sender_ota_send, sender_ota_read,
+                     NULL, now);
+    listening = true;
+    start_us = now;
+    ESP_LOGI(TAG, "Offering %s %s, %lu bytes in %lu chunks", desc.project_name, desc.version,
+             (unsigned long)meta.image_len, (unsigned long)xfer.chunks);
+    return true;
+}
+
+static void sender_ota_finish(int64_t now) {
+    listening = false;
+    state = SENDER_OTA_FINISHED;
+    int64_t elapsed_ms = (now - start_us) / 1000;
+    if (xfer.state == OTA_XFER_TX_DONE) {
+        ESP_LOGI(TAG, "Sender took the image in %lld ms (%lld KB/s)", elapsed_ms,
+                 elapsed_ms > 0 ? (int64_t)xfer.image_size * 1000 / 1024 / elapsed_ms : 0);
+    } else {
+        ESP_LOGW(TAG, "Transfer failed at chunk %lu of %lu after %lld ms", (unsigned long)xfer.base,
+                 (unsigned long)xfer.chunks, elapsed_ms);
+    }
+    ESP_LOGI(TAG, "%lu chunk sends for %lu chunks (%lu holes, %lu timeouts), %lu acks, %lu offers",
+             (unsigned long)xfer.stats.data_frames, (unsigned long)xfer.chunks,
+             (unsigned long)xfer.stats.fast_resends, (unsigned long)xfer.stats.timeout_resends,
+             (unsigned long)xfer.stats.acks, (unsigned long)xfer.stats.offers);
+}
+
+/**
+ * @brief Take the acks that arrived, then send what is due
+ * Called every main loop pass while the switch is on; acks and send
+ * completions wake the loop, so a chunk goes out as soon as the last one left.
+ */
+void sender_ota_run(void) {
+    int64_t now = esp_timer_get_time();
+    if (state == SENDER_OTA_FINISHED) {
+        return;
+    }
+    if (state == SENDER_OTA_OFF) {
+        if (!sender_ota_start(now)) {
+            state = SENDER_OTA_FINISHED;
+            return;
+        }
+        state = SENDER_OTA_SENDING;
+    }
+
+    sender_ota_ack_t *slot;
+    while ((slot = spsc_ring_peek(&ack_ring)) != NULL) {
+        if (!target_known && slot->ack.session == xfer.session) {
+            memcpy(target_mac, slot->mac, ESP_NOW_ETH_ALEN);
+            target_known = true;
+            ESP_LOGI(TAG, "Sender " MACSTR " answered, %lu chunks already there", MAC2STR(target_mac),
+                     (unsigned long)slot->ack.next);
+        }
+        if (target_known && memcmp(slot->mac, target_mac, ESP_NOW_ETH_ALEN) == 0) {
+            ota_xfer_tx_on_ack(&xfer, &slot->ack, now);
+        }
+        spsc_ring_release(&ack_ring);
+    }
+
+    ota_xfer_tx_state_t tx_state = ota_xfer_tx_poll(&xfer, now);
+    if (tx_state == OTA_XFER_TX_FAILED && !target_known) {
+        /* Senders take a few OTA requests to listen; keep offering while the switch is on */
+        uint8_t digest[SHA256_DIGEST_LEN];
+        memcpy(digest, xfer.sha256, sizeof(digest));
+        ota_xfer_tx_init(&xfer, xfer.image_size, digest, image_sig, image_sig_len, sender_ota_send, sender_ota_read,
+                         NULL, now);
+    } else if (tx_state >= OTA_XFER_TX_DONE) {
+        sender_ota_finish(now);
+    }
+}
+
+void sender_ota_stop(void) {
+    if (state == SENDER_OTA_SENDING) {
+        ESP_LOGI(TAG, "Stopped at chunk %lu of %lu", (unsigned long)xfer.base, (unsigned long)xfer.chunks);
+    }
+    listening = false;
+    state = SENDER_OTA_OFF;
+}
+
+bool sender_ota_answered(void) {
+    return state == SENDER_OTA_SENDING && target_known;
+}
+
+/**
+ * @brief Queue an ack for the main loop; anything else of ours is ignored
+ */
+void sender_ota_on_packet(const uint8_t *mac, const uint8_t *data, int len) {
+    if (!listening || len != sizeof(ota_xfer_ack_t) || data[0] != OTA_XFER_ACK) {
+        return;
+    }
+    sender_ota_ack_t *slot = spsc_ring_claim(&ack_ring);
+    if (slot == NULL) {
+        return;     // A later ack repeats what this one said
+    }
+    memcpy(slot->mac, mac, ESP_NOW_ETH_ALEN);
+    memcpy(&slot->ack, data, sizeof(slot->ack));
+    spsc_ring_publish(&ack_ring);
+    event_loop_notify(WAKE_SENDER_OTA);
+}
+
+void sender_ota_on_send_done(void) {
+    if (listening && frame_pending) {
+        frame_pending = false;
+        event_loop_notify(WAKE_SENDER_OTA);
+    }
+}
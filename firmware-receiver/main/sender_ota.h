@@ -0,0 +1,30 @@
+#ifndef SENDER_OTA_H
+#define SENDER_OTA_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/* --------------------------------------------------------------------------
+ * Sender firmware over ESP-NOW
+ * While the sender OTA switch is on, the image stored in the spare OTA
+ * partition (POST /update?target=sender) is offered to the senders and sent
+ * to the first one that answers (ota_xfer.h). Turning the switch off and on
+ * again offers it anew, and a sender that has part of it carries on.
+ * -------------------------------------------------------------------------- */
+
+#define SENDER_OTA_ACK_SLOTS 8      // Acks receive_cb can hand over between main loop passes, power of two
+
+/* From state_sender_ota(), every main loop pass */
+void sender_ota_run(void);
+
+/* Leaving STATE_SENDER_OTA */
+void sender_ota_stop(void);
+
+/* True once a sender has answered the offer; the OTA request command can stop */
+bool sender_ota_answered(void);
+
+/* From receive_cb and the ESP-NOW send callback, Wi-Fi task */
+void sender_ota_on_packet(const uint8_t *mac, const uint8_t *data, int len);
+void sender_ota_on_send_done(void);
+
+#endif // SENDER_OTA_H
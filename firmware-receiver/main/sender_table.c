@@ -0,0 +1,138 @@
+#include "sender_table.h"
+#include "event_processing.h"
+#include <string.h>
+
+/* Entries by pairing order; slots hold id + 1, 0 for an empty slot */
+static sender_t senders[SENDER_TABLE_MAX];
+static uint8_t slots[SENDER_TABLE_SLOTS];
+static uint8_t sender_count = 0;
+static int64_t pairing_until_us = 0;
+static bool legacy_pending = false;
+static uint32_t legacy_code = 0;
+
+uint32_t sender_table_probes = 0;
+
+/**
+ * @brief FNV-1a over the whole MAC
+ * Boards from one vendor share the first three bytes, so all six are mixed in.
+ */
+static uint32_t mac_hash(const uint8_t *mac) {
+    uint32_t h = 2166136261u;
+    for (int i = 0; i < ESP_NOW_ETH_ALEN; i++) {
+        h = (h ^ mac[i]) * 16777619u;
+    }
+    return h;
+}
+
+/**
+ * @brief Forget every sender and close pairing
+ */
+void sender_table_init(void) {
+    memset(senders, 0, sizeof(senders));
+    memset(slots, 0, sizeof(slots));
+    sender_count = 0;
+    pairing_until_us = 0;
+    legacy_pending = false;
+    sender_table_probes = 0;
+}
+
+/**
+ * @brief Id of a paired sender
+ * Called from receive_cb while the main task may be pairing: an entry is
+ * complete before its slot is published, so a lookup either finds it whole
+ * or not at all.
+ * @return Sender id, SENDER_ID_NONE if the MAC is not paired
+ */
+uint8_t sender_table_find(const uint8_t *mac) {
+    uint32_t i = mac_hash(mac) & (SENDER_TABLE_SLOTS - 1);
+    for (uint32_t n = 0; n < SENDER_TABLE_SLOTS; n++) {
+        uint8_t slot = __atomic_load_n(&slots[i], __ATOMIC_ACQUIRE);
+        if (slot == 0) {
+            return SENDER_ID_NONE;
+        }
+        sender_table_probes++;
+        if (memcmp(senders[slot - 1].mac, mac, ESP_NOW_ETH_ALEN) == 0) {
+            return slot - 1;
+        }
+        i = (i + 1) & (SENDER_TABLE_SLOTS - 1);
+    }
+    return SENDER_ID_NONE;
+}
+
+/**
+ * @brief Pair a sender, accepting only codes after highest_code from it
+ * @return Id of the new or already paired sender, SENDER_ID_NONE if the table is full
+ */
+uint8_t sender_table_add(const uint8_t *mac, uint32_t highest_code) {
+    uint8_t id = sender_table_find(mac);
+    if (id != SENDER_ID_NONE) {
+        return id;
+    }
+    if (sender_count >= SENDER_TABLE_MAX) {
+        return SENDER_ID_NONE;
+    }
+
+    id = sender_count;
+    sender_t *s = &senders[id];
+    memset(s, 0, sizeof(*s));
+    memcpy(s->mac, mac, ESP_NOW_ETH_ALEN);
+    s->id = id;
+    replay_window_init(&s->replay, highest_code);
+    replay_window_init(&s->queued, highest_code);
+    s->saved_code = highest_code;
+    rssi_window_init(&s->rssi, RSSI_WINDOW_LENGTH);
+
+    uint32_t i = mac_hash(mac) & (SENDER_TABLE_SLOTS - 1);
+    while (slots[i] != 0) {
+        i = (i + 1) & (SENDER_TABLE_SLOTS - 1);
+    }
+    /* Count first, so an id found through the slot is always valid for sender_table_get() */
+    __atomic_store_n(&sender_count, (uint8_t)(id + 1), __ATOMIC_RELEASE);
+    __atomic_store_n(&slots[i], (uint8_t)(id + 1), __ATOMIC_RELEASE);
+    return id;
+}
+
+sender_t *sender_table_get(uint8_t id) {
+    return id < sender_table_count() ? &senders[id] : NULL;
+}
+
+uint8_t sender_table_count(void) {
+    return __atomic_load_n(&sender_count, __ATOMIC_ACQUIRE);
+}
+
+/**
+ * @brief Accept new senders until the given time
+ */
+void sender_pairing_open_until(int64_t until_us) {
+    pairing_until_us = until_us;
+}
+
+/**
+ * @brief Check if an unknown sender's force open should pair it
+ * Pairing stays open while nothing is paired, so a fresh receiver always
+ * takes its first sender.
+ */
+bool sender_pairing_active(int64_t now_us) {
+    return sender_table_count() == 0 || now_us < pairing_until_us;
+}
+
+/**
+ * @brief Keep the rolling code of the one sender a receiver had before the table
+ * That firmware stored no MAC, so the code goes to the first sender to pair.
+ */
+void sender_pairing_set_legacy_code(uint32_t code) {
+    legacy_code = code;
+    legacy_pending = true;
+}
+
+/**
+ * @brief Code the first sender to pair has to continue from, if it is the upgraded one
+ * @return false once a sender is paired, or if there was no single sender before
+ */
+bool sender_pairing_legacy_code(uint32_t *code) {
+    if (!legacy_pending || sender_table_count() != 0) {
+        return false;
+    }
+    *code = legacy_code;
+    return true;
+}
@@ -0,0 +1,53 @@
+#ifndef SENDER_TABLE_H
+#define SENDER_TABLE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_now.h"
+#include "rssi_window.h"
+#include "replay_window.h"
+#include "estimator.h"
+
+/* --------------------------------------------------------------------------
+ * Paired senders
+ * Fixed-capacity table of every sender the receiver accepts packets from,
+ * indexed by MAC with open addressing and linear probing. Entries are never
+ * removed, so the probe sequence needs no tombstones and a lookup from
+ * receive_cb costs a hash and, at the table's load of at most 1/2, about
+ * one MAC compare. Each entry keeps that sender's rolling code window,
+ * RSSI window, approach filter and auto-open cooldown.
+ * -------------------------------------------------------------------------- */
+
+#define SENDER_TABLE_MAX        64          // Paired senders, one rolling code journal key each
+#define SENDER_TABLE_SLOTS      128         // Hash slots, power of two, at least 2 × SENDER_TABLE_MAX
+#define SENDER_ID_NONE          0xFF        // Not paired
+#define SENDER_PAIRING_WINDOW_US 60000000LL // Pairing stays open 60 s after boot
+
+typedef struct {
+    uint8_t mac[ESP_NOW_ETH_ALEN];
+    uint8_t id;                     // Pairing order: NVS list index and journal key
+    replay_window_t replay;         // Highest accepted code and the codes seen below it
+    uint32_t saved_code;            // Last code saved by the NVS fallback
+    rssi_window_t rssi;             // Last RSSI_WINDOW_LENGTH pings in arrival order
+    estimator_filter_t filter;      // Approach estimate
+    int64_t last_rx_us;             // Last ping
+    int16_t link_offset_q4;         // Our RSSI minus the sender's on the same link, Q.4 dB, averaged
+    uint8_t link_pairs;             // Two-sided pings the offset was learned from, up to LINK_OFFSET_PAIRS
+    int64_t last_auto_open_us;      // Last auto open issued for this sender
+    replay_window_t queued;         // Codes queued by receive_cb, only written there
+} sender_t;
+
+/* Function declarations */
+void sender_table_init(void);
+uint8_t sender_table_find(const uint8_t *mac);
+uint8_t sender_table_add(const uint8_t *mac, uint32_t highest_code);
+sender_t *sender_table_get(uint8_t id);
+uint8_t sender_table_count(void);
+void sender_pairing_open_until(int64_t until_us);
+bool sender_pairing_active(int64_t now_us);
+void sender_pairing_set_legacy_code(uint32_t code);
+bool sender_pairing_legacy_code(uint32_t *code);
+
+extern uint32_t sender_table_probes;    // Slots compared by sender_table_find, for benchmarks
+
+#endif // SENDER_TABLE_H
@@ -1,7 +1,11 @@
 #include "state_machine.h"
 #include "main.h"
 #include "gpio_config.h"
-#include "ring_buffer.h"
+#include "debouncer.h"
+#include "trace.h"
+#include "espnow_config.h"
+#include "event_processing.h"
+#include "sender_ota.h"
 #include "esp_log.h"
 #include "esp_timer.h"
 #include "driver/gpio.h"
@@ -14,7 +18,6 @@
 
 static const char *TAG = "STATE_MACHINE";
 
-static const bool server_mode = false; // Set to true to enable OTA server mode
 static int64_t ota_cooldown = 0; // Cooldown timer for OTA button
 
 typedef void (*state_func_t)(void); 
@@ -71,7 +74,11 @@ void state_machine_run(void) {
  */
 void state_machine_set_state(State new_state) {
     if (new_state < STATE_COUNT && new_state != current_state) {
+        if (current_state == STATE_SENDER_OTA) {
+            sender_ota_stop();
+        }
         current_state = new_state;
+        trace_record_state((uint8_t)new_state, esp_timer_get_time());
         ESP_LOGI(TAG, "State changed to %d", new_state);
     }
 }
@@ -91,12 +98,12 @@ State state_machine_get_current_state(void) {
 
 void state_open(void) {
     /* Drive GPIO to open gate */
-    if (ringbuf_is_majority_high(&gpio_ringbuf)) {
+    if (debouncer_level(&input_debouncer, GATE_STATUS_PIN_INPUT)) {
         gpio_set_level(GATE_CMD_PIN_OUT, 1);
     } else {
         gpio_set_level(GATE_CMD_PIN_OUT, 0);
         state_machine_set_state(STATE_IDLE);
-        last_auto_open_time = esp_timer_get_time();
+        auto_open_command_ended(esp_timer_get_time());
     }
 }
 
@@ -107,7 +114,7 @@ void state_toggle(void) {
         return;
     }
     
-    if (ringbuf_is_majority_high(&gpio_ringbuf) == last_gate_state) {
+    if (debouncer_level(&input_debouncer, GATE_STATUS_PIN_INPUT) == last_gate_state) {
         gpio_set_level(GATE_CMD_PIN_OUT, 1);
     } else {
         gpio_set_level(GATE_CMD_PIN_OUT, 0);
@@ -118,12 +125,15 @@ void state_toggle(void) {
 
 
 
+/**
+ * @brief Sender OTA switch is on: ask the senders to listen, then send them the stored image
+ * The request repeats every OTA_COOLDOWN_US until a sender answers the offer.
+ */
 void state_sender_ota(void) {
     int64_t now = esp_timer_get_time();
-    if (now - ota_cooldown < OTA_COOLDOWN_US) {
-        espnow_send_packet(2, rolling_code_get_and_increment());  // Sender OTA request
+    if (!sender_ota_answered() && now - ota_cooldown >= OTA_COOLDOWN_US) {
+        espnow_send_packet(CMD_SENDER_OTA);
         ota_cooldown = now;
     }
+    sender_ota_run();
 }
-
-
@@ -0,0 +1,217 @@
+#include "trace.h"
+#include <string.h>
+
+/* Raw records waiting for trace_flush() */
+static trace_raw_record_t staging[TRACE_STAGING_SIZE];
+static uint32_t staging_head = 0;   // Next slot to write
+static uint32_t staging_tail = 0;   // Next slot to encode
+static uint32_t staging_lost = 0;   // Records dropped since the last flush
+
+/* Encoded blocks, oldest at first_block */
+static uint8_t blocks[TRACE_BLOCK_COUNT][TRACE_BLOCK_SIZE];
+static uint32_t first_block = 0;
+static uint32_t block_count = 0;
+static uint32_t next_sequence = 0;
+
+/* Delta state of the block being filled */
+static int64_t prev_time_us = 0;
+static uint32_t prev_rolling_code = 0;
+
+bool trace_capture_enabled = true;
+trace_stats_t trace_stats = {0};
+
+/**
+ * @brief Drop every captured record
+ */
+void trace_init(void) {
+    staging_head = 0;
+    staging_tail = 0;
+    staging_lost = 0;
+    first_block = 0;
+    block_count = 0;
+    next_sequence = 0;
+    prev_time_us = 0;
+    prev_rolling_code = 0;
+    memset(&trace_stats, 0, sizeof(trace_stats));
+}
+
+static void stage(const trace_raw_record_t *rec) {
+    if (!trace_capture_enabled) {
+        return;
+    }
+    if (staging_head - staging_tail >= TRACE_STAGING_SIZE) {
+        staging_lost++;
+        trace_stats.dropped++;
+        return;
+    }
+    staging[staging_head & (TRACE_STAGING_SIZE - 1)] = *rec;
+    staging_head++;
+    trace_stats.staged++;
+}
+
+/**
+ * @brief Stage a received packet, called before it is processed
+ */
+void trace_record_rx(const rx_event_t *rx) {
+    trace_raw_record_t rec = {
+        .type = TRACE_REC_RX,
+        .value = rx->command,
+        .rssi = rx->rssi,
+        .rolling_code = rx->rolling_code,
+        .timestamp_us = (int64_t)rx->timestamp_us,
+    };
+    stage(&rec);
+}
+
+/**
+ * @brief Stage a state transition
+ */
+void trace_record_state(uint8_t state, int64_t timestamp_us) {
+    trace_raw_record_t rec = {
+        .type = TRACE_REC_STATE,
+        .value = state,
+        .timestamp_us = timestamp_us,
+    };
+    stage(&rec);
+}
+
+static size_t put_varint(uint8_t *out, uint64_t value) {
+    size_t n = 0;
+    while (value >= 0x80) {
+        out[n++] = (uint8_t)(value | 0x80);
+        value >>= 7;
+    }
+    out[n++] = (uint8_t)value;
+    return n;
+}
+
+static inline uint64_t zigzag(int64_t value) {
+    return ((uint64_t)value << 1) ^ (uint64_t)(value >> 63);
+}
+
+static trace_block_header_t *block_header(uint32_t slot) {
+    return (trace_block_header_t *)blocks[slot];
+}
+
+/**
+ * @brief Open a new block based at this record, evicting the oldest if needed
+ */
+static void start_block(const trace_raw_record_t *rec) {
+    uint32_t slot;
+    if (block_count == TRACE_BLOCK_COUNT) {
+        slot = first_block;
+        first_block = (first_block + 1) % TRACE_BLOCK_COUNT;
+        trace_stats.blocks_evicted++;
+    } else {
+        slot = (first_block + block_count) % TRACE_BLOCK_COUNT;
+        block_count++;
+    }
+
+    prev_time_us = rec->timestamp_us;
+    if (rec->type == TRACE_REC_RX) {
+        prev_rolling_code = rec->rolling_code;
+    }
+
+    trace_block_header_t *hdr = block_header(slot);
+    hdr->magic = TRACE_BLOCK_MAGIC;
+    hdr->used = 0;
+    hdr->sequence = next_sequence++;
+    hdr->base_time_us = (uint64_t)prev_time_us;
+    hdr->base_rolling_code = prev_rolling_code;
+}
+
+static void encode(const trace_raw_record_t *rec) {
+    uint8_t buf[TRACE_MAX_RECORD];
+    size_t len;
+
+    /* Deltas against the current block first; a new block rebases them */
+    for (int attempt = 0; attempt < 2; attempt++) {
+        len = 0;
+        buf[len++] = (uint8_t)(rec->type | (rec->value << 2));
+        len += put_varint(&buf[len], zigzag(rec->timestamp_us - prev_time_us));
+        if (rec->type == TRACE_REC_RX) {
+            len += put_varint(&buf[len], zigzag((int32_t)(rec->rolling_code - prev_rolling_code)));
+            buf[len++] = (uint8_t)rec->rssi;
+        }
+
+        if (block_count > 0) {
+            uint32_t slot = (first_block + block_count - 1) % TRACE_BLOCK_COUNT;
+            trace_block_header_t *hdr = block_header(slot);
+            if (sizeof(*hdr) + hdr->used + len <= TRACE_BLOCK_SIZE) {
+                memcpy(&blocks[slot][sizeof(*hdr) + hdr->used], buf, len);
+                hdr->used += len;
+                break;
+            }
+        }
+        start_block(rec);
+    }
+
+    prev_time_us = rec->timestamp_us;
+    if (rec->type == TRACE_REC_RX) {
+        prev_rolling_code = rec->rolling_code;
+    }
+    trace_stats.bytes_encoded += len;
+}
+
+/**
+ * @brief Encode every staged record into the block ring
+ * Called from the main loop after the state machine has run.
+ */
+void trace_flush(void) {
+    if (staging_lost > 0) {
+        trace_raw_record_t marker = {
+            .type = TRACE_REC_DROPPED,
+            .value = (uint8_t)(staging_lost > 63 ? 63 : staging_lost),
+            .timestamp_us = staging[(staging_head - 1) & (TRACE_STAGING_SIZE - 1)].timestamp_us,
+        };
+        staging_lost = 0;
+        encode(&marker);
+    }
+    while (staging_tail != staging_head) {
+        encode(&staging[staging_tail & (TRACE_STAGING_SIZE - 1)]);
+        staging_tail++;
+    }
+}
+
+/**
+ * @brief Size of the serialized trace: file header plus every block in use
+ */
+size_t trace_serialized_size(void) {
+    return sizeof(trace_file_header_t) + (size_t)block_count * TRACE_BLOCK_SIZE;
+}
+
+/**
+ * @brief Copy part of the serialized trace, oldest block first
+ * @return Bytes copied, 0 past the end
+ */
+size_t trace_read(uint8_t *out, size_t offset, size_t len) {
+    trace_file_header_t file_hdr = {
+        .magic = TRACE_MAGIC,
+        .version = TRACE_VERSION,
+        .block_size = TRACE_BLOCK_SIZE,
+        .block_count = block_count,
+    };
+    size_t total = trace_serialized_size();
+    size_t copied = 0;
+
+    while (copied < len && offset < total) {
+        const uint8_t *src;
+        size_t avail;
+        if (offset < sizeof(file_hdr)) {
+            src = (const uint8_t *)&file_hdr + offset;
+            avail = sizeof(file_hdr) - offset;
+        } else {
+            size_t pos = offset - sizeof(file_hdr);
+            uint32_t slot = (first_block + pos / TRACE_BLOCK_SIZE) % TRACE_BLOCK_COUNT;
+            src = &blocks[slot][pos % TRACE_BLOCK_SIZE];
+            avail = TRACE_BLOCK_SIZE - pos % TRACE_BLOCK_SIZE;
+        }
+        if (avail > len - copied) {
+            avail = len - copied;
+        }
+        memcpy(out + copied, src, avail);
+        copied += avail;
+        offset += avail;
+    }
+    return copied;
+}
@@ -0,0 +1,81 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "event_processing.h"
+
+/* --------------------------------------------------------------------------
+ * Ride trace capture
+ * The main loop stages every received packet and state transition as a raw
+ * record, which costs a copy. trace_flush() later delta-encodes them into a
+ * RAM ring of fixed-size blocks, so encoding never runs inside
+ * process_event(). Each block starts from absolute values, so dropping the
+ * oldest block when the ring is full never breaks the remaining deltas.
+ *
+ * Serialized trace: trace_file_header_t, then TRACE_BLOCK_SIZE-byte blocks
+ * oldest first. A block is a trace_block_header_t followed by records:
+ *   tag byte: bits 0-1 type, bits 2-7 command / state / dropped count
+ *   zigzag varint: microseconds since the previous record (or the block base)
+ *   RX only: zigzag varint rolling code delta, then the RSSI as int8
+ * -------------------------------------------------------------------------- */
+
+#define TRACE_MAGIC         0x43525447UL    // "GTRC"
+#define TRACE_VERSION       1
+#define TRACE_BLOCK_SIZE    256
+#define TRACE_BLOCK_COUNT   32              // 8 KB of RAM, several rides of pings
+#define TRACE_STAGING_SIZE  32              // Raw records between two flushes, power of two
+
+#define TRACE_BLOCK_MAGIC   0x5254          // "TR"
+#define TRACE_MAX_RECORD    (1 + 10 + 5 + 1)
+
+typedef enum {
+    TRACE_REC_RX = 0,       // rx_event_t, command in the tag
+    TRACE_REC_STATE = 1,    // State transition, new state in the tag
+    TRACE_REC_DROPPED = 2,  // Staged records lost to a full staging ring, count in the tag
+} trace_record_type_t;
+
+typedef struct __attribute__((packed)) {
+    uint32_t magic;
+    uint8_t version;
+    uint8_t reserved;
+    uint16_t block_size;
+    uint32_t block_count;   // Blocks that follow
+} trace_file_header_t;
+
+typedef struct __attribute__((packed)) {
+    uint16_t magic;
+    uint16_t used;          // Bytes of records after this header
+    uint32_t sequence;      // Increments per block, survives ring wrap
+    uint64_t base_time_us;
+    uint32_t base_rolling_code;
+} trace_block_header_t;
+
+typedef struct {
+    uint8_t type;
+    uint8_t value;          // Command, state or dropped count
+    int8_t rssi;
+    uint32_t rolling_code;
+    int64_t timestamp_us;
+} trace_raw_record_t;
+
+typedef struct {
+    uint32_t staged;        // Records staged since boot
+    uint32_t dropped;       // Records lost to a full staging ring
+    uint32_t bytes_encoded;
+    uint32_t blocks_evicted;
+} trace_stats_t;
+
+/* Function declarations */
+void trace_init(void);
+void trace_record_rx(const rx_event_t *rx);
+void trace_record_state(uint8_t state, int64_t timestamp_us);
+void trace_flush(void);
+size_t trace_serialized_size(void);
+size_t trace_read(uint8_t *out, size_t offset, size_t len);
+
+extern bool trace_capture_enabled;
+extern trace_stats_t trace_stats;
+
+#endif // TRACE_H
@@ -0,0 +1,46 @@
+#include "trace_http.h"
+#include "trace.h"
+#include "esp_log.h"
+
+static const char *TAG = "TRACE_HTTP";
+
+#define TRACE_HTTP_CHUNK 512
+
+/**
+ * @brief GET /trace: stream the serialized trace as an attachment
+ */
+static esp_err_t trace_get_handler(httpd_req_t *req) {
+    uint8_t chunk[TRACE_HTTP_CHUNK];
+    size_t offset = 0;
+    size_t len;
+
+    /* ESP-NOW is down in OTA mode, so the main loop is not encoding while this reads */
+    httpd_resp_set_type(req, "application/octet-stream");
+    httpd_resp_set_hdr(req, "Content-Disposition", "attachment; filename=\"ride.trc\"");
+
+    while ((len = trace_read(chunk, offset, sizeof(chunk))) > 0) {
+        if (httpd_resp_send_chunk(req, (const char *)chunk, len) != ESP_OK) {
+            ESP_LOGE(TAG, "Trace download aborted at %u bytes", (unsigned)offset);
+            return ESP_FAIL;
+        }
+        offset += len;
+    }
+    httpd_resp_send_chunk(req, NULL, 0);
+    ESP_LOGI(TAG, "Trace sent: %u bytes", (unsigned)offset);
+    return ESP_OK;
+}
+
+/**
+ * @brief Add GET /trace to the OTA HTTP server, if it started
+ */
+void trace_http_register(httpd_handle_t server) {
+    if (server == NULL) {
+        return;
+    }
+    httpd_uri_t trace_uri = {
+        .uri = "/trace",
+        .method = HTTP_GET,
+        .handler = trace_get_handler
+    };
+    httpd_register_uri_handler(server, &trace_uri);
+}
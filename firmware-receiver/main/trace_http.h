@@ -0,0 +1,9 @@
+#ifndef TRACE_HTTP_H
+#define TRACE_HTTP_H
+
+#include "esp_http_server.h"
+
+/* Serve the captured trace as GET /trace on the OTA HTTP server */
+void trace_http_register(httpd_handle_t server);
+
+#endif // TRACE_HTTP_H
@@ -1,48 +1,132 @@
 #include "button_handler.h"
-#include "ring_buffer.h"
 #include "driver/gpio.h"
+#include "driver/rtc_io.h"
+#include "esp_attr.h"
+#include "esp_sleep.h"
 #include "esp_timer.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "esp_log.h"
+#include <string.h>
 
 static const char *TAG = "BUTTON_HANDLER";
 
 static int64_t last_bypass_time = 0;
-static ringbuf_t bypass_rb = {0};
+static bool pressed = false;                // Confirmed level
+static bool press_tx_pending = false;       // Confirmed press still waiting for its first force open
+static int64_t press_start_us = 0;          // First edge of the confirmed press
+static esp_timer_handle_t settle_timer = NULL;
+static TaskHandle_t main_task = NULL;
+
+/* Written by the ISR; settled_edges by the main task once a level is confirmed */
+static volatile uint32_t edge_count = 0;
+static volatile uint32_t settled_edges = 0;
+static volatile int64_t last_edge_us = 0;
+static volatile int64_t burst_start_us = 0; // First edge since the last confirmed level
+
+button_stats_t button_stats = {0};
+static int64_t stats_window_start_us = 0;
+
+/* Raw button level, active low */
+static inline bool button_is_pressed(void) {
+    return gpio_get_level(INPUT_PIN) == 0;
+}
+
+static void IRAM_ATTR button_edge_isr(void *arg) {
+    (void)arg;
+    int64_t now = esp_timer_get_time();
+    if (edge_count == settled_edges) {
+        burst_start_us = now;
+    }
+    last_edge_us = now;
+    edge_count++;
+    BaseType_t woken = pdFALSE;
+    xTaskNotifyFromISR(main_task, BUTTON_WAKE_BIT, eSetBits, &woken);
+    portYIELD_FROM_ISR(woken);
+}
+
+static void settle_timer_cb(void *arg) {
+    (void)arg;
+    xTaskNotify(main_task, BUTTON_WAKE_BIT, eSetBits);
+}
 
 /* --------------------------------------------------------------------------
  * Button handler initialization
  * -------------------------------------------------------------------------- */
 void button_handler_init(void) {
+    main_task = xTaskGetCurrentTaskHandle();
+
     /* GPIO setup for bypass switch */
     gpio_config_t io_conf = {
         .pin_bit_mask = (1ULL << INPUT_PIN),
         .mode         = GPIO_MODE_INPUT,
         .pull_up_en   = GPIO_PULLUP_ENABLE,
         .pull_down_en = GPIO_PULLDOWN_DISABLE,
-        .intr_type    = GPIO_INTR_DISABLE
+        .intr_type    = GPIO_INTR_ANYEDGE
     };
     gpio_config(&io_conf);
 
-    /* Fill ring buffer initially */
-    for (int i = 0; i < WINDOW_SIZE; i++) {
-        bool sample = (gpio_get_level(INPUT_PIN) == 0); // Active low
-        ringbuf_add_sample(&bypass_rb, sample);
-        vTaskDelay(pdMS_TO_TICKS(1));
+    const esp_timer_create_args_t args = {
+        .callback = settle_timer_cb,
+        .dispatch_method = ESP_TIMER_TASK,
+        .name = "button",
+    };
+    if (esp_timer_create(&args, &settle_timer) != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to create settle timer");
+        settle_timer = NULL;
     }
 
+    /* Start from the current level; a button held at boot counts from now */
+    edge_count = 0;
+    settled_edges = 0;
+    pressed = button_is_pressed();
+    press_tx_pending = false;
+    memset(&button_stats, 0, sizeof(button_stats));
+    stats_window_start_us = esp_timer_get_time();
+
+    /* Woken from deep sleep by a press: it started before the app did */
+    if (pressed && esp_sleep_get_wakeup_cause() == ESP_SLEEP_WAKEUP_EXT0) {
+        button_stats.presses++;
+        press_start_us = 0;
+        press_tx_pending = true;
+    }
+
+    gpio_install_isr_service(0);
+    gpio_isr_handler_add(INPUT_PIN, button_edge_isr, NULL);
+
     last_bypass_time = esp_timer_get_time();
     ESP_LOGI(TAG, "Button handler initialized");
 }
 
 /* --------------------------------------------------------------------------
  * Update button state and check for bypass condition
+ * Runs whenever the main task wakes: after an edge it waits for the pin to
+ * go quiet, re-arming the settle timer, then takes the pin's level.
  * -------------------------------------------------------------------------- */
 void button_handler_update(void) {
-    ringbuf_add_sample(&bypass_rb, (gpio_get_level(INPUT_PIN) == 0)); // Active low
-    
-    if (!ringbuf_is_majority_high(&bypass_rb)) {
+    uint32_t edges = edge_count;
+    if (edges != settled_edges) {
+        int64_t quiet_us = esp_timer_get_time() - last_edge_us;
+        if (quiet_us < BUTTON_SETTLE_US) {
+            if (settle_timer != NULL) {
+                esp_timer_stop(settle_timer);   // ESP_ERR_INVALID_STATE when not armed
+                esp_timer_start_once(settle_timer, (uint64_t)(BUTTON_SETTLE_US - quiet_us));
+            }
+        } else {
+            int64_t start_us = burst_start_us;
+            button_stats.edges += edges - settled_edges;
+            settled_edges = edges;
+            bool level = button_is_pressed();
+            if (level && !pressed) {
+                button_stats.presses++;
+                press_start_us = start_us;
+                press_tx_pending = true;
+            }
+            pressed = level;
+        }
+    }
+
+    if (!pressed) {
         last_bypass_time = esp_timer_get_time();
     }
 }
@@ -53,6 +137,91 @@ void button_handler_update(void) {
 bool button_handler_is_bypass_active(void) {
     int64_t current_time = esp_timer_get_time();
     
-    return ringbuf_is_majority_high(&bypass_rb) && 
+    return pressed && 
            (current_time - last_bypass_time) < BYPASS_TIMEOUT_US;
-}
\ No newline at end of file
+}
+
+bool button_handler_is_pressed(void) {
+    return pressed;
+}
+
+/**
+ * @brief Check if an edge is waiting for the pin to settle
+ */
+bool button_handler_is_settling(void) {
+    return edge_count != settled_edges;
+}
+
+/**
+ * @brief Make the next change of the button level wake the chip
+ * Light sleep only wakes on a GPIO level, so the edge interrupt is masked and
+ * the pin wakes on the level opposite the confirmed one. Deep sleep wakes on
+ * a press through the RTC domain, which has its own pull-up.
+ */
+void button_handler_prepare_sleep(bool deep) {
+    if (deep) {
+        rtc_gpio_pullup_en(INPUT_PIN);
+        rtc_gpio_pulldown_dis(INPUT_PIN);
+        esp_sleep_enable_ext0_wakeup(INPUT_PIN, 0);
+        return;
+    }
+    gpio_intr_disable(INPUT_PIN);
+    gpio_wakeup_enable(INPUT_PIN, pressed ? GPIO_INTR_HIGH_LEVEL : GPIO_INTR_LOW_LEVEL);
+    esp_sleep_enable_gpio_wakeup();
+}
+
+/**
+ * @brief Back to edge interrupts after a light sleep
+ * A level change while asleep counts as an edge at wake-up, so it settles
+ * like any other.
+ */
+void button_handler_after_sleep(void) {
+    gpio_wakeup_disable(INPUT_PIN);
+    gpio_set_intr_type(INPUT_PIN, GPIO_INTR_ANYEDGE);
+    if (button_is_pressed() != pressed && edge_count == settled_edges) {
+        int64_t now = esp_timer_get_time();
+        burst_start_us = now;
+        last_edge_us = now;
+        edge_count++;
+    }
+    gpio_intr_enable(INPUT_PIN);
+}
+
+/**
+ * @brief Record press-to-TX latency, called after each force open is sent
+ */
+void button_handler_on_force_open_sent(void) {
+    if (!press_tx_pending) {
+        return;
+    }
+    press_tx_pending = false;
+    int64_t latency_us = esp_timer_get_time() - press_start_us;
+    uint32_t bucket = 0;
+    while (bucket < PRESS_LATENCY_BUCKETS - 1 && latency_us >= (1000LL << bucket)) {
+        bucket++;
+    }
+    button_stats.latency_hist[bucket]++;
+    if (latency_us > button_stats.latency_max_us) {
+        button_stats.latency_max_us = latency_us;
+    }
+}
+
+/**
+ * @brief Log the press-to-TX histogram once per BUTTON_STATS_PERIOD_US, if the button was used
+ */
+void button_handler_report_stats(void) {
+    int64_t now = esp_timer_get_time();
+    if (now - stats_window_start_us < BUTTON_STATS_PERIOD_US) {
+        return;
+    }
+    stats_window_start_us = now;
+    if (button_stats.presses == 0) {
+        return;
+    }
+    const uint32_t *h = button_stats.latency_hist;
+    ESP_LOGI(TAG, "presses %lu, edges %lu, press to TX <1 ms %lu, <2 %lu, <4 %lu, <8 %lu, <16 %lu, <32 %lu, "
+             "<64 %lu, >=64 %lu, max %lld us",
+             button_stats.presses, button_stats.edges, h[0], h[1], h[2], h[3], h[4], h[5], h[6], h[7],
+             button_stats.latency_max_us);
+    memset(&button_stats, 0, sizeof(button_stats));
+}
@@ -1,14 +1,45 @@
 #ifndef BUTTON_HANDLER_H
 #define BUTTON_HANDLER_H
 
+#include <stdint.h>
 #include <stdbool.h>
 
 #define INPUT_PIN 4  // GPIO pin for bypass button
-#define BYPASS_TIMEOUT_US 5000000ULL  // If bypass button held for 5s, ignore since using high beam from bike
+#define BYPASS_TIMEOUT_US 5000000LL   // If bypass button held for 5s, ignore since using high beam from bike
+
+/* --------------------------------------------------------------------------
+ * Bypass button
+ * Any edge on INPUT_PIN interrupts and wakes the main task, which arms a
+ * one-shot esp_timer; the new level is confirmed once the pin has had no
+ * edge for BUTTON_SETTLE_US, so contact bounce never reaches the state
+ * machine and a press goes on the air as soon as it is confirmed.
+ * -------------------------------------------------------------------------- */
+
+#define BUTTON_SETTLE_US        5000LL      // Quiet time after the last edge before a level counts
+#define BUTTON_WAKE_BIT         (1UL << 1)  // Main task notification bit set by the ISR and settle timer
+
+/* Press to first force open on the air, from the first edge of the press */
+#define PRESS_LATENCY_BUCKETS   8           // <1, <2, <4, <8, <16, <32, <64, >=64 ms
+#define BUTTON_STATS_PERIOD_US  60000000LL  // 1 minute
+
+typedef struct {
+    uint32_t edges;                 // Interrupts, bounce included
+    uint32_t presses;               // Confirmed presses
+    uint32_t latency_hist[PRESS_LATENCY_BUCKETS];
+    int64_t latency_max_us;
+} button_stats_t;
 
 /* Function declarations */
 void button_handler_init(void);
 bool button_handler_is_bypass_active(void);
 void button_handler_update(void);
+bool button_handler_is_pressed(void);
+bool button_handler_is_settling(void);
+void button_handler_prepare_sleep(bool deep);
+void button_handler_after_sleep(void);
+void button_handler_on_force_open_sent(void);
+void button_handler_report_stats(void);
+
+extern button_stats_t button_stats;
 
-#endif // BUTTON_HANDLER_H
\ No newline at end of file
+#endif // BUTTON_HANDLER_H
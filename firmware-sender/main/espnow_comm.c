@@ -1,5 +1,10 @@
 #include "espnow_comm.h"
+#include "tx_scheduler.h"
+#include "power_account.h"
+#include "espnow_ota.h"
+#include "ota_xfer.h"
 #include "esp_log.h"
+#include "esp_timer.h"
 #include <string.h>
 
 
@@ -17,9 +22,11 @@ static void (*link_detected_callback)(void) = NULL;
 
 /* --------------------------------------------------------------------------
  * ESP-NOW send callback
- * Used ONLY as a heuristic for link presence
+ * Used ONLY as a heuristic for link presence, and to pace the pings
  * -------------------------------------------------------------------------- */
 void espnow_send_cb(const uint8_t *mac_addr, esp_now_send_status_t status) {
+    power_account_on_tx(status == ESP_NOW_SEND_SUCCESS);
+    tx_scheduler_on_send_done(status == ESP_NOW_SEND_SUCCESS);
     if (status == ESP_NOW_SEND_SUCCESS && link_detected_callback) {
         link_detected_callback();
     }
@@ -28,6 +35,21 @@ void espnow_send_cb(const uint8_t *mac_addr, esp_now_send_status_t status) {
 void receive_cb(const esp_now_recv_info_t *recv_info,
                 const uint8_t *data,
                 int len) {
+    if (ota_xfer_is_packet(data, len)) {
+        if (memcmp(recv_info->src_addr, receiver_mac, 6) == 0) {
+            espnow_ota_on_packet(data, len);
+        }
+        return;
+    }
+    /* Replies come from the receiver only; they end force open bursts and pace pings */
+    if (len == sizeof(espnow_reply_t)) {
+        const espnow_reply_t *reply = (const espnow_reply_t *)data;
+        if (reply->version == FIRMWARE_VERSION && memcmp(recv_info->src_addr, receiver_mac, 6) == 0) {
+            tx_scheduler_on_reply(reply->rolling_code, reply->command, reply->gate_state, reply->rssi,
+                                  recv_info->rx_ctrl->rssi);
+        }
+        return;
+    }
     if (len != sizeof(espnow_data_t)) {
         ESP_LOGW(TAG, "Invalid packet size: %d", len);
         return;
@@ -37,8 +59,8 @@ void receive_cb(const esp_now_recv_info_t *recv_info,
                  ((espnow_data_t *)data)->version);
         return;
     }
-    int64_t time = esp_get_time();
-    if (((espnow_data_t *)data)->command == 2) { // Sender OTA request
+    int64_t time = esp_timer_get_time();
+    if (((espnow_data_t *)data)->command == CMD_SENDER_OTA) { // Sender OTA request
         // Multi sample OTA button state to avoid false triggers
         if (time - last_ota_command_time > 5000000LL) { // max 5 seconds between commands to count as one OTA request
             last_ota_command_time = time;
@@ -60,32 +82,48 @@ void receive_cb(const esp_now_recv_info_t *recv_info,
  * Initialize ESP-NOW communication
  * -------------------------------------------------------------------------- */
 void espnow_init_communication(void) {
-    /* ESP-NOW setup */
+    espnow_attach();
+    ESP_LOGI(TAG, "ESP-NOW communication initialized");
+}
+
+/* --------------------------------------------------------------------------
+ * Start ESP-NOW with our callbacks and the receiver as peer
+ * Also after OTA mode, whose esp_now_deinit() dropped all of them
+ * -------------------------------------------------------------------------- */
+void espnow_attach(void) {
     esp_now_init();
     esp_now_register_send_cb(espnow_send_cb);
+    esp_now_register_recv_cb(receive_cb);
 
     esp_now_peer_info_t peer = {0};
     memcpy(peer.peer_addr, receiver_mac, 6);
     peer.channel = 1;
     peer.encrypt = false;   // Enable later with proper keys
     esp_now_add_peer(&peer);
-
-    ESP_LOGI(TAG, "ESP-NOW communication initialized");
 }
 
 /* --------------------------------------------------------------------------
  * Packet transmission
  * -------------------------------------------------------------------------- */
-void espnow_send_packet(uint8_t command, uint32_t rolling_code) {
+void espnow_send_packet(uint8_t command, uint32_t rolling_code, int8_t reply_rssi) {
     espnow_data_t pkt = {
         .version      = FIRMWARE_VERSION,
         .rolling_code = rolling_code,
-        .command      = command
+        .command      = command,
+        .reply_rssi   = reply_rssi
     };
 
     esp_now_send(receiver_mac, (uint8_t *)&pkt, sizeof(pkt));
 }
 
+/**
+ * @brief Send a firmware transfer packet to the receiver
+ * @return false if ESP-NOW did not take it
+ */
+bool espnow_send_to_receiver(const void *pkt, size_t len) {
+    return esp_now_send(receiver_mac, pkt, len) == ESP_OK;
+}
+
 /* --------------------------------------------------------------------------
  * Set callback for link detection
  * -------------------------------------------------------------------------- */
@@ -2,9 +2,16 @@
 #define ESPNOW_COMM_H
 
 #include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
 #include "esp_now.h"
 
-#define FIRMWARE_VERSION 1
+#define FIRMWARE_VERSION 2      // Protocol version: 2 adds reply_rssi
+
+/* Command definitions */
+#define CMD_PING       0
+#define CMD_FORCE_OPEN 1
+#define CMD_SENDER_OTA 2     // From the receiver: listen for a firmware offer
 
 /* --------------------------------------------------------------------------
  * Packet format sent over ESP-NOW
@@ -13,20 +20,35 @@
 typedef struct __attribute__((packed)) {
     uint8_t version;
     uint32_t rolling_code;   // Monotonic counter for replay protection
-    uint8_t  command;        // 0 = ping, 1 = bypass / force open
+    uint8_t  command;        // 0 = ping, 1 = bypass / force open, 2 = sender OTA request from the receiver
+    int8_t   reply_rssi;     // RSSI measured on the reply to the previous packet, ESPNOW_RSSI_NONE if none
 } espnow_data_t;
 
-// Packet received from sender to trigger OTA update mode
+#define ESPNOW_RSSI_NONE 0
+
+/* Gate state in receiver replies */
+#define GATE_CLOSED    0
+#define GATE_MOVING    1        // Receiver is driving the gate
+#define GATE_OPEN      2
+#define GATE_UNKNOWN   0xFF     // No reply since the link came up
+
+/* Receiver reply to a packet it accepted */
 typedef struct __attribute__((packed)) {
-    uint8_t command;
-} receiver_send_packet_t;
+    uint8_t version;
+    uint32_t rolling_code;   // Code of the packet being answered
+    uint8_t  command;        // Its command
+    uint8_t  gate_state;     // GATE_CLOSED, GATE_MOVING or GATE_OPEN
+    int8_t   rssi;           // RSSI the receiver measured on it, dBm
+} espnow_reply_t;
 
 /* Variables */
 extern bool ota_update_mode;
 
 /* Function declarations */
 void espnow_init_communication(void);
-void espnow_send_packet(uint8_t command, uint32_t rolling_code);
+void espnow_attach(void);
+void espnow_send_packet(uint8_t command, uint32_t rolling_code, int8_t reply_rssi);
+bool espnow_send_to_receiver(const void *pkt, size_t len);
 void espnow_send_cb(const uint8_t *mac_addr, esp_now_send_status_t status);
 void espnow_set_link_detected_callback(void (*callback)(void));
 
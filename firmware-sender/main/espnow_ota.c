@@ -0,0 +1,201 @@
+#include "espnow_ota.h"
+#include "espnow_comm.h"
+#include "ota_xfer.h"
+#include "ota_signature.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_system.h"
+#include "esp_ota_ops.h"
+#include "esp_app_desc.h"
+#include "esp_app_format.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include <string.h>
+
+static const char *TAG = "ESPNOW_OTA";
+
+/* Image header and first segment header come before the app description */
+#define APP_DESC_OFFSET (sizeof(esp_image_header_t) + sizeof(esp_image_segment_header_t))
+
+typedef struct {
+    uint8_t len;
+    uint8_t data[sizeof(ota_xfer_data_t)];
+} espnow_ota_frame_t;
+
+static QueueHandle_t frame_queue = NULL;
+static volatile bool listening = false;
+
+static ota_xfer_rx_t xfer;
+static const esp_partition_t *update_partition = NULL;
+static esp_ota_handle_t update_handle = 0;
+
+/* Start of the image, checked once the app description is in */
+static uint8_t image_head[APP_DESC_OFFSET + sizeof(esp_app_desc_t)];
+static uint32_t image_head_len = 0;
+
+static bool ota_send(void *ctx, const void *pkt, size_t len) {
+    return espnow_send_to_receiver(pkt, len);
+}
+
+static void ota_abort(void) {
+    if (update_handle != 0) {
+        esp_ota_abort(update_handle);
+        update_handle = 0;
+    }
+}
+
+/**
+ * @brief Offer answered: erase the spare partition for the image
+ * A second offer of another image starts over.
+ */
+static bool ota_begin(void *ctx, uint32_t image_size) {
+    ota_abort();
+    update_partition = esp_ota_get_next_update_partition(NULL);
+    if (update_partition == NULL || image_size > update_partition->size) {
+        ESP_LOGE(TAG, "No room for a %lu byte image", (unsigned long)image_size);
+        return false;
+    }
+    if (esp_ota_begin(update_partition, image_size, &update_handle) != ESP_OK) {
+        update_handle = 0;
+        ESP_LOGE(TAG, "esp_ota_begin failed");
+        return false;
+    }
+    image_head_len = 0;
+    ESP_LOGI(TAG, "Receiving %lu bytes into %s", (unsigned long)image_size, update_partition->label);
+    return true;
+}
+
+/**
+ * @brief Write image bytes in order, refusing an image built for another project
+ * The receiver keeps both firmwares in its partitions, so a wrong pick is easy.
+ */
+static bool ota_write(void *ctx, const uint8_t *data, size_t len) {
+    if (image_head_len < sizeof(image_head)) {
+        size_t n = sizeof(image_head) - image_head_len < len ? sizeof(image_head) - image_head_len : len;
+        memcpy(image_head + image_head_len, data, n);
+        image_head_len += n;
+        if (image_head_len == sizeof(image_head)) {
+            const esp_app_desc_t *desc = (const esp_app_desc_t *)(image_head + APP_DESC_OFFSET);
+            const esp_app_desc_t *running = esp_app_get_description();
+            if (desc->magic_word != ESP_APP_DESC_MAGIC_WORD ||
+                strncmp(desc->project_name, running->project_name, sizeof(desc->project_name)) != 0) {
+                ESP_LOGE(TAG, "Image is not sender firmware (%.32s)", desc->project_name);
+                return false;
+            }
+            ESP_LOGI(TAG, "Image is %s %s", desc->project_name, desc->version);
+        }
+    }
+    return esp_ota_write(update_handle, data, len) == ESP_OK;
+}
+
+/**
+ * @brief Install the received image and reboot into it
+ * The SHA-256 matched the offer, but anyone can offer; with a signing key
+ * built in, only an image signed with the release key is installed, as
+ * for an upload over HTTP.
+ * @return false if unsigned, badly signed or esp_ota_end rejected it
+ */
+static bool ota_install(void) {
+    if (ota_signature_required()) {
+        if (xfer.sig_len == 0 || ota_signature_verify(xfer.sha256, xfer.sig, xfer.sig_len) != ESP_OK) {
+            ESP_LOGE(TAG, "Image refused: %s", xfer.sig_len == 0 ? "not signed" : "bad signature");
+            ota_abort();
+            return false;
+        }
+        ESP_LOGI(TAG, "Signature verified");
+    } else if (xfer.sig_len > 0) {
+        ESP_LOGW(TAG, "No signing key built in, signature not checked");
+    }
+
+    esp_err_t err = esp_ota_end(update_handle);
+    update_handle = 0;
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Image validation failed: %s", esp_err_to_name(err));
+        return false;
+    }
+    if (esp_ota_set_boot_partition(update_partition) != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to set the boot partition");
+        return false;
+    }
+    ESP_LOGI(TAG, "Update received, rebooting...");
+    esp_restart();
+    return true;
+}
+
+bool espnow_ota_receive(void) {
+    if (frame_queue == NULL) {
+        frame_queue = xQueueCreate(ESPNOW_OTA_QUEUE_LEN, sizeof(espnow_ota_frame_t));
+        if (frame_queue == NULL) {
+            ESP_LOGE(TAG, "Failed to create the packet queue");
+            return false;
+        }
+    }
+    xQueueReset(frame_queue);
+    ota_xfer_rx_init(&xfer, ota_begin, ota_write, ota_send, NULL);
+    listening = true;
+    ESP_LOGI(TAG, "Waiting for the receiver's firmware offer");
+
+    int64_t start_us = esp_timer_get_time();
+    int64_t progress_us = start_us;
+    int64_t finished_us = 0;
+    uint32_t progress_next = 0;
+    while (1) {
+        int64_t now = esp_timer_get_time();
+        int64_t wait_us = ota_xfer_rx_deadline(&xfer) - now;
+        if (wait_us > OTA_XFER_OFFER_US) {
+            wait_us = OTA_XFER_OFFER_US;
+        }
+        espnow_ota_frame_t frame;
+        TickType_t ticks = wait_us > 0 ? pdMS_TO_TICKS((wait_us + 999) / 1000) : 0;
+        if (xQueueReceive(frame_queue, &frame, ticks) == pdTRUE) {
+            ota_xfer_rx_feed(&xfer, frame.data, frame.len, esp_timer_get_time());
+        }
+        now = esp_timer_get_time();
+        ota_xfer_rx_poll(&xfer, now);
+
+        if (!xfer.active) {
+            if (now - start_us > ESPNOW_OTA_OFFER_WAIT_US) {
+                ESP_LOGW(TAG, "No firmware offer from the receiver");
+                break;
+            }
+            continue;
+        }
+        if (xfer.status == OTA_XFER_STATUS_RECEIVING) {
+            if (xfer.next != progress_next) {
+                progress_next = xfer.next;
+                progress_us = now;
+            } else if (now - progress_us > OTA_XFER_GIVE_UP_US) {
+                ESP_LOGW(TAG, "Transfer stalled at chunk %lu of %lu", (unsigned long)xfer.next,
+                         (unsigned long)xfer.chunks);
+                break;
+            }
+            continue;
+        }
+        if (finished_us == 0) {
+            finished_us = now;
+            ESP_LOGI(TAG, "%lu chunks taken for %lu (%lu out of order, %lu duplicates), %lu acks",
+                     (unsigned long)xfer.stats.chunks, (unsigned long)xfer.chunks,
+                     (unsigned long)xfer.stats.out_of_order, (unsigned long)xfer.stats.duplicates,
+                     (unsigned long)xfer.stats.acks);
+        }
+        if (now - finished_us > ESPNOW_OTA_LINGER_US) {
+            if (xfer.status == OTA_XFER_STATUS_COMPLETE && ota_install()) {
+                return true;
+            }
+            ESP_LOGE(TAG, "Transfer failed");
+            break;
+        }
+    }
+    listening = false;
+    ota_abort();
+    return false;
+}
+
+void espnow_ota_on_packet(const uint8_t *data, int len) {
+    if (!listening || len <= 0 || len > (int)sizeof(ota_xfer_data_t)) {
+        return;
+    }
+    espnow_ota_frame_t frame = {.len = (uint8_t)len};
+    memcpy(frame.data, data, len);
+    xQueueSend(frame_queue, &frame, 0);     // Dropped when full; the receiver resends
+}
@@ -0,0 +1,24 @@
+#ifndef ESPNOW_OTA_H
+#define ESPNOW_OTA_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/* --------------------------------------------------------------------------
+ * Firmware update over ESP-NOW
+ * After the receiver's OTA request, the sender waits for its offer and
+ * writes the image it sends (ota_xfer.h) to the spare OTA partition,
+ * without bringing up the soft-AP.
+ * -------------------------------------------------------------------------- */
+
+#define ESPNOW_OTA_QUEUE_LEN    16              // Packets receive_cb can hand over while a chunk is written
+#define ESPNOW_OTA_OFFER_WAIT_US 10000000LL     // Give up if no offer comes
+#define ESPNOW_OTA_LINGER_US    1000000LL       // Keep answering after the last chunk, in case the final ack was lost
+
+/* Receive an image and reboot into it; returns false if none came or it failed */
+bool espnow_ota_receive(void);
+
+/* From receive_cb, Wi-Fi task: a transfer packet from the receiver */
+void espnow_ota_on_packet(const uint8_t *data, int len);
+
+#endif // ESPNOW_OTA_H
@@ -1,19 +1,39 @@
+#include <string.h>
+
 #include "esp_wifi.h"
 #include "esp_event.h"
 #include "nvs_flash.h"
 #include "esp_log.h"
 #include "esp_ota_ops.h"
+#include "esp_timer.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 
 /* Module includes */
 #include "espnow_comm.h"
+#include "espnow_ota.h"
 #include "state_machine.h"
 #include "rolling_code.h"
 #include "button_handler.h"
+#include "tx_scheduler.h"
+#include "power_manager.h"
+#include "power_account.h"
+
+#define LOOP_STATS_PERIOD_US 60000000LL     // 1 minute
 
 static const char *TAG = "MAIN";
-int64_t ota_auto_exit_timer = 0; // Time when OTA update mode should auto-exit if no activity
+
+/* Main loop timing over the current statistics window */
+typedef struct {
+    uint32_t passes;
+    int64_t busy_sum_us;            // Time spent in a pass, excluding the wait
+    int64_t busy_max_us;
+    int64_t gap_max_us;             // Longest time between two passes
+    int64_t last_pass_us;
+    int64_t window_start_us;
+} loop_stats_t;
+
+static loop_stats_t loop_stats = {0};
 
 // sender device mac address: 3c:8a:1f:0c:18:00
 // receiver device mac address: 3c:8a:1f:0b:e3:d8
@@ -36,10 +56,45 @@ static void system_init(void) {
     ESP_LOGI(TAG, "System initialization complete");
 }
 
+/* --------------------------------------------------------------------------
+ * Main loop instrumentation
+ * -------------------------------------------------------------------------- */
+static void record_loop_pass(int64_t start_us, int64_t end_us) {
+    if (loop_stats.last_pass_us != 0 && start_us - loop_stats.last_pass_us > loop_stats.gap_max_us) {
+        loop_stats.gap_max_us = start_us - loop_stats.last_pass_us;
+    }
+    loop_stats.last_pass_us = start_us;
+    loop_stats.passes++;
+    loop_stats.busy_sum_us += end_us - start_us;
+    if (end_us - start_us > loop_stats.busy_max_us) {
+        loop_stats.busy_max_us = end_us - start_us;
+    }
+}
+
+/**
+ * @brief Log how long the main loop stalls, once per LOOP_STATS_PERIOD_US
+ */
+static void report_loop_stats(void) {
+    int64_t now = esp_timer_get_time();
+    if (now - loop_stats.window_start_us < LOOP_STATS_PERIOD_US) {
+        return;
+    }
+    ESP_LOGI(TAG, "loop passes %lu, busy avg %lld us max %lld us, longest gap between passes %lld us",
+             loop_stats.passes, loop_stats.passes ? loop_stats.busy_sum_us / loop_stats.passes : 0,
+             loop_stats.busy_max_us, loop_stats.gap_max_us);
+    int64_t last_pass_us = loop_stats.last_pass_us;
+    memset(&loop_stats, 0, sizeof(loop_stats));
+    loop_stats.last_pass_us = last_pass_us;
+    loop_stats.window_start_us = now;
+}
+
 /* --------------------------------------------------------------------------
  * Main application
  * -------------------------------------------------------------------------- */
 void app_main(void) {
+    /* Before anything that depends on whether this is a wake-up from deep sleep */
+    power_manager_init(POWER_MODE_DEFAULT);
+
     /* System initialization */
     system_init();
 
@@ -67,10 +122,12 @@ void app_main(void) {
     }
 
     /* Initialize all modules */
-    int32_t rolling_code = rolling_code_init();
+    rolling_code_init();
     espnow_init_communication();
     button_handler_init();
     state_machine_init();
+    tx_scheduler_init();
+    loop_stats.window_start_us = esp_timer_get_time();
 
     /* Set up ESP-NOW link detection callback */
     espnow_set_link_detected_callback(state_machine_on_link_detected);
@@ -79,41 +136,44 @@ void app_main(void) {
 
     /* Main application loop */
     while (1) {
-        /* Update button state */
+        int64_t pass_start_us = esp_timer_get_time();
+
+        /* Confirm a button level once its edges have settled */
         button_handler_update();
 
-        /* Handle state transitions based on button */
+        /* Handle state transitions based on button; link detection moves idle to detects */
         if (button_handler_is_bypass_active()) {
             state_machine_set_state(STATE_BYPASS);
         } else {
-            if (state_machine_get_current_state() != STATE_IDLE) {
+            if (state_machine_get_current_state() == STATE_BYPASS) {
                 state_machine_set_state(STATE_IDLE);
             }
         }
 
-        /* Periodic rolling code save to reduce NVS wear */
-        rolling_code_periodic_save(rolling_code);
+        /* Periodic rolling code save to reduce NVS wear, unless journaled */
+        rolling_code_periodic_save();
 
         /* Run the state machine */
         state_machine_run();
         
         if (ota_update_mode) {
             ESP_LOGI(TAG, "Entering OTA update mode...");
-            ota_setup();
+            /* Reboots on success; without an offer from the receiver, fall back to the upload page */
+            if (!espnow_ota_receive()) {
+                ota_setup();
+            }
             // The device will reboot after OTA, so we can break the loop here
             break;
-            if (ota_auto_exit_timer == 0) {
-                ota_auto_exit_timer = esp_get_time() + 300000000LL; // Auto exit after 5 minutes
-            } else if (esp_get_time() > ota_auto_exit_timer) {
-                ESP_LOGI(TAG, "Exiting OTA update mode due to inactivity...");
-                ota_teardown();
-                ota_update_mode = false;
-                ota_auto_exit_timer = 0;
-            }
         }
         
 
-        /* Small delay for the main loop */
-        vTaskDelay(pdMS_TO_TICKS(5));
+        record_loop_pass(pass_start_us, esp_timer_get_time());
+        tx_scheduler_report_stats();
+        button_handler_report_stats();
+        power_account_report();
+        report_loop_stats();
+
+        /* Sleep until a button edge, the settle timer or the TX timer */
+        power_manager_wait();
     }
 }
@@ -0,0 +1,104 @@
+#include "power_account.h"
+#include "esp_attr.h"
+#include "esp_timer.h"
+#include "esp_log.h"
+#include <string.h>
+
+static const char *TAG = "POWER";
+
+/* Current report window, kept across deep sleep */
+static RTC_DATA_ATTR power_account_t account;
+
+static int64_t awake_since_us = 0;
+
+/**
+ * @brief Start accounting at boot
+ * A cold boot starts a new window; after a deep sleep the window carries on
+ * and the boot itself is counted.
+ */
+void power_account_init(bool woke_from_deep_sleep) {
+    if (woke_from_deep_sleep) {
+        account.boots++;
+    } else {
+        memset(&account, 0, sizeof(account));
+    }
+    awake_since_us = esp_timer_get_time();
+}
+
+/**
+ * @brief Count one send, from the ESP-NOW send callback
+ * An unacknowledged frame went out once per MAC retry.
+ */
+void power_account_on_tx(bool acked) {
+    account.tx_count++;
+    if (acked) {
+        account.airtime_us += POWER_FRAME_AIRTIME_US;
+    } else {
+        account.tx_unacked++;
+        account.airtime_us += POWER_FRAME_AIRTIME_US * POWER_TX_ATTEMPTS_UNACKED;
+    }
+}
+
+void power_account_sleep_start(void) {
+    account.awake_us += esp_timer_get_time() - awake_since_us;
+}
+
+/**
+ * @brief Count a sleep; a deep sleep is counted before it starts, with its timer duration
+ */
+void power_account_sleep_end(int64_t slept_us, bool deep) {
+    if (deep) {
+        account.deep_sleep_us += slept_us;
+    } else {
+        account.light_sleep_us += slept_us;
+        account.light_sleeps++;
+    }
+    awake_since_us = esp_timer_get_time();
+}
+
+/**
+ * @brief Copy of the current window, awake time counted up to now
+ */
+void power_account_snapshot(power_account_t *out) {
+    *out = account;
+    out->awake_us += esp_timer_get_time() - awake_since_us;
+}
+
+static int64_t window_us(const power_account_t *a) {
+    return a->awake_us + a->light_sleep_us + a->deep_sleep_us + a->boots * POWER_BOOT_US;
+}
+
+/**
+ * @brief Average supply current over the window from the current profile
+ */
+uint32_t power_account_average_ua(const power_account_t *a) {
+    int64_t total_us = window_us(a);
+    if (total_us <= 0) {
+        return 0;
+    }
+    int64_t charge = a->awake_us * POWER_AWAKE_UA +
+                     a->airtime_us * (POWER_TX_UA - POWER_AWAKE_UA) +
+                     a->light_sleep_us * POWER_LIGHT_SLEEP_UA +
+                     a->deep_sleep_us * POWER_DEEP_SLEEP_UA +
+                     a->boots * POWER_BOOT_US * POWER_BOOT_UA;
+    return (uint32_t)(charge / total_us);
+}
+
+/**
+ * @brief Log the window once it spans POWER_REPORT_PERIOD_US, then start a new one
+ */
+void power_account_report(void) {
+    power_account_t a;
+    power_account_snapshot(&a);
+    int64_t total_us = window_us(&a);
+    if (total_us < POWER_REPORT_PERIOD_US) {
+        return;
+    }
+    ESP_LOGI(TAG, "over %lld s: awake %lld ms (%lld.%02lld%%), tx %lu (%lu unacked), airtime %lld ms, "
+             "light sleeps %lu, boots %lu, average %lu uA",
+             total_us / 1000000, a.awake_us / 1000, a.awake_us * 100 / total_us,
+             a.awake_us * 10000 / total_us % 100, a.tx_count, a.tx_unacked, a.airtime_us / 1000,
+             a.light_sleeps, a.boots, power_account_average_ua(&a));
+    memset(&account, 0, sizeof(account));
+    awake_since_us = esp_timer_get_time();
+}
@@ -0,0 +1,49 @@
+#ifndef POWER_ACCOUNT_H
+#define POWER_ACCOUNT_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/* --------------------------------------------------------------------------
+ * Power accounting
+ * Splits time into awake, light sleep, deep sleep and boots, counts sends and
+ * their airtime, and turns that into an average current from the typical
+ * ESP32 figures below. The totals live in RTC memory so an hour spans deep
+ * sleeps; the estimate is for comparing power profiles, not battery life.
+ * -------------------------------------------------------------------------- */
+
+#define POWER_AWAKE_UA          100000      // CPU at 160 MHz with the radio listening
+#define POWER_TX_UA             240000      // 802.11b 1 Mbps transmit at 19.5 dBm
+#define POWER_LIGHT_SLEEP_UA    800
+#define POWER_DEEP_SLEEP_UA     10          // RTC timer and RTC memory
+#define POWER_BOOT_UA           50000       // ROM and bootloader after a deep sleep, radio off
+#define POWER_BOOT_US           120000LL    // Not seen by esp_timer, which restarts with the app
+
+/* One ESP-NOW frame at 1 Mbps with long preamble: 192 us PLCP + 49 bytes
+ * (MAC header, vendor action element, 7-byte payload, FCS), then the ACK */
+#define POWER_FRAME_AIRTIME_US  592
+#define POWER_TX_ATTEMPTS_UNACKED 8         // MAC retries before the send callback reports failure
+
+#define POWER_REPORT_PERIOD_US  3600000000LL // 1 hour
+
+typedef struct {
+    int64_t awake_us;
+    int64_t light_sleep_us;
+    int64_t deep_sleep_us;
+    uint32_t light_sleeps;
+    uint32_t boots;                 // Wake-ups from deep sleep
+    uint32_t tx_count;
+    uint32_t tx_unacked;
+    int64_t airtime_us;             // Estimated time on air, retries included
+} power_account_t;
+
+/* Function declarations */
+void power_account_init(bool woke_from_deep_sleep);
+void power_account_on_tx(bool acked);
+void power_account_sleep_start(void);
+void power_account_sleep_end(int64_t slept_us, bool deep);
+void power_account_snapshot(power_account_t *out);
+uint32_t power_account_average_ua(const power_account_t *account);
+void power_account_report(void);
+
+#endif // POWER_ACCOUNT_H
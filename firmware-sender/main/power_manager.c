@@ -0,0 +1,117 @@
+#include "power_manager.h"
+#include "power_account.h"
+#include "button_handler.h"
+#include "state_machine.h"
+#include "tx_scheduler.h"
+#include "rolling_code.h"
+#include "esp_attr.h"
+#include "esp_sleep.h"
+#include "esp_system.h"
+#include "esp_timer.h"
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+static const char *TAG = "POWER";
+
+static power_mode_t power_mode = POWER_MODE_DEFAULT;
+static bool woke_from_deep_sleep = false;
+
+/* Set while pinging from deep sleep, kept across it */
+static RTC_DATA_ATTR bool dormant = false;
+
+/**
+ * @brief Pick the power mode and pick up where a deep sleep left off
+ * Call first in app_main: the button, rolling code and accounting depend on
+ * whether this boot is a dormant wake-up.
+ */
+void power_manager_init(power_mode_t mode) {
+    power_mode = mode;
+    woke_from_deep_sleep = esp_reset_reason() == ESP_RST_DEEPSLEEP;
+    if (!woke_from_deep_sleep || esp_sleep_get_wakeup_cause() != ESP_SLEEP_WAKEUP_TIMER) {
+        dormant = false;    // Cold boot, or the rider pressed the button
+    }
+    power_account_init(woke_from_deep_sleep);
+}
+
+bool power_manager_woke_from_deep_sleep(void) {
+    return woke_from_deep_sleep;
+}
+
+/**
+ * @brief Check if the sender should ping from deep sleep
+ * A dormant wake-up goes straight back once its ping went unanswered.
+ */
+static bool dormant_due(int64_t now) {
+    /* The NVS fallback only saves every few hours, which a deep sleep would lose */
+    if (!rolling_code_journaled() ||
+        state_machine_get_current_state() != STATE_IDLE || button_handler_is_pressed()) {
+        return false;
+    }
+    if (tx_scheduler_link_up()) {
+        if (dormant) {
+            ESP_LOGI(TAG, "Receiver answered, leaving dormant mode");
+            dormant = false;
+        }
+        return false;
+    }
+    if (dormant) {
+        return tx_stats.sent > 0;
+    }
+    return now - tx_scheduler_last_ack_us() >= POWER_DORMANT_AFTER_US;
+}
+
+static void enter_deep_sleep(void) {
+    if (!dormant) {
+        ESP_LOGI(TAG, "No ACK for %lld s, pinging every %lld s from deep sleep",
+                 POWER_DORMANT_AFTER_US / 1000000, POWER_DORMANT_PERIOD_US / 1000000);
+        dormant = true;
+    }
+    power_account_sleep_start();
+    power_account_sleep_end(POWER_DORMANT_PERIOD_US, true);
+    button_handler_prepare_sleep(true);
+    esp_sleep_enable_timer_wakeup(POWER_DORMANT_PERIOD_US);
+    esp_deep_sleep_start();
+}
+
+static void light_sleep(int64_t now, int64_t wake_us) {
+    button_handler_prepare_sleep(false);
+    esp_sleep_enable_timer_wakeup((uint64_t)(wake_us - now));
+    power_account_sleep_start();
+    esp_light_sleep_start();
+    power_account_sleep_end(esp_timer_get_time() - now, false);
+    button_handler_after_sleep();
+}
+
+/**
+ * @brief Wait for the next thing to do: a button edge, the settle timer, the TX timer or a reply
+ */
+void power_manager_wait(void) {
+    int64_t now = esp_timer_get_time();
+    int64_t wake_us = now + POWER_MAX_WAIT_US;
+    int64_t tx_us = tx_scheduler_next_us();
+    if (tx_us != 0 && tx_us < wake_us) {
+        wake_us = tx_us;
+    }
+    /* The radio is off in light sleep, so a reply on its way is waited for awake */
+    int64_t reply_us = tx_scheduler_reply_deadline_us();
+    if (reply_us != 0 && reply_us < wake_us) {
+        wake_us = reply_us;
+    }
+
+    if (power_mode != POWER_MODE_AWAKE && !tx_scheduler_send_in_flight() && reply_us == 0 &&
+        !button_handler_is_settling()) {
+        if (power_mode == POWER_MODE_DORMANT && dormant_due(now)) {
+            enter_deep_sleep();
+        }
+        /* Sleep only with nothing pending; a notification that raced in is handled first */
+        if (wake_us - now >= POWER_MIN_SLEEP_US) {
+            if (xTaskNotifyWait(0, UINT32_MAX, NULL, 0) != pdTRUE) {
+                light_sleep(now, wake_us);
+            }
+            return;
+        }
+    }
+    int64_t wait_ms = wake_us > now ? (wake_us - now + 999) / 1000 : 0;
+    xTaskNotifyWait(0, UINT32_MAX, NULL, pdMS_TO_TICKS(wait_ms));
+}
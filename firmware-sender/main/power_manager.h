@@ -0,0 +1,35 @@
+#ifndef POWER_MANAGER_H
+#define POWER_MANAGER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/* --------------------------------------------------------------------------
+ * Power manager
+ * Ends every main loop pass. Between sends the sender light-sleeps until the
+ * TX timer is due or the button changes level, unless a button level is
+ * settling or a send is waiting for its callback. Once no ACK has come back
+ * for POWER_DORMANT_AFTER_US it goes dormant: one ping per
+ * POWER_DORMANT_PERIOD_US from deep sleep, until a ping is acknowledged or
+ * the button wakes it. The rolling code survives in RTC memory.
+ * -------------------------------------------------------------------------- */
+
+#define POWER_MAX_WAIT_US       1000000LL       // Longest wait, for housekeeping
+#define POWER_MIN_SLEEP_US      3000LL          // Shorter waits stay awake: waking and restoring the RF take about 1 ms
+#define POWER_DORMANT_AFTER_US  1800000000LL    // 30 min without an ACK
+#define POWER_DORMANT_PERIOD_US 20000000LL      // Deep sleep between dormant pings
+
+typedef enum {
+    POWER_MODE_AWAKE,           // Radio and CPU stay up between sends
+    POWER_MODE_LIGHT_SLEEP,     // Light sleep between sends
+    POWER_MODE_DORMANT,         // Light sleep, and deep sleep once out of range for a while
+} power_mode_t;
+
+#define POWER_MODE_DEFAULT      POWER_MODE_DORMANT
+
+/* Function declarations */
+void power_manager_init(power_mode_t mode);
+bool power_manager_woke_from_deep_sleep(void);
+void power_manager_wait(void);
+
+#endif // POWER_MANAGER_H
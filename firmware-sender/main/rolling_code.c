@@ -1,61 +1,130 @@
 #include "rolling_code.h"
+#include "rc_journal.h"
 #include "nvs_flash.h"
 #include "nvs.h"
 #include "esp_log.h"
 #include "esp_timer.h"
+#include "esp_attr.h"
+#include "esp_system.h"
+
+#define RTC_ROLLING_CODE_MAGIC 0x52434F44UL
 
 static const char *TAG = "ROLLING_CODE";
 
-/* Rolling code persisted in NVS */
+/* Rolling code persisted in the journal, or in NVS without a journal partition */
 static uint32_t rolling_code = 0;
 static int64_t last_save_time = 0;
-static int32_t last_saved_rolling_code = 0;
+static uint32_t last_saved_rolling_code = 0;
+static rc_journal_t journal = {0};
+static bool journaled = false;
+static uint32_t reserved_code = 0;      // Journal value covering the codes up to it
+
+/* Copy of the journaled counter in RTC memory, which deep sleep keeps */
+typedef struct {
+    uint32_t code;                      // Last code sent
+    uint32_t reserved;                  // Journal value covering it
+    uint32_t check;                     // code ^ reserved ^ RTC_ROLLING_CODE_MAGIC
+} rtc_rolling_code_t;
+
+static RTC_DATA_ATTR rtc_rolling_code_t rtc_copy;
+
+static void rtc_copy_update(void) {
+    rtc_copy.code = rolling_code;
+    rtc_copy.reserved = reserved_code;
+    rtc_copy.check = rolling_code ^ reserved_code ^ RTC_ROLLING_CODE_MAGIC;
+}
 
 /* --------------------------------------------------------------------------
  * Rolling code persistence
  * -------------------------------------------------------------------------- */
-static int32_t load_rolling_code(void) {
+static uint32_t load_rolling_code(void) {
     nvs_handle_t nvs;
-    uint32_t rolling_code = 0;
+    uint32_t code = 0;
 
     if (nvs_open("sec", NVS_READWRITE, &nvs) != ESP_OK) {
-        rolling_code = 0;
-        return;
+        return 0;
     }
 
-    if (nvs_get_u32(nvs, "roll", &rolling_code) == ESP_ERR_NVS_NOT_FOUND) {
-        rolling_code = 1;              // First boot initialization
-        nvs_set_u32(nvs, "roll", rolling_code);
+    if (nvs_get_u32(nvs, "roll", &code) == ESP_ERR_NVS_NOT_FOUND) {
+        code = 1;              // First boot initialization
+        nvs_set_u32(nvs, "roll", code);
         nvs_commit(nvs);
     }
 
     nvs_close(nvs);
-    ESP_LOGI(TAG, "Loaded rolling code: %lu", rolling_code);
-    return rolling_code;
+    ESP_LOGI(TAG, "Loaded rolling code: %lu", code);
+    return code;
 }
 
-int32_t rolling_code_init( void ) {
-    uint32_t rolling_code = load_rolling_code();
+/**
+ * @brief Load the rolling code, from the journal if it has one
+ * The journal holds a value reserved ahead of every code sent, so continuing
+ * from it never repeats a code after a power cut. The first boot with a
+ * journal partition carries the NVS value over.
+ */
+uint32_t rolling_code_init(void) {
     last_save_time = esp_timer_get_time();
+
+    /* After a deep sleep the RTC copy continues from the exact code sent last,
+     * and the journal is only opened once its reservation runs out */
+    if (esp_reset_reason() == ESP_RST_DEEPSLEEP && rtc_copy.reserved != 0 &&
+        rtc_copy.check == (rtc_copy.code ^ rtc_copy.reserved ^ RTC_ROLLING_CODE_MAGIC)) {
+        rolling_code = rtc_copy.code;
+        reserved_code = rtc_copy.reserved;
+        journaled = true;
+        last_saved_rolling_code = rolling_code;
+        return rolling_code;
+    }
+
+    journaled = rc_journal_open(&journal, RC_JOURNAL_PARTITION_LABEL) == ESP_OK;
+    if (!journaled || !rc_journal_get(&journal, RC_JOURNAL_KEY_OWN, &rolling_code)) {
+        rolling_code = load_rolling_code();
+        if (journaled) {
+            rc_journal_append(&journal, RC_JOURNAL_KEY_OWN, rolling_code);
+        }
+    }
+    reserved_code = 0;
+    if (journaled) {
+        rc_journal_get(&journal, RC_JOURNAL_KEY_OWN, &reserved_code);
+    }
     last_saved_rolling_code = rolling_code;
+    rtc_copy_update();
     return rolling_code;
 }
 
-void rolling_code_save( int32_t rolling_code ) {
+void rolling_code_save(uint32_t code) {
     nvs_handle_t nvs;
     if (nvs_open("sec", NVS_READWRITE, &nvs) == ESP_OK) {
-        nvs_set_u32(nvs, "roll", rolling_code);
+        nvs_set_u32(nvs, "roll", code);
         nvs_commit(nvs);
         nvs_close(nvs);
-        ESP_LOGI(TAG, "Saved rolling code: %lu", rolling_code);
+        ESP_LOGI(TAG, "Saved rolling code: %lu", code);
     }
 }
 
-uint32_t rolling_code_get_and_increment( int32_t rolling_code ) {
-    return ++rolling_code;
+/**
+ * @brief Next code to send, journaled ahead before it goes out
+ */
+uint32_t rolling_code_get_and_increment(void) {
+    if (journaled && (int32_t)(rolling_code + 1 - reserved_code) > 0) {      // Serial order, as the journal
+        if (journal.partition == NULL && rc_journal_open(&journal, RC_JOURNAL_PARTITION_LABEL) != ESP_OK) {
+            ESP_LOGE(TAG, "Rolling code journal unavailable after deep sleep");
+        }
+        if (journal.partition == NULL ||
+            rc_journal_reserve(&journal, RC_JOURNAL_KEY_OWN, rolling_code + 1) != ESP_OK) {
+            ESP_LOGW(TAG, "Rolling code %lu sent without reservation", rolling_code + 1);
+        }
+        rc_journal_get(&journal, RC_JOURNAL_KEY_OWN, &reserved_code);
+    }
+    rolling_code++;
+    rtc_copy_update();
+    return rolling_code;
 }
 
-void rolling_code_periodic_save( int32_t rolling_code ) {
+void rolling_code_periodic_save(void) {
+    if (rolling_code_journaled()) {
+        return;
+    }
     uint64_t current_time = esp_timer_get_time();
     
     // Save rolling code every SAVE_ROLLING_CODE_DELAY_US if it has increased to decrease wear on NVS
@@ -67,4 +136,8 @@ void rolling_code_periodic_save( int32_t rolling_code ) {
             last_save_time = current_time;
         }
     }
-}
\ No newline at end of file
+}
+
+bool rolling_code_journaled(void) {
+    return journaled;
+}
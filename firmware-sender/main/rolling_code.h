@@ -2,13 +2,15 @@
 #define ROLLING_CODE_H
 
 #include <stdint.h>
+#include <stdbool.h>
 
-#define SAVE_ROLLING_CODE_DELAY_US 21600000000ULL  // Save rolling code every 6 hours
+#define SAVE_ROLLING_CODE_DELAY_US 21600000000ULL  // NVS fallback: save rolling code every 6 hours
 
 /* Function declarations */
-int32_t rolling_code_init();
-void rolling_code_save(int32_t rolling_code);
-uint32_t rolling_code_get_and_increment(int32_t rolling_code);
-void rolling_code_periodic_save(int32_t rolling_code);
+uint32_t rolling_code_init(void);
+void rolling_code_save(uint32_t rolling_code);
+uint32_t rolling_code_get_and_increment(void);
+void rolling_code_periodic_save(void);
+bool rolling_code_journaled(void);
 
-#endif // ROLLING_CODE_H
\ No newline at end of file
+#endif // ROLLING_CODE_H
@@ -1,8 +1,7 @@
 #include "state_machine.h"
 #include "espnow_comm.h"
-#include "rolling_code.h"
-#include "freertos/FreeRTOS.h"
-#include "freertos/task.h"
+#include "tx_scheduler.h"
+#include "button_handler.h"
 #include "esp_log.h"
 
 static const char *TAG = "STATE_MACHINE";
@@ -25,22 +24,27 @@ static const state_func_t state_table[STATE_COUNT] = {
 
 /* --------------------------------------------------------------------------
  * State implementations
- * Each state performs one iteration and returns to the main loop for event handling
+ * Each state performs one iteration and returns to the main loop for event
+ * handling; the TX scheduler sends only when the state's packet is due
  * -------------------------------------------------------------------------- */
 
 static void state_idle(void) {
-    espnow_send_packet(0, rolling_code_get_and_increment());  // Ping
-    vTaskDelay(pdMS_TO_TICKS(1000));   // 1 Hz
+    tx_scheduler_run(CMD_PING, TX_IDLE_PERIOD_US);
 }
 
 static void state_detects(void) {
-    espnow_send_packet(0, rolling_code_get_and_increment());  // Ping
-    vTaskDelay(pdMS_TO_TICKS(250));    // 4 Hz
+    /* Back to slow pings once the receiver stops acknowledging */
+    if (!tx_scheduler_link_up()) {
+        state_machine_set_state(STATE_IDLE);
+        return;
+    }
+    tx_scheduler_run(CMD_PING, TX_DETECTS_PERIOD_US);
 }
 
 static void state_bypass(void) {
-    espnow_send_packet(1, rolling_code_get_and_increment());  // Force open
-    vTaskDelay(pdMS_TO_TICKS(250));    // 4 Hz
+    if (tx_scheduler_run(CMD_FORCE_OPEN, TX_BYPASS_PERIOD_US)) {
+        button_handler_on_force_open_sent();
+    }
 }
 
 /* --------------------------------------------------------------------------
@@ -0,0 +1,336 @@
+#include "tx_scheduler.h"
+#include "espnow_comm.h"
+#include "rolling_code.h"
+#include "esp_timer.h"
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include <string.h>
+
+static const char *TAG = "TX_SCHED";
+
+static esp_timer_handle_t tx_timer = NULL;
+static TaskHandle_t main_task = NULL;
+static int64_t last_tx_us = 0;
+static int64_t next_tx_us = 0;          // Due time the timer is armed for, 0 if not armed
+static uint32_t approach_pings = 0;     // Fast pings left after the link came up
+static uint8_t last_command = CMD_PING;
+static bool started = false;            // A packet was sent since init, replied_code orders from it
+static uint32_t reply_misses = 0;       // Acknowledged sends in a row whose reply never came
+
+/* Written by the send callback in the Wi-Fi task */
+static volatile uint32_t unacked = TX_LOST_AFTER;   // Out of range until the first ACK
+static volatile bool link_regained = false;
+static int64_t approach_until_us = 0;               // Replies to every ping are heard until then
+static volatile int64_t pending_tx_us = 0;          // Send time of the packet awaiting its callback
+static volatile bool in_flight = false;
+static volatile int64_t last_ack_us = 0;
+static volatile int64_t reply_due_us = 0;           // Wait for the reply to last_code until then, 0 if not waiting
+
+/* Written by the main task, read by the receive callback */
+static volatile uint32_t last_code = 0;             // Code of the last packet sent
+
+/* Written by the receive callback in the Wi-Fi task */
+static volatile uint32_t replied_code = 0;          // Newest code the receiver replied to
+static volatile uint32_t burst_code = 0;            // First code of the current force open burst
+static volatile bool burst_served = false;          // The receiver replied to a force open of this burst
+static volatile uint8_t gate_state = GATE_UNKNOWN;
+static volatile int8_t receiver_rssi = 0;           // RSSI the receiver measured on our last answered packet
+static volatile int8_t reply_rssi = ESPNOW_RSSI_NONE;  // RSSI we measured on that reply
+
+tx_stats_t tx_stats = {0};
+static tx_stats_t reported_stats = {0};
+static int64_t stats_window_start_us = 0;
+
+/**
+ * @brief Whether code a comes after code b, in serial-number order as in replay_window.c
+ * Rolling codes wrap at 2^32, so a plain compare would ignore every reply past the wrap.
+ */
+static inline bool code_after(uint32_t a, uint32_t b) {
+    return (int32_t)(a - b) > 0;
+}
+
+static void tx_timer_cb(void *arg) {
+    (void)arg;
+    xTaskNotify(main_task, TX_WAKE_BIT, eSetBits);
+}
+
+/**
+ * @brief Create the wake-up timer for the calling (main) task
+ */
+void tx_scheduler_init(void) {
+    main_task = xTaskGetCurrentTaskHandle();
+    const esp_timer_create_args_t args = {
+        .callback = tx_timer_cb,
+        .dispatch_method = ESP_TIMER_TASK,
+        .name = "tx_sched",
+    };
+    if (esp_timer_create(&args, &tx_timer) != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to create TX timer");
+        tx_timer = NULL;
+    }
+    last_tx_us = esp_timer_get_time() - TX_BACKOFF_MAX_US;  // First packet goes out right away
+    next_tx_us = 0;
+    approach_pings = 0;
+    last_command = CMD_PING;
+    last_code = 0;
+    started = false;
+    reply_misses = 0;
+    reply_due_us = 0;
+    replied_code = 0;
+    burst_code = 0;
+    burst_served = false;
+    gate_state = GATE_UNKNOWN;
+    receiver_rssi = 0;
+    reply_rssi = ESPNOW_RSSI_NONE;
+    unacked = TX_LOST_AFTER;
+    link_regained = false;
+    approach_until_us = 0;
+    in_flight = false;
+    last_ack_us = esp_timer_get_time();     // Boot counts as the last sign of the receiver
+    memset(&tx_stats, 0, sizeof(tx_stats));
+    memset(&reported_stats, 0, sizeof(reported_stats));
+    stats_window_start_us = esp_timer_get_time();
+}
+
+/**
+ * @brief Period until the next packet for the current link state
+ * Force opens keep the state's rate: the rider is holding the button and the
+ * receiver may just be about to come into range.
+ */
+static int64_t tx_period_us(uint8_t command, int64_t base_period_us) {
+    if (command != CMD_PING) {
+        return base_period_us;
+    }
+    uint32_t misses = unacked;
+    if (misses >= TX_LOST_AFTER) {
+        /* Double per unanswered ping past the threshold */
+        int64_t period = base_period_us;
+        for (uint32_t i = TX_LOST_AFTER; i <= misses && period < TX_BACKOFF_MAX_US; i++) {
+            period *= 2;
+        }
+        return period < TX_BACKOFF_MAX_US ? period : TX_BACKOFF_MAX_US;
+    }
+    /* Nothing for the receiver to decide while the gate is open or moving */
+    uint8_t gate = gate_state;
+    if ((gate == GATE_OPEN || gate == GATE_MOVING) && base_period_us < TX_GATE_OPEN_PERIOD_US) {
+        return TX_GATE_OPEN_PERIOD_US;
+    }
+    if (approach_pings > 0 && TX_APPROACH_PERIOD_US < base_period_us) {
+        return TX_APPROACH_PERIOD_US;
+    }
+    return base_period_us;
+}
+
+static void disarm_timer(void) {
+    if (tx_timer != NULL && next_tx_us != 0) {
+        esp_timer_stop(tx_timer);
+        next_tx_us = 0;
+    }
+}
+
+static void arm_timer(int64_t due_us) {
+    if (tx_timer == NULL || due_us == next_tx_us) {
+        return;
+    }
+    esp_timer_stop(tx_timer);   // ESP_ERR_INVALID_STATE when it already fired
+    int64_t delay_us = due_us - esp_timer_get_time();
+    esp_timer_start_once(tx_timer, delay_us > 0 ? (uint64_t)delay_us : 0);
+    next_tx_us = due_us;
+}
+
+/**
+ * @brief Send the state's packet if it is due, never blocking
+ * Called on every main loop pass by the current state. A faster state takes
+ * effect at once, since the due time is recomputed from the last send, and
+ * a new command (the button was just pressed) goes out right away. A force
+ * open burst stops once the receiver has replied to one of its packets.
+ * @return true if a packet was sent
+ */
+bool tx_scheduler_run(uint8_t command, int64_t base_period_us) {
+    if (link_regained) {
+        link_regained = false;
+        approach_pings = TX_APPROACH_PINGS;
+        reply_misses = 0;
+    }
+    if (command == CMD_FORCE_OPEN && last_command == CMD_FORCE_OPEN && burst_served) {
+        disarm_timer();     // Quiet until the button is released
+        return false;
+    }
+    int64_t now = esp_timer_get_time();
+    int64_t due_us = command != last_command ? now : last_tx_us + tx_period_us(command, base_period_us);
+    if (now < due_us) {
+        arm_timer(due_us);
+        return false;
+    }
+
+    /* The previous send was acknowledged, but its reply never came */
+    if (reply_due_us != 0 && replied_code != last_code && reply_misses < UINT32_MAX) {
+        reply_misses++;
+    }
+    reply_due_us = 0;
+    /* Our side of the link goes with the next packet, if the last one was answered */
+    int8_t rssi = started && replied_code == last_code ? reply_rssi : ESPNOW_RSSI_NONE;
+    uint32_t code = rolling_code_get_and_increment();
+    if (!started) {
+        replied_code = code - 1;    // Nothing before the first code was answered
+        started = true;
+    }
+    if (command == CMD_FORCE_OPEN && last_command != CMD_FORCE_OPEN) {
+        burst_code = code;
+        burst_served = false;
+    }
+    last_code = code;
+    last_command = command;
+    pending_tx_us = now;
+    in_flight = true;
+    espnow_send_packet(command, code, rssi);
+    int64_t tx_us = esp_timer_get_time() - now;
+    tx_stats.sent++;
+    tx_stats.tx_sum_us += tx_us;
+    if (tx_us > tx_stats.tx_max_us) {
+        tx_stats.tx_max_us = tx_us;
+    }
+
+    /* Late passes do not bunch up packets: the next one is a full period away */
+    last_tx_us = now;
+    if (command == CMD_PING && approach_pings > 0) {
+        approach_pings--;
+    }
+    arm_timer(last_tx_us + tx_period_us(command, base_period_us));
+    return true;
+}
+
+/**
+ * @brief Record the outcome of a send, from the ESP-NOW send callback
+ * Wakes the main task, which does not sleep while a send is in flight.
+ */
+void tx_scheduler_on_send_done(bool acked) {
+    int64_t done_us = esp_timer_get_time();
+    int64_t ack_us = done_us - pending_tx_us;
+    tx_stats.ack_sum_us += ack_us;
+    if (ack_us > tx_stats.ack_max_us) {
+        tx_stats.ack_max_us = ack_us;
+    }
+    if (acked) {
+        tx_stats.acked++;
+        last_ack_us = done_us;
+        if (unacked >= TX_LOST_AFTER) {
+            link_regained = true;
+            approach_until_us = done_us + TX_REPLY_APPROACH_US;
+        }
+        unacked = 0;
+        /* Force opens wait for their reply, and so do pings for a while after coming
+         * into range, for the reply RSSI the receiver's approach decision uses. Then
+         * pings only now and then for the gate state, and a receiver that never
+         * replies is only probed */
+        bool listen = last_command != CMD_PING || done_us < approach_until_us ||
+                      tx_stats.acked % TX_REPLY_PING_EVERY == 0;
+        if (reply_misses >= TX_REPLY_MISSES_MAX) {
+            listen = tx_stats.acked % TX_REPLY_PROBE_EVERY == 0;
+        }
+        if (listen) {
+            reply_due_us = done_us + TX_REPLY_WAIT_US;
+        }
+    } else {
+        tx_stats.failed++;
+        if (unacked < UINT32_MAX) {
+            unacked++;
+        }
+        if (unacked == TX_LOST_AFTER) {
+            gate_state = GATE_UNKNOWN;
+        }
+    }
+    in_flight = false;
+    if (main_task != NULL) {
+        xTaskNotify(main_task, TX_WAKE_BIT, eSetBits);
+    }
+}
+
+/**
+ * @brief Record a receiver reply, from the ESP-NOW receive callback
+ * @param measured_rssi RSSI of the reply itself, reported back with the next packet
+ * Replies to codes not sent yet, or older than one already answered, are ignored.
+ */
+void tx_scheduler_on_reply(uint32_t rolling_code, uint8_t command, uint8_t gate, int8_t rssi,
+                           int8_t measured_rssi) {
+    if (code_after(rolling_code, last_code) || code_after(replied_code, rolling_code)) {
+        return;
+    }
+    tx_stats.replies++;
+    replied_code = rolling_code;
+    reply_misses = 0;
+    gate_state = gate;
+    receiver_rssi = rssi;
+    reply_rssi = measured_rssi;
+    if (command == CMD_FORCE_OPEN && !code_after(burst_code, rolling_code) && !burst_served) {
+        burst_served = true;
+        tx_stats.served++;
+    }
+    if (main_task != NULL) {
+        xTaskNotify(main_task, TX_WAKE_BIT, eSetBits);
+    }
+}
+
+/**
+ * @brief Check if the receiver acknowledged one of the last TX_LOST_AFTER sends
+ */
+bool tx_scheduler_link_up(void) {
+    return unacked < TX_LOST_AFTER;
+}
+
+/**
+ * @brief Check if the last send is still waiting for its callback
+ */
+bool tx_scheduler_send_in_flight(void) {
+    return in_flight;
+}
+
+/**
+ * @brief Time of the last acknowledged send, or of boot if none was
+ */
+int64_t tx_scheduler_last_ack_us(void) {
+    return last_ack_us;
+}
+
+/**
+ * @brief Time the next packet is due, for sleeping until then
+ */
+int64_t tx_scheduler_next_us(void) {
+    return next_tx_us;
+}
+
+/**
+ * @brief Time until which the radio has to stay on for a reply, 0 if none is expected
+ */
+int64_t tx_scheduler_reply_deadline_us(void) {
+    int64_t due_us = reply_due_us;
+    if (due_us == 0 || replied_code == last_code || due_us <= esp_timer_get_time()) {
+        return 0;
+    }
+    return due_us;
+}
+
+/**
+ * @brief Log send counts and timing once per TX_STATS_PERIOD_US
+ */
+void tx_scheduler_report_stats(void) {
+    int64_t now = esp_timer_get_time();
+    if (now - stats_window_start_us < TX_STATS_PERIOD_US) {
+        return;
+    }
+    tx_stats_t s = tx_stats;
+    uint32_t sent = s.sent - reported_stats.sent;
+    uint32_t done = (s.acked + s.failed) - (reported_stats.acked + reported_stats.failed);
+    ESP_LOGI(TAG, "sent %lu, acked %lu, failed %lu, tx avg %lld us max %lld us, ack avg %lld us max %lld us",
+             sent, s.acked - reported_stats.acked, s.failed - reported_stats.failed,
+             sent ? (s.tx_sum_us - reported_stats.tx_sum_us) / sent : 0, s.tx_max_us,
+             done ? (s.ack_sum_us - reported_stats.ack_sum_us) / done : 0, s.ack_max_us);
+    ESP_LOGI(TAG, "replies %lu, bursts served %lu, gate %u, receiver RSSI %d dBm",
+             s.replies - reported_stats.replies, s.served - reported_stats.served,
+             gate_state, receiver_rssi);
+    tx_stats.tx_max_us = 0;
+    tx_stats.ack_max_us = 0;
+    reported_stats = tx_stats;
+    stats_window_start_us = now;
+}
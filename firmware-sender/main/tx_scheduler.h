@@ -0,0 +1,65 @@
+#ifndef TX_SCHEDULER_H
+#define TX_SCHEDULER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/* --------------------------------------------------------------------------
+ * Transmit scheduler
+ * Sends each state's packet when it is due instead of sleeping in the state
+ * function, and wakes the main task with a one-shot esp_timer at the next
+ * send time. The ping rate follows the link: it backs off while the
+ * receiver does not acknowledge and speeds up for a few pings after it
+ * starts to, so the receiver's RSSI window fills while the vehicle closes in.
+ * Receiver replies end a force open burst once one of its packets has been
+ * served, and slow the pings down while the gate is open or moving.
+ * -------------------------------------------------------------------------- */
+
+#define TX_IDLE_PERIOD_US       1000000LL   // 1 Hz ping
+#define TX_DETECTS_PERIOD_US    250000LL    // 4 Hz ping once the receiver acknowledges
+#define TX_BYPASS_PERIOD_US     250000LL    // 4 Hz force open while the button is held
+#define TX_APPROACH_PERIOD_US   100000LL    // 10 Hz ping right after the link comes up
+#define TX_APPROACH_PINGS       16          // Fast pings after the link comes up
+#define TX_LOST_AFTER           3           // Unacknowledged sends before the receiver counts as out of range
+#define TX_BACKOFF_MAX_US       4000000LL   // Slowest ping while out of range
+#define TX_GATE_OPEN_PERIOD_US  2000000LL   // Ping while the receiver reports the gate open or moving
+
+#define TX_REPLY_WAIT_US        10000LL     // Radio stays on this long after an ACK for the reply
+#define TX_REPLY_PING_EVERY     4           // Wait for the reply to every Nth acknowledged ping, every force open
+#define TX_REPLY_APPROACH_US    60000000LL  // After the link comes up, wait after every ping for the reply RSSI
+#define TX_REPLY_MISSES_MAX     8           // Acknowledged sends without a reply before no longer waiting
+#define TX_REPLY_PROBE_EVERY    16          // After that, still wait after every Nth acknowledged send
+
+#define TX_WAKE_BIT             (1UL << 0)  // Main task notification bit set by the TX timer
+
+/* Send statistics, cumulative; acked and failed are written from the Wi-Fi task */
+typedef struct {
+    uint32_t sent;
+    uint32_t acked;                 // Send callback reported a MAC-layer ACK
+    uint32_t failed;
+    uint32_t replies;               // Receiver replies to our packets, written from the Wi-Fi task
+    uint32_t served;                // Force open bursts ended by a reply
+    int64_t tx_sum_us;              // Time spent in the send path (code reserve + esp_now_send)
+    int64_t tx_max_us;
+    int64_t ack_sum_us;             // Send to send callback
+    int64_t ack_max_us;
+} tx_stats_t;
+
+#define TX_STATS_PERIOD_US      60000000LL  // 1 minute
+
+/* Function declarations */
+void tx_scheduler_init(void);
+bool tx_scheduler_run(uint8_t command, int64_t base_period_us);
+void tx_scheduler_on_send_done(bool acked);
+void tx_scheduler_on_reply(uint32_t rolling_code, uint8_t command, uint8_t gate_state, int8_t rssi,
+                           int8_t reply_rssi);
+bool tx_scheduler_link_up(void);
+bool tx_scheduler_send_in_flight(void);
+int64_t tx_scheduler_last_ack_us(void);
+int64_t tx_scheduler_next_us(void);
+int64_t tx_scheduler_reply_deadline_us(void);
+void tx_scheduler_report_stats(void);
+
+extern tx_stats_t tx_stats;
+
+#endif // TX_SCHEDULER_H
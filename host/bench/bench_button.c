@@ -0,0 +1,382 @@
+/* --------------------------------------------------------------------------
+ * Bypass button benchmark
+ *
+ * Drives INPUT_PIN through --seconds of riding: the rider presses the bypass
+ * button every 2 to 8 s, mostly briefly but one press in five held past
+ * BYPASS_TIMEOUT_US, every press and release bouncing up to --bounces times
+ * within --bounce-us, plus --glitches short spikes per minute from
+ * vibration. Three senders handle it:
+ *
+ *   polled     the original loop: 16-sample debouncer read once per pass,
+ *              state functions sleeping 250 ms or 1 s after each packet
+ *   scheduler  the same debouncer sampled every 5 ms, packets sent by
+ *              tx_scheduler.c
+ *   interrupt  button_handler.c: edge interrupt, settle timer, and the main
+ *              task asleep until a button edge or timer
+ *
+ * Reports the press to first force open latency histogram (from the first
+ * edge of the press), its median and worst case, presses that never sent a
+ * force open, force opens outside any press (false) or more than one TX
+ * period past the hold timeout (late), and main loop passes per second.
+ *
+ * Usage: bench_button [--seconds N] [--bounces N] [--bounce-us N]
+ *                     [--glitches N] [--seed N]
+ * -------------------------------------------------------------------------- */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "esp_timer.h"
+#include "host_sim.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "debouncer.h"
+#include "button_handler.h"
+#include "espnow_comm.h"
+#include "state_machine.h"
+#include "tx_scheduler.h"
+
+#define RIDE_START_US       1000000LL
+#define POLL_MS             5
+#define MAIN_LOOP_MAX_WAIT_US 1000000LL
+#define MAX_PRESSES         1024
+#define MAX_EDGES           (MAX_PRESSES * 64)
+#define MAX_OPENS           65536
+
+typedef enum {
+    SENDER_POLLED,
+    SENDER_SCHEDULER,
+    SENDER_INTERRUPT,
+} sender_mode_t;
+
+static const char *const sender_mode_names[] = {
+    [SENDER_POLLED]    = "polled",
+    [SENDER_SCHEDULER] = "scheduler",
+    [SENDER_INTERRUPT] = "interrupt",
+};
+
+typedef struct {
+    uint32_t seconds;
+    uint32_t bounces;
+    uint32_t bounce_us;
+    uint32_t glitches;
+    uint32_t seed;
+} bench_config_t;
+
+typedef struct {
+    int64_t at_us;
+    uint32_t level;
+} edge_t;
+
+typedef struct {
+    int64_t start_us;               // First edge of the press
+    int64_t end_us;                 // Last edge of the release
+} press_t;
+
+/* Ride script, the same for every sender */
+static edge_t edges[MAX_EDGES];
+static uint32_t edge_count;
+static press_t presses[MAX_PRESSES];
+static uint32_t press_count;
+
+/* Force opens the senders put on the air */
+static int64_t opens[MAX_OPENS];
+static uint32_t open_count;
+static sender_mode_t mode;
+
+/* Original button handler and state machine, kept here as the baseline */
+static debouncer_t legacy_debouncer;
+static int64_t legacy_bypass_time;
+static State legacy_state = STATE_IDLE;
+
+uint32_t rolling_code_get_and_increment(void) {
+    static uint32_t code = 0;
+    return ++code;
+}
+
+/* Stands in for espnow_comm.c: the receiver is in range and acknowledges everything */
+void espnow_send_packet(uint8_t command, uint32_t rolling_code, int8_t reply_rssi) {
+    (void)reply_rssi;
+    (void)rolling_code;
+    if (command == CMD_FORCE_OPEN && open_count < MAX_OPENS) {
+        opens[open_count++] = esp_timer_get_time();
+    }
+    if (mode == SENDER_POLLED) {
+        if (legacy_state == STATE_IDLE) {
+            legacy_state = STATE_DETECTS;
+        }
+    } else {
+        tx_scheduler_on_send_done(true);
+        state_machine_on_link_detected();
+    }
+}
+
+/* --------------------------------------------------------------------------
+ * Ride script
+ * -------------------------------------------------------------------------- */
+
+static void add_edge(int64_t at_us, uint32_t level) {
+    if (edge_count < MAX_EDGES) {
+        edges[edge_count++] = (edge_t){at_us, level};
+    }
+}
+
+static int cmp_i64(const void *a, const void *b) {
+    int64_t x = *(const int64_t *)a;
+    int64_t y = *(const int64_t *)b;
+    return (x > y) - (x < y);
+}
+
+/* One press or release: the contact bounces, then settles on level; returns the last edge */
+static int64_t add_transition(const bench_config_t *cfg, int64_t at_us, uint32_t level) {
+    uint32_t bounces = cfg->bounce_us ? rand() % (cfg->bounces + 1) : 0;
+    int64_t times[64];
+    for (uint32_t i = 0; i < 2 * bounces && i < 64; i++) {
+        times[i] = at_us + 1 + rand() % cfg->bounce_us;
+    }
+    uint32_t n = 2 * bounces < 64 ? 2 * bounces : 64;
+    qsort(times, n, sizeof(times[0]), cmp_i64);
+    add_edge(at_us, level);
+    for (uint32_t i = 0; i < n; i++) {
+        add_edge(times[i], i % 2 == 0 ? !level : level);
+    }
+    return n ? times[n - 1] : at_us;
+}
+
+static void build_ride(const bench_config_t *cfg) {
+    edge_count = 0;
+    press_count = 0;
+    int64_t end_us = RIDE_START_US + (int64_t)cfg->seconds * 1000000;
+    int64_t released_us = RIDE_START_US;
+    int64_t t = RIDE_START_US + 2000000 + rand() % 6000000;
+    while (t < end_us - 10000000 && press_count < MAX_PRESSES) {
+        /* Vibration spikes while released, well clear of the button's own edges */
+        int64_t gap_us = t - released_us - 20000;
+        uint32_t glitches = (uint32_t)((int64_t)cfg->glitches * (t - released_us) / 60000000);
+        for (uint32_t g = 0; g < glitches && gap_us > 0; g++) {
+            int64_t at_us = released_us + 10000 + rand() % gap_us;
+            add_edge(at_us, 0);
+            add_edge(at_us + 50 + rand() % 450, 1);
+        }
+
+        int64_t hold_us = rand() % 5 ? 200000 + rand() % 1300000 : 6000000 + rand() % 2000000;
+        presses[press_count].start_us = t;
+        add_transition(cfg, t, 0);
+        presses[press_count].end_us = add_transition(cfg, t + hold_us, 1);
+        released_us = presses[press_count].end_us;
+        press_count++;
+        t = released_us + 2000000 + rand() % 6000000;
+    }
+    qsort(edges, edge_count, sizeof(edges[0]), cmp_i64);   // at_us is the first member
+}
+
+/* --------------------------------------------------------------------------
+ * Main loops
+ * -------------------------------------------------------------------------- */
+
+static bool legacy_bypass_active(void) {
+    debouncer_update(&legacy_debouncer, debouncer_read_inputs());
+    bool pressed = !debouncer_level(&legacy_debouncer, INPUT_PIN);
+    int64_t now = esp_timer_get_time();
+    if (!pressed) {
+        legacy_bypass_time = now;
+    }
+    return pressed && (now - legacy_bypass_time) < (int64_t)BYPASS_TIMEOUT_US;
+}
+
+/* One pass of the original loop; returns how long the state function slept */
+static int64_t polled_pass(void) {
+    if (legacy_bypass_active()) {
+        legacy_state = STATE_BYPASS;
+    } else if (legacy_state == STATE_BYPASS) {
+        legacy_state = STATE_IDLE;
+    }
+    switch (legacy_state) {
+        case STATE_IDLE:
+            espnow_send_packet(CMD_PING, rolling_code_get_and_increment(), ESPNOW_RSSI_NONE);
+            return 1000000;
+        case STATE_DETECTS:
+            espnow_send_packet(CMD_PING, rolling_code_get_and_increment(), ESPNOW_RSSI_NONE);
+            return 250000;
+        default:
+            espnow_send_packet(CMD_FORCE_OPEN, rolling_code_get_and_increment(), ESPNOW_RSSI_NONE);
+            return 250000;
+    }
+}
+
+static void scheduled_pass(bool bypass) {
+    if (bypass) {
+        state_machine_set_state(STATE_BYPASS);
+    } else if (state_machine_get_current_state() == STATE_BYPASS) {
+        state_machine_set_state(STATE_IDLE);
+    }
+    state_machine_run();
+}
+
+/* Plays the script against one sender; returns main loop passes */
+static uint32_t run_ride(const bench_config_t *cfg) {
+    host_sim_reset();
+    host_clock_set_us(RIDE_START_US);
+    host_gpio_set_input(INPUT_PIN, 1);
+    open_count = 0;
+    legacy_state = STATE_IDLE;
+    legacy_bypass_time = RIDE_START_US;
+    debouncer_init(&legacy_debouncer, 1ULL << INPUT_PIN, debouncer_read_inputs());
+    state_machine_init();
+    tx_scheduler_init();
+    if (mode == SENDER_INTERRUPT) {
+        button_handler_init();
+    }
+
+    int64_t end_us = RIDE_START_US + (int64_t)cfg->seconds * 1000000;
+    int64_t next_pass_us = RIDE_START_US;
+    uint32_t next_edge = 0;
+    uint32_t passes = 0;
+    while (true) {
+        int64_t edge_us = next_edge < edge_count ? edges[next_edge].at_us : INT64_MAX;
+        int64_t wake_us = next_pass_us;
+        if (mode != SENDER_POLLED) {
+            int64_t timer_us = host_timer_next_deadline_us();
+            wake_us = timer_us < wake_us ? timer_us : wake_us;
+        }
+        int64_t t = edge_us < wake_us ? edge_us : wake_us;
+        if (t >= end_us) {
+            break;
+        }
+        host_clock_set_us(t);
+        if (edge_us == t) {
+            host_gpio_set_input(INPUT_PIN, edges[next_edge++].level);
+        }
+        host_timer_run_due();
+
+        /* Polled loops run on their own clock, the interrupt loop whenever it is notified */
+        bool run = t >= next_pass_us || host_task_notify_pending();
+        if (mode == SENDER_POLLED) {
+            run = t >= next_pass_us;
+        }
+        if (!run) {
+            continue;
+        }
+        passes++;
+        switch (mode) {
+            case SENDER_POLLED:
+                next_pass_us = t + polled_pass() + POLL_MS * 1000;
+                break;
+            case SENDER_SCHEDULER:
+                scheduled_pass(legacy_bypass_active());
+                next_pass_us = t + POLL_MS * 1000;
+                break;
+            default:
+                button_handler_update();
+                scheduled_pass(button_handler_is_bypass_active());
+                next_pass_us = t + MAIN_LOOP_MAX_WAIT_US;
+                break;
+        }
+        xTaskNotifyWait(0, UINT32_MAX, NULL, 0);
+    }
+    return passes;
+}
+
+/* --------------------------------------------------------------------------
+ * Scoring
+ * -------------------------------------------------------------------------- */
+
+static uint32_t latency_bucket(int64_t latency_us) {
+    uint32_t bucket = 0;
+    while (bucket < PRESS_LATENCY_BUCKETS - 1 && latency_us >= (1000LL << bucket)) {
+        bucket++;
+    }
+    return bucket;
+}
+
+static void score_ride(uint32_t passes, const bench_config_t *cfg) {
+    static int64_t latencies[MAX_PRESSES];
+    uint32_t hist[PRESS_LATENCY_BUCKETS] = {0};
+    uint32_t latency_count = 0;
+    uint32_t missed = 0;
+    uint32_t false_opens = 0;
+    uint32_t late_opens = 0;
+
+    uint32_t o = 0;
+    for (uint32_t p = 0; p < press_count; p++) {
+        /* A force open may trail the release by up to one pass and one TX period */
+        int64_t from_us = presses[p].start_us;
+        int64_t to_us = presses[p].end_us + 300000;
+        int64_t timeout_us = from_us + (int64_t)BYPASS_TIMEOUT_US + TX_BYPASS_PERIOD_US + 100000;
+        for (; o < open_count && opens[o] < from_us; o++) {
+            false_opens++;
+        }
+        bool served = false;
+        for (; o < open_count && opens[o] <= to_us; o++) {
+            if (!served) {
+                served = true;
+                latencies[latency_count++] = opens[o] - from_us;
+                hist[latency_bucket(opens[o] - from_us)]++;
+            }
+            if (opens[o] > timeout_us) {
+                late_opens++;
+            }
+        }
+        missed += !served;
+    }
+    false_opens += open_count - o;
+
+    qsort(latencies, latency_count, sizeof(latencies[0]), cmp_i64);
+    printf("%-9s ", sender_mode_names[mode]);
+    for (uint32_t b = 0; b < PRESS_LATENCY_BUCKETS; b++) {
+        printf(" %5u", hist[b]);
+    }
+    printf("  %8.1f %8.1f  %4u/%-4u %5u %4u  %8.1f\n",
+           latency_count ? latencies[latency_count / 2] / 1000.0 : -1.0,
+           latency_count ? latencies[latency_count - 1] / 1000.0 : -1.0,
+           missed, press_count, false_opens, late_opens, (double)passes / cfg->seconds);
+}
+
+static void parse_args(int argc, char **argv, bench_config_t *cfg) {
+    for (int i = 1; i + 1 < argc; i += 2) {
+        uint32_t value = (uint32_t)strtoul(argv[i + 1], NULL, 10);
+        if (strcmp(argv[i], "--seconds") == 0) {
+            cfg->seconds = value < 20 ? 20 : value;
+        } else if (strcmp(argv[i], "--bounces") == 0) {
+            cfg->bounces = value > 32 ? 32 : value;
+        } else if (strcmp(argv[i], "--bounce-us") == 0) {
+            cfg->bounce_us = value;
+        } else if (strcmp(argv[i], "--glitches") == 0) {
+            cfg->glitches = value;
+        } else if (strcmp(argv[i], "--seed") == 0) {
+            cfg->seed = value;
+        } else {
+            fprintf(stderr, "Unknown option %s\n", argv[i]);
+            exit(1);
+        }
+    }
+}
+
+int main(int argc, char **argv) {
+    bench_config_t cfg = {
+        .seconds = 1800,
+        .bounces = 4,
+        .bounce_us = 2000,
+        .glitches = 6,
+        .seed = 1,
+    };
+    parse_args(argc, argv, &cfg);
+
+    srand(cfg.seed);
+    build_ride(&cfg);
+    printf("%u s ride, %u presses, up to %u bounces within %u us, %u glitches/min, settle %lld us\n",
+           cfg.seconds, press_count, cfg.bounces, cfg.bounce_us, cfg.glitches, BUTTON_SETTLE_US);
+    printf("          press to first force open, ms\n");
+    printf("%-9s ", "sender");
+    for (uint32_t b = 0; b < PRESS_LATENCY_BUCKETS - 1; b++) {
+        char label[8];
+        snprintf(label, sizeof(label), "<%u", 1u << b);
+        printf(" %5s", label);
+    }
+    printf(" %5s  %8s %8s  %9s %5s %4s  %8s\n", ">=64", "p50 ms", "max ms", "missed", "false", "late", "passes/s");
+    for (mode = SENDER_POLLED; mode <= SENDER_INTERRUPT; mode++) {
+        uint32_t passes = run_ride(&cfg);
+        score_ride(passes, &cfg);
+    }
+    return 0;
+}
@@ -0,0 +1,329 @@
+/* --------------------------------------------------------------------------
+ * Sender firmware over ESP-NOW: transfer time and resend overhead
+ *
+ * Runs the ota_xfer.c source and sink against each other on a simulated
+ * clock. Both directions share one channel: a frame takes its payload plus
+ * 43 bytes of ESP-NOW framing at --phy-kbps, plus preamble, MAC ack and
+ * backoff. The source hands the driver one frame at a time, the next once
+ * the send callback fires, as the receiver does. --loss-pct of frames are
+ * lost after the radio's own retries, one at a time or in runs averaging
+ * --burst frames (Gilbert-Elliott). The sink's receive callback queues
+ * frames for its task, --queue deep, dropping any that do not fit; the task
+ * takes 150 us per frame plus esp_ota_write() at --write-kbps, after
+ * esp_ota_begin() has block-erased the image at --block-erase-ms per 64 KB.
+ *
+ *   time s        first offer to the sink's final ack
+ *   KB/s          image bytes over that time
+ *   sent          data frames, first sends and resends
+ *   resent %      resends over the image's chunk count
+ *   fast / rto    resends of holes below an acked chunk / after --rto-ms
+ *   acks          acks that reached the source
+ *   drops         frames the sink's queue had no room for
+ *
+ * Two tables: the loss rates below at --window, then windows 1 to 32 at
+ * --loss-pct.
+ *
+ * Usage: bench_espnow_ota [--kb N] [--phy-kbps N] [--loss-pct N] [--burst N]
+ *                         [--window N] [--rto-ms N] [--queue N]
+ *                         [--write-kbps N] [--block-erase-ms N] [--seed N]
+ * -------------------------------------------------------------------------- */
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ota_xfer.h"
+
+#define ESPNOW_FRAMING      43          // MAC header, action frame, vendor element, FCS
+#define FRAME_FIXED_US      620         // Preamble, SIFS, MAC ack and average backoff
+#define SINK_FRAME_US       150         // Queue hand-over and task switch per frame
+#define BLOCK_SIZE          (64 * 1024)
+#define AIR_SLOTS           1024
+#define OUTBOX_SLOTS        64
+#define SIM_LIMIT_US        600000000LL
+
+typedef struct {
+    uint32_t kb;
+    uint32_t phy_kbps;
+    uint32_t loss_pct;
+    uint32_t burst;
+    uint32_t window;
+    uint32_t rto_ms;
+    uint32_t queue;
+    uint32_t write_kbps;
+    uint32_t block_erase_ms;
+    uint32_t seed;
+} bench_config_t;
+
+typedef struct {
+    int64_t at;                 // Delivery time
+    bool to_sink;
+    size_t len;
+    uint8_t data[sizeof(ota_xfer_data_t)];
+} frame_t;
+
+typedef struct {
+    double time_s;
+    bool done;
+    uint32_t acks_sent;
+    uint32_t drops;
+    ota_xfer_tx_stats_t tx;
+    uint32_t chunks;
+} result_t;
+
+static bench_config_t *cfg;
+static uint8_t *image;
+static uint32_t image_len;
+
+/* Simulation state, reset per run */
+static int64_t now;
+static int64_t medium_free_us;
+static int64_t source_busy_until;
+static int64_t sink_busy_until;
+static int64_t sink_cost_us;
+static frame_t air[AIR_SLOTS];
+static uint32_t air_head, air_tail;
+static frame_t *sink_queue;
+static uint32_t queue_head, queue_tail;
+static frame_t outbox[OUTBOX_SLOTS];   // Sink acks, released once the work before them is done
+static uint32_t outbox_head, outbox_tail;
+static bool channel_bad;
+static uint32_t loss_pct;
+static result_t res;
+
+static bool frame_lost(void) {
+    if (cfg->burst <= 1) {
+        return (uint32_t)(rand() % 1000) < loss_pct * 10;
+    }
+    // Bad state lasts cfg->burst frames on average and takes loss_pct of the time
+    double leave = 1.0 / cfg->burst;
+    double enter = loss_pct >= 100 ? 1.0 : leave * loss_pct / (100.0 - loss_pct);
+    double r = rand() / (RAND_MAX + 1.0);
+    channel_bad = channel_bad ? r >= leave : r < enter;
+    return channel_bad;
+}
+
+static int64_t airtime_us(size_t len) {
+    return FRAME_FIXED_US + (int64_t)(len + ESPNOW_FRAMING) * 8 * 1000 / cfg->phy_kbps;
+}
+
+static void transmit(const void *pkt, size_t len, bool to_sink) {
+    int64_t start = now > medium_free_us ? now : medium_free_us;
+    medium_free_us = start + airtime_us(len);
+    if (to_sink) {
+        source_busy_until = medium_free_us;
+    }
+    if (frame_lost() || air_tail - air_head == AIR_SLOTS) {
+        return;
+    }
+    frame_t *f = &air[air_tail++ % AIR_SLOTS];
+    f->at = medium_free_us;
+    f->to_sink = to_sink;
+    f->len = len;
+    memcpy(f->data, pkt, len);
+}
+
+static bool source_send(void *ctx, const void *pkt, size_t len) {
+    if (now < source_busy_until) {
+        return false;       // Previous frame still with the driver
+    }
+    transmit(pkt, len, true);
+    return true;
+}
+
+static bool source_read(void *ctx, uint32_t offset, uint8_t *data, size_t len) {
+    memcpy(data, image + offset, len);
+    return true;
+}
+
+static bool sink_send(void *ctx, const void *pkt, size_t len) {
+    if (outbox_tail - outbox_head == OUTBOX_SLOTS) {
+        return false;
+    }
+    frame_t *f = &outbox[outbox_tail++ % OUTBOX_SLOTS];
+    f->at = now + sink_cost_us;
+    f->len = len;
+    memcpy(f->data, pkt, len);
+    res.acks_sent++;
+    return true;
+}
+
+static bool sink_begin(void *ctx, uint32_t image_size) {
+    sink_cost_us += (int64_t)((image_size + BLOCK_SIZE - 1) / BLOCK_SIZE) * cfg->block_erase_ms * 1000;
+    return true;
+}
+
+static bool sink_write(void *ctx, const uint8_t *data, size_t len) {
+    sink_cost_us += (int64_t)len * 1000000 / ((int64_t)cfg->write_kbps * 1024);
+    return true;
+}
+
+static int64_t min64(int64_t a, int64_t b) {
+    return a < b ? a : b;
+}
+
+static void run(uint32_t window, uint32_t loss, const uint8_t sha[SHA256_DIGEST_LEN]) {
+    static ota_xfer_tx_t tx;
+    static ota_xfer_rx_t rx;
+    now = 0;
+    medium_free_us = source_busy_until = sink_busy_until = 0;
+    air_head = air_tail = queue_head = queue_tail = outbox_head = outbox_tail = 0;
+    channel_bad = false;
+    loss_pct = loss;
+    memset(&res, 0, sizeof(res));
+    srand(cfg->seed);
+
+    ota_xfer_tx_init(&tx, image_len, sha, NULL, 0, source_send, source_read, NULL, 0);
+    tx.window = window;
+    tx.rto_us = (int64_t)cfg->rto_ms * 1000;
+    ota_xfer_rx_init(&rx, sink_begin, sink_write, sink_send, NULL);
+
+    while (now < SIM_LIMIT_US) {
+        while (air_head != air_tail && air[air_head % AIR_SLOTS].at <= now) {
+            frame_t *f = &air[air_head++ % AIR_SLOTS];
+            if (!f->to_sink) {
+                ota_xfer_tx_on_ack(&tx, (const ota_xfer_ack_t *)f->data, now);
+            } else if (queue_tail - queue_head == cfg->queue) {
+                res.drops++;
+            } else {
+                sink_queue[queue_tail++ % cfg->queue] = *f;
+            }
+        }
+        if (tx.state >= OTA_XFER_TX_DONE) {
+            break;
+        }
+        if (now >= sink_busy_until) {
+            sink_cost_us = 0;
+            if (queue_head != queue_tail) {
+                frame_t *f = &sink_queue[queue_head++ % cfg->queue];
+                sink_cost_us = SINK_FRAME_US;
+                ota_xfer_rx_feed(&rx, f->data, f->len, now);
+            } else {
+                ota_xfer_rx_poll(&rx, now);
+            }
+            sink_busy_until = now + sink_cost_us;
+        }
+        while (outbox_head != outbox_tail && outbox[outbox_head % OUTBOX_SLOTS].at <= now) {
+            frame_t *f = &outbox[outbox_head++ % OUTBOX_SLOTS];
+            transmit(f->data, f->len, false);
+        }
+        if (now >= source_busy_until && ota_xfer_tx_poll(&tx, now) == OTA_XFER_TX_FAILED) {
+            break;
+        }
+
+        int64_t next = INT64_MAX;
+        if (air_head != air_tail) {
+            next = air[air_head % AIR_SLOTS].at;
+        }
+        if (outbox_head != outbox_tail) {
+            next = min64(next, outbox[outbox_head % OUTBOX_SLOTS].at);
+        }
+        int64_t source_at = ota_xfer_tx_deadline(&tx);
+        next = min64(next, source_at > source_busy_until ? source_at : source_busy_until);
+        if (queue_head != queue_tail) {
+            next = min64(next, sink_busy_until);
+        } else {
+            int64_t ack_at = ota_xfer_rx_deadline(&rx);
+            next = min64(next, ack_at > sink_busy_until ? ack_at : sink_busy_until);
+        }
+        now = next > now ? next : now + 1;
+    }
+    res.done = tx.state == OTA_XFER_TX_DONE;
+    res.time_s = now / 1e6;
+    res.tx = tx.stats;
+    res.chunks = tx.chunks;
+}
+
+static void print_row(const char *label, uint32_t value) {
+    printf("%-6s %4u  ", label, value);
+    if (!res.done) {
+        printf("failed after %.1f s\n", res.time_s);
+        return;
+    }
+    uint32_t resent = res.tx.data_frames - res.chunks;
+    printf("%6.2f  %5.1f  %6u  %8.1f  %5u / %-5u %5u  %5u\n", res.time_s, image_len / 1024.0 / res.time_s,
+           res.tx.data_frames, 100.0 * resent / res.chunks, res.tx.fast_resends, res.tx.timeout_resends,
+           res.tx.acks, res.drops);
+}
+
+static void parse_args(int argc, char **argv, bench_config_t *c) {
+    for (int i = 1; i + 1 < argc; i += 2) {
+        uint32_t value = (uint32_t)strtoul(argv[i + 1], NULL, 10);
+        if (strcmp(argv[i], "--kb") == 0) {
+            c->kb = value ? value : 1;
+        } else if (strcmp(argv[i], "--phy-kbps") == 0) {
+            c->phy_kbps = value ? value : 1;
+        } else if (strcmp(argv[i], "--loss-pct") == 0) {
+            c->loss_pct = value < 90 ? value : 90;
+        } else if (strcmp(argv[i], "--burst") == 0) {
+            c->burst = value;
+        } else if (strcmp(argv[i], "--window") == 0) {
+            c->window = value < 1 ? 1 : value > OTA_XFER_WINDOW ? OTA_XFER_WINDOW : value;
+        } else if (strcmp(argv[i], "--rto-ms") == 0) {
+            c->rto_ms = value ? value : 1;
+        } else if (strcmp(argv[i], "--queue") == 0) {
+            c->queue = value ? value : 1;
+        } else if (strcmp(argv[i], "--write-kbps") == 0) {
+            c->write_kbps = value ? value : 1;
+        } else if (strcmp(argv[i], "--block-erase-ms") == 0) {
+            c->block_erase_ms = value;
+        } else if (strcmp(argv[i], "--seed") == 0) {
+            c->seed = value;
+        } else {
+            fprintf(stderr, "Unknown option %s\n", argv[i]);
+            exit(1);
+        }
+    }
+}
+
+int main(int argc, char **argv) {
+    static bench_config_t config = {
+        .kb = 1024,
+        .phy_kbps = 1000,           // ESP-NOW default rate, 1 Mbps
+        .loss_pct = 5,
+        .burst = 1,
+        .window = OTA_XFER_WINDOW,
+        .rto_ms = OTA_XFER_RTO_US / 1000,
+        .queue = 16,
+        .write_kbps = 350,          // 256 byte pages in 0.7 ms
+        .block_erase_ms = 150,      // Typical 64 KB erase
+        .seed = 1,
+    };
+    parse_args(argc, argv, &config);
+    cfg = &config;
+
+    image_len = cfg->kb * 1024;
+    image = malloc(image_len);
+    sink_queue = malloc(cfg->queue * sizeof(frame_t));
+    srand(cfg->seed);
+    for (uint32_t i = 0; i < image_len; i++) {
+        image[i] = (uint8_t)rand();
+    }
+    uint8_t sha[SHA256_DIGEST_LEN];
+    sha256_ctx_t ctx;
+    sha256_init(&ctx);
+    sha256_update(&ctx, image, image_len);
+    sha256_final(&ctx, sha);
+
+    printf("%u KB image, %u byte chunks, %u kbps PHY (%.1f KB/s of chunks on a clear channel), burst %u, "
+           "rto %u ms, queue %u, write %u KB/s, erase %u ms/block\n", cfg->kb, OTA_XFER_CHUNK, cfg->phy_kbps,
+           OTA_XFER_CHUNK / 1024.0 / (airtime_us(sizeof(ota_xfer_data_t)) / 1e6), cfg->burst, cfg->rto_ms,
+           cfg->queue, cfg->write_kbps, cfg->block_erase_ms);
+    printf("\nwindow %u\nloss %%        time s   KB/s    sent  resent %%   fast / rto    acks  drops\n",
+           cfg->window);
+    static const uint32_t losses[] = {0, 1, 5, 10, 20, 40};
+    for (size_t i = 0; i < sizeof(losses) / sizeof(losses[0]); i++) {
+        run(cfg->window, losses[i], sha);
+        print_row("", losses[i]);
+    }
+    printf("\nloss %u%%\nwindow       time s   KB/s    sent  resent %%   fast / rto    acks  drops\n",
+           cfg->loss_pct);
+    static const uint32_t windows[] = {1, 4, 8, 16, 32};
+    for (size_t i = 0; i < sizeof(windows) / sizeof(windows[0]); i++) {
+        run(windows[i], cfg->loss_pct, sha);
+        print_row("", windows[i]);
+    }
+    free(image);
+    free(sink_queue);
+    return 0;
+}
@@ -0,0 +1,281 @@
+/* --------------------------------------------------------------------------
+ * Early-open benchmark for the approach estimator
+ *
+ * Simulates a bike riding straight at the gate with log-distance path loss
+ * and multipath noise, plus a gate that takes --travel-ms to open or close.
+ * Each trial first closes the gate with a force-open toggle so the receiver
+ * learns the travel time from GATE_STATUS_PIN_INPUT, then runs the approach
+ * through the event-driven receiver loop. Reports when the gate is fully
+ * open relative to the bike's arrival, with the estimator's early open
+ * enabled and with the RSSI window check alone, and the estimator's
+ * predicted arrival against the actual one. --trace writes the ride trace
+ * of the last estimator trial, for tools/trace_replay.
+ *
+ * Usage: bench_estimator [--trials N] [--speed-kmh N] [--travel-ms N]
+ *                        [--noise-db N] [--seed N] [--trace FILE]
+ * -------------------------------------------------------------------------- */
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "esp_timer.h"
+#include "host_sim.h"
+#include "receiver_host.h"
+#include "gpio_config.h"
+#include "espnow_config.h"
+#include "event_processing.h"
+#include "estimator.h"
+#include "trace.h"
+
+#define TRIAL_START_US       1000000000LL // Well past every cooldown
+#define PING_INTERVAL_US     250000LL     // Sender rate once the link is detected
+#define START_DISTANCE_M     300.0
+#define ARRIVAL_DISTANCE_M   5.0          // Bike is at the gate
+#define RSSI_AT_1M_DBM       -40.0
+#define PATH_LOSS_EXPONENT   2.2
+#define RSSI_FLOOR_DBM       -95.0        // Packets below this are lost
+#define GATE_START_US        300000LL     // Motor start until the closed switch opens
+
+typedef struct {
+    uint32_t trials;
+    uint32_t speed_kmh;
+    uint32_t travel_ms;
+    uint32_t noise_db;
+    uint32_t seed;
+    const char *trace_path;
+} bench_config_t;
+
+typedef struct {
+    int64_t *samples;
+    uint32_t count;
+} sample_set_t;
+
+/* Gate model: status pin high while closed */
+static bool gate_closed = true;
+static int64_t gate_event_us = INT64_MAX;     // Next status pin change
+static int64_t gate_fully_open_us = -1;
+static uint32_t next_rolling_code = 1;
+static const bench_config_t *config = NULL;
+
+static void on_gpio_output(gpio_num_t pin, uint32_t level) {
+    if (pin != GATE_CMD_PIN_OUT || !level || gate_event_us != INT64_MAX) {
+        return;
+    }
+    int64_t now = esp_timer_get_time();
+    int64_t travel_us = (int64_t)config->travel_ms * 1000;
+    if (gate_closed) {
+        gate_event_us = now + GATE_START_US;
+        gate_fully_open_us = now + travel_us;
+    } else {
+        gate_event_us = now + travel_us;
+    }
+}
+
+static void deliver_packet(uint8_t command, int8_t rssi) {
+    espnow_data_t pkt = {
+        .version = SUPPORTED_PROTOCOL_VERSION,
+        .rolling_code = next_rolling_code++,
+        .command = command,
+    };
+    wifi_pkt_rx_ctrl_t rx_ctrl = {.rssi = rssi};
+    esp_now_recv_info_t info = {.src_addr = receiver_host_sender_mac, .rx_ctrl = &rx_ctrl};
+    receive_cb(&info, (const uint8_t *)&pkt, sizeof(pkt));
+}
+
+/* Run the event loop until `until_us`, applying gate movements on the way */
+static void run_until(int64_t until_us) {
+    while (1) {
+        int64_t wake_us = host_task_notify_pending() ? esp_timer_get_time()
+                                                     : receiver_host_wake_deadline_us();
+        if (gate_event_us <= wake_us && gate_event_us <= until_us) {
+            host_clock_set_us(gate_event_us);
+            gate_event_us = INT64_MAX;
+            gate_closed = !gate_closed;
+            host_gpio_set_input(GATE_STATUS_PIN_INPUT, gate_closed);
+            continue;
+        }
+        if (wake_us > until_us) {
+            break;
+        }
+        host_clock_set_us(wake_us);
+        receiver_host_event_pass();
+    }
+    host_clock_set_us(until_us);
+}
+
+static double gaussian(void) {
+    double u1 = (rand() + 1.0) / (RAND_MAX + 2.0);
+    double u2 = (rand() + 1.0) / (RAND_MAX + 2.0);
+    return sqrt(-2.0 * log(u1)) * cos(2.0 * M_PI * u2);
+}
+
+/* One trial: learn the travel time, then approach. Returns false if the gate never opened. */
+static bool run_trial(bool early_open, int64_t *open_vs_arrival_us, int64_t *prediction_error_us) {
+    host_sim_reset();
+    gate_closed = false; // Start open so the first toggle times a full close
+    gate_event_us = INT64_MAX;
+    gate_fully_open_us = -1;
+    next_rolling_code = 1;
+    host_gpio_set_input(GATE_STATUS_PIN_INPUT, 0);
+    receiver_host_init();
+    estimator_early_open = early_open;
+    host_gpio_set_output_hook(on_gpio_output);
+    host_clock_set_us(TRIAL_START_US);
+
+    /* Close the gate with a force-open toggle */
+    deliver_packet(CMD_FORCE_OPEN, -60);
+    run_until(TRIAL_START_US + (int64_t)config->travel_ms * 1000 + 2000000);
+
+    /* Straight approach */
+    double speed_mps = config->speed_kmh / 3.6;
+    int64_t start_us = esp_timer_get_time();
+    int64_t arrival_us = start_us + (int64_t)((START_DISTANCE_M - ARRIVAL_DISTANCE_M) / speed_mps * 1e6);
+    for (int64_t t = start_us; t < arrival_us; t += PING_INTERVAL_US + rand() % 2000) {
+        double distance_m = START_DISTANCE_M - speed_mps * (t - start_us) / 1e6;
+        double rssi = RSSI_AT_1M_DBM - 10.0 * PATH_LOSS_EXPONENT * log10(distance_m)
+                      + gaussian() * config->noise_db;
+        run_until(t);
+        if (rssi >= RSSI_FLOOR_DBM) {
+            deliver_packet(CMD_PING, (int8_t)lround(rssi < -128 ? -128 : rssi));
+        }
+    }
+    /* Keep riding in at the gate so the estimator sees the arrival */
+    for (int i = 0; i < 8; i++) {
+        run_until(esp_timer_get_time() + PING_INTERVAL_US);
+        deliver_packet(CMD_PING, (int8_t)(RSSI_AT_1M_DBM - 10.0 * PATH_LOSS_EXPONENT * log10(ARRIVAL_DISTANCE_M / 2)));
+    }
+    run_until(esp_timer_get_time() + 1000000);
+
+    if (gate_fully_open_us < 0) {
+        return false;
+    }
+    *open_vs_arrival_us = gate_fully_open_us - arrival_us;
+    *prediction_error_us = estimator_stats.open_command_us
+        ? estimator_stats.predicted_arrival_us - arrival_us : INT64_MIN;
+    return true;
+}
+
+/* Serialize the receiver's trace buffer to a file */
+static void write_trace(const char *path) {
+    size_t size = trace_serialized_size();
+    uint8_t *buf = malloc(size);
+    FILE *f = fopen(path, "wb");
+    if (buf == NULL || f == NULL) {
+        fprintf(stderr, "Cannot write %s\n", path);
+        exit(1);
+    }
+    trace_read(buf, 0, size);
+    fwrite(buf, 1, size, f);
+    fclose(f);
+    free(buf);
+    printf("%-30s %zu bytes, %u records, %u blocks evicted -> %s\n", "trace",
+           size, trace_stats.staged, trace_stats.blocks_evicted, path);
+}
+
+static int cmp_i64(const void *a, const void *b) {
+    int64_t x = *(const int64_t *)a;
+    int64_t y = *(const int64_t *)b;
+    return (x > y) - (x < y);
+}
+
+static double percentile_ms(sample_set_t *set, uint32_t pct) {
+    return set->samples[(uint64_t)(set->count - 1) * pct / 100] / 1000.0;
+}
+
+static void report(const char *name, sample_set_t *set, uint32_t misses, bool show_in_time) {
+    qsort(set->samples, set->count, sizeof(int64_t), cmp_i64);
+    if (set->count == 0) {
+        printf("%-30s no samples (%u never opened)\n", name, misses);
+        return;
+    }
+    printf("%-30s p10=%9.1f ms  p50=%9.1f ms  p90=%9.1f ms",
+           name, percentile_ms(set, 10), percentile_ms(set, 50), percentile_ms(set, 90));
+    if (show_in_time) {
+        uint32_t in_time = 0;
+        for (uint32_t i = 0; i < set->count; i++) {
+            in_time += set->samples[i] <= 0;
+        }
+        printf("  open in time %5.1f%%  never opened=%u", 100.0 * in_time / set->count, misses);
+    }
+    printf("\n");
+}
+
+static void parse_args(int argc, char **argv, bench_config_t *cfg) {
+    for (int i = 1; i + 1 < argc; i += 2) {
+        if (strcmp(argv[i], "--trace") == 0) {
+            cfg->trace_path = argv[i + 1];
+            continue;
+        }
+        uint32_t value = (uint32_t)strtoul(argv[i + 1], NULL, 10);
+        if (strcmp(argv[i], "--trials") == 0) {
+            cfg->trials = value ? value : 1;
+        } else if (strcmp(argv[i], "--speed-kmh") == 0) {
+            cfg->speed_kmh = value ? value : 1;
+        } else if (strcmp(argv[i], "--travel-ms") == 0) {
+            cfg->travel_ms = value ? value : 1;
+        } else if (strcmp(argv[i], "--noise-db") == 0) {
+            cfg->noise_db = value;
+        } else if (strcmp(argv[i], "--seed") == 0) {
+            cfg->seed = value;
+        } else {
+            fprintf(stderr, "Unknown option %s\n", argv[i]);
+            exit(1);
+        }
+    }
+}
+
+int main(int argc, char **argv) {
+    bench_config_t cfg = {
+        .trials = 200,
+        .speed_kmh = 25,
+        .travel_ms = 10000,
+        .noise_db = 3,
+        .seed = 1,
+    };
+    parse_args(argc, argv, &cfg);
+    config = &cfg;
+
+    sample_set_t open = {.samples = calloc(cfg.trials, sizeof(int64_t))};
+    sample_set_t predicted = {.samples = calloc(cfg.trials, sizeof(int64_t))};
+    if (open.samples == NULL || predicted.samples == NULL) {
+        fprintf(stderr, "Out of memory\n");
+        return 1;
+    }
+
+    printf("trials=%u  speed=%u km/h  gate travel=%u ms  noise=%u dB\n",
+           cfg.trials, cfg.speed_kmh, cfg.travel_ms, cfg.noise_db);
+    printf("gate fully open relative to arrival (negative = already open when the bike arrives)\n");
+
+    for (int early = 0; early <= 1; early++) {
+        srand(cfg.seed);
+        uint32_t misses = 0;
+        int64_t learned_travel_us = 0;
+        for (uint32_t t = 0; t < cfg.trials; t++) {
+            int64_t open_us, prediction_us;
+            if (!run_trial(early, &open_us, &prediction_us)) {
+                misses++;
+                continue;
+            }
+            open.samples[open.count++] = open_us;
+            if (prediction_us != INT64_MIN) {
+                predicted.samples[predicted.count++] = prediction_us;
+            }
+            learned_travel_us = estimator_stats.gate_travel_us;
+        }
+        report(early ? "estimator early open" : "window check only", &open, misses, true);
+        if (early) {
+            printf("%-30s learned %lld ms\n", "gate travel", (long long)(learned_travel_us / 1000));
+            report("predicted - actual arrival", &predicted, 0, false);
+            if (cfg.trace_path != NULL) {
+                write_trace(cfg.trace_path);
+            }
+        }
+        open.count = 0;
+        predicted.count = 0;
+    }
+
+    free(open.samples);
+    free(predicted.samples);
+    return 0;
+}
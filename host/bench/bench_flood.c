@@ -0,0 +1,227 @@
+/* --------------------------------------------------------------------------
+ * receive_cb flood benchmark
+ *
+ * A paired sender pings every 250 ms and sends a force open every 10 s while
+ * an attacker floods receive_cb at each --rates value: replays of codes it
+ * sniffed from the sender, packets from random unpaired MACs, and packets
+ * with a bad protocol version. The main task only gets to drain the 8-slot
+ * packet rings once per --service-us, as it would behind the higher priority
+ * Wi-Fi task. Each rate runs with the receive_cb pre-filter off and on:
+ *
+ *   queued     packets that took a ring slot
+ *   full       packets dropped because their lane's ring was full
+ *   genuine    genuine pings and force opens that got a ring slot, of those sent
+ *   opens      genuine force opens that got a ring slot
+ *   forged     gate toggles by a replayed code whose genuine copy was dropped,
+ *              resent by the attacker as a force open
+ *   cb ns      host CPU time per receive_cb call
+ *
+ * Usage: bench_flood [--seconds N] [--service-us N] [--seed N]
+ *                    [--rates N,N,...]
+ * -------------------------------------------------------------------------- */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "esp_timer.h"
+#include "host_sim.h"
+#include "receiver_host.h"
+#include "gpio_config.h"
+#include "espnow_config.h"
+#include "event_processing.h"
+
+#define TRIAL_START_US      1000000000LL    // Well past every cooldown
+#define PING_US             250000LL
+#define FORCE_OPEN_US       10000000LL
+#define SNIFFED_CODES       48              // Recent codes the attacker replays
+#define MAX_RATES           8
+
+typedef struct {
+    uint32_t seconds;
+    uint32_t service_us;
+    uint32_t seed;
+    uint32_t rates[MAX_RATES];
+    uint32_t rate_count;
+} bench_config_t;
+
+typedef struct {
+    uint32_t pings_sent;
+    uint32_t opens_sent;
+    uint32_t genuine_queued;
+    uint32_t opens_queued;
+    uint32_t toggles;
+    uint64_t cb_ns;
+    uint32_t cb_calls;
+} flood_result_t;
+
+/* Gate model: status pin high while closed, moves one service pass after a command */
+static bool gate_closed = true;
+static bool gate_cmd = false;
+static bool gate_flip_pending = false;
+static uint32_t gate_toggles = 0;
+
+static void on_gpio_output(gpio_num_t pin, uint32_t level) {
+    if (pin != GATE_CMD_PIN_OUT) {
+        return;
+    }
+    if (level && !gate_cmd) {
+        gate_toggles++;
+        gate_flip_pending = true;
+    }
+    gate_cmd = level;
+}
+
+static bool deliver(uint8_t *mac, uint8_t version, uint8_t command, uint32_t code, flood_result_t *res) {
+    uint32_t queued = espnow_rx_stats.queued;
+    espnow_data_t pkt = {
+        .version = version,
+        .rolling_code = code,
+        .command = command,
+    };
+    wifi_pkt_rx_ctrl_t rx_ctrl = {.rssi = -85};
+    esp_now_recv_info_t info = {.src_addr = mac, .rx_ctrl = &rx_ctrl};
+    uint64_t start_ns = host_wall_ns();
+    receive_cb(&info, (const uint8_t *)&pkt, sizeof(pkt));
+    res->cb_ns += host_wall_ns() - start_ns;
+    res->cb_calls++;
+    return espnow_rx_stats.queued != queued;
+}
+
+static void flood_packet(uint32_t genuine_code, flood_result_t *res) {
+    int kind = rand() % 10;
+    if (kind < 5 && genuine_code > 1) {
+        /* Replay of a recently sniffed code */
+        uint32_t back = 1 + rand() % (genuine_code - 1 < SNIFFED_CODES ? genuine_code - 1 : SNIFFED_CODES);
+        deliver(receiver_host_sender_mac, SUPPORTED_PROTOCOL_VERSION, rand() % 2, genuine_code - back, res);
+    } else if (kind < 8) {
+        uint8_t mac[ESP_NOW_ETH_ALEN];
+        for (int i = 0; i < ESP_NOW_ETH_ALEN; i++) {
+            mac[i] = (uint8_t)rand();
+        }
+        deliver(mac, SUPPORTED_PROTOCOL_VERSION, CMD_PING, (uint32_t)rand(), res);
+    } else {
+        deliver(receiver_host_sender_mac, SUPPORTED_PROTOCOL_VERSION + 1, CMD_FORCE_OPEN,
+                genuine_code + 1, res);
+    }
+}
+
+static flood_result_t run_flood(const bench_config_t *cfg, uint32_t rate, bool prefilter) {
+    flood_result_t res = {0};
+    host_sim_reset();
+    host_gpio_set_input(GATE_STATUS_PIN_INPUT, 1);
+    host_clock_set_us(TRIAL_START_US);
+    receiver_host_init();
+    espnow_rx_prefilter = prefilter;
+    host_gpio_set_output_hook(on_gpio_output);
+    gate_closed = true;
+    gate_cmd = false;
+    gate_flip_pending = false;
+    gate_toggles = 0;
+
+    uint32_t code = 0;
+    int64_t flood_period_ns = rate ? 1000000000LL / rate : 0;
+    int64_t next_flood_ns = rate ? (int64_t)TRIAL_START_US * 1000 : INT64_MAX;
+    int64_t next_ping_us = TRIAL_START_US + rand() % PING_US;
+    int64_t next_open_us = TRIAL_START_US + FORCE_OPEN_US / 2 + rand() % PING_US;
+    int64_t end_us = TRIAL_START_US + (int64_t)cfg->seconds * 1000000;
+
+    for (int64_t t = TRIAL_START_US; t < end_us; t += cfg->service_us) {
+        int64_t pass_us = t + cfg->service_us;
+        /* Everything that arrives before the main task runs again, in time order */
+        while (1) {
+            int64_t flood_us = next_flood_ns / 1000;
+            int64_t genuine_us = next_ping_us < next_open_us ? next_ping_us : next_open_us;
+            int64_t at_us = flood_us < genuine_us ? flood_us : genuine_us;
+            if (at_us >= pass_us) {
+                break;
+            }
+            host_clock_set_us(at_us);
+            if (flood_us <= genuine_us) {
+                flood_packet(code, &res);
+                next_flood_ns += flood_period_ns;
+            } else if (next_open_us <= next_ping_us) {
+                if (deliver(receiver_host_sender_mac, SUPPORTED_PROTOCOL_VERSION, CMD_FORCE_OPEN, ++code, &res)) {
+                    res.genuine_queued++;
+                    res.opens_queued++;
+                }
+                res.opens_sent++;
+                next_open_us += FORCE_OPEN_US + rand() % 1000;
+            } else {
+                res.genuine_queued += deliver(receiver_host_sender_mac, SUPPORTED_PROTOCOL_VERSION,
+                                              CMD_PING, ++code, &res);
+                res.pings_sent++;
+                next_ping_us += PING_US - PING_US / 10 + rand() % (PING_US / 5);
+            }
+        }
+
+        host_clock_set_us(pass_us);
+        if (gate_flip_pending) {
+            gate_flip_pending = false;
+            gate_closed = !gate_closed;
+            host_gpio_set_input(GATE_STATUS_PIN_INPUT, gate_closed);
+        }
+        receiver_host_event_pass();
+    }
+    res.toggles = gate_toggles;
+    return res;
+}
+
+static void parse_rates(const char *arg, bench_config_t *cfg) {
+    cfg->rate_count = 0;
+    const char *p = arg;
+    while (*p && cfg->rate_count < MAX_RATES) {
+        char *end;
+        cfg->rates[cfg->rate_count++] = (uint32_t)strtoul(p, &end, 10);
+        p = *end == ',' ? end + 1 : end;
+        if (end == p && *p) {
+            break;
+        }
+    }
+}
+
+static void parse_args(int argc, char **argv, bench_config_t *cfg) {
+    for (int i = 1; i + 1 < argc; i += 2) {
+        uint32_t value = (uint32_t)strtoul(argv[i + 1], NULL, 10);
+        if (strcmp(argv[i], "--seconds") == 0) {
+            cfg->seconds = value ? value : 1;
+        } else if (strcmp(argv[i], "--service-us") == 0) {
+            cfg->service_us = value ? value : 1;
+        } else if (strcmp(argv[i], "--seed") == 0) {
+            cfg->seed = value;
+        } else if (strcmp(argv[i], "--rates") == 0) {
+            parse_rates(argv[i + 1], cfg);
+        } else {
+            fprintf(stderr, "Unknown option %s\n", argv[i]);
+            exit(1);
+        }
+    }
+}
+
+int main(int argc, char **argv) {
+    bench_config_t cfg = {
+        .seconds = 60,
+        .service_us = 5000,
+        .seed = 1,
+        .rates = {0, 1000, 2000, 5000, 10000},
+        .rate_count = 5,
+    };
+    parse_args(argc, argv, &cfg);
+
+    printf("seconds=%u  main task drains the rings every %u us  %d slots per lane\n", cfg.seconds, cfg.service_us, RX_RING_SLOTS);
+    printf("rate/s  filter   queued     full  replayed  unknown  format         genuine   opens  forged  cb ns\n");
+    for (uint32_t r = 0; r < cfg.rate_count; r++) {
+        for (int prefilter = 0; prefilter < 2; prefilter++) {
+            srand(cfg.seed);
+            flood_result_t res = run_flood(&cfg, cfg.rates[r], prefilter);
+            uint32_t sent = res.pings_sent + res.opens_sent;
+            printf("%6u  %-6s %8u %8u %9u %8u %7u  %7u %5.1f%%  %3u/%-3u %6u  %5.0f\n",
+                   cfg.rates[r], prefilter ? "on" : "off", espnow_rx_stats.queued,
+                   rx_rings[EVENT_LANE_COMMAND].stats.overflows + rx_rings[EVENT_LANE_PING].stats.overflows,
+                   espnow_rx_stats.replayed, espnow_rx_stats.unknown_sender, espnow_rx_stats.bad_format,
+                   res.genuine_queued, 100.0 * res.genuine_queued / sent, res.opens_queued, res.opens_sent,
+                   res.toggles > res.opens_queued ? res.toggles - res.opens_queued : 0,
+                   (double)res.cb_ns / res.cb_calls);
+        }
+    }
+    return 0;
+}
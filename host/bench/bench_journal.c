@@ -0,0 +1,316 @@
+/* --------------------------------------------------------------------------
+ * Rolling code journal benchmark
+ *
+ * Runs the shared rc_journal.c against the simulated raw flash partition:
+ *
+ *   wear      codes used over --days at the sender's 1 Hz idle ping, with a
+ *             reboot every --reboot-hours; flash writes, erases and the
+ *             most-erased sector next to the nvs_commit calls of the
+ *             periodic NVS save it replaces
+ *   boot      flash reads to recover the value with the binary search,
+ *             against a linear scan of the newest sector
+ *   power     --cuts random power cuts in the middle of writes and erases,
+ *             with codes of --keys senders interleaved; every recovered
+ *             value must cover the codes used before the cut
+ *   replay    receiver pipeline: accept a run of codes, cut power, reboot and
+ *             replay the last code, with the journal and with NVS only
+ *   wrap      codes reserved across the 32-bit wrap and recovered after a reboot
+ *   holes     record writes that fail without a power cut, leaving their slot
+ *             as it was, then more appends and a reboot; every recovered
+ *             value must cover the codes used
+ *
+ * Usage: bench_journal [--days N] [--reboot-hours N] [--cuts N] [--keys N] [--seed N]
+ * -------------------------------------------------------------------------- */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "esp_timer.h"
+#include "host_sim.h"
+#include "receiver_host.h"
+#include "espnow_config.h"
+#include "event_processing.h"
+#include "nvs_config.h"
+#include "sender_table.h"
+#include "rc_journal.h"
+
+#define JOURNAL_SIZE        0x4000          // Same as partitions.csv
+#define PING_PER_DAY        86400UL         // Sender idle state pings at 1 Hz
+#define SENDER_NVS_SAVE_S   (6 * 3600)      // SAVE_ROLLING_CODE_DELAY_US
+#define RECEIVER_NVS_SAVE_S (12 * 3600)     // FLASH_WRITE_DELAY_US
+#define REPLAY_CODES        500
+
+typedef struct {
+    uint32_t days;
+    uint32_t reboot_hours;
+    uint32_t cuts;
+    uint32_t keys;
+    uint32_t seed;
+} bench_config_t;
+
+static void fresh_flash(void) {
+    host_sim_reset();
+    host_flash_create(RC_JOURNAL_PARTITION_LABEL, RC_JOURNAL_PARTITION_SUBTYPE, JOURNAL_SIZE);
+}
+
+/* Reads a linear scan of the newest sector would take to find its end */
+static uint32_t linear_scan_reads(const rc_journal_t *journal) {
+    return journal->sector_count + journal->next_slot + (journal->next_slot < RC_JOURNAL_SLOTS);
+}
+
+/* --------------------------------------------------------------------------
+ * Wear and boot cost
+ * -------------------------------------------------------------------------- */
+
+static void bench_wear(const bench_config_t *cfg) {
+    fresh_flash();
+    rc_journal_t journal;
+    rc_journal_open(&journal, RC_JOURNAL_PARTITION_LABEL);
+    rc_journal_append(&journal, RC_JOURNAL_KEY_OWN, 1);
+
+    uint64_t codes = (uint64_t)cfg->days * PING_PER_DAY;
+    uint64_t reboot_every = (uint64_t)cfg->reboot_hours * 3600;
+    uint32_t code = 1;
+    uint32_t reboots = 0;
+    uint64_t binary_reads = 0;
+    uint64_t linear_reads = 0;
+    uint32_t max_skipped = 0;
+
+    for (uint64_t i = 1; i <= codes; i++) {
+        if (rc_journal_reserve(&journal, RC_JOURNAL_KEY_OWN, code + 1) != ESP_OK) {
+            printf("wear: append failed at code %u\n", code + 1);
+            return;
+        }
+        code++;
+        if (reboot_every && i % reboot_every == 0) {
+            rc_journal_open(&journal, RC_JOURNAL_PARTITION_LABEL);
+            binary_reads += journal.stats.flash_reads;
+            linear_reads += linear_scan_reads(&journal);
+            uint32_t recovered = 0;
+            rc_journal_get(&journal, RC_JOURNAL_KEY_OWN, &recovered);
+            if (recovered - code > max_skipped) {
+                max_skipped = recovered - code;
+            }
+            code = recovered;
+            reboots++;
+        }
+    }
+
+    host_flash_stats_t stats;
+    host_flash_get_stats(&stats);
+    double per_day = cfg->days ? 1.0 / cfg->days : 0;
+    uint32_t sectors = JOURNAL_SIZE / RC_JOURNAL_SECTOR_SIZE;
+    printf("wear: %u days, %llu codes, %u sectors, %u codes per record\n",
+           cfg->days, (unsigned long long)codes, sectors, RC_JOURNAL_RESERVE);
+    printf("  journal   %8.1f writes/day  %6.2f erases/day  most-erased sector %u (%.0f years to 100k)\n",
+           stats.writes * per_day, stats.erases * per_day, stats.max_sector_erases,
+           stats.max_sector_erases ? 100000.0 * cfg->days / stats.max_sector_erases / 365 : 0.0);
+    printf("  NVS save  %8.1f commits/day (sender every 6 h), %.1f (receiver every 12 h), "
+           "up to %u codes lost per power cut\n",
+           86400.0 / SENDER_NVS_SAVE_S, 86400.0 / RECEIVER_NVS_SAVE_S,
+           (unsigned)(SENDER_NVS_SAVE_S * PING_PER_DAY / 86400));
+    printf("  journal   0 codes lost per power cut, up to %u codes skipped per reboot\n", max_skipped);
+    if (reboots) {
+        printf("boot: %u reboots, %.1f flash reads with binary search, %.1f with a linear scan\n",
+               reboots, (double)binary_reads / reboots, (double)linear_reads / reboots);
+    }
+}
+
+/* --------------------------------------------------------------------------
+ * Power cuts
+ * -------------------------------------------------------------------------- */
+
+static void bench_power_cuts(const bench_config_t *cfg) {
+    fresh_flash();
+    rc_journal_t journal;
+    rc_journal_open(&journal, RC_JOURNAL_PARTITION_LABEL);
+
+    uint32_t codes[RC_JOURNAL_MAX_KEYS];    // Last code used per key
+    for (uint32_t k = 0; k < cfg->keys; k++) {
+        codes[k] = 1;
+        rc_journal_append(&journal, (uint8_t)k, 1);
+    }
+    uint32_t failures = 0;
+
+    for (uint32_t cut = 0; cut < cfg->cuts && failures == 0; cut++) {
+        host_flash_cut_power_after((uint32_t)(rand() % 200));
+        /* Use codes until the flash loses power; a code is only used once reserved */
+        uint8_t key = (uint8_t)(rand() % cfg->keys);
+        while (rc_journal_reserve(&journal, key, codes[key] + 1) == ESP_OK) {
+            codes[key]++;
+            key = (uint8_t)(rand() % cfg->keys);
+        }
+        host_flash_power_on();
+        rc_journal_open(&journal, RC_JOURNAL_PARTITION_LABEL);
+        for (uint32_t k = 0; k < cfg->keys; k++) {
+            uint32_t recovered;
+            if (!rc_journal_get(&journal, (uint8_t)k, &recovered) || recovered < codes[k]) {
+                failures++;
+                printf("power: cut %u lost key %u (used code %u)\n", cut, k, codes[k]);
+                break;
+            }
+            codes[k] = recovered;
+        }
+    }
+    printf("power: %u cuts during writes and erases, %u keys, %u recoveries below a used code\n",
+           cfg->cuts, cfg->keys, failures);
+}
+
+/* --------------------------------------------------------------------------
+ * Receiver replay after a power cut
+ * -------------------------------------------------------------------------- */
+
+static void deliver_packet(uint32_t rolling_code) {
+    espnow_data_t pkt = {
+        .version = SUPPORTED_PROTOCOL_VERSION,
+        .rolling_code = rolling_code,
+        .command = CMD_PING,
+    };
+    wifi_pkt_rx_ctrl_t rx_ctrl = {.rssi = -90};
+    esp_now_recv_info_t info = {.src_addr = receiver_host_sender_mac, .rx_ctrl = &rx_ctrl};
+    receive_cb(&info, (const uint8_t *)&pkt, sizeof(pkt));
+    host_clock_advance_us(250000);
+    receiver_host_event_pass();
+}
+
+/* Accept REPLAY_CODES codes, lose power, reboot and replay the last one */
+static bool replay_accepted(bool journal) {
+    host_sim_reset();
+    if (journal) {
+        host_flash_create(RC_JOURNAL_PARTITION_LABEL, RC_JOURNAL_PARTITION_SUBTYPE, JOURNAL_SIZE);
+    }
+    host_clock_set_us(1000000);
+    receiver_host_init();
+    save_paired_senders();
+    load_paired_senders();
+    for (uint32_t code = 2; code <= REPLAY_CODES; code++) {
+        deliver_packet(code);
+    }
+
+    /* Power cut: RAM state is gone, NVS and flash stay */
+    receiver_host_init();
+    load_paired_senders();
+    uint32_t before = sender_table_get(0)->replay.highest;
+    deliver_packet(REPLAY_CODES);
+    return sender_table_get(0)->replay.highest != before;
+}
+
+static void bench_replay(void) {
+    printf("replay: code %u after a power cut is %s with the journal, %s with NVS only\n",
+           REPLAY_CODES, replay_accepted(true) ? "ACCEPTED" : "rejected",
+           replay_accepted(false) ? "accepted" : "rejected");
+}
+
+/* --------------------------------------------------------------------------
+ * Codes across the 32-bit wrap
+ * -------------------------------------------------------------------------- */
+
+static void bench_wrap(void) {
+    fresh_flash();
+    rc_journal_t journal;
+    rc_journal_open(&journal, RC_JOURNAL_PARTITION_LABEL);
+    uint32_t code = UINT32_MAX - 1000;
+    rc_journal_append(&journal, RC_JOURNAL_KEY_OWN, code);
+    uint32_t refused = 0;
+    for (uint32_t i = 0; i < 2000; i++) {
+        if (rc_journal_reserve(&journal, RC_JOURNAL_KEY_OWN, code + 1) != ESP_OK) {
+            refused++;
+        }
+        code++;
+    }
+    rc_journal_open(&journal, RC_JOURNAL_PARTITION_LABEL);
+    uint32_t recovered = 0;
+    rc_journal_get(&journal, RC_JOURNAL_KEY_OWN, &recovered);
+    printf("wrap: 2000 codes from 2^32 - 1000, %u reservations refused, recovered %u covers last code %u: %s\n",
+           refused, recovered, code, (int32_t)(recovered - code) >= 0 ? "yes" : "NO");
+}
+
+/* --------------------------------------------------------------------------
+ * Failed writes in the middle of a sector
+ * -------------------------------------------------------------------------- */
+
+static void bench_holes(const bench_config_t *cfg) {
+    fresh_flash();
+    rc_journal_t journal;
+    rc_journal_open(&journal, RC_JOURNAL_PARTITION_LABEL);
+    uint32_t keys = cfg->keys < 4 ? cfg->keys : 4;
+    uint32_t codes[4];
+    for (uint32_t k = 0; k < keys; k++) {
+        codes[k] = 1;
+        rc_journal_append(&journal, (uint8_t)k, 1);
+    }
+    uint32_t failed = 0;
+    uint32_t failures = 0;
+
+    for (uint32_t round = 0; round < cfg->cuts && failures == 0; round++) {
+        /* One or two writes refused: the record alone, or the slot marking after it too */
+        for (uint32_t i = (uint32_t)(rand() % 40); i > 0; i--) {
+            uint8_t key = (uint8_t)(rand() % keys);
+            if (rc_journal_reserve(&journal, key, codes[key] + 1) == ESP_OK) {
+                codes[key]++;
+            }
+        }
+        host_flash_fail_writes(1 + (uint32_t)(rand() % 2));
+        uint8_t key = (uint8_t)(rand() % keys);
+        if (rc_journal_reserve(&journal, key, codes[key] + RC_JOURNAL_RESERVE) != ESP_OK) {
+            failed++;
+        }
+        host_flash_fail_writes(0);
+        for (uint32_t i = (uint32_t)(rand() % 40); i > 0; i--) {
+            key = (uint8_t)(rand() % keys);
+            if (rc_journal_reserve(&journal, key, codes[key] + 1) == ESP_OK) {
+                codes[key]++;
+            }
+        }
+        rc_journal_open(&journal, RC_JOURNAL_PARTITION_LABEL);
+        for (uint32_t k = 0; k < keys; k++) {
+            uint32_t recovered;
+            if (!rc_journal_get(&journal, (uint8_t)k, &recovered) || (int32_t)(recovered - codes[k]) < 0) {
+                failures++;
+                printf("holes: round %u lost key %u (used code %u)\n", round, k, codes[k]);
+                break;
+            }
+            codes[k] = recovered;
+        }
+    }
+    printf("holes: %u failed record writes, %u keys, %u recoveries below a used code\n", failed, keys, failures);
+}
+
+static void parse_args(int argc, char **argv, bench_config_t *cfg) {
+    for (int i = 1; i + 1 < argc; i += 2) {
+        uint32_t value = (uint32_t)strtoul(argv[i + 1], NULL, 10);
+        if (strcmp(argv[i], "--days") == 0) {
+            cfg->days = value ? value : 1;
+        } else if (strcmp(argv[i], "--reboot-hours") == 0) {
+            cfg->reboot_hours = value;
+        } else if (strcmp(argv[i], "--cuts") == 0) {
+            cfg->cuts = value;
+        } else if (strcmp(argv[i], "--keys") == 0) {
+            cfg->keys = value < 1 ? 1 : value > RC_JOURNAL_MAX_KEYS ? RC_JOURNAL_MAX_KEYS : value;
+        } else if (strcmp(argv[i], "--seed") == 0) {
+            cfg->seed = value;
+        } else {
+            fprintf(stderr, "Unknown option %s\n", argv[i]);
+            exit(1);
+        }
+    }
+}
+
+int main(int argc, char **argv) {
+    bench_config_t cfg = {
+        .days = 30,
+        .reboot_hours = 24,
+        .cuts = 2000,
+        .keys = SENDER_TABLE_MAX,
+        .seed = 1,
+    };
+    parse_args(argc, argv, &cfg);
+    srand(cfg.seed);
+
+    bench_wear(&cfg);
+    bench_power_cuts(&cfg);
+    bench_replay();
+    bench_wrap();
+    bench_holes(&cfg);
+    return 0;
+}
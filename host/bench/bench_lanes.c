@@ -0,0 +1,253 @@
+/* --------------------------------------------------------------------------
+ * Intake lane benchmark
+ *
+ * --senders paired vehicles parked in range ping the receiver at a combined
+ * rate of each --rates value, while one more sender sends a force open
+ * every 6 s. Two main loops handle the load:
+ *
+ *   fifo      the original loop: one packet per 5 ms pass, oldest first
+ *   lanes     process_pending_events(): the command lane first, then every
+ *             pending ping, with the main task only getting to run once per
+ *             --service-us behind the higher priority Wi-Fi task
+ *
+ * For each lane it reports packets dispatched and the queueing latency from
+ * arrival to dispatch (average and worst), and for force opens also the
+ * arrival to GATE_CMD_PIN_OUT latency and how many were lost to a full ring.
+ *
+ * Usage: bench_lanes [--senders N] [--seconds N] [--service-us N] [--seed N]
+ *                    [--rates N,N,...]
+ * -------------------------------------------------------------------------- */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "esp_timer.h"
+#include "host_sim.h"
+#include "receiver_host.h"
+#include "gpio_config.h"
+#include "espnow_config.h"
+#include "event_loop.h"
+#include "event_processing.h"
+#include "sender_table.h"
+
+#define TRIAL_START_US      1000000000LL    // Well past every cooldown
+#define FORCE_OPEN_US       6000000LL       // Just over TOGGLE_COOLDOWN_US
+#define PARKED_RSSI         -85             // Steady, so pings never trigger an auto open
+#define MAX_RATES           8
+#define MAX_OPENS           1024
+
+typedef enum {
+    LOOP_FIFO,
+    LOOP_LANES,
+} loop_mode_t;
+
+static const char *const loop_mode_names[] = {
+    [LOOP_FIFO]  = "fifo",
+    [LOOP_LANES] = "lanes",
+};
+
+typedef struct {
+    uint32_t senders;
+    uint32_t seconds;
+    uint32_t service_us;
+    uint32_t seed;
+    uint32_t rates[MAX_RATES];
+    uint32_t rate_count;
+} bench_config_t;
+
+typedef struct {
+    uint8_t mac[ESP_NOW_ETH_ALEN];
+    uint32_t next_code;
+} vehicle_t;
+
+static vehicle_t vehicles[SENDER_TABLE_MAX];
+static uint32_t opener_code;
+
+/* Force open waiting for the command pin, -1 if none */
+static int64_t open_arrival_us = -1;
+static int64_t open_latency_us[MAX_OPENS];
+static uint32_t open_count;
+
+/* Gate model: status pin high while closed, moves one pass after a command */
+static bool gate_closed = true;
+static bool gate_cmd = false;
+static bool gate_flip_pending = false;
+
+static void on_gpio_output(gpio_num_t pin, uint32_t level) {
+    if (pin != GATE_CMD_PIN_OUT) {
+        return;
+    }
+    if (level && !gate_cmd) {
+        gate_flip_pending = true;
+        if (open_arrival_us >= 0 && open_count < MAX_OPENS) {
+            open_latency_us[open_count++] = esp_timer_get_time() - open_arrival_us;
+        }
+        open_arrival_us = -1;
+    }
+    gate_cmd = level;
+}
+
+static void deliver(uint8_t *mac, uint8_t command, uint32_t code) {
+    espnow_data_t pkt = {
+        .version = SUPPORTED_PROTOCOL_VERSION,
+        .rolling_code = code,
+        .command = command,
+    };
+    wifi_pkt_rx_ctrl_t rx_ctrl = {.rssi = PARKED_RSSI};
+    esp_now_recv_info_t info = {.src_addr = mac, .rx_ctrl = &rx_ctrl};
+    receive_cb(&info, (const uint8_t *)&pkt, sizeof(pkt));
+}
+
+static void start_trial(const bench_config_t *cfg) {
+    host_sim_reset();
+    host_gpio_set_input(GATE_STATUS_PIN_INPUT, 1);
+    host_clock_set_us(TRIAL_START_US);
+    receiver_host_init();
+    host_gpio_set_output_hook(on_gpio_output);
+    for (uint32_t i = 0; i < cfg->senders; i++) {
+        vehicles[i].mac[0] = 0x24;
+        vehicles[i].mac[1] = 0x6f;
+        vehicles[i].mac[2] = 0x28;
+        vehicles[i].mac[3] = 0x10;
+        vehicles[i].mac[4] = (uint8_t)(i >> 8);
+        vehicles[i].mac[5] = (uint8_t)i;
+        vehicles[i].next_code = 1;
+        sender_table_add(vehicles[i].mac, 0);
+    }
+    opener_code = 0;
+    open_arrival_us = -1;
+    open_count = 0;
+    gate_closed = true;
+    gate_cmd = false;
+    gate_flip_pending = false;
+}
+
+/* Runs one main loop pass at the current time, then applies the gate model */
+static void run_pass(loop_mode_t mode) {
+    if (mode == LOOP_FIFO) {
+        receiver_host_loop_once(0);
+    } else {
+        receiver_host_event_pass();
+    }
+    if (gate_flip_pending) {
+        gate_flip_pending = false;
+        gate_closed = !gate_closed;
+        host_gpio_set_input(GATE_STATUS_PIN_INPUT, gate_closed);
+    }
+}
+
+static int cmp_i64(const void *a, const void *b) {
+    int64_t x = *(const int64_t *)a;
+    int64_t y = *(const int64_t *)b;
+    return (x > y) - (x < y);
+}
+
+static void run_trial(const bench_config_t *cfg, loop_mode_t mode, uint32_t rate) {
+    start_trial(cfg);
+    int64_t pass_us = mode == LOOP_FIFO ? RECEIVER_HOST_LOOP_MS * 1000 : cfg->service_us;
+    int64_t ping_period_ns = rate ? 1000000000LL / rate : 0;
+    int64_t next_ping_ns = rate ? (int64_t)TRIAL_START_US * 1000 + rand() % ping_period_ns : INT64_MAX;
+    int64_t next_open_us = TRIAL_START_US + FORCE_OPEN_US / 2;
+    int64_t end_us = TRIAL_START_US + (int64_t)cfg->seconds * 1000000;
+    uint32_t opens_sent = 0;
+    uint32_t next_sender = 0;
+
+    for (int64_t t = TRIAL_START_US; t < end_us; t += pass_us) {
+        int64_t pass_end_us = t + pass_us;
+        /* Everything the Wi-Fi task hands over before the main task runs again */
+        while (true) {
+            int64_t ping_us = next_ping_ns / 1000;
+            int64_t at_us = ping_us < next_open_us ? ping_us : next_open_us;
+            if (at_us >= pass_end_us) {
+                break;
+            }
+            host_clock_set_us(at_us);
+            if (next_open_us <= ping_us) {
+                uint32_t overflows = rx_rings[EVENT_LANE_COMMAND].stats.overflows;
+                deliver(receiver_host_sender_mac, CMD_FORCE_OPEN, ++opener_code);
+                if (rx_rings[EVENT_LANE_COMMAND].stats.overflows == overflows) {
+                    open_arrival_us = at_us;
+                }
+                opens_sent++;
+                next_open_us += FORCE_OPEN_US + rand() % pass_us;
+            } else {
+                /* Senders take turns, with random gaps so runs from one sender also occur */
+                vehicle_t *v = &vehicles[rand() % 4 ? next_sender++ % cfg->senders : next_sender % cfg->senders];
+                deliver(v->mac, CMD_PING, v->next_code++);
+                next_ping_ns += ping_period_ns - ping_period_ns / 4 + rand() % (ping_period_ns / 2 + 1);
+            }
+        }
+        host_clock_set_us(pass_end_us);
+        run_pass(mode);
+    }
+
+    const event_lane_stats_t *cmd = &event_loop_stats.lanes[EVENT_LANE_COMMAND];
+    const event_lane_stats_t *ping = &event_loop_stats.lanes[EVENT_LANE_PING];
+    uint32_t lost = rx_rings[EVENT_LANE_COMMAND].stats.overflows + rx_rings[EVENT_LANE_PING].stats.overflows;
+    qsort(open_latency_us, open_count, sizeof(open_latency_us[0]), cmp_i64);
+    printf("%7u  %-5s  %10u %7.2f %7.2f  %5u/%-5u %7.2f %7.2f  %7.2f %6u %8u\n",
+           rate, loop_mode_names[mode],
+           ping->dispatched, ping->dispatched ? ping->latency_sum_us / 1000.0 / ping->dispatched : 0.0,
+           ping->latency_max_us / 1000.0,
+           cmd->dispatched, opens_sent, cmd->dispatched ? cmd->latency_sum_us / 1000.0 / cmd->dispatched : 0.0,
+           cmd->latency_max_us / 1000.0,
+           open_count ? open_latency_us[open_count / 2] / 1000.0 : -1.0,
+           opens_sent - open_count, lost);
+}
+
+static void parse_rates(const char *arg, bench_config_t *cfg) {
+    cfg->rate_count = 0;
+    const char *p = arg;
+    while (*p && cfg->rate_count < MAX_RATES) {
+        char *end;
+        cfg->rates[cfg->rate_count++] = (uint32_t)strtoul(p, &end, 10);
+        p = *end == ',' ? end + 1 : end;
+        if (end == p && *p) {
+            break;
+        }
+    }
+}
+
+static void parse_args(int argc, char **argv, bench_config_t *cfg) {
+    for (int i = 1; i + 1 < argc; i += 2) {
+        uint32_t value = (uint32_t)strtoul(argv[i + 1], NULL, 10);
+        if (strcmp(argv[i], "--senders") == 0) {
+            cfg->senders = value < 1 ? 1 : value > SENDER_TABLE_MAX - 1 ? SENDER_TABLE_MAX - 1 : value;
+        } else if (strcmp(argv[i], "--seconds") == 0) {
+            cfg->seconds = value ? value : 1;
+        } else if (strcmp(argv[i], "--service-us") == 0) {
+            cfg->service_us = value ? value : 1;
+        } else if (strcmp(argv[i], "--seed") == 0) {
+            cfg->seed = value;
+        } else if (strcmp(argv[i], "--rates") == 0) {
+            parse_rates(argv[i + 1], cfg);
+        } else {
+            fprintf(stderr, "Unknown option %s\n", argv[i]);
+            exit(1);
+        }
+    }
+}
+
+int main(int argc, char **argv) {
+    bench_config_t cfg = {
+        .senders = 8,
+        .seconds = 600,
+        .service_us = 5000,
+        .seed = 1,
+        .rates = {0, 100, 200, 400, 1000},
+        .rate_count = 5,
+    };
+    parse_args(argc, argv, &cfg);
+
+    printf("%u parked senders, %u s, fifo pass every %d ms, lanes pass every %u us, %d slots per lane\n",
+           cfg.senders, cfg.seconds, RECEIVER_HOST_LOOP_MS, cfg.service_us, RX_RING_SLOTS);
+    printf("                 ping lane                    command lane                  pin\n");
+    printf("pings/s  loop   dispatched  avg ms  max ms  dispatched  avg ms  max ms   p50 ms missed     lost\n");
+    for (uint32_t r = 0; r < cfg.rate_count; r++) {
+        for (loop_mode_t mode = LOOP_FIFO; mode <= LOOP_LANES; mode++) {
+            srand(cfg.seed);
+            run_trial(&cfg, mode, cfg.rates[r]);
+        }
+    }
+    return 0;
+}
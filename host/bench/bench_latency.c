@@ -0,0 +1,286 @@
+/* --------------------------------------------------------------------------
+ * End-to-end receiver latency benchmark
+ *
+ * Feeds ESP-NOW packets through receive_cb() -> rx_rings -> process_event()
+ * -> state_machine_run() on the simulated clock and reports how long it takes
+ * from packet arrival to the GATE_CMD_PIN_OUT rising edge. Every scenario runs
+ * against the original 5 ms polling loop and the event-driven loop.
+ *
+ * Usage: bench_latency [--loop-ms N] [--trials N] [--ping-interval-ms N] [--seed N]
+ * -------------------------------------------------------------------------- */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "esp_timer.h"
+#include "host_sim.h"
+#include "receiver_host.h"
+#include "gpio_config.h"
+#include "espnow_config.h"
+#include "event_processing.h"
+
+#define TRIAL_START_US      1000000000LL // Well past every cooldown
+#define TRIAL_TIMEOUT_US    10000000LL   // Give up on a trial after 10 s
+#define IDLE_WINDOW_US      60000000LL   // Quiet period used to count idle wake-ups
+#define MAX_PINGS_PER_TRIAL 64
+
+typedef enum {
+    LOOP_POLL,
+    LOOP_EVENT,
+} loop_mode_t;
+
+static const char *const loop_mode_names[] = {
+    [LOOP_POLL]  = "poll",
+    [LOOP_EVENT] = "event",
+};
+
+typedef struct {
+    uint32_t loop_ms;
+    uint32_t trials;
+    uint32_t ping_interval_ms;
+    uint32_t seed;
+} bench_config_t;
+
+typedef struct {
+    int64_t *samples;
+    uint32_t count;
+    uint32_t misses;
+} latency_set_t;
+
+typedef struct {
+    const int64_t *arrivals;
+    const int8_t *rssi;
+    uint8_t command;
+    uint32_t count;
+} packet_plan_t;
+
+/* Per-trial simulation state */
+static int64_t cmd_rise_us = -1;
+static int64_t last_arrival_us = -1;
+static uint32_t next_rolling_code = 1;
+static uint64_t wakeups = 0;
+
+static void on_gpio_output(gpio_num_t pin, uint32_t level) {
+    if (pin == GATE_CMD_PIN_OUT && level && cmd_rise_us < 0) {
+        cmd_rise_us = esp_timer_get_time();
+    }
+}
+
+/* Deliver one packet as the Wi-Fi task would, stamped at its arrival time */
+static void deliver_packet(uint8_t command, int8_t rssi, int64_t arrival_us) {
+    int64_t now = esp_timer_get_time();
+    espnow_data_t pkt = {
+        .version = SUPPORTED_PROTOCOL_VERSION,
+        .rolling_code = next_rolling_code++,
+        .command = command,
+    };
+    wifi_pkt_rx_ctrl_t rx_ctrl = {.rssi = rssi};
+    esp_now_recv_info_t info = {.src_addr = receiver_host_sender_mac, .rx_ctrl = &rx_ctrl};
+
+    host_clock_set_us(arrival_us);
+    receive_cb(&info, (const uint8_t *)&pkt, sizeof(pkt));
+    if (now > arrival_us) {
+        host_clock_set_us(now);
+    }
+    last_arrival_us = arrival_us;
+}
+
+static void start_trial(void) {
+    host_sim_reset();
+    host_gpio_set_input(GATE_STATUS_PIN_INPUT, 1); // Closed, pulled up
+    receiver_host_init();
+    host_gpio_set_output_hook(on_gpio_output);
+    host_clock_set_us(TRIAL_START_US);
+
+    cmd_rise_us = -1;
+    last_arrival_us = -1;
+    next_rolling_code = 1;
+}
+
+/* Run one loop until `until_us` or the command pin rises, delivering planned packets */
+static void run_loop(loop_mode_t mode, const bench_config_t *cfg, const packet_plan_t *plan,
+                     int64_t until_us, latency_set_t *cpu) {
+    uint32_t next = 0;
+
+    while (esp_timer_get_time() < until_us && cmd_rise_us < 0) {
+        if (mode == LOOP_POLL) {
+            /* Packets that arrived during the last vTaskDelay() */
+            while (next < plan->count && plan->arrivals[next] <= esp_timer_get_time()) {
+                deliver_packet(plan->command, plan->rssi[next], plan->arrivals[next]);
+                next++;
+            }
+            uint64_t t0 = host_wall_ns();
+            bool processed = receiver_host_loop_once(cfg->loop_ms);
+            uint64_t t1 = host_wall_ns();
+            if (processed && cpu) {
+                cpu->samples[cpu->count++] = (int64_t)(t1 - t0);
+            }
+            wakeups++;
+            continue;
+        }
+
+        /* Event loop: sleep until the next packet or timer deadline, whichever is first */
+        int64_t wake_us = host_task_notify_pending() ? esp_timer_get_time()
+                                                     : receiver_host_wake_deadline_us();
+        int64_t packet_us = next < plan->count ? plan->arrivals[next] : INT64_MAX;
+        if (packet_us < wake_us) {
+            if (packet_us >= until_us) {
+                break;
+            }
+            deliver_packet(plan->command, plan->rssi[next], packet_us);
+            next++;
+            continue;
+        }
+        if (wake_us >= until_us) {
+            break;
+        }
+        host_clock_set_us(wake_us);
+
+        uint64_t t0 = host_wall_ns();
+        uint32_t dispatched = receiver_host_event_pass();
+        uint64_t t1 = host_wall_ns();
+        if (dispatched && cpu) {
+            cpu->samples[cpu->count++] = (int64_t)(t1 - t0);
+        }
+        wakeups++;
+    }
+    host_clock_set_us(esp_timer_get_time() > until_us ? esp_timer_get_time() : until_us);
+}
+
+static int cmp_i64(const void *a, const void *b) {
+    int64_t x = *(const int64_t *)a;
+    int64_t y = *(const int64_t *)b;
+    return (x > y) - (x < y);
+}
+
+static int64_t percentile(latency_set_t *set, uint32_t pct) {
+    if (set->count == 0) {
+        return -1;
+    }
+    return set->samples[(uint64_t)(set->count - 1) * pct / 100];
+}
+
+static void report(const char *mode, const char *name, latency_set_t *set, const char *unit, double scale) {
+    qsort(set->samples, set->count, sizeof(int64_t), cmp_i64);
+    if (set->count == 0) {
+        printf("%-5s %-24s  no samples (%u missed)\n", mode, name, set->misses);
+        return;
+    }
+    printf("%-5s %-24s  n=%-6u p50=%9.3f %s  p99=%9.3f %s  max=%9.3f %s  missed=%u\n",
+           mode, name, set->count,
+           percentile(set, 50) / scale, unit,
+           percentile(set, 99) / scale, unit,
+           set->samples[set->count - 1] / scale, unit,
+           set->misses);
+    set->count = 0;
+    set->misses = 0;
+}
+
+static void record_trial(latency_set_t *e2e) {
+    if (cmd_rise_us >= 0) {
+        e2e->samples[e2e->count++] = cmd_rise_us - last_arrival_us;
+    } else {
+        e2e->misses++;
+    }
+}
+
+static void bench_force_open(loop_mode_t mode, const bench_config_t *cfg,
+                             latency_set_t *e2e, latency_set_t *cpu) {
+    for (uint32_t t = 0; t < cfg->trials; t++) {
+        start_trial();
+        int64_t arrival = TRIAL_START_US + 20000 + rand() % ((int64_t)cfg->loop_ms * 1000);
+        int8_t rssi = -60;
+        packet_plan_t plan = {&arrival, &rssi, CMD_FORCE_OPEN, 1};
+
+        run_loop(mode, cfg, &plan, TRIAL_START_US + TRIAL_TIMEOUT_US, cpu);
+        record_trial(e2e);
+    }
+}
+
+static void bench_approach(loop_mode_t mode, const bench_config_t *cfg,
+                           latency_set_t *e2e, latency_set_t *cpu) {
+    int64_t arrivals[MAX_PINGS_PER_TRIAL];
+    int8_t rssi[MAX_PINGS_PER_TRIAL];
+
+    for (uint32_t t = 0; t < cfg->trials; t++) {
+        start_trial();
+        int64_t first = TRIAL_START_US + 20000 + rand() % ((int64_t)cfg->loop_ms * 1000);
+        for (uint32_t i = 0; i < MAX_PINGS_PER_TRIAL; i++) {
+            int64_t jitter = rand() % 2000; // Up to 2 ms of air/Wi-Fi task jitter
+            arrivals[i] = first + (int64_t)i * cfg->ping_interval_ms * 1000 + jitter;
+            rssi[i] = (int8_t)(-90 + (int)(i * 2 > 60 ? 60 : i * 2)); // Closing in, 2 dB per ping
+        }
+        packet_plan_t plan = {arrivals, rssi, CMD_PING, MAX_PINGS_PER_TRIAL};
+
+        run_loop(mode, cfg, &plan, TRIAL_START_US + TRIAL_TIMEOUT_US, cpu);
+        record_trial(e2e);
+    }
+}
+
+/* Wake-ups per second with nothing on the air */
+static double bench_idle_wakeups(loop_mode_t mode, const bench_config_t *cfg) {
+    packet_plan_t plan = {NULL, NULL, CMD_PING, 0};
+    start_trial();
+    run_loop(mode, cfg, &plan, TRIAL_START_US + IDLE_WINDOW_US / 10, NULL); // Let inputs settle
+    wakeups = 0;
+    run_loop(mode, cfg, &plan, esp_timer_get_time() + IDLE_WINDOW_US, NULL);
+    return wakeups * 1e6 / IDLE_WINDOW_US;
+}
+
+static void parse_args(int argc, char **argv, bench_config_t *cfg) {
+    for (int i = 1; i + 1 < argc; i += 2) {
+        uint32_t value = (uint32_t)strtoul(argv[i + 1], NULL, 10);
+        if (strcmp(argv[i], "--loop-ms") == 0) {
+            cfg->loop_ms = value ? value : 1;
+        } else if (strcmp(argv[i], "--trials") == 0) {
+            cfg->trials = value ? value : 1;
+        } else if (strcmp(argv[i], "--ping-interval-ms") == 0) {
+            cfg->ping_interval_ms = value ? value : 1;
+        } else if (strcmp(argv[i], "--seed") == 0) {
+            cfg->seed = value;
+        } else {
+            fprintf(stderr, "Unknown option %s\n", argv[i]);
+            exit(1);
+        }
+    }
+}
+
+int main(int argc, char **argv) {
+    bench_config_t cfg = {
+        .loop_ms = RECEIVER_HOST_LOOP_MS,
+        .trials = 2000,
+        .ping_interval_ms = 100,
+        .seed = 1,
+    };
+    parse_args(argc, argv, &cfg);
+
+    size_t cpu_cap = (size_t)cfg.trials * MAX_PINGS_PER_TRIAL;
+    latency_set_t e2e = {.samples = calloc(cfg.trials, sizeof(int64_t))};
+    latency_set_t cpu = {.samples = calloc(cpu_cap, sizeof(int64_t))};
+    if (e2e.samples == NULL || cpu.samples == NULL) {
+        fprintf(stderr, "Out of memory\n");
+        return 1;
+    }
+
+    printf("poll loop=%u ms  trials=%u  ping interval=%u ms\n",
+           cfg.loop_ms, cfg.trials, cfg.ping_interval_ms);
+
+    for (loop_mode_t mode = LOOP_POLL; mode <= LOOP_EVENT; mode++) {
+        const char *name = loop_mode_names[mode];
+        srand(cfg.seed);
+
+        bench_force_open(mode, &cfg, &e2e, &cpu);
+        report(name, "force-open arrival->pin", &e2e, "ms", 1000.0);
+        report(name, "force-open pass cpu", &cpu, "us", 1000.0);
+
+        bench_approach(mode, &cfg, &e2e, &cpu);
+        report(name, "approach arrival->pin", &e2e, "ms", 1000.0);
+        report(name, "approach pass cpu", &cpu, "us", 1000.0);
+
+        printf("%-5s %-24s  %.1f /s\n", name, "idle wake-ups", bench_idle_wakeups(mode, &cfg));
+    }
+
+    free(e2e.samples);
+    free(cpu.samples);
+    return 0;
+}
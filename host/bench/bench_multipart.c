@@ -0,0 +1,220 @@
+/* --------------------------------------------------------------------------
+ * OTA upload parsing benchmark: the original update handler loop against
+ * shared-lib multipart.c
+ *
+ * Builds --uploads browser-style form uploads of a --kb firmware image with a
+ * random-length preamble, so the boundary and the part headers land at a
+ * different offset in every upload, and cuts each into httpd_req_recv()
+ * chunks of at most --chunks bytes (one run per size, 0 for random sizes up
+ * to 4096). Both parsers write through an esp_ota_write() stand-in that
+ * copies into the output image:
+ *
+ *   original  CR LF CR LF searched in the first chunk only, then strstr()
+ *             for the boundary in each chunk on its own (the buffer is
+ *             NUL-terminated here, which the handler never did); strstr()
+ *             stops at the first zero byte, so it looks at little of a
+ *             binary chunk, which is why it is fast
+ *   streaming multipart_feed() over the same chunks
+ *
+ *   MB/s      upload bytes parsed per second, writes included
+ *   exact     uploads whose written image matches byte for byte
+ *
+ * Usage: bench_multipart [--uploads N] [--kb N] [--chunks N,N,...] [--seed N]
+ * -------------------------------------------------------------------------- */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "multipart.h"
+
+#define RECV_BUF_SIZE   4096
+#define MAX_CHUNK_SIZES 8
+#define BOUNDARY        "----WebKitFormBoundaryuVz4YkJ0q2XQb8Rn"
+
+typedef struct {
+    uint32_t uploads;
+    uint32_t kb;
+    uint32_t chunks[MAX_CHUNK_SIZES];
+    uint32_t chunk_count;
+    uint32_t seed;
+} bench_config_t;
+
+typedef struct {
+    uint8_t *data;
+    size_t len;
+    size_t max;
+} image_t;
+
+static const bench_config_t *cfg;
+
+/* Stands in for esp_ota_write() */
+static bool image_write(image_t *img, const void *data, size_t len) {
+    if (img->len + len > img->max) {
+        return false;
+    }
+    memcpy(img->data + img->len, data, len);
+    img->len += len;
+    return true;
+}
+
+static bool on_part_data(void *ctx, uint32_t part, const uint8_t *data, size_t len) {
+    return part != 0 || image_write(ctx, data, len);
+}
+
+static double now_s(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static size_t next_chunk(uint32_t max_chunk, size_t left) {
+    size_t n = max_chunk ? max_chunk : 1 + (size_t)rand() % RECV_BUF_SIZE;
+    return n < left ? n : left;
+}
+
+/* The loop update_handler_func ran before, minus the esp_ota_* error paths */
+static void parse_original(const uint8_t *upload, size_t len, uint32_t max_chunk, image_t *img) {
+    static char buf[RECV_BUF_SIZE + 1];
+    char boundary_pattern[132];
+    snprintf(boundary_pattern, sizeof(boundary_pattern), "\r\n--%s", BOUNDARY);
+    bool headers_parsed = false;
+    size_t pos = 0;
+    while (pos < len) {
+        size_t received = next_chunk(max_chunk, len - pos);
+        memcpy(buf, upload + pos, received);
+        buf[received] = '\0';
+        pos += received;
+        if (!headers_parsed) {
+            for (size_t i = 0; i + 3 < received; i++) {
+                if (memcmp(buf + i, "\r\n\r\n", 4) == 0) {
+                    headers_parsed = true;
+                    image_write(img, buf + i + 4, received - i - 4);
+                    break;
+                }
+            }
+        } else {
+            char *boundary_pos = strstr(buf, boundary_pattern);
+            if (boundary_pos) {
+                image_write(img, buf, boundary_pos - buf);
+                break;
+            }
+            image_write(img, buf, received);
+        }
+    }
+}
+
+static void parse_streaming(const uint8_t *upload, size_t len, uint32_t max_chunk, image_t *img) {
+    static uint8_t buf[RECV_BUF_SIZE];
+    static multipart_parser_t parser;
+    multipart_init(&parser, BOUNDARY, on_part_data, img);
+    size_t pos = 0;
+    while (pos < len) {
+        size_t received = next_chunk(max_chunk, len - pos);
+        memcpy(buf, upload + pos, received);    // httpd_req_recv() into the handler's buffer
+        pos += received;
+        if (multipart_feed(&parser, buf, received) >= MULTIPART_DONE) {
+            break;
+        }
+    }
+}
+
+/* One form upload around the image; returns its length */
+static size_t build_upload(uint8_t *out, const uint8_t *image, size_t image_len) {
+    size_t len = 0;
+    size_t preamble = (size_t)rand() % 3000;   // Moves everything after it to a new offset
+    memset(out, 'p', preamble);
+    len += preamble;
+    len += (size_t)sprintf((char *)out + len,
+                           "\r\n--" BOUNDARY "\r\n"
+                           "Content-Disposition: form-data; name=\"firmware\"; filename=\"gate.bin\"\r\n"
+                           "Content-Type: application/octet-stream\r\n\r\n");
+    memcpy(out + len, image, image_len);
+    len += image_len;
+    len += (size_t)sprintf((char *)out + len, "\r\n--" BOUNDARY "--\r\n");
+    return len;
+}
+
+static void parse_args(int argc, char **argv, bench_config_t *c) {
+    for (int i = 1; i + 1 < argc; i += 2) {
+        if (strcmp(argv[i], "--chunks") == 0) {
+            c->chunk_count = 0;
+            for (char *s = argv[i + 1]; *s && c->chunk_count < MAX_CHUNK_SIZES; s++) {
+                uint32_t n = (uint32_t)strtoul(s, &s, 10);
+                c->chunks[c->chunk_count++] = n > RECV_BUF_SIZE ? RECV_BUF_SIZE : n;
+                if (*s != ',') {
+                    break;
+                }
+            }
+            continue;
+        }
+        uint32_t value = (uint32_t)strtoul(argv[i + 1], NULL, 10);
+        if (strcmp(argv[i], "--uploads") == 0) {
+            c->uploads = value ? value : 1;
+        } else if (strcmp(argv[i], "--kb") == 0) {
+            c->kb = value ? value : 1;
+        } else if (strcmp(argv[i], "--seed") == 0) {
+            c->seed = value;
+        } else {
+            fprintf(stderr, "Unknown option %s\n", argv[i]);
+            exit(1);
+        }
+    }
+}
+
+int main(int argc, char **argv) {
+    static bench_config_t config = {
+        .uploads = 50,
+        .kb = 1024,
+        .chunks = {1436, 4096, 0},
+        .chunk_count = 3,
+        .seed = 1,
+    };
+    parse_args(argc, argv, &config);
+    cfg = &config;
+
+    size_t image_len = (size_t)cfg->kb * 1024;
+    uint8_t *image = malloc(image_len);
+    uint8_t *upload = malloc(image_len + 4096);
+    image_t out = {.data = malloc(image_len + 4096), .max = image_len + 4096};
+    if (image == NULL || upload == NULL || out.data == NULL) {
+        fprintf(stderr, "Out of memory\n");
+        return 1;
+    }
+
+    printf("%u uploads of a %u KB image\n", cfg->uploads, cfg->kb);
+    printf("chunk  parser        MB/s   exact\n");
+    for (uint32_t c = 0; c < cfg->chunk_count; c++) {
+        for (int streaming = 0; streaming <= 1; streaming++) {
+            srand(cfg->seed);
+            double busy_s = 0;
+            uint64_t bytes = 0;
+            uint32_t exact = 0;
+            for (uint32_t u = 0; u < cfg->uploads; u++) {
+                for (size_t i = 0; i < image_len; i++) {
+                    image[i] = (uint8_t)rand();
+                }
+                size_t len = build_upload(upload, image, image_len);
+                out.len = 0;
+                double start = now_s();
+                if (streaming) {
+                    parse_streaming(upload, len, cfg->chunks[c], &out);
+                } else {
+                    parse_original(upload, len, cfg->chunks[c], &out);
+                }
+                busy_s += now_s() - start;
+                bytes += len;
+                exact += out.len == image_len && memcmp(out.data, image, image_len) == 0;
+            }
+            char chunk[16];
+            snprintf(chunk, sizeof(chunk), cfg->chunks[c] ? "%u" : "random", cfg->chunks[c]);
+            printf("%-6s %-9s  %8.1f  %5.1f%%\n", chunk, streaming ? "streaming" : "original",
+                   bytes / busy_s / 1e6, 100.0 * exact / cfg->uploads);
+        }
+    }
+
+    free(image);
+    free(upload);
+    free(out.data);
+    return 0;
+}
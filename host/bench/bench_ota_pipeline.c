@@ -0,0 +1,218 @@
+/* --------------------------------------------------------------------------
+ * OTA upload timing model: serial receive and write against the pipeline
+ *
+ * Times a --kb image upload over the soft-AP on a simulated clock. The
+ * browser sends at --net-kbps while the socket has room in its --tcp-wnd
+ * receive window; each httpd_req_recv() takes what is buffered, waiting for
+ * a segment if there is none. Flash programs a sector in --program-ms and
+ * erases one in --sector-erase-ms, or a 64 KB block in --block-erase-ms;
+ * erase times vary from 0.6x to 1.6x. With --hash-kbps each buffer is hashed
+ * at that rate before it is written, by the receive stage when pipelined
+ * (ota_pipeline_submit()). The TCP stack is assumed to keep
+ * receiving while flash is busy. Four ways to upload:
+ *
+ *   serial        the original handler: recv and esp_ota_write() in turn,
+ *                 each new sector erased by the write that reaches it
+ *   pipelined     OTA_PIPELINE_BUFFERS sector buffers (ota_pipeline.c): the
+ *                 handler receives while the writer task flashes
+ *   serial+erase  esp_ota_begin() told the upload size, so the image is
+ *                 block-erased up front and writes only program
+ *   pipe+erase    both, as built
+ *
+ *   total s       upload start to the last write done
+ *   KB/s          image bytes over total time
+ *   recv stall    receive stage waiting for a free buffer or for flash, ms
+ *   writer idle   write stage waiting for a full buffer, ms
+ *   link %        share of the total the browser was sending
+ *
+ * Usage: bench_ota_pipeline [--kb N] [--net-kbps N] [--tcp-wnd N]
+ *                           [--program-ms N] [--sector-erase-ms N]
+ *                           [--block-erase-ms N] [--hash-kbps N] [--seed N]
+ * -------------------------------------------------------------------------- */
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ota_pipeline.h"
+
+#define TCP_MSS         1436
+#define RECV_COST_US    80          // lwIP copy and httpd per recv call
+#define BLOCK_SIZE      (64 * 1024)
+#define MAX_SECTORS     4096
+
+typedef struct {
+    uint32_t kb;
+    uint32_t net_kbps;
+    uint32_t tcp_wnd;
+    uint32_t program_ms;
+    uint32_t sector_erase_ms;
+    uint32_t block_erase_ms;
+    uint32_t hash_kbps;         // 0: not hashed
+    uint32_t seed;
+} bench_config_t;
+
+typedef struct {
+    double total_us;
+    double recv_stall_us;
+    double writer_idle_us;
+} result_t;
+
+static const bench_config_t *cfg;
+
+/* Socket: bytes the browser has sent into the receive window */
+static double sock_bytes;
+static double sock_updated_us;
+static double sent_bytes;
+static double upload_bytes;
+
+static void net_advance(double now_us) {
+    if (now_us <= sock_updated_us) {
+        return;
+    }
+    double can = cfg->net_kbps * 1024.0 * (now_us - sock_updated_us) / 1e6;
+    double room = cfg->tcp_wnd - sock_bytes;
+    double left = upload_bytes - sent_bytes;
+    double add = can < room ? can : room;
+    add = add < left ? add : left;
+    sock_bytes += add;
+    sent_bytes += add;
+    sock_updated_us = now_us;
+}
+
+/* One httpd_req_recv() of up to want bytes; returns the bytes and advances *now */
+static double net_recv(double *now_us, double want) {
+    net_advance(*now_us);
+    if (sock_bytes < 1) {
+        double segment = upload_bytes - sent_bytes < TCP_MSS ? upload_bytes - sent_bytes : TCP_MSS;
+        *now_us += segment / (cfg->net_kbps * 1024.0) * 1e6;
+        net_advance(*now_us);
+    }
+    double got = sock_bytes < want ? sock_bytes : want;
+    sock_bytes -= got;
+    *now_us += RECV_COST_US;
+    return got;
+}
+
+/* Receive one sector buffer's worth of image */
+static double fill_buffer(double now_us, double len) {
+    while (len > 0.5) {
+        len -= net_recv(&now_us, len);
+    }
+    return now_us;
+}
+
+static double erase_jitter(void) {
+    return 0.6 + (double)rand() / RAND_MAX;
+}
+
+static void run(bool pipelined, bool erase_ahead, uint32_t sectors, result_t *res) {
+    static double write_done_us[MAX_SECTORS];
+    memset(res, 0, sizeof(*res));
+    sock_bytes = 0;
+    sock_updated_us = 0;
+    sent_bytes = 0;
+    upload_bytes = (double)cfg->kb * 1024;
+
+    double recv_us = 0;
+    if (erase_ahead) {
+        uint32_t blocks = (uint32_t)((upload_bytes + BLOCK_SIZE - 1) / BLOCK_SIZE);
+        for (uint32_t b = 0; b < blocks; b++) {
+            recv_us += cfg->block_erase_ms * 1000.0 * erase_jitter();
+        }
+        res->recv_stall_us += recv_us;
+    }
+    double write_us = recv_us;
+    for (uint32_t k = 0; k < sectors; k++) {
+        double len = upload_bytes - (double)k * OTA_PIPELINE_BUF_SIZE;
+        len = len < OTA_PIPELINE_BUF_SIZE ? len : OTA_PIPELINE_BUF_SIZE;
+        double cost_us = cfg->program_ms * 1000.0 * len / OTA_PIPELINE_BUF_SIZE;
+        if (!erase_ahead) {
+            cost_us += cfg->sector_erase_ms * 1000.0 * erase_jitter();
+        }
+        double hash_us = cfg->hash_kbps > 0 ? len / (cfg->hash_kbps * 1024.0) * 1e6 : 0;
+        if (!pipelined) {
+            recv_us = fill_buffer(recv_us, len) + hash_us;
+            recv_us += cost_us;
+            res->recv_stall_us += cost_us;
+            write_done_us[k] = recv_us;
+            continue;
+        }
+        if (k >= OTA_PIPELINE_BUFFERS && write_done_us[k - OTA_PIPELINE_BUFFERS] > recv_us) {
+            res->recv_stall_us += write_done_us[k - OTA_PIPELINE_BUFFERS] - recv_us;
+            recv_us = write_done_us[k - OTA_PIPELINE_BUFFERS];
+        }
+        recv_us = fill_buffer(recv_us, len) + hash_us;
+        if (recv_us > write_us) {
+            if (k > 0) {
+                res->writer_idle_us += recv_us - write_us;
+            }
+            write_us = recv_us;
+        }
+        write_us += cost_us;
+        write_done_us[k] = write_us;
+    }
+    res->total_us = write_done_us[sectors - 1];
+}
+
+static void parse_args(int argc, char **argv, bench_config_t *c) {
+    for (int i = 1; i + 1 < argc; i += 2) {
+        uint32_t value = (uint32_t)strtoul(argv[i + 1], NULL, 10);
+        if (strcmp(argv[i], "--kb") == 0) {
+            c->kb = value ? value : 1;
+        } else if (strcmp(argv[i], "--net-kbps") == 0) {
+            c->net_kbps = value ? value : 1;
+        } else if (strcmp(argv[i], "--tcp-wnd") == 0) {
+            c->tcp_wnd = value < TCP_MSS ? TCP_MSS : value;
+        } else if (strcmp(argv[i], "--program-ms") == 0) {
+            c->program_ms = value;
+        } else if (strcmp(argv[i], "--sector-erase-ms") == 0) {
+            c->sector_erase_ms = value;
+        } else if (strcmp(argv[i], "--block-erase-ms") == 0) {
+            c->block_erase_ms = value;
+        } else if (strcmp(argv[i], "--hash-kbps") == 0) {
+            c->hash_kbps = value;
+        } else if (strcmp(argv[i], "--seed") == 0) {
+            c->seed = value;
+        } else {
+            fprintf(stderr, "Unknown option %s\n", argv[i]);
+            exit(1);
+        }
+    }
+}
+
+int main(int argc, char **argv) {
+    static bench_config_t config = {
+        .kb = 1024,
+        .net_kbps = 400,
+        .tcp_wnd = 5760,            // CONFIG_LWIP_TCP_WND_DEFAULT
+        .program_ms = 11,           // 16 pages of 256 bytes, 0.7 ms each
+        .sector_erase_ms = 45,      // Typical 4 KB erase of 4 MB SPI NOR
+        .block_erase_ms = 150,      // Typical 64 KB erase
+        .seed = 1,
+    };
+    parse_args(argc, argv, &config);
+    cfg = &config;
+
+    uint32_t sectors = (uint32_t)(((uint64_t)cfg->kb * 1024 + OTA_PIPELINE_BUF_SIZE - 1) / OTA_PIPELINE_BUF_SIZE);
+    if (sectors > MAX_SECTORS) {
+        fprintf(stderr, "Image larger than %u sectors\n", MAX_SECTORS);
+        return 1;
+    }
+
+    static const char *const names[] = {"serial", "pipelined", "serial+erase", "pipe+erase"};
+    printf("%u KB image at %u KB/s, %u byte window, %u buffers, program %u ms, erase %u ms/sector "
+           "or %u ms/block, hash %u KB/s\n", cfg->kb, cfg->net_kbps, cfg->tcp_wnd, OTA_PIPELINE_BUFFERS,
+           cfg->program_ms, cfg->sector_erase_ms, cfg->block_erase_ms, cfg->hash_kbps);
+    printf("mode           total s    KB/s  recv stall  writer idle  link %%\n");
+    for (int mode = 0; mode < 4; mode++) {
+        srand(cfg->seed);
+        result_t res;
+        run(mode % 2, mode >= 2, sectors, &res);
+        double link_us = (double)cfg->kb / cfg->net_kbps * 1e6;
+        printf("%-13s  %7.2f  %6.1f  %10.0f  %11.0f  %6.1f\n", names[mode], res.total_us / 1e6,
+               cfg->kb / (res.total_us / 1e6), res.recv_stall_us / 1000, res.writer_idle_us / 1000,
+               100.0 * link_us / res.total_us);
+    }
+    return 0;
+}
@@ -0,0 +1,279 @@
+/* --------------------------------------------------------------------------
+ * OTA image size and time to flash: plain, compressed and delta
+ *
+ * Encodes --image with ota_encode() on its own and against --base, checks
+ * both decode back to the image, and times the decoder on this host. Without
+ * files a --kb firmware-like image is made up (code words from a small
+ * vocabulary, strings, 0xFF padding) and the next build is that image with
+ * a 64 byte insertion near the start and --edits patched bytes.
+ *
+ * Time to flash is modelled on the pipelined upload as built (ota_pipeline.c,
+ * erase up front): the image is block-erased in --block-erase-ms per 64 KB,
+ * after a delta has hashed the running image at --flash-read-kbps, then the
+ * stream arrives at --net-kbps, is decoded at --decode-kbps of output on the
+ * receive side, and each 4 KB sector programs in --program-ms. Base copies
+ * read flash at --flash-read-kbps on the same SPI bus as the writes.
+ *
+ *   sent KB       bytes over the network
+ *   erase s       base hash and block erase before the first byte is taken
+ *   stream s      the slowest of network, decode and flash after that
+ *   total s       upload start to the last sector programmed
+ *
+ * Usage: bench_ota_stream [--kb N] [--edits N] [--net-kbps N]
+ *                         [--program-ms N] [--block-erase-ms N]
+ *                         [--flash-read-kbps N] [--decode-kbps N]
+ *                         [--base FILE --image FILE] [--seed N]
+ * -------------------------------------------------------------------------- */
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "ota_encode.h"
+#include "ota_stream.h"
+
+#define SECTOR_SIZE     4096
+#define BLOCK_SIZE      (64 * 1024)
+#define DECODE_RUNS     20
+
+typedef struct {
+    uint32_t kb;
+    uint32_t edits;
+    uint32_t net_kbps;
+    uint32_t program_ms;
+    uint32_t block_erase_ms;
+    uint32_t flash_read_kbps;
+    uint32_t decode_kbps;
+    uint32_t seed;
+    const char *base_path;
+    const char *image_path;
+} bench_config_t;
+
+typedef struct {
+    const uint8_t *image;
+    const uint8_t *base;
+    size_t checked;
+    bool mismatch;
+} check_t;
+
+static uint8_t *read_file(const char *path, size_t *len) {
+    FILE *f = fopen(path, "rb");
+    if (f == NULL) {
+        fprintf(stderr, "Cannot open %s\n", path);
+        exit(1);
+    }
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    uint8_t *data = malloc(size > 0 ? (size_t)size : 1);
+    if (data == NULL || fread(data, 1, (size_t)size, f) != (size_t)size) {
+        fprintf(stderr, "Cannot read %s\n", path);
+        exit(1);
+    }
+    fclose(f);
+    *len = (size_t)size;
+    return data;
+}
+
+static void make_firmware(uint8_t *buf, size_t len) {
+    static const char *strings[] = {"ESP-NOW send failed", "state %d -> %d", "nvs_get_u8", "Rebooting...",
+                                    "rssi %d dBm", "OTA_MODULE", "Wrote %lu bytes"};
+    uint32_t words[256];
+    for (int i = 0; i < 256; i++) {
+        words[i] = (uint32_t)rand();
+    }
+    size_t pos = 0;
+    while (pos < len) {
+        int kind = rand() % 10;
+        size_t n;
+        if (kind < 7) {
+            n = 4 * (1 + rand() % 16);
+            for (size_t i = 0; i < n && pos + i < len; i += 4) {
+                uint32_t w = words[rand() % 256] ^ (uint32_t)(rand() % 16);
+                for (size_t b = 0; b < 4 && pos + i + b < len; b++) {
+                    buf[pos + i + b] = (uint8_t)(w >> (8 * b));
+                }
+            }
+        } else if (kind < 9) {
+            const char *s = strings[rand() % 7];
+            n = strlen(s) + 1;
+            for (size_t i = 0; i < n && pos + i < len; i++) {
+                buf[pos + i] = (uint8_t)s[i];
+            }
+        } else {
+            n = 1 + rand() % 64;
+            memset(buf + pos, 0xff, pos + n <= len ? n : len - pos);
+        }
+        pos += n;
+    }
+    buf[0] = 0xe9;
+}
+
+static bool check_data(void *ctx, const uint8_t *data, size_t len) {
+    check_t *c = ctx;
+    if (memcmp(c->image + c->checked, data, len) != 0) {
+        c->mismatch = true;
+    }
+    c->checked += len;
+    return true;
+}
+
+static bool check_base(void *ctx, uint32_t offset, uint8_t *data, size_t len) {
+    check_t *c = ctx;
+    memcpy(data, c->base + offset, len);
+    return true;
+}
+
+/// Decode DECODE_RUNS times in 1436 byte chunks; returns MB/s of image output
+static double decode_rate(const uint8_t *stream, size_t len, const uint8_t *image, size_t image_len,
+                          const uint8_t *base) {
+    static ota_stream_t s;
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (int run = 0; run < DECODE_RUNS; run++) {
+        check_t c = {.image = image, .base = base};
+        ota_stream_init(&s, NULL, check_data, check_base, &c);
+        ota_stream_state_t state = OTA_STREAM_HEADER;
+        for (size_t pos = 0; pos < len; pos += 1436) {
+            state = ota_stream_feed(&s, stream + pos, len - pos < 1436 ? len - pos : 1436);
+        }
+        if (state != OTA_STREAM_DONE || c.mismatch || c.checked != image_len) {
+            fprintf(stderr, "Stream does not decode to the image\n");
+            exit(1);
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    double s_elapsed = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+    return (double)image_len * DECODE_RUNS / s_elapsed / 1e6;
+}
+
+static void parse_args(int argc, char **argv, bench_config_t *c) {
+    for (int i = 1; i + 1 < argc; i += 2) {
+        uint32_t value = (uint32_t)strtoul(argv[i + 1], NULL, 10);
+        if (strcmp(argv[i], "--kb") == 0) {
+            c->kb = value ? value : 1;
+        } else if (strcmp(argv[i], "--edits") == 0) {
+            c->edits = value;
+        } else if (strcmp(argv[i], "--net-kbps") == 0) {
+            c->net_kbps = value ? value : 1;
+        } else if (strcmp(argv[i], "--program-ms") == 0) {
+            c->program_ms = value;
+        } else if (strcmp(argv[i], "--block-erase-ms") == 0) {
+            c->block_erase_ms = value;
+        } else if (strcmp(argv[i], "--flash-read-kbps") == 0) {
+            c->flash_read_kbps = value ? value : 1;
+        } else if (strcmp(argv[i], "--decode-kbps") == 0) {
+            c->decode_kbps = value ? value : 1;
+        } else if (strcmp(argv[i], "--base") == 0) {
+            c->base_path = argv[i + 1];
+        } else if (strcmp(argv[i], "--image") == 0) {
+            c->image_path = argv[i + 1];
+        } else if (strcmp(argv[i], "--seed") == 0) {
+            c->seed = value;
+        } else {
+            fprintf(stderr, "Unknown option %s\n", argv[i]);
+            exit(1);
+        }
+    }
+}
+
+int main(int argc, char **argv) {
+    static bench_config_t config = {
+        .kb = 1024,
+        .edits = 200,
+        .net_kbps = 400,
+        .program_ms = 11,           // 16 pages of 256 bytes, 0.7 ms each
+        .block_erase_ms = 150,      // Typical 64 KB erase
+        .flash_read_kbps = 4000,    // Through esp_partition_read(), 256 bytes at a time
+        .decode_kbps = 3000,        // Rough ESP32 figure, a tenth or so of this host's
+        .seed = 1,
+    };
+    parse_args(argc, argv, &config);
+    bench_config_t *cfg = &config;
+    srand(cfg->seed);
+
+    uint8_t *base;
+    uint8_t *image;
+    size_t base_len;
+    size_t image_len;
+    if (cfg->base_path != NULL && cfg->image_path != NULL) {
+        base = read_file(cfg->base_path, &base_len);
+        image = read_file(cfg->image_path, &image_len);
+    } else {
+        base_len = (size_t)cfg->kb * 1024;
+        base = malloc(base_len);
+        make_firmware(base, base_len);
+        size_t insert_at = base_len / 16;
+        image_len = base_len + 64;
+        image = malloc(image_len);
+        memcpy(image, base, insert_at);
+        for (size_t i = 0; i < 64; i++) {
+            image[insert_at + i] = (uint8_t)rand();
+        }
+        memcpy(image + insert_at + 64, base + insert_at, base_len - insert_at);
+        for (uint32_t i = 0; i < cfg->edits; i++) {
+            image[(size_t)rand() % image_len] = (uint8_t)rand();
+        }
+    }
+    if (image_len == 0) {
+        fprintf(stderr, "Empty image\n");
+        return 1;
+    }
+
+    size_t out_size = ota_encode_bound(image_len);
+    uint8_t *streams[2] = {malloc(out_size), malloc(out_size)};
+    size_t lens[2];
+    ota_encode_stats_t stats[2];
+    for (int delta = 0; delta < 2; delta++) {
+        lens[delta] = ota_encode(image, image_len, base, delta ? base_len : 0, streams[delta], out_size,
+                                 &stats[delta]);
+    }
+
+    printf("%zu byte image, %zu byte base, %u KB/s network, program %u ms, erase %u ms/block, "
+           "flash read %u KB/s, decode %u KB/s\n", image_len, base_len, cfg->net_kbps, cfg->program_ms,
+           cfg->block_erase_ms, cfg->flash_read_kbps, cfg->decode_kbps);
+    printf("mode          sent KB  ratio  erase s  stream s  total s  host decode MB/s\n");
+    static const char *const names[] = {"plain", "compressed", "delta"};
+    double image_kb = image_len / 1024.0;
+    double program_s = (double)((image_len + SECTOR_SIZE - 1) / SECTOR_SIZE) * cfg->program_ms / 1000;
+    double block_erase_s = (double)((image_len + BLOCK_SIZE - 1) / BLOCK_SIZE) * cfg->block_erase_ms / 1000;
+    for (int mode = 0; mode < 3; mode++) {
+        size_t sent = mode == 0 ? image_len : lens[mode - 1];
+        double erase_s = block_erase_s;
+        double decode_s = 0;
+        double base_read_s = 0;
+        double rate = 0;
+        if (mode > 0) {
+            decode_s = image_kb / cfg->decode_kbps;
+            rate = decode_rate(streams[mode - 1], sent, image, image_len, base);
+        }
+        if (mode == 2) {
+            erase_s += base_len / 1024.0 / cfg->flash_read_kbps;
+            base_read_s = stats[1].base_bytes / 1024.0 / cfg->flash_read_kbps;
+        }
+        // Receive side decodes and reads the base; flash is shared by base reads and programming
+        double net_s = sent / 1024.0 / cfg->net_kbps;
+        double recv_s = decode_s + base_read_s;
+        double flash_s = program_s + base_read_s;
+        double stream_s = net_s > recv_s ? net_s : recv_s;
+        stream_s = stream_s > flash_s ? stream_s : flash_s;
+        double total_s = erase_s + stream_s + (double)cfg->program_ms / 1000;
+        printf("%-12s  %7.1f  %4.1f%%  %7.2f  %8.2f  %7.2f", names[mode], sent / 1024.0,
+               100.0 * sent / image_len, erase_s, stream_s, total_s);
+        if (mode > 0) {
+            printf("  %16.0f", rate);
+        }
+        printf("\n");
+    }
+    printf("compressed: literal %u, window %u copies / %u bytes\n", stats[0].literal_bytes,
+           stats[0].window_copies, stats[0].window_bytes);
+    printf("delta:      literal %u, window %u copies / %u bytes, base %u copies / %u bytes\n",
+           stats[1].literal_bytes, stats[1].window_copies, stats[1].window_bytes, stats[1].base_copies,
+           stats[1].base_bytes);
+    free(streams[0]);
+    free(streams[1]);
+    free(base);
+    free(image);
+    return 0;
+}
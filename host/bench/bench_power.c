@@ -0,0 +1,384 @@
+/* --------------------------------------------------------------------------
+ * Sender power profile benchmark
+ *
+ * Runs the sender firmware (state machine, TX scheduler, button handler,
+ * rolling code journal, power manager and accounting) on the simulated
+ * clock through --days commuting days: parked at home in range overnight,
+ * out of range from 07:31, parked at work, a bypass press at 12:30, back in
+ * range around 17:40 and a bypass press at the gate 20 s later. In range,
+ * --ack-percent of sends are acknowledged. Each power mode runs the same
+ * days:
+ *
+ *   awake      radio and CPU up between sends, as before
+ *   light      light sleep between sends
+ *   dormant    light sleep, and pings from deep sleep every 20 s after
+ *              30 min without an ACK
+ *
+ * Reports the average current from power_account.c's profile, awake share,
+ * sends and airtime per hour, deep sleep boots per hour, time from coming
+ * into range to the first ACK, press to first force open (median and worst),
+ * journal flash writes per day and rolling codes that did not increase.
+ *
+ * Usage: bench_power [--days N] [--ack-percent N] [--seed N]
+ * -------------------------------------------------------------------------- */
+#include <setjmp.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "esp_timer.h"
+#include "host_sim.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "button_handler.h"
+#include "espnow_comm.h"
+#include "power_account.h"
+#include "power_manager.h"
+#include "rc_journal.h"
+#include "rolling_code.h"
+#include "state_machine.h"
+#include "tx_scheduler.h"
+
+#define DAY_US              86400000000LL
+#define HOUR_US             3600000000LL
+#define SIM_START_US        1000000LL
+#define PRESS_HOLD_US       800000LL
+#define SEND_ACKED_US       1000LL      // Send to callback with an ACK
+#define SEND_UNACKED_US     12000LL     // Send to callback after every MAC retry
+#define SEND_REPLY_US       4000LL      // Send to the receiver's reply, for acknowledged sends
+#define MAX_EVENTS          4096
+#define MAX_SAMPLES         1024
+
+static const char *const power_mode_names[] = {
+    [POWER_MODE_AWAKE]       = "awake",
+    [POWER_MODE_LIGHT_SLEEP] = "light",
+    [POWER_MODE_DORMANT]     = "dormant",
+};
+
+typedef struct {
+    uint32_t days;
+    uint32_t ack_percent;
+    uint32_t seed;
+} bench_config_t;
+
+typedef enum {
+    EVENT_RANGE,            // Receiver comes into or goes out of range
+    EVENT_BUTTON,           // Button level, active low
+} event_kind_t;
+
+typedef struct {
+    int64_t at_us;
+    event_kind_t kind;
+    uint32_t value;
+} script_event_t;
+
+/* Day script, the same for every mode */
+static script_event_t events[MAX_EVENTS];
+static uint32_t event_count;
+static uint32_t next_event;
+
+/* Radio model and the send callback it owes */
+static bool in_range = true;
+static uint32_t ack_percent = 95;
+static int64_t callback_due_us = -1;
+static bool callback_acked;
+static int64_t reply_due_us = -1;
+static uint32_t reply_code;
+static uint8_t reply_command;
+
+/* Results of the current mode */
+static int64_t in_range_since_us = -1;      // Waiting for the first ACK since, -1 if not
+static int64_t press_at_us = -1;            // Waiting for the first force open since, -1 if not
+static int64_t arrivals[MAX_SAMPLES];
+static uint32_t arrival_count;
+static int64_t press_latencies[MAX_SAMPLES];
+static uint32_t press_count;
+static uint32_t last_code;
+static uint32_t code_repeats;
+static uint32_t codes_sent;
+
+static jmp_buf boot_env;
+
+/* --------------------------------------------------------------------------
+ * Day script
+ * -------------------------------------------------------------------------- */
+
+static void add_event(int64_t at_us, event_kind_t kind, uint32_t value) {
+    if (event_count < MAX_EVENTS) {
+        events[event_count++] = (script_event_t){at_us, kind, value};
+    }
+}
+
+static void add_press(int64_t at_us) {
+    add_event(at_us, EVENT_BUTTON, 0);
+    add_event(at_us + PRESS_HOLD_US, EVENT_BUTTON, 1);
+}
+
+static int64_t clock_us(int hours, int minutes) {
+    return (int64_t)hours * HOUR_US + (int64_t)minutes * 60000000LL;
+}
+
+static void build_days(const bench_config_t *cfg) {
+    event_count = 0;
+    for (uint32_t d = 0; d < cfg->days; d++) {
+        int64_t day_us = SIM_START_US + (int64_t)d * DAY_US;
+        add_event(day_us + clock_us(7, 31) + rand() % 60000000, EVENT_RANGE, 0);
+        add_press(day_us + clock_us(12, 30) + rand() % 600000000);
+        int64_t home_us = day_us + clock_us(17, 40) + rand() % 1200000000;
+        add_event(home_us, EVENT_RANGE, 1);
+        add_press(home_us + 20000000);
+    }
+}
+
+/* Applies the next script event; the ISR runs if the button's edge interrupt is enabled */
+static void apply_event(void) {
+    const script_event_t *e = &events[next_event++];
+    host_clock_set_us(e->at_us);
+    if (e->kind == EVENT_RANGE) {
+        in_range = e->value;
+        in_range_since_us = in_range ? e->at_us : -1;
+    } else {
+        if (e->value == 0) {
+            press_at_us = e->at_us;
+        }
+        host_gpio_set_input(INPUT_PIN, e->value);
+    }
+}
+
+/* --------------------------------------------------------------------------
+ * Firmware stand-ins and sleep hooks
+ * -------------------------------------------------------------------------- */
+
+/* Stands in for espnow_comm.c: the send callback arrives SEND_ACKED_US or SEND_UNACKED_US later,
+ * and the receiver's reply to an acknowledged send SEND_REPLY_US later */
+void espnow_send_packet(uint8_t command, uint32_t rolling_code, int8_t reply_rssi) {
+    (void)reply_rssi;
+    int64_t now = esp_timer_get_time();
+    codes_sent++;
+    if (rolling_code <= last_code) {
+        code_repeats++;
+    }
+    last_code = rolling_code;
+    if (command == CMD_FORCE_OPEN && press_at_us >= 0) {
+        if (press_count < MAX_SAMPLES) {
+            press_latencies[press_count++] = now - press_at_us;
+        }
+        press_at_us = -1;
+    }
+    callback_acked = in_range && (uint32_t)(rand() % 100) < ack_percent;
+    callback_due_us = now + (callback_acked ? SEND_ACKED_US : SEND_UNACKED_US);
+    reply_due_us = callback_acked ? now + SEND_REPLY_US : -1;
+    reply_code = rolling_code;
+    reply_command = command;
+}
+
+static void deliver_send_callback(void) {
+    bool acked = callback_acked;
+    callback_due_us = -1;
+    if (acked && in_range_since_us >= 0) {
+        if (arrival_count < MAX_SAMPLES) {
+            arrivals[arrival_count++] = esp_timer_get_time() - in_range_since_us;
+        }
+        in_range_since_us = -1;
+    }
+    /* As espnow_send_cb() does */
+    power_account_on_tx(acked);
+    tx_scheduler_on_send_done(acked);
+    if (acked) {
+        state_machine_on_link_detected();
+    }
+}
+
+/* As receive_cb() does; the gate stays closed in this script */
+static void deliver_reply(void) {
+    reply_due_us = -1;
+    tx_scheduler_on_reply(reply_code, reply_command, GATE_CLOSED, -60, -62);
+}
+
+/* Light sleep: script events before the wake-up happen while asleep */
+static int64_t light_sleep_hook(int64_t wake_us) {
+    if (next_event < event_count && events[next_event].at_us < wake_us) {
+        apply_event();
+        return esp_timer_get_time();
+    }
+    return wake_us;
+}
+
+/* Deep sleep: run the script until the timer or a press, then boot again */
+static void deep_sleep_hook(int64_t wake_us) {
+    host_sim_reboot();
+    esp_sleep_wakeup_cause_t cause = ESP_SLEEP_WAKEUP_TIMER;
+    int64_t woke_us = wake_us;
+    while (next_event < event_count && events[next_event].at_us < wake_us) {
+        apply_event();
+        if (gpio_get_level(INPUT_PIN) == 0) {
+            cause = ESP_SLEEP_WAKEUP_EXT0;
+            woke_us = esp_timer_get_time();
+            break;
+        }
+    }
+    int64_t booted_us = woke_us + POWER_BOOT_US;
+    while (next_event < event_count && events[next_event].at_us < booted_us) {
+        apply_event();
+    }
+    host_clock_set_us(booted_us);
+    host_set_reset_reason(ESP_RST_DEEPSLEEP);
+    host_sleep_set_wakeup_cause(cause);
+    longjmp(boot_env, 1);
+}
+
+/* --------------------------------------------------------------------------
+ * Main loop
+ * -------------------------------------------------------------------------- */
+
+/* Blocks the awake main task until the next timer, callback, reply, housekeeping pass or button edge */
+static void wait_awake(void) {
+    int64_t now = esp_timer_get_time();
+    int64_t until_us = now + POWER_MAX_WAIT_US;
+    int64_t timer_us = host_timer_next_deadline_us();
+    if (timer_us < until_us) {
+        until_us = timer_us;
+    }
+    if (callback_due_us >= 0 && callback_due_us < until_us) {
+        until_us = callback_due_us;
+    }
+    if (reply_due_us >= 0 && reply_due_us < until_us) {
+        until_us = reply_due_us;
+    }
+    int64_t listen_us = tx_scheduler_reply_deadline_us();
+    if (listen_us != 0 && listen_us < until_us) {
+        until_us = listen_us;
+    }
+    while (next_event < event_count && events[next_event].at_us <= until_us) {
+        apply_event();
+        if (host_task_notify_pending()) {
+            return;
+        }
+    }
+    if (until_us > esp_timer_get_time()) {
+        host_clock_set_us(until_us);
+    }
+}
+
+/* Boots the sender and runs app_main's loop until end_us, booting again after each deep sleep */
+static void run_sender(power_mode_t mode, int64_t end_us) {
+    setjmp(boot_env);
+    callback_due_us = -1;
+    reply_due_us = -1;
+    power_manager_init(mode);
+    rolling_code_init();
+    button_handler_init();
+    state_machine_init();
+    tx_scheduler_init();
+
+    while (esp_timer_get_time() < end_us) {
+        button_handler_update();
+        if (button_handler_is_bypass_active()) {
+            state_machine_set_state(STATE_BYPASS);
+        } else if (state_machine_get_current_state() == STATE_BYPASS) {
+            state_machine_set_state(STATE_IDLE);
+        }
+        rolling_code_periodic_save();
+        state_machine_run();
+
+        /* On the host only a light sleep moves the clock; an awake wait is played out here,
+         * unless a notification was already pending and the wait returned at once */
+        power_account_t before;
+        power_account_snapshot(&before);
+        bool notified = host_task_notify_pending() != 0;
+        power_manager_wait();
+        power_account_t after;
+        power_account_snapshot(&after);
+        if (!notified && after.light_sleeps == before.light_sleeps) {
+            wait_awake();
+        }
+        if (callback_due_us >= 0 && callback_due_us <= esp_timer_get_time()) {
+            deliver_send_callback();
+        }
+        if (reply_due_us >= 0 && reply_due_us <= esp_timer_get_time() && callback_due_us < 0) {
+            deliver_reply();
+        }
+        host_timer_run_due();
+    }
+}
+
+static int cmp_i64(const void *a, const void *b) {
+    int64_t x = *(const int64_t *)a;
+    int64_t y = *(const int64_t *)b;
+    return (x > y) - (x < y);
+}
+
+static void run_mode(const bench_config_t *cfg, power_mode_t mode) {
+    host_sim_reset();
+    host_flash_create(RC_JOURNAL_PARTITION_LABEL, RC_JOURNAL_PARTITION_SUBTYPE, 4 * RC_JOURNAL_SECTOR_SIZE);
+    host_gpio_set_input(INPUT_PIN, 1);
+    host_clock_set_us(SIM_START_US);
+    host_sleep_set_hooks(light_sleep_hook, deep_sleep_hook);
+    next_event = 0;
+    in_range = true;
+    in_range_since_us = -1;
+    press_at_us = -1;
+    arrival_count = 0;
+    press_count = 0;
+    last_code = 0;
+    code_repeats = 0;
+    codes_sent = 0;
+
+    int64_t end_us = SIM_START_US + (int64_t)cfg->days * DAY_US;
+    run_sender(mode, end_us);
+
+    power_account_t a;
+    power_account_snapshot(&a);
+    host_flash_stats_t flash;
+    host_flash_get_stats(&flash);
+    double hours = (double)cfg->days * 24;
+    int64_t total_us = a.awake_us + a.light_sleep_us + a.deep_sleep_us + a.boots * POWER_BOOT_US;
+    qsort(arrivals, arrival_count, sizeof(arrivals[0]), cmp_i64);
+    qsort(press_latencies, press_count, sizeof(press_latencies[0]), cmp_i64);
+    printf("%-8s %8.2f %7.3f %7.0f %7.0f %6.0f  %6.1f %6.1f  %7.1f %7.1f  %7.1f %5u\n",
+           power_mode_names[mode], power_account_average_ua(&a) / 1000.0,
+           100.0 * a.awake_us / total_us, a.tx_count / hours, a.airtime_us / 1000.0 / hours,
+           a.boots / hours,
+           arrival_count ? arrivals[arrival_count / 2] / 1e6 : -1.0,
+           arrival_count ? arrivals[arrival_count - 1] / 1e6 : -1.0,
+           press_count ? press_latencies[press_count / 2] / 1000.0 : -1.0,
+           press_count ? press_latencies[press_count - 1] / 1000.0 : -1.0,
+           flash.writes / (double)cfg->days, code_repeats);
+}
+
+static void parse_args(int argc, char **argv, bench_config_t *cfg) {
+    for (int i = 1; i + 1 < argc; i += 2) {
+        uint32_t value = (uint32_t)strtoul(argv[i + 1], NULL, 10);
+        if (strcmp(argv[i], "--days") == 0) {
+            cfg->days = value < 1 ? 1 : value > 365 ? 365 : value;
+        } else if (strcmp(argv[i], "--ack-percent") == 0) {
+            cfg->ack_percent = value > 100 ? 100 : value;
+        } else if (strcmp(argv[i], "--seed") == 0) {
+            cfg->seed = value;
+        } else {
+            fprintf(stderr, "Unknown option %s\n", argv[i]);
+            exit(1);
+        }
+    }
+}
+
+int main(int argc, char **argv) {
+    bench_config_t cfg = {
+        .days = 7,
+        .ack_percent = 95,
+        .seed = 1,
+    };
+    parse_args(argc, argv, &cfg);
+    ack_percent = cfg.ack_percent;
+
+    srand(cfg.seed);
+    build_days(&cfg);
+    printf("%u commuting days, %u%% of sends acknowledged in range\n", cfg.days, cfg.ack_percent);
+    printf("                                                    first ACK s    press ms\n");
+    printf("mode          mA  awake %%    tx/h   air ms/h  boots/h   p50    max      p50     max  flash/day  repeats\n");
+    for (power_mode_t mode = POWER_MODE_AWAKE; mode <= POWER_MODE_DORMANT; mode++) {
+        srand(cfg.seed + 1);
+        run_mode(&cfg, mode);
+    }
+    return 0;
+}
@@ -0,0 +1,154 @@
+/* --------------------------------------------------------------------------
+ * Anti-replay window benchmark
+ *
+ * Sends rolling codes the way redundant transmissions would arrive: each code
+ * --copies times, shuffled up to --reorder positions, with --loss-pct loss.
+ * The codes start just below UINT32_MAX so the run crosses the 32-bit wrap.
+ * Compares the receiver's original "drop if <= expected" rule with the
+ * 64-bit window in replay_window.c: unique codes accepted, duplicates that
+ * got through, and the cost per check.
+ *
+ * Usage: bench_replay_window [--codes N] [--copies N] [--reorder N]
+ *                            [--loss-pct N] [--seed N]
+ * -------------------------------------------------------------------------- */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "host_sim.h"
+#include "replay_window.h"
+
+typedef struct {
+    uint32_t codes;
+    uint32_t copies;
+    uint32_t reorder;
+    uint32_t loss_pct;
+    uint32_t seed;
+} bench_config_t;
+
+typedef struct {
+    uint32_t accepted;      // Unique codes accepted
+    uint32_t duplicates;    // Copies accepted after the first
+    uint64_t ns;
+} result_t;
+
+/* Original receiver check: anything not above the last code is dropped */
+typedef struct {
+    uint32_t expected;
+} legacy_check_t;
+
+static inline bool legacy_accept(legacy_check_t *c, uint32_t code) {
+    if (code <= c->expected) {
+        return false;
+    }
+    c->expected = code;
+    return true;
+}
+
+static void score(uint32_t code, uint32_t base, bool ok, uint8_t *seen, result_t *r) {
+    if (!ok) {
+        return;
+    }
+    uint32_t off = code - base;
+    if (seen[off]) {
+        r->duplicates++;
+    } else {
+        seen[off] = 1;
+        r->accepted++;
+    }
+}
+
+static void parse_args(int argc, char **argv, bench_config_t *cfg) {
+    for (int i = 1; i + 1 < argc; i += 2) {
+        uint32_t value = (uint32_t)strtoul(argv[i + 1], NULL, 10);
+        if (strcmp(argv[i], "--codes") == 0) {
+            cfg->codes = value ? value : 1;
+        } else if (strcmp(argv[i], "--copies") == 0) {
+            cfg->copies = value ? value : 1;
+        } else if (strcmp(argv[i], "--reorder") == 0) {
+            cfg->reorder = value;
+        } else if (strcmp(argv[i], "--loss-pct") == 0) {
+            cfg->loss_pct = value;
+        } else if (strcmp(argv[i], "--seed") == 0) {
+            cfg->seed = value;
+        } else {
+            fprintf(stderr, "Unknown option %s\n", argv[i]);
+            exit(1);
+        }
+    }
+}
+
+int main(int argc, char **argv) {
+    bench_config_t cfg = {
+        .codes = 1000000,
+        .copies = 2,
+        .reorder = 8,
+        .loss_pct = 5,
+        .seed = 1,
+    };
+    parse_args(argc, argv, &cfg);
+    srand(cfg.seed);
+
+    /* Build the arrival order once so both checks see the same packets */
+    uint32_t base = UINT32_MAX - cfg.codes / 2;
+    size_t total = (size_t)cfg.codes * cfg.copies;
+    uint32_t *arrivals = malloc(total * sizeof(uint32_t));
+    uint8_t *sent = calloc(cfg.codes, 1);
+    uint8_t *seen = calloc(cfg.codes, 1);
+    if (arrivals == NULL || sent == NULL || seen == NULL) {
+        fprintf(stderr, "Out of memory\n");
+        return 1;
+    }
+    size_t count = 0;
+    for (uint32_t i = 1; i < cfg.codes; i++) {
+        for (uint32_t c = 0; c < cfg.copies; c++) {
+            if ((uint32_t)(rand() % 100) >= cfg.loss_pct) {
+                arrivals[count++] = base + i;
+                sent[i] = 1;
+            }
+        }
+    }
+    for (size_t i = 0; i + 1 < count && cfg.reorder; i++) {
+        size_t j = i + (size_t)(rand() % (cfg.reorder + 1));
+        if (j < count) {
+            uint32_t tmp = arrivals[i];
+            arrivals[i] = arrivals[j];
+            arrivals[j] = tmp;
+        }
+    }
+    uint32_t unique = 0;
+    for (uint32_t i = 0; i < cfg.codes; i++) {
+        unique += sent[i];
+    }
+
+    result_t legacy = {0};
+    legacy_check_t check = {.expected = base};
+    uint64_t start = host_wall_ns();
+    for (size_t i = 0; i < count; i++) {
+        score(arrivals[i], base, legacy_accept(&check, arrivals[i]), seen, &legacy);
+    }
+    legacy.ns = host_wall_ns() - start;
+
+    result_t window = {0};
+    replay_window_t w;
+    replay_window_init(&w, base);
+    memset(seen, 0, cfg.codes);
+    start = host_wall_ns();
+    for (size_t i = 0; i < count; i++) {
+        score(arrivals[i], base, replay_window_accept(&w, arrivals[i]), seen, &window);
+    }
+    window.ns = host_wall_ns() - start;
+
+    printf("codes=%u  copies=%u  reorder=%u  loss=%u%%  packets=%zu  unique codes received=%u  (crosses 2^32)\n",
+           cfg.codes, cfg.copies, cfg.reorder, cfg.loss_pct, count, unique);
+    printf("%-22s %9s %9s %11s %8s\n", "check", "accepted", "of unique", "duplicates", "ns/pkt");
+    printf("%-22s %9u %8.1f%% %11u %8.2f\n", "<= expected (legacy)", legacy.accepted,
+           100.0 * legacy.accepted / unique, legacy.duplicates, (double)legacy.ns / count);
+    printf("%-22s %9u %8.1f%% %11u %8.2f\n", "64-bit window", window.accepted,
+           100.0 * window.accepted / unique, window.duplicates, (double)window.ns / count);
+
+    free(arrivals);
+    free(sent);
+    free(seen);
+    return 0;
+}
@@ -0,0 +1,279 @@
+/* --------------------------------------------------------------------------
+ * Receiver reply benchmark
+ *
+ * Runs the sender's state machine and tx_scheduler.c on the simulated clock
+ * over --arrivals arrivals at the gate: --away-s out of range, then --near-s
+ * in range with --ack-percent of sends acknowledged (and replied to). On
+ * --auto-percent of arrivals the receiver opens the gate itself once it holds
+ * RSSI_WINDOW_LENGTH pings; on the others the rider presses the bypass button
+ * --press-s after coming into range and holds it for --hold-ms. The gate
+ * opens for --travel-s, stays open --open-s and closes for --travel-s. Each
+ * arrival runs against a receiver that only ACKs at the MAC layer, as before,
+ * and one that replies with the gate state. Rolling codes start after
+ * --first-code, so a value just below 2^32 runs the arrivals across the wrap:
+ *
+ *   pkts        packets sent in range per arrival
+ *   opens/press force opens sent per press
+ *   open pings  pings sent while the gate was open or moving, per arrival
+ *   air ms      estimated airtime in range per arrival, retries included
+ *   open s      coming into range to the gate starting to open (median)
+ *
+ * Usage: bench_replies [--arrivals N] [--away-s N] [--near-s N]
+ *                      [--ack-percent N] [--auto-percent N] [--press-s N]
+ *                      [--hold-ms N] [--travel-s N] [--open-s N] [--seed N]
+ *                      [--first-code N]
+ * -------------------------------------------------------------------------- */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "esp_timer.h"
+#include "host_sim.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "espnow_comm.h"
+#include "power_account.h"
+#include "state_machine.h"
+#include "tx_scheduler.h"
+
+#define LOOP_MS             5
+#define RSSI_WINDOW_LENGTH  8           // Receiver pings before its proximity check runs
+#define MAX_ARRIVALS        4096
+
+typedef enum {
+    RECEIVER_ACK_ONLY,
+    RECEIVER_REPLIES,
+} receiver_mode_t;
+
+static const char *const receiver_mode_names[] = {
+    [RECEIVER_ACK_ONLY] = "ack only",
+    [RECEIVER_REPLIES]  = "replies",
+};
+
+typedef struct {
+    uint32_t arrivals;
+    uint32_t away_s;
+    uint32_t near_s;
+    uint32_t ack_percent;
+    uint32_t auto_percent;
+    uint32_t press_s;
+    uint32_t hold_ms;
+    uint32_t travel_s;
+    uint32_t open_s;
+    uint32_t seed;
+    uint32_t first_code;
+} bench_config_t;
+
+typedef struct {
+    uint32_t packets;
+    uint32_t force_opens;
+    uint32_t open_pings;
+    int64_t airtime_us;
+} arrival_result_t;
+
+/* Receiver and gate model, read by the espnow_send_packet() stand-in */
+static const bench_config_t *cfg;
+static receiver_mode_t mode;
+static bool in_range;
+static bool auto_open;              // The receiver opens this arrival on its own
+static uint32_t near_pings;
+static int64_t gate_opened_us;      // Start of the current gate cycle, -1 while closed
+static arrival_result_t res;
+
+static uint32_t code_counter;       // Last rolling code handed out
+
+uint32_t rolling_code_get_and_increment(void) {
+    return ++code_counter;
+}
+
+/* Gate state at now: opening, open, closing, then closed again */
+static uint8_t gate_state_at(int64_t now) {
+    if (gate_opened_us < 0) {
+        return GATE_CLOSED;
+    }
+    int64_t travel_us = (int64_t)cfg->travel_s * 1000000;
+    int64_t t = now - gate_opened_us;
+    if (t < travel_us) {
+        return GATE_MOVING;
+    }
+    if (t < travel_us + (int64_t)cfg->open_s * 1000000) {
+        return GATE_OPEN;
+    }
+    if (t < 2 * travel_us + (int64_t)cfg->open_s * 1000000) {
+        return GATE_MOVING;
+    }
+    gate_opened_us = -1;
+    return GATE_CLOSED;
+}
+
+/* Stands in for espnow_comm.c: the send callback, and the reply if there is one,
+ * arrive before the next loop pass */
+void espnow_send_packet(uint8_t command, uint32_t rolling_code, int8_t reply_rssi) {
+    (void)reply_rssi;
+    int64_t now = esp_timer_get_time();
+    bool acked = in_range && (uint32_t)(rand() % 100) < cfg->ack_percent;
+    if (in_range) {
+        res.packets++;
+        res.airtime_us += POWER_FRAME_AIRTIME_US * (acked ? 1 : POWER_TX_ATTEMPTS_UNACKED);
+        if (command == CMD_FORCE_OPEN) {
+            res.force_opens++;
+        } else if (gate_state_at(now) != GATE_CLOSED) {
+            res.open_pings++;
+        }
+    }
+
+    /* The receiver handles what it got: a force open, or the ping completing its RSSI window */
+    if (acked && gate_state_at(now) == GATE_CLOSED) {
+        if (command == CMD_FORCE_OPEN ||
+            (auto_open && command == CMD_PING && ++near_pings == RSSI_WINDOW_LENGTH)) {
+            gate_opened_us = now;
+        }
+    }
+
+    tx_scheduler_on_send_done(acked);
+    if (acked) {
+        state_machine_on_link_detected();
+    }
+    if (acked && mode == RECEIVER_REPLIES && (uint32_t)(rand() % 100) < cfg->ack_percent) {
+        tx_scheduler_on_reply(rolling_code, command, gate_state_at(now), -60, -62);
+    }
+}
+
+/* One pass of app_main, then the wait for the button period or the TX timer */
+static void scheduled_pass(bool button) {
+    if (button) {
+        state_machine_set_state(STATE_BYPASS);
+    } else if (state_machine_get_current_state() == STATE_BYPASS) {
+        state_machine_set_state(STATE_IDLE);
+    }
+    state_machine_run();
+
+    int64_t wake_us = esp_timer_get_time() + LOOP_MS * 1000;
+    int64_t timer_us = host_timer_next_deadline_us();
+    if (timer_us < wake_us) {
+        wake_us = timer_us;
+    }
+    host_clock_set_us(wake_us);
+    host_timer_run_due();
+    xTaskNotifyWait(0, UINT32_MAX, NULL, 0);
+}
+
+/* @return Coming into range to the gate starting to open, -1 if it never did */
+static int64_t run_arrival(void) {
+    host_sim_reset();
+    host_clock_set_us(1000000 + rand() % 1000000);
+    state_machine_init();
+    tx_scheduler_init();
+    memset(&res, 0, sizeof(res));
+    in_range = false;
+    auto_open = (uint32_t)(rand() % 100) < cfg->auto_percent;
+    near_pings = 0;
+    gate_opened_us = -1;
+
+    int64_t start_us = esp_timer_get_time();
+    int64_t near_us = start_us + (int64_t)cfg->away_s * 1000000;
+    int64_t end_us = near_us + (int64_t)cfg->near_s * 1000000;
+    int64_t press_us = auto_open ? -1 : near_us + (int64_t)cfg->press_s * 1000000;
+    int64_t opened_us = -1;
+
+    while (esp_timer_get_time() < end_us) {
+        int64_t now = esp_timer_get_time();
+        in_range = now >= near_us;
+        bool button = press_us >= 0 && now >= press_us && now < press_us + (int64_t)cfg->hold_ms * 1000;
+        scheduled_pass(button);
+        if (opened_us < 0 && gate_opened_us >= 0) {
+            opened_us = gate_opened_us;
+        }
+    }
+    return opened_us < 0 ? -1 : opened_us - near_us;
+}
+
+static int cmp_i64(const void *a, const void *b) {
+    int64_t x = *(const int64_t *)a;
+    int64_t y = *(const int64_t *)b;
+    return (x > y) - (x < y);
+}
+
+static void parse_args(int argc, char **argv, bench_config_t *c) {
+    for (int i = 1; i + 1 < argc; i += 2) {
+        uint32_t value = (uint32_t)strtoul(argv[i + 1], NULL, 10);
+        if (strcmp(argv[i], "--arrivals") == 0) {
+            c->arrivals = value ? value : 1;
+        } else if (strcmp(argv[i], "--away-s") == 0) {
+            c->away_s = value;
+        } else if (strcmp(argv[i], "--near-s") == 0) {
+            c->near_s = value ? value : 1;
+        } else if (strcmp(argv[i], "--ack-percent") == 0) {
+            c->ack_percent = value > 100 ? 100 : value;
+        } else if (strcmp(argv[i], "--auto-percent") == 0) {
+            c->auto_percent = value > 100 ? 100 : value;
+        } else if (strcmp(argv[i], "--press-s") == 0) {
+            c->press_s = value;
+        } else if (strcmp(argv[i], "--hold-ms") == 0) {
+            c->hold_ms = value ? value : 1;
+        } else if (strcmp(argv[i], "--travel-s") == 0) {
+            c->travel_s = value ? value : 1;
+        } else if (strcmp(argv[i], "--open-s") == 0) {
+            c->open_s = value;
+        } else if (strcmp(argv[i], "--seed") == 0) {
+            c->seed = value;
+        } else if (strcmp(argv[i], "--first-code") == 0) {
+            c->first_code = value;
+        } else {
+            fprintf(stderr, "Unknown option %s\n", argv[i]);
+            exit(1);
+        }
+    }
+}
+
+int main(int argc, char **argv) {
+    static bench_config_t config = {
+        .arrivals = 200,
+        .away_s = 30,
+        .near_s = 120,
+        .ack_percent = 90,
+        .auto_percent = 50,
+        .press_s = 4,
+        .hold_ms = 1500,
+        .travel_s = 12,
+        .open_s = 30,
+        .seed = 1,
+    };
+    parse_args(argc, argv, &config);
+    cfg = &config;
+
+    static int64_t open_delays[MAX_ARRIVALS];
+    printf("%u arrivals: %u s in range, %u%% acknowledged, %u%% opened by the receiver, "
+           "the others by a %u ms press\n",
+           cfg->arrivals, cfg->near_s, cfg->ack_percent, cfg->auto_percent, cfg->hold_ms);
+    printf("receiver      pkts  opens/press  open pings   air ms  open s\n");
+    for (mode = RECEIVER_ACK_ONLY; mode <= RECEIVER_REPLIES; mode++) {
+        srand(cfg->seed);
+        code_counter = cfg->first_code;
+        uint64_t packets = 0;
+        uint64_t force_opens = 0;
+        uint64_t open_pings = 0;
+        int64_t airtime_us = 0;
+        uint32_t presses = 0;
+        uint32_t opened = 0;
+        for (uint32_t a = 0; a < cfg->arrivals; a++) {
+            int64_t delay_us = run_arrival();
+            packets += res.packets;
+            force_opens += res.force_opens;
+            open_pings += res.open_pings;
+            airtime_us += res.airtime_us;
+            presses += auto_open ? 0 : 1;
+            if (delay_us >= 0 && opened < MAX_ARRIVALS) {
+                open_delays[opened++] = delay_us;
+            }
+        }
+        qsort(open_delays, opened, sizeof(open_delays[0]), cmp_i64);
+        printf("%-9s  %7.1f  %11.2f  %10.1f  %7.1f  %6.2f\n", receiver_mode_names[mode],
+               (double)packets / cfg->arrivals,
+               presses ? (double)force_opens / presses : 0.0,
+               (double)open_pings / cfg->arrivals,
+               airtime_us / 1000.0 / cfg->arrivals,
+               opened ? open_delays[opened / 2] / 1e6 : -1.0);
+    }
+    return 0;
+}
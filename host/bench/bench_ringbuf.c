@@ -0,0 +1,206 @@
+/* --------------------------------------------------------------------------
+ * Input debounce microbenchmark
+ *
+ * Compares the original bool-array ring buffer (32 bools, majority recomputed
+ * by a loop on every call) with the bit-packed one in shared-lib, in cycles
+ * per call, and checks both agree on every call. Then compares sampling the
+ * receiver's three inputs pin by pin into ring buffers with one register
+ * snapshot through the vertical-counter debouncer.
+ *
+ * Usage: bench_ringbuf [--iterations N]
+ * -------------------------------------------------------------------------- */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "host_sim.h"
+#include "ring_buffer.h"
+#include "debouncer.h"
+#include "soc/soc.h"
+#include "soc/gpio_reg.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define BENCH_CYCLES() __rdtsc()
+#define BENCH_UNIT "cycles"
+#else
+#define BENCH_CYCLES() host_wall_ns()
+#define BENCH_UNIT "ns"
+#endif
+
+/* Stops the compiler from treating the buffer as loop-invariant */
+#define BENCH_CLOBBER() __asm__ volatile("" ::: "memory")
+
+/* Original implementation, kept here as the baseline */
+typedef struct {
+    bool samples[WINDOW_SIZE];
+    uint8_t index;
+    bool full;
+} legacy_ringbuf_t;
+
+static void legacy_add_sample(legacy_ringbuf_t *rb, bool sample) {
+    rb->samples[rb->index] = sample;
+    rb->index++;
+    if (rb->index >= WINDOW_SIZE) {
+        rb->index = 0;
+        rb->full = true;
+    }
+}
+
+static uint8_t legacy_count_high(legacy_ringbuf_t *rb) {
+    uint8_t count = 0;
+    uint8_t limit = rb->full ? WINDOW_SIZE : rb->index;
+    for (uint8_t i = 0; i < limit; i++) {
+        if (rb->samples[i]) {
+            count++;
+        }
+    }
+    return count;
+}
+
+static bool legacy_is_majority_high(legacy_ringbuf_t *rb) {
+    uint8_t total_count = rb->full ? WINDOW_SIZE : rb->index;
+    if (total_count == 0) {
+        return false;
+    }
+    return legacy_count_high(rb) > (total_count / 2);
+}
+
+/* Noinline wrappers so the compiler can't hoist work out of the timed loop */
+__attribute__((noinline)) static bool legacy_step(legacy_ringbuf_t *rb, bool sample) {
+    legacy_add_sample(rb, sample);
+    return legacy_is_majority_high(rb);
+}
+
+__attribute__((noinline)) static bool packed_step(ringbuf_t *rb, bool sample) {
+    ringbuf_add_sample(rb, sample);
+    return ringbuf_is_majority_high(rb);
+}
+
+/* Receiver inputs: gate status, OTA button, sender OTA switch */
+static const uint8_t input_pins[] = {4, 0, 15};
+#define INPUT_COUNT (sizeof(input_pins) / sizeof(input_pins[0]))
+
+__attribute__((noinline)) static uint32_t ringbuf_inputs_step(ringbuf_t *rbs) {
+    uint32_t levels = 0;
+    for (uint32_t i = 0; i < INPUT_COUNT; i++) {
+        ringbuf_add_sample(&rbs[i], gpio_get_level(input_pins[i]));
+        levels |= (uint32_t)ringbuf_is_majority_high(&rbs[i]) << i;
+    }
+    return levels;
+}
+
+__attribute__((noinline)) static uint32_t debouncer_inputs_step(debouncer_t *db) {
+    debouncer_update(db, debouncer_read_inputs());
+    return (uint32_t)db->levels;
+}
+
+__attribute__((noinline)) static bool legacy_majority(legacy_ringbuf_t *rb) {
+    return legacy_is_majority_high(rb);
+}
+
+__attribute__((noinline)) static bool packed_majority(ringbuf_t *rb) {
+    return ringbuf_is_majority_high(rb);
+}
+
+int main(int argc, char **argv) {
+    uint32_t iterations = 10000000;
+    if (argc == 3 && strcmp(argv[1], "--iterations") == 0) {
+        iterations = (uint32_t)strtoul(argv[2], NULL, 10);
+    }
+
+    /* Bouncy input: mostly high with random glitches */
+    uint8_t *input = malloc(iterations);
+    if (input == NULL) {
+        fprintf(stderr, "Out of memory\n");
+        return 1;
+    }
+    srand(1);
+    for (uint32_t i = 0; i < iterations; i++) {
+        input[i] = (rand() % 8) != 0;
+    }
+
+    /* Correctness: both implementations must agree on every sample */
+    legacy_ringbuf_t legacy = {0};
+    ringbuf_t packed = {0};
+    for (uint32_t i = 0; i < iterations; i++) {
+        bool a = legacy_step(&legacy, input[i]);
+        bool b = packed_step(&packed, input[i]);
+        if (a != b || legacy_count_high(&legacy) != ringbuf_count_high(&packed) ||
+            ringbuf_count_high(&packed) != ringbuf_recount_high(&packed)) {
+            fprintf(stderr, "Mismatch at sample %u\n", i);
+            return 1;
+        }
+    }
+
+    uint32_t sink = 0;
+    uint64_t t0, t1;
+
+    memset(&legacy, 0, sizeof(legacy));
+    t0 = BENCH_CYCLES();
+    for (uint32_t i = 0; i < iterations; i++) {
+        sink += legacy_step(&legacy, input[i]);
+    }
+    t1 = BENCH_CYCLES();
+    double legacy_step_cost = (double)(t1 - t0) / iterations;
+
+    memset(&packed, 0, sizeof(packed));
+    t0 = BENCH_CYCLES();
+    for (uint32_t i = 0; i < iterations; i++) {
+        sink += packed_step(&packed, input[i]);
+    }
+    t1 = BENCH_CYCLES();
+    double packed_step_cost = (double)(t1 - t0) / iterations;
+
+    t0 = BENCH_CYCLES();
+    for (uint32_t i = 0; i < iterations; i++) {
+        sink += legacy_majority(&legacy);
+        BENCH_CLOBBER();
+    }
+    t1 = BENCH_CYCLES();
+    double legacy_majority_cost = (double)(t1 - t0) / iterations;
+
+    t0 = BENCH_CYCLES();
+    for (uint32_t i = 0; i < iterations; i++) {
+        sink += packed_majority(&packed);
+        BENCH_CLOBBER();
+    }
+    t1 = BENCH_CYCLES();
+    double packed_majority_cost = (double)(t1 - t0) / iterations;
+
+    /* Three inputs per loop pass, pins toggled from the same noisy input stream */
+    ringbuf_t input_rbs[INPUT_COUNT] = {0};
+    debouncer_t db;
+    debouncer_init(&db, (1ULL << 4) | (1ULL << 0) | (1ULL << 15), 0);
+    uint32_t pass_count = iterations / 8;
+
+    t0 = BENCH_CYCLES();
+    for (uint32_t i = 0; i < pass_count; i++) {
+        host_gpio_set_input(input_pins[i % INPUT_COUNT], input[i]);
+        sink += ringbuf_inputs_step(input_rbs);
+    }
+    t1 = BENCH_CYCLES();
+    double ringbuf_inputs_cost = (double)(t1 - t0) / pass_count;
+
+    t0 = BENCH_CYCLES();
+    for (uint32_t i = 0; i < pass_count; i++) {
+        host_gpio_set_input(input_pins[i % INPUT_COUNT], input[i]);
+        sink += debouncer_inputs_step(&db);
+    }
+    t1 = BENCH_CYCLES();
+    double debouncer_inputs_cost = (double)(t1 - t0) / pass_count;
+
+    printf("iterations=%u (sink %u)\n", iterations, sink);
+    printf("%-28s %8s %8s\n", "", "bool[]", "packed");
+    printf("%-28s %8.2f %8.2f  %s/call\n", "add + is_majority_high",
+           legacy_step_cost, packed_step_cost, BENCH_UNIT);
+    printf("%-28s %8.2f %8.2f  %s/call\n", "is_majority_high",
+           legacy_majority_cost, packed_majority_cost, BENCH_UNIT);
+    printf("%-28s %8zu %8zu  bytes\n", "sizeof", sizeof(legacy_ringbuf_t), sizeof(ringbuf_t));
+    printf("\n%-28s %8s %8s\n", "", "ringbuf", "vertical");
+    printf("%-28s %8.2f %8.2f  %s/pass (incl. simulated pin writes)\n", "3 inputs sample+debounce",
+           ringbuf_inputs_cost, debouncer_inputs_cost, BENCH_UNIT);
+
+    free(input);
+    return 0;
+}
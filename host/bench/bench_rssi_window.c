@@ -0,0 +1,178 @@
+/* --------------------------------------------------------------------------
+ * RSSI window microbenchmark
+ *
+ * Checks the running sums of rssi_window.c against a direct recomputation
+ * over the samples in arrival order, for several window lengths, and reports
+ * the cost of one ping (add + proximity check) next to the original
+ * signal_history[8] version, which summed the array by index.
+ *
+ * Usage: bench_rssi_window [--iterations N]
+ * -------------------------------------------------------------------------- */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "host_sim.h"
+#include "rssi_window.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define BENCH_CYCLES() __rdtsc()
+#define BENCH_UNIT "cycles"
+#else
+#define BENCH_CYCLES() host_wall_ns()
+#define BENCH_UNIT "ns"
+#endif
+
+#define PING_INTERVAL_US 100000
+
+/* Original implementation, kept here as the baseline */
+typedef struct {
+    uint8_t rssi;
+    int64_t timestamp_us;
+} legacy_signal_t;
+
+typedef struct {
+    legacy_signal_t history[8];
+    int16_t index;
+    int16_t count;
+} legacy_history_t;
+
+__attribute__((noinline)) static bool legacy_step(legacy_history_t *h, int8_t rssi, int64_t now_us) {
+    h->history[h->index].rssi = (uint8_t)rssi;
+    h->history[h->index].timestamp_us = now_us;
+    h->index = (int16_t)((h->index + 1) % 8);
+    if (h->count < 8) {
+        h->count++;
+    }
+    if (h->count < 8) {
+        return false;
+    }
+
+    signed int lower_average = 0;
+    signed int higher_average = 0;
+    signed int total_delay_us = 0;
+    for (int i = 0; i < 4; i++) {
+        lower_average  += h->history[i].rssi;
+        higher_average += h->history[i + 4].rssi;
+        total_delay_us += (now_us - h->history[i].timestamp_us) + (now_us - h->history[i + 4].timestamp_us);
+    }
+    return total_delay_us < 3000000 && higher_average > lower_average;
+}
+
+__attribute__((noinline)) static bool window_step(rssi_window_t *w, int8_t rssi, int64_t now_us) {
+    rssi_window_add(w, rssi, now_us);
+    if (w->count < w->length) {
+        return false;
+    }
+    return rssi_window_slope_q(w) > 0 && rssi_window_span_us(w) < 3000000;
+}
+
+/* Direct O(n) recomputation of the statistics in arrival order */
+static bool check_window(const rssi_window_t *w, const int8_t *input, uint32_t end) {
+    int64_t n = w->count;
+    int64_t sum = 0, sum_sq = 0, sum_xy = 0;
+    for (int64_t x = 0; x < n; x++) {
+        int64_t y = (int64_t)input[end - n + x] * (1 << RSSI_FRAC_BITS);
+        sum += y;
+        sum_sq += y * y;
+        sum_xy += x * y;
+    }
+    if (sum != w->sum || sum_sq != w->sum_sq || sum_xy != w->sum_xy) {
+        return false;
+    }
+    if (n >= 2) {
+        int64_t sum_x = n * (n - 1) / 2;
+        int64_t sum_xx = (n - 1) * n * (2 * n - 1) / 6;
+        int32_t slope = (int32_t)((n * sum_xy - sum_x * sum) / (n * sum_xx - sum_x * sum_x));
+        if (slope != rssi_window_slope_q(w) ||
+            rssi_window_span_us(w) != (n - 1) * PING_INTERVAL_US) {
+            return false;
+        }
+    }
+    return true;
+}
+
+int main(int argc, char **argv) {
+    uint32_t iterations = 10000000;
+    if (argc == 3 && strcmp(argv[1], "--iterations") == 0) {
+        iterations = (uint32_t)strtoul(argv[2], NULL, 10);
+    }
+
+    /* Signed dBm: slow random walk with multipath noise */
+    int8_t *input = malloc(iterations);
+    if (input == NULL) {
+        fprintf(stderr, "Out of memory\n");
+        return 1;
+    }
+    srand(1);
+    int level = -70;
+    for (uint32_t i = 0; i < iterations; i++) {
+        level += (rand() % 3) - 1;
+        level = level < -95 ? -95 : (level > -30 ? -30 : level);
+        input[i] = (int8_t)(level + (rand() % 9) - 4);
+    }
+
+    static const uint8_t lengths[] = {8, 64, 128};
+    rssi_window_t w;
+
+    /* Correctness: running sums must match a recomputation after every sample */
+    uint32_t check_count = iterations < 100000 ? iterations : 100000;
+    for (size_t l = 0; l < sizeof(lengths); l++) {
+        rssi_window_init(&w, lengths[l]);
+        for (uint32_t i = 0; i < check_count; i++) {
+            rssi_window_add(&w, input[i], (int64_t)i * PING_INTERVAL_US);
+            if (!check_window(&w, input, i + 1)) {
+                fprintf(stderr, "Mismatch at sample %u (window %u)\n", i, lengths[l]);
+                return 1;
+            }
+        }
+    }
+
+    /* A steady approach must read as approaching whatever the ring position */
+    legacy_history_t legacy = {0};
+    rssi_window_init(&w, 8);
+    uint32_t legacy_misses = 0, window_misses = 0;
+    for (uint32_t i = 0; i < 64; i++) {
+        int8_t rssi = (int8_t)(-90 + (int)i);
+        int64_t now_us = (int64_t)i * PING_INTERVAL_US;
+        bool a = legacy_step(&legacy, rssi, now_us);
+        bool b = window_step(&w, rssi, now_us);
+        if (i >= 7) {
+            legacy_misses += !a;
+            window_misses += !b;
+        }
+    }
+
+    uint32_t sink = 0;
+    uint64_t t0, t1;
+
+    memset(&legacy, 0, sizeof(legacy));
+    t0 = BENCH_CYCLES();
+    for (uint32_t i = 0; i < iterations; i++) {
+        sink += legacy_step(&legacy, input[i], (int64_t)i * PING_INTERVAL_US);
+    }
+    t1 = BENCH_CYCLES();
+    double legacy_cost = (double)(t1 - t0) / iterations;
+
+    printf("iterations=%u\n", iterations);
+    printf("%-26s %8.2f %s/ping\n", "signal_history[8]", legacy_cost, BENCH_UNIT);
+
+    for (size_t l = 0; l < sizeof(lengths); l++) {
+        rssi_window_init(&w, lengths[l]);
+        t0 = BENCH_CYCLES();
+        for (uint32_t i = 0; i < iterations; i++) {
+            sink += window_step(&w, input[i], (int64_t)i * PING_INTERVAL_US);
+        }
+        t1 = BENCH_CYCLES();
+        char name[32];
+        snprintf(name, sizeof(name), "rssi_window[%u]", lengths[l]);
+        printf("%-26s %8.2f %s/ping\n", name, (double)(t1 - t0) / iterations, BENCH_UNIT);
+    }
+
+    printf("steady approach, 57 full-window pings: missed by signal_history %u, by rssi_window %u (sink %u)\n",
+           legacy_misses, window_misses, sink);
+
+    free(input);
+    return 0;
+}
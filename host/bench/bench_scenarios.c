@@ -0,0 +1,422 @@
+/* --------------------------------------------------------------------------
+ * Ride scenario scorecard for the open decision
+ *
+ * Generates parametrised rides around the gate and drives them through
+ * receive_cb() -> process_event() -> state_machine_run() on the host event
+ * loop. Scenarios where the rider comes home should open the gate before
+ * arrival; the others (driving past on the street, parked just inside radio
+ * range, leaving home) should not open it at all. Each scenario is scored
+ * with the estimator's early open and with the RSSI window check alone, each
+ * with the RSSI measured at the receiver only (1-side) and with the sender's
+ * RSSI on the receiver's replies fused in (2-side). The downlink fades
+ * independently of the uplink and reads --asym-db lower; the sender reports
+ * it on every --reply-every'th ping (every one for TX_REPLY_APPROACH_US after
+ * coming into range, then every fourth).
+ *
+ *   open ms    gate fully open relative to arrival, p50/p90 (negative = early)
+ *   in time    share of opening rides where the gate was open on arrival
+ *   missed     share of rides home where the gate never opened
+ *   false      share of the other rides where it opened
+ *   pings      pings received before the open command, mean over rides home
+ *
+ * A ride past the gate that RSSI cannot tell from a ride home before the
+ * open command has to go out is marked unwinnable, with the numbers below
+ * the table: its false opens are what opening early costs, not a tuning
+ * target. The open goes out speed x travel time before the gate, and there
+ * a pass lateral_m off the street reads within the fading of a head-on
+ * approach.
+ *
+ * The header lists RSSI_WINDOW_LENGTH, RSSI_HISTORY_GAP_US and
+ * AUTO_OPEN_COOLDOWN_US as built, so tuning them comes with numbers.
+ *
+ * Usage: bench_scenarios [--trials N] [--travel-ms N] [--ping-ms N]
+ *                        [--asym-db N] [--reply-every N] [--seed N]
+ *                        [--scenario NAME]
+ * -------------------------------------------------------------------------- */
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "esp_timer.h"
+#include "host_sim.h"
+#include "receiver_host.h"
+#include "main.h"
+#include "gpio_config.h"
+#include "espnow_config.h"
+#include "event_processing.h"
+#include "estimator.h"
+
+#define TRIAL_START_US       1000000000LL // Well past every cooldown
+#define ARRIVAL_DISTANCE_M   5.0          // Bike is at the gate
+#define RSSI_AT_1M_DBM       -40.0
+#define PATH_LOSS_EXPONENT   2.2
+#define RSSI_FLOOR_DBM       -95.0        // Packets below this are lost, about 315 m
+#define GATE_START_US        300000LL     // Motor start until the closed switch opens
+
+typedef struct {
+    const char *name;
+    bool should_open;
+    double start_m;         // Along the street, negative before the gate
+    double end_m;
+    double lateral_m;       // Distance from the street to the receiver
+    double speed_kmh;       // 0 for a parked bike, which stays for duration_s
+    double duration_s;
+    double noise_db;        // Multipath fading, 1 sigma
+    double loss;            // Independent packet loss
+    double burst_start;     // Per packet chance of entering a loss burst
+    double burst_end;       // Per packet chance of leaving it
+} scenario_t;
+
+static const scenario_t scenarios[] = {
+    {"approach",   true,  300, 5,   0,  25, 0,   3, 0.02, 0,    0},
+    {"drive_by",   false, -300, 300, 20, 40, 0,  3, 0.02, 0,    0},
+    {"parked",     false, 290, 290, 0,  0,  180, 3, 0.02, 0,    0},
+    {"leaving",    false, 5,   300, 0,  25, 0,   3, 0.02, 0,    0},
+    {"fading",     true,  300, 5,   0,  25, 0,   8, 0.02, 0,    0},
+    {"loss_burst", true,  300, 5,   0,  25, 0,   3, 0.02, 0.05, 0.25},
+};
+#define SCENARIO_COUNT (sizeof(scenarios) / sizeof(scenarios[0]))
+
+typedef struct {
+    uint32_t trials;
+    uint32_t travel_ms;
+    uint32_t ping_ms;
+    uint32_t asym_db;
+    uint32_t reply_every;
+    uint32_t seed;
+    const char *only;
+} bench_config_t;
+
+typedef struct {
+    int64_t *samples;       // Gate fully open - arrival
+    uint32_t count;
+    uint32_t opened;
+    uint32_t in_time;
+    uint64_t pings;         // Received before the open command, rides home
+} score_t;
+
+/* Gate model: status pin high while closed */
+static bool gate_closed = true;
+static int64_t gate_event_us = INT64_MAX;     // Next status pin change
+static int64_t gate_fully_open_us = -1;
+static uint32_t next_rolling_code = 1;
+static const bench_config_t *config = NULL;
+
+/* Link model for the receiver's replies */
+static const scenario_t *ride = NULL;
+static double ride_distance_m = ARRIVAL_DISTANCE_M;
+static bool ride_in_burst = false;
+static int8_t reply_rssi = ESPNOW_RSSI_NONE;    // Sender's RSSI on the last reply, for the next ping
+static uint32_t pings_received = 0;
+static uint32_t pings_at_open = 0;
+
+static void on_gpio_output(gpio_num_t pin, uint32_t level) {
+    if (pin != GATE_CMD_PIN_OUT || !level || gate_event_us != INT64_MAX) {
+        return;
+    }
+    int64_t now = esp_timer_get_time();
+    int64_t travel_us = (int64_t)config->travel_ms * 1000;
+    if (gate_closed) {
+        gate_event_us = now + GATE_START_US;
+        gate_fully_open_us = now + travel_us;
+        pings_at_open = pings_received;
+    } else {
+        gate_event_us = now + travel_us;
+    }
+}
+
+static void deliver_packet(uint8_t command, int8_t rssi) {
+    espnow_data_t pkt = {
+        .version = SUPPORTED_PROTOCOL_VERSION,
+        .rolling_code = next_rolling_code++,
+        .command = command,
+        .reply_rssi = reply_rssi,
+    };
+    reply_rssi = ESPNOW_RSSI_NONE;
+    pings_received += command == CMD_PING;
+    wifi_pkt_rx_ctrl_t rx_ctrl = {.rssi = rssi};
+    esp_now_recv_info_t info = {.src_addr = receiver_host_sender_mac, .rx_ctrl = &rx_ctrl};
+    receive_cb(&info, (const uint8_t *)&pkt, sizeof(pkt));
+}
+
+/* Run the event loop until `until_us`, applying gate movements on the way */
+static void run_until(int64_t until_us) {
+    while (1) {
+        int64_t wake_us = host_task_notify_pending() ? esp_timer_get_time()
+                                                     : receiver_host_wake_deadline_us();
+        if (gate_event_us <= wake_us && gate_event_us <= until_us) {
+            host_clock_set_us(gate_event_us);
+            gate_event_us = INT64_MAX;
+            gate_closed = !gate_closed;
+            host_gpio_set_input(GATE_STATUS_PIN_INPUT, gate_closed);
+            continue;
+        }
+        if (wake_us > until_us) {
+            break;
+        }
+        host_clock_set_us(wake_us);
+        receiver_host_event_pass();
+    }
+    host_clock_set_us(until_us);
+}
+
+static double uniform(void) {
+    return (rand() + 1.0) / (RAND_MAX + 2.0);
+}
+
+static double gaussian(void) {
+    return sqrt(-2.0 * log(uniform())) * cos(2.0 * M_PI * uniform());
+}
+
+static double rssi_at(double distance_m, double noise_db) {
+    if (distance_m < 1.0) {
+        distance_m = 1.0;
+    }
+    return RSSI_AT_1M_DBM - 10.0 * PATH_LOSS_EXPONENT * log10(distance_m) + gaussian() * noise_db;
+}
+
+/* The receiver replied: the sender hears it, with its own fading, unless it is lost */
+static void on_espnow_send(const uint8_t *peer_addr, const uint8_t *data, size_t len) {
+    (void)peer_addr;
+    (void)data;
+    if (len != sizeof(espnow_reply_t) || ride == NULL || ride_in_burst || uniform() < ride->loss) {
+        return;
+    }
+    double rssi = rssi_at(ride_distance_m, ride->noise_db) - config->asym_db;
+    if (rssi >= RSSI_FLOOR_DBM) {
+        reply_rssi = (int8_t)lround(rssi < -128 ? -128 : rssi);
+    }
+}
+
+/**
+ * One ride. Returns the arrival time for rides home, 0 otherwise; the gate
+ * opening is left in gate_fully_open_us.
+ */
+static int64_t run_ride(const scenario_t *sc, bool early_open, bool two_sided) {
+    host_sim_reset();
+    gate_closed = false; // Start open so the first toggle times a full close
+    gate_event_us = INT64_MAX;
+    gate_fully_open_us = -1;
+    next_rolling_code = 1;
+    host_gpio_set_input(GATE_STATUS_PIN_INPUT, 0);
+    receiver_host_init();
+    estimator_early_open = early_open;
+    rssi_two_sided = two_sided;
+    host_gpio_set_output_hook(on_gpio_output);
+    host_espnow_set_send_hook(on_espnow_send);
+    host_clock_set_us(TRIAL_START_US);
+    ride = NULL;
+    reply_rssi = ESPNOW_RSSI_NONE;
+
+    /* Close the gate with a force-open toggle, which also teaches the travel time */
+    deliver_packet(CMD_FORCE_OPEN, -60);
+    run_until(TRIAL_START_US + (int64_t)config->travel_ms * 1000 + 2000000);
+    gate_fully_open_us = -1;
+    ride = sc;
+    reply_rssi = ESPNOW_RSSI_NONE;
+    ride_in_burst = false;
+    pings_received = 0;
+    pings_at_open = 0;
+    uint32_t pings_sent = 0;
+
+    double speed_mps = sc->speed_kmh / 3.6;
+    double length_m = fabs(sc->end_m - sc->start_m);
+    double duration_s = speed_mps > 0 ? length_m / speed_mps : sc->duration_s;
+    double direction = sc->end_m >= sc->start_m ? 1.0 : -1.0;
+    int64_t start_us = esp_timer_get_time();
+    int64_t end_us = start_us + (int64_t)(duration_s * 1e6);
+    int64_t ping_us = (int64_t)config->ping_ms * 1000;
+
+    for (int64_t t = start_us; t < end_us; t += ping_us + rand() % 2000) {
+        double along_m = sc->start_m + direction * speed_mps * (t - start_us) / 1e6;
+        double distance_m = hypot(along_m, sc->lateral_m);
+        ride_distance_m = distance_m < ARRIVAL_DISTANCE_M ? ARRIVAL_DISTANCE_M : distance_m;
+        double rssi = rssi_at(ride_distance_m, sc->noise_db);
+
+        ride_in_burst = ride_in_burst ? uniform() >= sc->burst_end : uniform() < sc->burst_start;
+        run_until(t);
+        /* The sender only reports the replies it stayed awake for */
+        if (++pings_sent % config->reply_every != 0) {
+            reply_rssi = ESPNOW_RSSI_NONE;
+        }
+        if (!ride_in_burst && uniform() >= sc->loss && rssi >= RSSI_FLOOR_DBM) {
+            deliver_packet(CMD_PING, (int8_t)lround(rssi < -128 ? -128 : rssi));
+        } else {
+            reply_rssi = ESPNOW_RSSI_NONE;
+        }
+    }
+
+    if (sc->should_open) {
+        /* Keep riding in at the gate for a few pings */
+        ride_distance_m = ARRIVAL_DISTANCE_M / 2;
+        for (int i = 0; i < 8; i++) {
+            run_until(esp_timer_get_time() + ping_us);
+            deliver_packet(CMD_PING, (int8_t)lround(rssi_at(ride_distance_m, sc->noise_db)));
+        }
+    }
+    run_until(esp_timer_get_time() + 1000000);
+    return sc->should_open ? end_us : 0;
+}
+
+/**
+ * How much weaker a pass reads than a head-on approach where the open has
+ * to go out; NAN for rides that do not pass the gate.
+ */
+static double pass_gap_db(const scenario_t *sc, double *open_at_m) {
+    if (sc->should_open || sc->speed_kmh <= 0 || sc->lateral_m <= 0 || sc->start_m * sc->end_m >= 0) {
+        return NAN;
+    }
+    *open_at_m = sc->speed_kmh / 3.6 * config->travel_ms / 1000.0;
+    return 10.0 * PATH_LOSS_EXPONENT * log10(hypot(*open_at_m, sc->lateral_m) / *open_at_m);
+}
+
+static bool unwinnable(const scenario_t *sc) {
+    double open_at_m;
+    double gap_db = pass_gap_db(sc, &open_at_m);
+    return !isnan(gap_db) && gap_db < sc->noise_db;
+}
+
+static int cmp_i64(const void *a, const void *b) {
+    int64_t x = *(const int64_t *)a;
+    int64_t y = *(const int64_t *)b;
+    return (x > y) - (x < y);
+}
+
+static double percentile_ms(const score_t *score, uint32_t pct) {
+    return score->samples[(uint64_t)(score->count - 1) * pct / 100] / 1000.0;
+}
+
+static void score_scenario(const scenario_t *sc, bool early_open, bool two_sided, score_t *score) {
+    score->count = 0;
+    score->opened = 0;
+    score->in_time = 0;
+    score->pings = 0;
+    for (uint32_t t = 0; t < config->trials; t++) {
+        int64_t arrival_us = run_ride(sc, early_open, two_sided);
+        if (gate_fully_open_us < 0) {
+            continue;
+        }
+        score->opened++;
+        if (sc->should_open) {
+            int64_t open_us = gate_fully_open_us - arrival_us;
+            score->samples[score->count++] = open_us;
+            score->in_time += open_us <= 0;
+            score->pings += pings_at_open;
+        }
+    }
+    qsort(score->samples, score->count, sizeof(int64_t), cmp_i64);
+}
+
+static void print_score(const scenario_t *sc, const char *mode, const score_t *score) {
+    double trials = config->trials;
+    printf("%-11s %-10s", sc->name, mode);
+    if (!sc->should_open) {
+        printf("  %9s  %9s  %7s  %6s  %5.1f%%  %6s%s\n", "-", "-", "-", "-", 100.0 * score->opened / trials, "-",
+               unwinnable(sc) ? "  unwinnable" : "");
+        return;
+    }
+    if (score->count > 0) {
+        printf("  %9.0f  %9.0f  %6.1f%%", percentile_ms(score, 50), percentile_ms(score, 90),
+               100.0 * score->in_time / score->count);
+    } else {
+        printf("  %9s  %9s  %7s", "-", "-", "-");
+    }
+    printf("  %5.1f%%  %6s", 100.0 * (trials - score->opened) / trials, "-");
+    if (score->count > 0) {
+        printf("  %6.1f\n", (double)score->pings / score->count);
+    } else {
+        printf("  %6s\n", "-");
+    }
+}
+
+static const char *const mode_names[] = {"est 1-side", "est 2-side", "win 1-side", "win 2-side"};
+
+static void parse_args(int argc, char **argv, bench_config_t *cfg) {
+    for (int i = 1; i + 1 < argc; i += 2) {
+        if (strcmp(argv[i], "--scenario") == 0) {
+            cfg->only = argv[i + 1];
+            continue;
+        }
+        uint32_t value = (uint32_t)strtoul(argv[i + 1], NULL, 10);
+        if (strcmp(argv[i], "--trials") == 0) {
+            cfg->trials = value ? value : 1;
+        } else if (strcmp(argv[i], "--travel-ms") == 0) {
+            cfg->travel_ms = value ? value : 1;
+        } else if (strcmp(argv[i], "--ping-ms") == 0) {
+            cfg->ping_ms = value ? value : 1;
+        } else if (strcmp(argv[i], "--asym-db") == 0) {
+            cfg->asym_db = value;
+        } else if (strcmp(argv[i], "--reply-every") == 0) {
+            cfg->reply_every = value ? value : 1;
+        } else if (strcmp(argv[i], "--seed") == 0) {
+            cfg->seed = value;
+        } else {
+            fprintf(stderr, "Unknown option %s\n", argv[i]);
+            exit(1);
+        }
+    }
+}
+
+int main(int argc, char **argv) {
+    bench_config_t cfg = {
+        .trials = 200,
+        .travel_ms = 10000,
+        .ping_ms = 250,
+        .asym_db = 4,
+        .reply_every = 1,
+        .seed = 1,
+    };
+    parse_args(argc, argv, &cfg);
+    config = &cfg;
+
+    score_t score = {.samples = calloc(cfg.trials, sizeof(int64_t))};
+    if (score.samples == NULL) {
+        fprintf(stderr, "Out of memory\n");
+        return 1;
+    }
+
+    printf("trials=%u  gate travel=%u ms  ping=%u ms  window=%u  history gap=%lld ms  cooldown=%lld s\n",
+           cfg.trials, cfg.travel_ms, cfg.ping_ms, RSSI_WINDOW_LENGTH,
+           RSSI_HISTORY_GAP_US / 1000, (long long)(AUTO_OPEN_COOLDOWN_US / 1000000));
+    printf("downlink %u dB below uplink, reported on every %u ping(s)\n", cfg.asym_db, cfg.reply_every);
+    printf("%-11s %-10s  %9s  %9s  %7s  %6s  %6s  %6s\n",
+           "scenario", "decision", "open p50", "open p90", "in time", "missed", "false", "pings");
+
+    bool found = false;
+    for (uint32_t s = 0; s < SCENARIO_COUNT; s++) {
+        if (cfg.only != NULL && strcmp(cfg.only, scenarios[s].name) != 0) {
+            continue;
+        }
+        found = true;
+        for (int mode = 0; mode < 4; mode++) {
+            bool early = mode < 2;
+            bool two_sided = mode % 2;
+            srand(cfg.seed + s);
+            score_scenario(&scenarios[s], early, two_sided, &score);
+            print_score(&scenarios[s], mode_names[mode], &score);
+        }
+    }
+    if (!found) {
+        fprintf(stderr, "Unknown scenario %s\n", cfg.only);
+        return 1;
+    }
+    for (uint32_t s = 0; s < SCENARIO_COUNT; s++) {
+        double open_at_m;
+        if ((cfg.only == NULL || strcmp(cfg.only, scenarios[s].name) == 0) && unwinnable(&scenarios[s])) {
+            const scenario_t *sc = &scenarios[s];
+            double gap_db = pass_gap_db(sc, &open_at_m);
+            /* Where the gap grows to one sigma of fading */
+            double ratio = pow(10.0, sc->noise_db / (10.0 * PATH_LOSS_EXPONENT));
+            double apart_m = sc->lateral_m / sqrt(ratio * ratio - 1.0);
+            printf("%s unwinnable: the open goes out %.0f m before the gate, where a pass %.0f m off the street\n"
+                   "reads %.1f dB below a head-on approach, inside %.0f dB of fading. The gap reaches the fading\n"
+                   "%.0f m before the gate, %.1f s before arrival, too late to open in time.\n",
+                   sc->name, open_at_m, sc->lateral_m, gap_db, sc->noise_db, apart_m,
+                   apart_m / (sc->speed_kmh / 3.6));
+        }
+    }
+
+    free(score.samples);
+    return 0;
+}
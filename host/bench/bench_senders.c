@@ -0,0 +1,321 @@
+/* --------------------------------------------------------------------------
+ * Multi-sender benchmark
+ *
+ * Pairs --senders vehicles (at most SENDER_TABLE_MAX) with random MACs from
+ * one vendor prefix and drives the receiver with all of them at once:
+ *
+ *   lookup    sender_table_find() for paired and unknown MACs: time and MAC
+ *             compares per lookup, next to a linear scan of the same list
+ *   traffic   every sender pings at --ping-ms with random phase and jitter
+ *             for --seconds, with 5% of packets delivered a second time and
+ *             --strangers unpaired neighbours pinging too; each sender's
+ *             filter must count exactly its own pings, every duplicate and
+ *             stranger packet has to be dropped
+ *   cooldown  two senders arrive --gap-s apart; each gets its own auto open
+ *             even though the second arrives inside AUTO_OPEN_COOLDOWN_US
+ *   pairing   a force open from a new MAC pairs it while pairing is open,
+ *             is dropped once it closed, and the list survives a reboot
+ *
+ * Usage: bench_senders [--senders N] [--strangers N] [--seconds N]
+ *                      [--ping-ms N] [--gap-s N] [--seed N]
+ * -------------------------------------------------------------------------- */
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "esp_timer.h"
+#include "host_sim.h"
+#include "receiver_host.h"
+#include "main.h"
+#include "espnow_config.h"
+#include "event_processing.h"
+#include "estimator.h"
+#include "nvs_config.h"
+#include "sender_table.h"
+
+#define TRIAL_START_US      1000000000LL    // Well past every cooldown
+#define LOOKUP_ROUNDS       20000
+#define DUPLICATE_PERCENT   5
+#define MAX_STRANGERS       64
+
+typedef struct {
+    uint32_t senders;
+    uint32_t strangers;
+    uint32_t seconds;
+    uint32_t ping_ms;
+    uint32_t gap_s;
+    uint32_t seed;
+} bench_config_t;
+
+typedef struct {
+    uint8_t mac[ESP_NOW_ETH_ALEN];
+    uint32_t next_code;
+    int64_t next_ping_us;
+    int8_t rssi;
+    uint32_t pings;
+} vehicle_t;
+
+static vehicle_t vehicles[SENDER_TABLE_MAX + MAX_STRANGERS];
+static volatile uint32_t sink;
+
+static void random_mac(uint8_t *mac) {
+    mac[0] = 0x24; // Espressif prefix, shared by every board in the household
+    mac[1] = 0x6f;
+    mac[2] = 0x28;
+    for (int i = 3; i < ESP_NOW_ETH_ALEN; i++) {
+        mac[i] = (uint8_t)rand();
+    }
+}
+
+static void deliver_packet(uint8_t *mac, uint8_t command, uint32_t rolling_code, int8_t rssi) {
+    espnow_data_t pkt = {
+        .version = SUPPORTED_PROTOCOL_VERSION,
+        .rolling_code = rolling_code,
+        .command = command,
+    };
+    wifi_pkt_rx_ctrl_t rx_ctrl = {.rssi = rssi};
+    esp_now_recv_info_t info = {.src_addr = mac, .rx_ctrl = &rx_ctrl};
+    receive_cb(&info, (const uint8_t *)&pkt, sizeof(pkt));
+}
+
+/* Fresh receiver with `count` paired vehicles, distinct MACs, codes from 1 */
+static void pair_vehicles(uint32_t count, uint32_t strangers) {
+    host_sim_reset();
+    host_clock_set_us(TRIAL_START_US);
+    receiver_host_init();
+    sender_table_init();
+    for (uint32_t v = 0; v < count + strangers; v++) {
+        do {
+            random_mac(vehicles[v].mac);
+        } while (sender_table_find(vehicles[v].mac) != SENDER_ID_NONE);
+        if (v < count) {
+            sender_table_add(vehicles[v].mac, 0);
+        }
+        vehicles[v].next_code = 1;
+        vehicles[v].pings = 0;
+    }
+}
+
+/* --------------------------------------------------------------------------
+ * Lookup cost
+ * -------------------------------------------------------------------------- */
+
+static uint8_t linear_find(uint32_t count, const uint8_t *mac) {
+    for (uint32_t v = 0; v < count; v++) {
+        if (memcmp(vehicles[v].mac, mac, ESP_NOW_ETH_ALEN) == 0) {
+            return (uint8_t)v;
+        }
+    }
+    return SENDER_ID_NONE;
+}
+
+static void bench_lookup(const bench_config_t *cfg) {
+    uint32_t strangers = cfg->strangers ? cfg->strangers : 1;
+    pair_vehicles(cfg->senders, strangers);
+
+    uint32_t errors = 0;
+    for (uint32_t v = 0; v < cfg->senders + strangers; v++) {
+        uint8_t expected = v < cfg->senders ? (uint8_t)v : SENDER_ID_NONE;
+        errors += sender_table_find(vehicles[v].mac) != expected;
+    }
+
+    const char *names[] = {"hash hit", "hash miss", "linear hit", "linear miss"};
+    for (int mode = 0; mode < 4; mode++) {
+        bool hit = mode % 2 == 0;
+        uint32_t first = hit ? 0 : cfg->senders;
+        uint32_t count = hit ? cfg->senders : strangers;
+        sender_table_probes = 0;
+        uint64_t start_ns = host_wall_ns();
+        for (uint32_t r = 0; r < LOOKUP_ROUNDS; r++) {
+            for (uint32_t v = first; v < first + count; v++) {
+                sink += mode < 2 ? sender_table_find(vehicles[v].mac)
+                                 : linear_find(cfg->senders, vehicles[v].mac);
+            }
+        }
+        double lookups = (double)LOOKUP_ROUNDS * count;
+        double ns = (host_wall_ns() - start_ns) / lookups;
+        if (mode < 2) {
+            printf("lookup: %-11s %6.1f ns  %4.2f MAC compares\n", names[mode], ns,
+                   sender_table_probes / lookups);
+        } else {
+            printf("lookup: %-11s %6.1f ns  %4.2f MAC compares\n", names[mode], ns,
+                   hit ? (cfg->senders + 1) / 2.0 : (double)cfg->senders);
+        }
+    }
+    printf("lookup: %u senders in %u slots, %u wrong ids\n", cfg->senders, SENDER_TABLE_SLOTS, errors);
+}
+
+/* --------------------------------------------------------------------------
+ * Everyone talking at once
+ * -------------------------------------------------------------------------- */
+
+static void bench_traffic(const bench_config_t *cfg) {
+    uint32_t total = cfg->senders + cfg->strangers;
+    pair_vehicles(cfg->senders, cfg->strangers);
+    int64_t ping_us = (int64_t)cfg->ping_ms * 1000;
+    for (uint32_t v = 0; v < total; v++) {
+        vehicles[v].next_ping_us = TRIAL_START_US + rand() % ping_us;
+        vehicles[v].rssi = (int8_t)(-90 + rand() % 30); // Parked, far enough not to open
+    }
+
+    uint32_t delivered = 0;
+    uint32_t duplicates = 0;
+    uint32_t dispatched = 0;
+    uint64_t cpu_ns = 0;
+    int64_t end_us = TRIAL_START_US + (int64_t)cfg->seconds * 1000000;
+    while (1) {
+        /* Next sender to ping */
+        vehicle_t *next = &vehicles[0];
+        for (uint32_t v = 1; v < total; v++) {
+            if (vehicles[v].next_ping_us < next->next_ping_us) {
+                next = &vehicles[v];
+            }
+        }
+        if (next->next_ping_us >= end_us) {
+            break;
+        }
+        host_clock_set_us(next->next_ping_us);
+
+        uint32_t code = next->next_code++;
+        uint32_t copies = rand() % 100 < DUPLICATE_PERCENT ? 2 : 1;
+        uint64_t start_ns = host_wall_ns();
+        for (uint32_t c = 0; c < copies; c++) {
+            deliver_packet(next->mac, CMD_PING, code, next->rssi);
+        }
+        dispatched += receiver_host_event_pass();
+        cpu_ns += host_wall_ns() - start_ns;
+
+        next->pings++;
+        delivered += copies;
+        duplicates += copies - 1;
+        next->next_ping_us += ping_us - ping_us / 10 + rand() % (ping_us / 5 + 1);
+    }
+
+    /* The filter counts pings since it started, so it sees exactly the sender's own */
+    uint32_t wrong = 0;
+    for (uint32_t v = 0; v < cfg->senders; v++) {
+        const sender_t *sender = sender_table_get((uint8_t)v);
+        if (sender->filter.samples != vehicles[v].pings ||
+            sender->replay.highest != vehicles[v].next_code - 1) {
+            wrong++;
+        }
+    }
+    uint32_t stranger_packets = 0;
+    for (uint32_t v = cfg->senders; v < total; v++) {
+        stranger_packets += vehicles[v].pings;
+    }
+    printf("traffic: %u senders + %u strangers for %u s: %u packets (%u duplicates, %u from strangers), "
+           "%.0f packets/s\n", cfg->senders, cfg->strangers, cfg->seconds, delivered, duplicates,
+           stranger_packets, (double)delivered / cfg->seconds);
+    printf("traffic: %u reached process_event, receive_cb dropped %u from strangers and %u replayed, "
+           "%u senders with a wrong ping count or code, %.0f ns CPU per packet\n",
+           dispatched, espnow_rx_stats.unknown_sender, espnow_rx_stats.replayed, wrong,
+           (double)cpu_ns / delivered);
+}
+
+/* --------------------------------------------------------------------------
+ * Per-sender cooldown
+ * -------------------------------------------------------------------------- */
+
+/* Approach from 300 m at 25 km/h, returns when the gate started moving for the sender's auto open */
+static int64_t approach(vehicle_t *vehicle, const sender_t *sender, int64_t start_us) {
+    int64_t ping_us = (int64_t)250 * 1000;
+    double speed_mps = 25 / 3.6;
+    for (int64_t t = start_us; ; t += ping_us) {
+        double d = 300 - speed_mps * (t - start_us) / 1e6;
+        if (d < 1) {
+            return -1;
+        }
+        host_clock_set_us(t);
+        int8_t rssi = (int8_t)lround(-40 - 22 * log10(d));
+        deliver_packet(vehicle->mac, CMD_PING, vehicle->next_code++, rssi);
+        receiver_host_event_pass();
+        if (sender->last_auto_open_us != 0) {
+            return sender->last_auto_open_us;
+        }
+    }
+}
+
+static void bench_cooldown(const bench_config_t *cfg) {
+    pair_vehicles(2, 0);
+    int64_t first_us = approach(&vehicles[0], sender_table_get(0), TRIAL_START_US);
+    int64_t second_us = approach(&vehicles[1], sender_table_get(1),
+                                 TRIAL_START_US + (int64_t)cfg->gap_s * 1000000);
+    if (first_us < 0 || second_us < 0) {
+        printf("cooldown: first %s, second %s\n", first_us < 0 ? "never opened" : "opened",
+               second_us < 0 ? "never opened" : "opened");
+        return;
+    }
+    printf("cooldown: second sender opened %.1f s after the first (cooldown %lld s per sender)\n",
+           (second_us - first_us) / 1e6, (long long)(AUTO_OPEN_COOLDOWN_US / 1000000));
+}
+
+/* --------------------------------------------------------------------------
+ * Pairing
+ * -------------------------------------------------------------------------- */
+
+static void bench_pairing(void) {
+    pair_vehicles(1, 2);
+    save_paired_senders();
+    load_paired_senders();
+    sender_pairing_open_until(TRIAL_START_US + SENDER_PAIRING_WINDOW_US);
+
+    deliver_packet(vehicles[1].mac, CMD_PING, 1, -60);            // Pings never pair
+    deliver_packet(vehicles[1].mac, CMD_FORCE_OPEN, 1000, -60);
+    receiver_host_event_pass();
+    bool paired = sender_table_find(vehicles[1].mac) == 1;
+
+    host_clock_set_us(TRIAL_START_US + SENDER_PAIRING_WINDOW_US);
+    deliver_packet(vehicles[2].mac, CMD_FORCE_OPEN, 1, -60);
+    uint32_t late = receiver_host_event_pass();
+
+    /* Reboot: the list comes back from NVS in pairing order */
+    load_paired_senders();
+    bool kept = sender_table_count() == 2 && sender_table_find(vehicles[1].mac) == 1;
+
+    printf("pairing: force open while open %s, after it closed %s, reboot %s\n",
+           paired ? "paired" : "NOT paired", late ? "PAIRED" : "dropped",
+           kept ? "kept 2 senders" : "LOST the list");
+}
+
+static void parse_args(int argc, char **argv, bench_config_t *cfg) {
+    for (int i = 1; i + 1 < argc; i += 2) {
+        uint32_t value = (uint32_t)strtoul(argv[i + 1], NULL, 10);
+        if (strcmp(argv[i], "--senders") == 0) {
+            cfg->senders = value < 2 ? 2 : value > SENDER_TABLE_MAX ? SENDER_TABLE_MAX : value;
+        } else if (strcmp(argv[i], "--strangers") == 0) {
+            cfg->strangers = value > MAX_STRANGERS ? MAX_STRANGERS : value;
+        } else if (strcmp(argv[i], "--seconds") == 0) {
+            cfg->seconds = value ? value : 1;
+        } else if (strcmp(argv[i], "--ping-ms") == 0) {
+            cfg->ping_ms = value < 10 ? 10 : value;
+        } else if (strcmp(argv[i], "--gap-s") == 0) {
+            cfg->gap_s = value;
+        } else if (strcmp(argv[i], "--seed") == 0) {
+            cfg->seed = value;
+        } else {
+            fprintf(stderr, "Unknown option %s\n", argv[i]);
+            exit(1);
+        }
+    }
+}
+
+int main(int argc, char **argv) {
+    bench_config_t cfg = {
+        .senders = SENDER_TABLE_MAX,
+        .strangers = 8,
+        .seconds = 60,
+        .ping_ms = 250,
+        .gap_s = 40,
+        .seed = 1,
+    };
+    parse_args(argc, argv, &cfg);
+    srand(cfg.seed);
+
+    bench_lookup(&cfg);
+    bench_traffic(&cfg);
+    bench_cooldown(&cfg);
+    bench_pairing();
+    return (int)(sink & 0);
+}
@@ -0,0 +1,331 @@
+/* --------------------------------------------------------------------------
+ * Packet hand-off benchmark: rx_queue against rx_ring
+ *
+ * Moves event_t packets from a producer (receive_cb on the Wi-Fi task) to a
+ * consumer (app_main) two ways:
+ *
+ *   xQueue    the old path: rx_event_t built on the stack, copied into the
+ *             queue and back out into an event_t, each queue call inside a
+ *             critical section (modelled as the spinlock portENTER_CRITICAL
+ *             takes on the dual-core ESP32)
+ *   spsc      shared-lib spsc_ring.c: the event is built in its slab slot and
+ *             processed in place, no lock
+ *
+ * Both have 8 slots. Three runs per path:
+ *
+ *   single    one thread, send then receive: cost of one hand-off in ns
+ *   burst     producer and consumer threads, --items packets as fast as
+ *             possible; packets per second and sends refused while full
+ *   paced     --samples packets, one every --gap-ns; arrival-to-dispatch
+ *             latency percentiles, packets lost to a full queue, ring high
+ *             water and overflows
+ *
+ * The consumer yields while it waits, so on a single CPU the threaded runs
+ * measure context switches as much as the hand-off itself.
+ *
+ * Usage: bench_spsc [--items N] [--gap-ns N] [--samples N]
+ * -------------------------------------------------------------------------- */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "host_sim.h"
+#include "spsc_ring.h"
+#include "event_processing.h"
+
+#define SLOTS 8
+
+typedef struct {
+    uint32_t items;
+    uint32_t gap_ns;
+    uint32_t samples;
+} bench_config_t;
+
+/* --------------------------------------------------------------------------
+ * The two hand-off paths
+ * -------------------------------------------------------------------------- */
+
+/* xQueue model: copy in and out under a spinlock */
+typedef struct {
+    rx_event_t storage[SLOTS];
+    uint32_t head;
+    uint32_t count;
+    int lock;
+} model_queue_t;
+
+static void critical_enter(model_queue_t *q) {
+    while (__atomic_exchange_n(&q->lock, 1, __ATOMIC_ACQUIRE)) {
+        sched_yield();
+    }
+}
+
+static void critical_exit(model_queue_t *q) {
+    __atomic_store_n(&q->lock, 0, __ATOMIC_RELEASE);
+}
+
+static bool queue_send(model_queue_t *q, const rx_event_t *item) {
+    critical_enter(q);
+    bool ok = q->count < SLOTS;
+    if (ok) {
+        memcpy(&q->storage[(q->head + q->count) % SLOTS], item, sizeof(*item));
+        q->count++;
+    }
+    critical_exit(q);
+    return ok;
+}
+
+static bool queue_receive(model_queue_t *q, rx_event_t *item) {
+    critical_enter(q);
+    bool ok = q->count > 0;
+    if (ok) {
+        memcpy(item, &q->storage[q->head], sizeof(*item));
+        q->head = (q->head + 1) % SLOTS;
+        q->count--;
+    }
+    critical_exit(q);
+    return ok;
+}
+
+typedef enum {
+    PATH_QUEUE,
+    PATH_SPSC,
+} path_t;
+
+static const char *const path_names[] = {"xQueue", "spsc"};
+
+static model_queue_t queue;
+static spsc_ring_t ring;
+static event_t slab[SLOTS];
+
+static void path_init(void) {
+    memset(&queue, 0, sizeof(queue));
+    spsc_ring_init(&ring, slab, sizeof(event_t), SLOTS);
+}
+
+/* Producer: what receive_cb does with a packet that passed the pre-filter */
+static bool produce(path_t path, uint32_t code, uint64_t stamp) {
+    if (path == PATH_QUEUE) {
+        rx_event_t evnt = {
+            .command = CMD_PING,
+            .rolling_code = code,
+            .rssi = -60,
+            .timestamp_us = stamp,
+        };
+        return queue_send(&queue, &evnt);
+    }
+    event_t *evnt = spsc_ring_claim(&ring);
+    if (evnt == NULL) {
+        return false;
+    }
+    evnt->type = EVNT_RX_PACKET;
+    evnt->rx = (rx_event_t){
+        .command = CMD_PING,
+        .rolling_code = code,
+        .rssi = -60,
+        .timestamp_us = stamp,
+    };
+    spsc_ring_publish(&ring);
+    return true;
+}
+
+/* Consumer: hands the next packet to check(), which stands in for process_event() */
+static bool consume(path_t path, void (*check)(const event_t *)) {
+    if (path == PATH_QUEUE) {
+        event_t evnt = {.type = EVNT_RX_PACKET};
+        if (!queue_receive(&queue, &evnt.rx)) {
+            return false;
+        }
+        check(&evnt);
+        return true;
+    }
+    const event_t *evnt = spsc_ring_peek(&ring);
+    if (evnt == NULL) {
+        return false;
+    }
+    check(evnt);
+    spsc_ring_release(&ring);
+    return true;
+}
+
+/* --------------------------------------------------------------------------
+ * Consumer checks
+ * -------------------------------------------------------------------------- */
+
+static uint32_t expected_code;
+static uint32_t out_of_order;
+static uint64_t *latencies;
+static uint32_t latency_count;
+
+/* Paced runs lose refused packets, so only a code going backwards counts */
+static void check_order(const event_t *evnt) {
+    if (evnt->rx.rolling_code < expected_code) {
+        out_of_order++;
+    }
+    expected_code = evnt->rx.rolling_code + 1;
+}
+
+static void check_latency(const event_t *evnt) {
+    check_order(evnt);
+    latencies[latency_count++] = host_wall_ns() - evnt->rx.timestamp_us; // Stamped in ns here
+}
+
+static void reset_checks(void) {
+    expected_code = 1;
+    out_of_order = 0;
+    latency_count = 0;
+}
+
+/* --------------------------------------------------------------------------
+ * Runs
+ * -------------------------------------------------------------------------- */
+
+static void bench_single(path_t path, uint32_t items) {
+    path_init();
+    reset_checks();
+    uint64_t start = host_wall_ns();
+    for (uint32_t code = 1; code <= items; code++) {
+        produce(path, code, 0);
+        consume(path, check_order);
+    }
+    double ns = (double)(host_wall_ns() - start) / items;
+    printf("single  %-7s %7.1f ns per packet  %u out of order\n", path_names[path], ns, out_of_order);
+}
+
+typedef struct {
+    path_t path;
+    uint32_t items;
+    uint32_t gap_ns;
+    uint32_t refused;
+    bool done;
+} producer_args_t;
+
+static void *producer_thread(void *arg) {
+    producer_args_t *p = arg;
+    struct timespec next;
+    clock_gettime(CLOCK_MONOTONIC, &next);
+    for (uint32_t code = 1; code <= p->items; code++) {
+        if (p->gap_ns) {
+            /* Paced: sleep until the next packet is due, a refused one is lost as on the radio */
+            next.tv_nsec += p->gap_ns;
+            while (next.tv_nsec >= 1000000000L) {
+                next.tv_nsec -= 1000000000L;
+                next.tv_sec++;
+            }
+            clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL);
+            if (!produce(p->path, code, host_wall_ns())) {
+                p->refused++;
+            }
+        } else {
+            while (!produce(p->path, code, 0)) {
+                p->refused++;
+                sched_yield();
+            }
+        }
+    }
+    __atomic_store_n(&p->done, true, __ATOMIC_RELEASE);
+    return NULL;
+}
+
+/* Consume until the producer is done and everything it sent has been dispatched */
+static void run_threads(path_t path, uint32_t items, uint32_t gap_ns, void (*check)(const event_t *),
+                        uint32_t *refused, double *seconds) {
+    path_init();
+    reset_checks();
+    producer_args_t args = {.path = path, .items = items, .gap_ns = gap_ns};
+    pthread_t producer;
+    uint64_t start = host_wall_ns();
+    pthread_create(&producer, NULL, producer_thread, &args);
+    while (true) {
+        bool done = __atomic_load_n(&args.done, __ATOMIC_ACQUIRE);
+        if (consume(path, check)) {
+            continue;
+        }
+        if (done) {
+            break;
+        }
+        sched_yield();
+    }
+    pthread_join(producer, NULL);
+    *seconds = (double)(host_wall_ns() - start) / 1e9;
+    *refused = args.refused;
+}
+
+static void bench_burst(path_t path, uint32_t items) {
+    uint32_t refused;
+    double seconds;
+    run_threads(path, items, 0, check_order, &refused, &seconds);
+    printf("burst   %-7s %7.2f M packets/s  %9u sends refused while full  %u out of order\n",
+           path_names[path], items / seconds / 1e6, refused, out_of_order);
+}
+
+static int compare_u64(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *)a;
+    uint64_t y = *(const uint64_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+static void bench_paced(path_t path, uint32_t samples, uint32_t gap_ns) {
+    uint32_t refused;
+    double seconds;
+    run_threads(path, samples, gap_ns, check_latency, &refused, &seconds);
+    if (latency_count == 0) {
+        printf("paced   %-7s nothing dispatched\n", path_names[path]);
+        return;
+    }
+    qsort(latencies, latency_count, sizeof(latencies[0]), compare_u64);
+    printf("paced   %-7s p50 %7llu ns  p99 %8llu ns  max %9llu ns  lost %u",
+           path_names[path], (unsigned long long)latencies[latency_count / 2],
+           (unsigned long long)latencies[latency_count * 99ULL / 100],
+           (unsigned long long)latencies[latency_count - 1], refused);
+    if (path == PATH_SPSC) {
+        printf("  high water %u/%u  overflows %u", ring.stats.high_water, SLOTS, ring.stats.overflows);
+    }
+    printf("  %u out of order\n", out_of_order);
+}
+
+static void parse_args(int argc, char **argv, bench_config_t *cfg) {
+    for (int i = 1; i + 1 < argc; i += 2) {
+        uint32_t value = (uint32_t)strtoul(argv[i + 1], NULL, 10);
+        if (strcmp(argv[i], "--items") == 0) {
+            cfg->items = value ? value : 1;
+        } else if (strcmp(argv[i], "--gap-ns") == 0) {
+            cfg->gap_ns = value ? value : 1;
+        } else if (strcmp(argv[i], "--samples") == 0) {
+            cfg->samples = value ? value : 1;
+        } else {
+            fprintf(stderr, "Unknown option %s\n", argv[i]);
+            exit(1);
+        }
+    }
+}
+
+int main(int argc, char **argv) {
+    bench_config_t cfg = {
+        .items = 2000000,
+        .gap_ns = 20000,
+        .samples = 20000,
+    };
+    parse_args(argc, argv, &cfg);
+    latencies = malloc(cfg.samples * sizeof(latencies[0]));
+    if (latencies == NULL) {
+        return 1;
+    }
+
+    printf("%u slots, %zu-byte event_t, %ld CPUs\n", SLOTS, sizeof(event_t), sysconf(_SC_NPROCESSORS_ONLN));
+    for (path_t path = PATH_QUEUE; path <= PATH_SPSC; path++) {
+        bench_single(path, cfg.items);
+    }
+    for (path_t path = PATH_QUEUE; path <= PATH_SPSC; path++) {
+        bench_burst(path, cfg.items);
+    }
+    for (path_t path = PATH_QUEUE; path <= PATH_SPSC; path++) {
+        bench_paced(path, cfg.samples, cfg.gap_ns);
+    }
+    free(latencies);
+    return 0;
+}
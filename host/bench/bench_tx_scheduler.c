@@ -0,0 +1,266 @@
+/* --------------------------------------------------------------------------
+ * Sender transmit scheduler benchmark
+ *
+ * Runs the sender's state machine and tx_scheduler.c on the simulated clock
+ * over --rides rides: --away-s with the receiver out of range, then --near-s
+ * in range (each send acknowledged with --ack-percent probability) while the
+ * rider holds the force-open button for 1 s every 10 s. Each ride goes
+ * through the original blocking states (vTaskDelay in the state function)
+ * and the scheduler:
+ *
+ *   away pings/min   packets sent per minute out of range
+ *   window s         time from coming into range to the receiver holding
+ *                    RSSI_WINDOW_LENGTH pings
+ *   press ms         button press to the first force open on the air
+ *   gap ms           longest time between two button samples
+ *   packets          packets sent per ride
+ *
+ * Usage: bench_tx_scheduler [--rides N] [--away-s N] [--near-s N]
+ *                           [--ack-percent N] [--seed N]
+ * -------------------------------------------------------------------------- */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "esp_timer.h"
+#include "host_sim.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "espnow_comm.h"
+#include "state_machine.h"
+#include "tx_scheduler.h"
+
+#define LOOP_MS             5
+#define RSSI_WINDOW_LENGTH  8           // Receiver pings before its proximity check runs
+#define PRESS_EVERY_US      10000000LL
+#define PRESS_HOLD_US       1000000LL
+#define MAX_PRESSES         4096
+
+typedef enum {
+    SENDER_BLOCKING,
+    SENDER_SCHEDULED,
+} sender_mode_t;
+
+static const char *const sender_mode_names[] = {
+    [SENDER_BLOCKING]  = "blocking",
+    [SENDER_SCHEDULED] = "scheduler",
+};
+
+typedef struct {
+    uint32_t rides;
+    uint32_t away_s;
+    uint32_t near_s;
+    uint32_t ack_percent;
+    uint32_t seed;
+} bench_config_t;
+
+typedef struct {
+    uint32_t away_pings;
+    double window_s_sum;
+    uint32_t windows;
+    int64_t press_us[MAX_PRESSES];
+    uint32_t presses;
+    int64_t gap_max_us;
+    uint32_t packets;
+} ride_result_t;
+
+/* Radio model, read by the espnow_send_packet() stand-in */
+static bool in_range = false;
+static uint32_t ack_percent = 100;
+static sender_mode_t mode;
+static int64_t near_since_us;
+static uint32_t near_pings;
+static int64_t first_press_us;
+static int64_t served_press = -1;   // Last press a force open went out for
+static ride_result_t res;
+
+/* Original state machine, kept here as the baseline */
+static State legacy_state = STATE_IDLE;
+
+uint32_t rolling_code_get_and_increment(void) {
+    static uint32_t code = 0;
+    return ++code;
+}
+
+/* Stands in for espnow_comm.c: the send callback fires before the next loop pass */
+void espnow_send_packet(uint8_t command, uint32_t rolling_code, int8_t reply_rssi) {
+    (void)reply_rssi;
+    (void)rolling_code;
+    int64_t now = esp_timer_get_time();
+    res.packets++;
+    if (!in_range) {
+        res.away_pings++;
+    }
+    int64_t press = (now - first_press_us) / PRESS_EVERY_US;
+    if (command == CMD_FORCE_OPEN && press != served_press && res.presses < MAX_PRESSES) {
+        res.press_us[res.presses++] = now - (first_press_us + press * PRESS_EVERY_US);
+        served_press = press;
+    }
+    bool acked = in_range && (uint32_t)(rand() % 100) < ack_percent;
+    if (acked && command == CMD_PING && near_pings < RSSI_WINDOW_LENGTH && ++near_pings == RSSI_WINDOW_LENGTH) {
+        res.window_s_sum += (now - near_since_us) / 1e6;
+        res.windows++;
+    }
+    if (mode == SENDER_SCHEDULED) {
+        tx_scheduler_on_send_done(acked);
+        if (acked) {
+            state_machine_on_link_detected();
+        }
+    } else if (acked && legacy_state == STATE_IDLE) {
+        legacy_state = STATE_DETECTS;
+    }
+}
+
+/* One pass of the original loop: the state function sends, then sleeps */
+static void legacy_pass(bool button) {
+    if (button) {
+        legacy_state = STATE_BYPASS;
+    } else if (legacy_state != STATE_IDLE) {
+        legacy_state = STATE_IDLE;
+    }
+    switch (legacy_state) {
+        case STATE_IDLE:
+            espnow_send_packet(CMD_PING, rolling_code_get_and_increment(), ESPNOW_RSSI_NONE);
+            vTaskDelay(pdMS_TO_TICKS(1000));
+            break;
+        case STATE_DETECTS:
+            espnow_send_packet(CMD_PING, rolling_code_get_and_increment(), ESPNOW_RSSI_NONE);
+            vTaskDelay(pdMS_TO_TICKS(250));
+            break;
+        default:
+            espnow_send_packet(CMD_FORCE_OPEN, rolling_code_get_and_increment(), ESPNOW_RSSI_NONE);
+            vTaskDelay(pdMS_TO_TICKS(250));
+            break;
+    }
+    vTaskDelay(pdMS_TO_TICKS(LOOP_MS));
+}
+
+/* One pass of app_main with the scheduler, then the wait for the button period or the TX timer */
+static void scheduled_pass(bool button) {
+    if (button) {
+        state_machine_set_state(STATE_BYPASS);
+    } else if (state_machine_get_current_state() == STATE_BYPASS) {
+        state_machine_set_state(STATE_IDLE);
+    }
+    state_machine_run();
+
+    int64_t wake_us = esp_timer_get_time() + LOOP_MS * 1000;
+    int64_t timer_us = host_timer_next_deadline_us();
+    if (timer_us < wake_us) {
+        wake_us = timer_us;
+    }
+    host_clock_set_us(wake_us);
+    host_timer_run_due();
+    xTaskNotifyWait(0, UINT32_MAX, NULL, 0);
+}
+
+static void run_ride(const bench_config_t *cfg) {
+    host_sim_reset();
+    host_clock_set_us(1000000 + rand() % 1000000);
+    legacy_state = STATE_IDLE;
+    state_machine_init();
+    tx_scheduler_init();
+    memset(&res, 0, sizeof(res));
+    in_range = false;
+    near_pings = 0;
+    served_press = -1;
+
+    int64_t start_us = esp_timer_get_time();
+    int64_t near_us = start_us + (int64_t)cfg->away_s * 1000000;
+    int64_t end_us = near_us + (int64_t)cfg->near_s * 1000000;
+    first_press_us = near_us + PRESS_EVERY_US / 2 + rand() % PRESS_EVERY_US;
+    int64_t last_pass_us = -1;
+
+    while (esp_timer_get_time() < end_us) {
+        int64_t now = esp_timer_get_time();
+        if (!in_range && now >= near_us) {
+            in_range = true;
+            near_since_us = now;
+        }
+        /* Button held for PRESS_HOLD_US every PRESS_EVERY_US once in range */
+        bool button = now >= first_press_us && (now - first_press_us) % PRESS_EVERY_US < PRESS_HOLD_US;
+        if (last_pass_us >= 0 && now - last_pass_us > res.gap_max_us) {
+            res.gap_max_us = now - last_pass_us;
+        }
+        last_pass_us = now;
+
+        if (mode == SENDER_BLOCKING) {
+            legacy_pass(button);
+        } else {
+            scheduled_pass(button);
+        }
+    }
+}
+
+static int cmp_i64(const void *a, const void *b) {
+    int64_t x = *(const int64_t *)a;
+    int64_t y = *(const int64_t *)b;
+    return (x > y) - (x < y);
+}
+
+static void parse_args(int argc, char **argv, bench_config_t *cfg) {
+    for (int i = 1; i + 1 < argc; i += 2) {
+        uint32_t value = (uint32_t)strtoul(argv[i + 1], NULL, 10);
+        if (strcmp(argv[i], "--rides") == 0) {
+            cfg->rides = value ? value : 1;
+        } else if (strcmp(argv[i], "--away-s") == 0) {
+            cfg->away_s = value ? value : 1;
+        } else if (strcmp(argv[i], "--near-s") == 0) {
+            cfg->near_s = value ? value : 1;
+        } else if (strcmp(argv[i], "--ack-percent") == 0) {
+            cfg->ack_percent = value > 100 ? 100 : value;
+        } else if (strcmp(argv[i], "--seed") == 0) {
+            cfg->seed = value;
+        } else {
+            fprintf(stderr, "Unknown option %s\n", argv[i]);
+            exit(1);
+        }
+    }
+}
+
+int main(int argc, char **argv) {
+    bench_config_t cfg = {
+        .rides = 50,
+        .away_s = 120,
+        .near_s = 60,
+        .ack_percent = 90,
+        .seed = 1,
+    };
+    parse_args(argc, argv, &cfg);
+    ack_percent = cfg.ack_percent;
+
+    static int64_t presses[MAX_PRESSES];
+    printf("%u rides: %u s out of range, %u s in range with %u%% of sends acknowledged\n",
+           cfg.rides, cfg.away_s, cfg.near_s, cfg.ack_percent);
+    printf("sender     away pings/min  window s   press ms p50    max   gap ms max  packets/ride\n");
+    for (mode = SENDER_BLOCKING; mode <= SENDER_SCHEDULED; mode++) {
+        srand(cfg.seed);
+        uint32_t press_count = 0;
+        uint64_t away_pings = 0;
+        uint64_t packets = 0;
+        double window_sum = 0;
+        uint32_t windows = 0;
+        int64_t gap_max_us = 0;
+        for (uint32_t r = 0; r < cfg.rides; r++) {
+            run_ride(&cfg);
+            away_pings += res.away_pings;
+            packets += res.packets;
+            window_sum += res.window_s_sum;
+            windows += res.windows;
+            if (res.gap_max_us > gap_max_us) {
+                gap_max_us = res.gap_max_us;
+            }
+            for (uint32_t i = 0; i < res.presses && press_count < MAX_PRESSES; i++) {
+                presses[press_count++] = res.press_us[i];
+            }
+        }
+        qsort(presses, press_count, sizeof(presses[0]), cmp_i64);
+        printf("%-9s  %14.1f  %8.2f  %11.1f  %7.1f  %10.1f  %12.1f\n", sender_mode_names[mode],
+               away_pings * 60.0 / ((double)cfg.away_s * cfg.rides),
+               windows ? window_sum / windows : -1.0,
+               press_count ? presses[press_count / 2] / 1000.0 : -1.0,
+               press_count ? presses[press_count - 1] / 1000.0 : -1.0,
+               gap_max_us / 1000.0, (double)packets / cfg.rides);
+    }
+    return 0;
+}
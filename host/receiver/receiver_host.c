@@ -0,0 +1,115 @@
+#include "receiver_host.h"
+#include "main.h"
+#include "gpio_config.h"
+#include "debouncer.h"
+#include "state_machine.h"
+#include "event_processing.h"
+#include "sender_table.h"
+#include "estimator.h"
+#include "trace.h"
+#include "espnow_config.h"
+#include "event_loop.h"
+#include "esp_timer.h"
+#include "driver/gpio.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+/* Globals owned by main.c on target */
+debouncer_t input_debouncer = {0};
+bool last_gate_state = false;
+int64_t last_toggle_time = 0;
+
+/* Same values as main.c */
+const int64_t AUTO_OPEN_COOLDOWN_US = 120000000LL; // 2 minutes cooldown in microseconds
+const int64_t TOGGLE_COOLDOWN_US = 5000000LL; // 5 seconds cooldown in microseconds
+
+uint8_t receiver_host_sender_mac[ESP_NOW_ETH_ALEN] = {0x24, 0x6f, 0x28, 0x00, 0x00, 0x01};
+
+static bool polling = true;
+
+void receiver_host_init(void) {
+    last_gate_state = false;
+    last_toggle_time = 0;
+    polling = true;
+
+    sender_table_init();
+    sender_table_add(receiver_host_sender_mac, 0);
+    estimator_init();
+
+    event_loop_init();
+    trace_init();
+    gpio_setup();
+    espnow_setup();
+    state_machine_init();
+
+    debouncer_init(&input_debouncer, 1ULL << GATE_STATUS_PIN_INPUT, debouncer_read_inputs());
+}
+
+/* Same gate status handling as app_main */
+static void update_inputs(void) {
+    debouncer_update(&input_debouncer, debouncer_read_inputs());
+    if (debouncer_rose(&input_debouncer, GATE_STATUS_PIN_INPUT) ||
+        debouncer_fell(&input_debouncer, GATE_STATUS_PIN_INPUT)) {
+        estimator_on_gate_status(debouncer_level(&input_debouncer, GATE_STATUS_PIN_INPUT),
+                                 esp_timer_get_time());
+    }
+}
+
+/* Lane holding the packet that arrived first, NULL if both are empty */
+static spsc_ring_t *oldest_lane(void) {
+    const event_t *command = spsc_ring_peek(&rx_rings[EVENT_LANE_COMMAND]);
+    const event_t *ping = spsc_ring_peek(&rx_rings[EVENT_LANE_PING]);
+    if (command == NULL && ping == NULL) {
+        return NULL;
+    }
+    if (ping == NULL || (command != NULL && command->rx.timestamp_us <= ping->rx.timestamp_us)) {
+        return &rx_rings[EVENT_LANE_COMMAND];
+    }
+    return &rx_rings[EVENT_LANE_PING];
+}
+
+bool receiver_host_loop_once(uint32_t loop_ms) {
+    bool processed = false;
+
+    update_inputs();
+
+    /* The original loop: one packet per pass, oldest first whatever its lane */
+    spsc_ring_t *ring = oldest_lane();
+    if (ring != NULL) {
+        const event_t *evnt = spsc_ring_peek(ring);
+        event_loop_record_dispatch(ring == &rx_rings[EVENT_LANE_COMMAND] ? EVENT_LANE_COMMAND : EVENT_LANE_PING,
+                                   evnt->rx.timestamp_us);
+        trace_record_rx(&evnt->rx);
+        process_event(evnt);
+        spsc_ring_release(ring);
+        processed = true;
+    }
+
+    state_machine_run();
+    trace_flush();
+    vTaskDelay(pdMS_TO_TICKS(loop_ms));
+
+    return processed;
+}
+
+uint32_t receiver_host_event_pass(void) {
+    event_loop_wait(0);
+    update_inputs();
+
+    uint32_t dispatched = process_pending_events();
+
+    state_machine_run();
+    trace_flush();
+
+    polling = !debouncer_is_settled(&input_debouncer) ||
+              state_machine_get_current_state() != STATE_IDLE;
+    return dispatched;
+}
+
+int64_t receiver_host_wake_deadline_us(void) {
+    TickType_t ticks = event_loop_timeout_ticks(polling, 0);
+    if (ticks == portMAX_DELAY) {
+        return INT64_MAX;
+    }
+    return esp_timer_get_time() + (int64_t)ticks * portTICK_PERIOD_MS * 1000;
+}
@@ -0,0 +1,35 @@
+#ifndef RECEIVER_HOST_H
+#define RECEIVER_HOST_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/* --------------------------------------------------------------------------
+ * Host build of the receiver decision pipeline
+ * Stands in for firmware-receiver/main/main.c so host tools can run the
+ * real event_processing.c / state_machine.c against the simulated clock.
+ * -------------------------------------------------------------------------- */
+
+/* Loop period of the original polling app_main (vTaskDelay(pdMS_TO_TICKS(5))) */
+#define RECEIVER_HOST_LOOP_MS 5
+
+/* Sender paired by receiver_host_init(), for tools that simulate a single vehicle */
+extern uint8_t receiver_host_sender_mac[6];
+
+/* Reset all receiver globals, pair receiver_host_sender_mac and start
+ * debouncing from the current pin levels */
+void receiver_host_init(void);
+
+/* One pass of the original polling loop: one packet at most, then sleep loop_ms.
+ * Returns true if a packet was dequeued and processed on this pass. */
+bool receiver_host_loop_once(uint32_t loop_ms);
+
+/* One wake-up of the event-driven app_main loop (without the OTA button handling).
+ * The caller advances the clock to the wake-up time first. Returns packets dispatched. */
+uint32_t receiver_host_event_pass(void);
+
+/* Absolute time of the event loop's next timer wake-up, INT64_MAX if it would
+ * sleep until a packet or input edge arrives */
+int64_t receiver_host_wake_deadline_us(void);
+
+#endif // RECEIVER_HOST_H
@@ -0,0 +1,943 @@
+#include "host_sim.h"
+#include "esp_timer.h"
+#include "esp_now.h"
+#include "soc/soc.h"
+#include "soc/gpio_reg.h"
+#include "nvs_flash.h"
+#include "driver/rtc_io.h"
+#include "esp_partition.h"
+#include "esp_ota_ops.h"
+#include "esp_image_format.h"
+#include "freertos/queue.h"
+#include "freertos/task.h"
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define HOST_NVS_MAX_KEYS 80
+#define HOST_NVS_KEY_LEN  16
+#define HOST_NVS_BLOB_MAX 1024
+#define HOST_FLASH_SECTOR 4096
+#define HOST_FLASH_MAX_SECTORS 64
+#define HOST_TIMERS_MAX 8
+
+/* Simulated time and pins */
+static int64_t sim_now_us = 0;
+static uint32_t gpio_levels[GPIO_NUM_MAX] = {0};
+static uint64_t gpio_level_bits = 0; // Same levels packed like the input registers
+static host_gpio_hook_t gpio_output_hook = NULL;
+static gpio_isr_t gpio_isr_handlers[GPIO_NUM_MAX] = {0};
+static void *gpio_isr_args[GPIO_NUM_MAX] = {0};
+static uint64_t gpio_intr_masked = 0;   // Pins whose ISR gpio_intr_disable() holds off
+
+/* One-shot esp_timer instances, fired by host_timer_run_due() */
+struct host_esp_timer {
+    bool used;
+    bool armed;
+    int64_t deadline_us;
+    esp_timer_cb_t callback;
+    void *arg;
+};
+static struct host_esp_timer esp_timers[HOST_TIMERS_MAX];
+
+/* The one simulated task and its notification value */
+struct host_task {
+    uint32_t notify_value;
+    bool notify_pending;
+};
+
+static struct host_task main_task = {0};
+
+/* Sleep and reset */
+static host_light_sleep_hook_t light_sleep_hook = NULL;
+static host_deep_sleep_hook_t deep_sleep_hook = NULL;
+static int64_t sleep_timer_us = -1;                 // Timer wakeup, -1 if not enabled
+static gpio_int_type_t gpio_wakeup[GPIO_NUM_MAX] = {0};
+static bool gpio_wakeup_enabled = false;
+static esp_sleep_wakeup_cause_t wakeup_cause = ESP_SLEEP_WAKEUP_UNDEFINED;
+static esp_reset_reason_t reset_reason = ESP_RST_POWERON;
+
+/* Simulated radio */
+static host_espnow_send_hook_t espnow_send_hook = NULL;
+static uint32_t espnow_sends = 0;
+static bool espnow_initialised = false;
+static esp_now_send_cb_t espnow_send_cb = NULL;
+static uint8_t espnow_peers[ESP_NOW_MAX_TOTAL_PEER_NUM][ESP_NOW_ETH_ALEN];
+static uint32_t espnow_peer_count = 0;
+static uint32_t espnow_unconfirmed = 0;    // Frames sent whose send callback is still to come
+
+/* In-memory NVS table */
+typedef struct {
+    char key[HOST_NVS_KEY_LEN];
+    uint32_t value;
+    uint8_t blob[HOST_NVS_BLOB_MAX];
+    size_t blob_len;
+    bool used;
+} host_nvs_entry_t;
+
+static host_nvs_entry_t nvs_table[HOST_NVS_MAX_KEYS] = {0};
+static uint32_t nvs_commits = 0;
+
+/* RAM-backed data partition */
+static esp_partition_t flash_partition = {0};
+static uint8_t *flash_data = NULL;
+static uint32_t flash_sector_erases[HOST_FLASH_MAX_SECTORS] = {0};
+static host_flash_stats_t flash_stats = {0};
+static uint32_t flash_ops_until_cut = UINT32_MAX;
+static uint32_t flash_failing_writes = 0;
+static bool flash_powered = true;
+
+/* Spare OTA app partition: only the image in it is kept, the rest reads erased */
+static const esp_partition_t ota_partition = {
+    .type = ESP_PARTITION_TYPE_APP,
+    .subtype = 0x11,                    // ota_1
+    .address = 0x110000,
+    .size = 0x100000,
+    .erase_size = HOST_FLASH_SECTOR,
+    .label = "ota_1",
+};
+static uint8_t *ota_image = NULL;
+static uint32_t ota_image_len = 0;
+static esp_app_desc_t ota_image_desc = {0};
+static esp_app_desc_t running_app_desc = {0};
+
+/* --------------------------------------------------------------------------
+ * Simulation controls
+ * -------------------------------------------------------------------------- */
+
+void host_sim_reset(void) {
+    sim_now_us = 0;
+    memset(gpio_levels, 0, sizeof(gpio_levels));
+    gpio_level_bits = 0;
+    memset(gpio_isr_handlers, 0, sizeof(gpio_isr_handlers));
+    memset(gpio_isr_args, 0, sizeof(gpio_isr_args));
+    gpio_intr_masked = 0;
+    memset(&main_task, 0, sizeof(main_task));
+    memset(nvs_table, 0, sizeof(nvs_table));
+    nvs_commits = 0;
+    free(flash_data);
+    flash_data = NULL;
+    memset(&flash_partition, 0, sizeof(flash_partition));
+    host_flash_power_on();
+    host_flash_reset_stats();
+    gpio_output_hook = NULL;
+    espnow_send_hook = NULL;
+    espnow_sends = 0;
+    esp_now_deinit();
+    host_ota_set_spare_image(NULL, 0, NULL);
+    host_ota_set_running_project(HOST_RUNNING_PROJECT);
+    memset(esp_timers, 0, sizeof(esp_timers));
+    light_sleep_hook = NULL;
+    deep_sleep_hook = NULL;
+    sleep_timer_us = -1;
+    memset(gpio_wakeup, 0, sizeof(gpio_wakeup));
+    gpio_wakeup_enabled = false;
+    wakeup_cause = ESP_SLEEP_WAKEUP_UNDEFINED;
+    reset_reason = ESP_RST_POWERON;
+}
+
+void host_sim_reboot(void) {
+    memset(gpio_isr_handlers, 0, sizeof(gpio_isr_handlers));
+    memset(gpio_isr_args, 0, sizeof(gpio_isr_args));
+    gpio_intr_masked = 0;
+    memset(&main_task, 0, sizeof(main_task));
+    memset(esp_timers, 0, sizeof(esp_timers));
+    sleep_timer_us = -1;
+    memset(gpio_wakeup, 0, sizeof(gpio_wakeup));
+    gpio_wakeup_enabled = false;
+}
+
+void host_clock_set_us(int64_t now_us) {
+    sim_now_us = now_us;
+}
+
+void host_clock_advance_us(int64_t delta_us) {
+    sim_now_us += delta_us;
+}
+
+uint32_t host_task_notify_pending(void) {
+    return main_task.notify_pending ? main_task.notify_value : 0;
+}
+
+void host_gpio_set_input(gpio_num_t pin, uint32_t level) {
+    if (pin < 0 || pin >= GPIO_NUM_MAX) {
+        return;
+    }
+    level = level ? 1 : 0;
+    if (gpio_levels[pin] != level) {
+        gpio_levels[pin] = level;
+        gpio_level_bits ^= 1ULL << pin;
+        if (gpio_isr_handlers[pin] && !(gpio_intr_masked >> pin & 1)) {
+            gpio_isr_handlers[pin](gpio_isr_args[pin]);
+        }
+    }
+}
+
+uint32_t host_gpio_get_output(gpio_num_t pin) {
+    return (pin >= 0 && pin < GPIO_NUM_MAX) ? gpio_levels[pin] : 0;
+}
+
+void host_gpio_set_output_hook(host_gpio_hook_t hook) {
+    gpio_output_hook = hook;
+}
+
+void host_espnow_set_send_hook(host_espnow_send_hook_t hook) {
+    espnow_send_hook = hook;
+}
+
+uint32_t host_espnow_send_count(void) {
+    return espnow_sends;
+}
+
+uint32_t host_espnow_peer_count(void) {
+    return espnow_peer_count;
+}
+
+uint32_t host_espnow_complete_sends(esp_now_send_status_t status) {
+    uint32_t done = espnow_unconfirmed;
+    espnow_unconfirmed = 0;
+    for (uint32_t i = 0; i < done && espnow_send_cb != NULL; i++) {
+        espnow_send_cb(NULL, status);
+    }
+    return done;
+}
+
+void host_ota_set_spare_image(const uint8_t *image, uint32_t len, const char *project_name) {
+    free(ota_image);
+    ota_image = NULL;
+    ota_image_len = 0;
+    memset(&ota_image_desc, 0, sizeof(ota_image_desc));
+    if (image == NULL || len == 0 || len > ota_partition.size) {
+        return;
+    }
+    ota_image = malloc(len);
+    memcpy(ota_image, image, len);
+    ota_image_len = len;
+    ota_image_desc.magic_word = ESP_APP_DESC_MAGIC_WORD;
+    strncpy(ota_image_desc.project_name, project_name, sizeof(ota_image_desc.project_name) - 1);
+    strncpy(ota_image_desc.version, "host", sizeof(ota_image_desc.version) - 1);
+}
+
+void host_ota_set_running_project(const char *project_name) {
+    memset(&running_app_desc, 0, sizeof(running_app_desc));
+    running_app_desc.magic_word = ESP_APP_DESC_MAGIC_WORD;
+    strncpy(running_app_desc.project_name, project_name, sizeof(running_app_desc.project_name) - 1);
+    strncpy(running_app_desc.version, "host", sizeof(running_app_desc.version) - 1);
+}
+
+uint64_t host_wall_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+/* --------------------------------------------------------------------------
+ * esp_timer / FreeRTOS task stand-ins
+ * -------------------------------------------------------------------------- */
+
+int64_t esp_timer_get_time(void) {
+    return sim_now_us;
+}
+
+void vTaskDelay(TickType_t ticks) {
+    sim_now_us += (int64_t)ticks * portTICK_PERIOD_MS * 1000;
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle(void) {
+    return &main_task;
+}
+
+BaseType_t xTaskNotify(TaskHandle_t task, uint32_t value, eNotifyAction action) {
+    switch (action) {
+        case eSetBits:
+            task->notify_value |= value;
+            break;
+        case eIncrement:
+            task->notify_value++;
+            break;
+        case eSetValueWithOverwrite:
+        case eSetValueWithoutOverwrite:
+            task->notify_value = value;
+            break;
+        default:
+            break;
+    }
+    task->notify_pending = true;
+    return pdPASS;
+}
+
+BaseType_t xTaskNotifyFromISR(TaskHandle_t task, uint32_t value, eNotifyAction action,
+                              BaseType_t *higher_prio_task_woken) {
+    if (higher_prio_task_woken) {
+        *higher_prio_task_woken = pdTRUE;
+    }
+    return xTaskNotify(task, value, action);
+}
+
+BaseType_t xTaskNotifyWait(uint32_t bits_to_clear_on_entry, uint32_t bits_to_clear_on_exit,
+                           uint32_t *notification_value, TickType_t ticks_to_wait) {
+    (void)ticks_to_wait;
+    struct host_task *task = &main_task;
+    if (!task->notify_pending) {
+        task->notify_value &= ~bits_to_clear_on_entry;
+    }
+    if (notification_value) {
+        *notification_value = task->notify_value;
+    }
+    BaseType_t woken = task->notify_pending ? pdTRUE : pdFALSE;
+    task->notify_value &= ~bits_to_clear_on_exit;
+    task->notify_pending = false;
+    return woken;
+}
+
+/* --------------------------------------------------------------------------
+ * GPIO stand-ins
+ * -------------------------------------------------------------------------- */
+
+esp_err_t gpio_config(const gpio_config_t *cfg) {
+    return cfg ? ESP_OK : ESP_ERR_INVALID_ARG;
+}
+
+uint32_t host_reg_read(uint32_t reg) {
+    switch (reg) {
+        case GPIO_IN_REG:
+            return (uint32_t)gpio_level_bits;
+        case GPIO_IN1_REG:
+            return (uint32_t)(gpio_level_bits >> 32);
+        default:
+            return 0;
+    }
+}
+
+esp_err_t gpio_install_isr_service(int intr_alloc_flags) {
+    (void)intr_alloc_flags;
+    return ESP_OK;
+}
+
+esp_err_t gpio_isr_handler_add(gpio_num_t gpio_num, gpio_isr_t isr_handler, void *args) {
+    if (gpio_num < 0 || gpio_num >= GPIO_NUM_MAX) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    gpio_isr_handlers[gpio_num] = isr_handler;
+    gpio_isr_args[gpio_num] = args;
+    return ESP_OK;
+}
+
+esp_err_t gpio_set_intr_type(gpio_num_t gpio_num, gpio_int_type_t intr_type) {
+    (void)intr_type;
+    return gpio_num >= 0 && gpio_num < GPIO_NUM_MAX ? ESP_OK : ESP_ERR_INVALID_ARG;
+}
+
+esp_err_t gpio_intr_enable(gpio_num_t gpio_num) {
+    if (gpio_num < 0 || gpio_num >= GPIO_NUM_MAX) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    gpio_intr_masked &= ~(1ULL << gpio_num);
+    return ESP_OK;
+}
+
+esp_err_t gpio_intr_disable(gpio_num_t gpio_num) {
+    if (gpio_num < 0 || gpio_num >= GPIO_NUM_MAX) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    gpio_intr_masked |= 1ULL << gpio_num;
+    return ESP_OK;
+}
+
+esp_err_t gpio_wakeup_disable(gpio_num_t gpio_num) {
+    if (gpio_num < 0 || gpio_num >= GPIO_NUM_MAX) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    gpio_wakeup[gpio_num] = GPIO_INTR_DISABLE;
+    return ESP_OK;
+}
+
+esp_err_t rtc_gpio_pullup_en(gpio_num_t gpio_num) {
+    return gpio_num >= 0 && gpio_num < GPIO_NUM_MAX ? ESP_OK : ESP_ERR_INVALID_ARG;
+}
+
+esp_err_t rtc_gpio_pulldown_dis(gpio_num_t gpio_num) {
+    return gpio_num >= 0 && gpio_num < GPIO_NUM_MAX ? ESP_OK : ESP_ERR_INVALID_ARG;
+}
+
+esp_err_t gpio_wakeup_enable(gpio_num_t gpio_num, gpio_int_type_t intr_type) {
+    if (gpio_num < 0 || gpio_num >= GPIO_NUM_MAX ||
+        (intr_type != GPIO_INTR_LOW_LEVEL && intr_type != GPIO_INTR_HIGH_LEVEL)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    gpio_wakeup[gpio_num] = intr_type;
+    return ESP_OK;
+}
+
+esp_err_t gpio_set_level(gpio_num_t gpio_num, uint32_t level) {
+    if (gpio_num < 0 || gpio_num >= GPIO_NUM_MAX) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    level = level ? 1 : 0;
+    if (gpio_levels[gpio_num] != level) {
+        gpio_levels[gpio_num] = level;
+        gpio_level_bits ^= 1ULL << gpio_num;
+        if (gpio_output_hook) {
+            gpio_output_hook(gpio_num, level);
+        }
+    }
+    return ESP_OK;
+}
+
+int gpio_get_level(gpio_num_t gpio_num) {
+    return (gpio_num >= 0 && gpio_num < GPIO_NUM_MAX) ? (int)gpio_levels[gpio_num] : 0;
+}
+
+/* --------------------------------------------------------------------------
+ * ESP-NOW stand-ins
+ * -------------------------------------------------------------------------- */
+
+esp_err_t esp_now_init(void) {
+    espnow_initialised = true;
+    return ESP_OK;
+}
+
+esp_err_t esp_now_deinit(void) {
+    espnow_initialised = false;
+    espnow_send_cb = NULL;
+    espnow_peer_count = 0;
+    espnow_unconfirmed = 0;
+    return ESP_OK;
+}
+
+esp_err_t esp_now_register_recv_cb(esp_now_recv_cb_t cb) {
+    (void)cb; // Host tools call the firmware's receive callback directly
+    return espnow_initialised ? ESP_OK : ESP_ERR_ESPNOW_NOT_INIT;
+}
+
+esp_err_t esp_now_register_send_cb(esp_now_send_cb_t cb) {
+    if (!espnow_initialised) {
+        return ESP_ERR_ESPNOW_NOT_INIT;
+    }
+    espnow_send_cb = cb;
+    return ESP_OK;
+}
+
+/* Index of a registered peer, -1 if it is not one */
+static int espnow_peer_find(const uint8_t *peer_addr) {
+    for (uint32_t i = 0; i < espnow_peer_count; i++) {
+        if (memcmp(espnow_peers[i], peer_addr, ESP_NOW_ETH_ALEN) == 0) {
+            return (int)i;
+        }
+    }
+    return -1;
+}
+
+esp_err_t esp_now_add_peer(const esp_now_peer_info_t *peer) {
+    if (peer == NULL) {
+        return ESP_ERR_ESPNOW_ARG;
+    }
+    if (!espnow_initialised) {
+        return ESP_ERR_ESPNOW_NOT_INIT;
+    }
+    if (espnow_peer_find(peer->peer_addr) >= 0) {
+        return ESP_ERR_ESPNOW_EXIST;
+    }
+    if (espnow_peer_count == ESP_NOW_MAX_TOTAL_PEER_NUM) {
+        return ESP_ERR_ESPNOW_FULL;
+    }
+    memcpy(espnow_peers[espnow_peer_count++], peer->peer_addr, ESP_NOW_ETH_ALEN);
+    return ESP_OK;
+}
+
+esp_err_t esp_now_del_peer(const uint8_t *peer_addr) {
+    if (peer_addr == NULL) {
+        return ESP_ERR_ESPNOW_ARG;
+    }
+    int i = espnow_peer_find(peer_addr);
+    if (!espnow_initialised || i < 0) {
+        return espnow_initialised ? ESP_ERR_ESPNOW_NOT_FOUND : ESP_ERR_ESPNOW_NOT_INIT;
+    }
+    memmove(espnow_peers[i], espnow_peers[i + 1], (espnow_peer_count - i - 1) * ESP_NOW_ETH_ALEN);
+    espnow_peer_count--;
+    return ESP_OK;
+}
+
+/* NULL sends to every registered peer, as on target */
+esp_err_t esp_now_send(const uint8_t *peer_addr, const uint8_t *data, size_t len) {
+    if (!espnow_initialised) {
+        return ESP_ERR_ESPNOW_NOT_INIT;
+    }
+    if (peer_addr != NULL ? espnow_peer_find(peer_addr) < 0 : espnow_peer_count == 0) {
+        return ESP_ERR_ESPNOW_NOT_FOUND;
+    }
+    espnow_sends++;
+    espnow_unconfirmed += peer_addr != NULL ? 1 : espnow_peer_count;
+    if (espnow_send_hook) {
+        espnow_send_hook(peer_addr, data, len);
+    }
+    return ESP_OK;
+}
+
+/* --------------------------------------------------------------------------
+ * esp_timer one-shot stand-ins
+ * -------------------------------------------------------------------------- */
+
+esp_err_t esp_timer_create(const esp_timer_create_args_t *create_args, esp_timer_handle_t *out_handle) {
+    for (int i = 0; i < HOST_TIMERS_MAX; i++) {
+        if (!esp_timers[i].used) {
+            esp_timers[i] = (struct host_esp_timer){
+                .used = true,
+                .callback = create_args->callback,
+                .arg = create_args->arg,
+            };
+            *out_handle = &esp_timers[i];
+            return ESP_OK;
+        }
+    }
+    return ESP_ERR_NO_MEM;
+}
+
+esp_err_t esp_timer_start_once(esp_timer_handle_t timer, uint64_t timeout_us) {
+    if (timer->armed) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    timer->armed = true;
+    timer->deadline_us = sim_now_us + (int64_t)timeout_us;
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_stop(esp_timer_handle_t timer) {
+    if (!timer->armed) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    timer->armed = false;
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_delete(esp_timer_handle_t timer) {
+    memset(timer, 0, sizeof(*timer));
+    return ESP_OK;
+}
+
+int64_t host_timer_next_deadline_us(void) {
+    int64_t next = INT64_MAX;
+    for (int i = 0; i < HOST_TIMERS_MAX; i++) {
+        if (esp_timers[i].armed && esp_timers[i].deadline_us < next) {
+            next = esp_timers[i].deadline_us;
+        }
+    }
+    return next;
+}
+
+uint32_t host_timer_run_due(void) {
+    uint32_t fired = 0;
+    for (int i = 0; i < HOST_TIMERS_MAX; i++) {
+        if (esp_timers[i].armed && esp_timers[i].deadline_us <= sim_now_us) {
+            esp_timers[i].armed = false;
+            esp_timers[i].callback(esp_timers[i].arg);
+            fired++;
+        }
+    }
+    return fired;
+}
+
+/* --------------------------------------------------------------------------
+ * FreeRTOS queue stand-in
+ * -------------------------------------------------------------------------- */
+
+struct host_queue {
+    uint8_t *storage;
+    UBaseType_t length;
+    UBaseType_t item_size;
+    UBaseType_t head;
+    UBaseType_t count;
+};
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t item_size) {
+    QueueHandle_t q = calloc(1, sizeof(*q));
+    if (q == NULL) {
+        return NULL;
+    }
+    q->storage = calloc(length, item_size);
+    if (q->storage == NULL) {
+        free(q);
+        return NULL;
+    }
+    q->length = length;
+    q->item_size = item_size;
+    return q;
+}
+
+void vQueueDelete(QueueHandle_t queue) {
+    if (queue) {
+        free(queue->storage);
+        free(queue);
+    }
+}
+
+BaseType_t xQueueSend(QueueHandle_t queue, const void *item, TickType_t ticks_to_wait) {
+    (void)ticks_to_wait; // Single-threaded host: a full queue never drains while we wait
+    if (queue->count >= queue->length) {
+        return errQUEUE_FULL;
+    }
+    UBaseType_t tail = (queue->head + queue->count) % queue->length;
+    memcpy(queue->storage + tail * queue->item_size, item, queue->item_size);
+    queue->count++;
+    return pdTRUE;
+}
+
+BaseType_t xQueueSendFromISR(QueueHandle_t queue, const void *item, BaseType_t *higher_prio_task_woken) {
+    if (higher_prio_task_woken) {
+        *higher_prio_task_woken = pdFALSE;
+    }
+    return xQueueSend(queue, item, 0);
+}
+
+BaseType_t xQueueReceive(QueueHandle_t queue, void *item, TickType_t ticks_to_wait) {
+    (void)ticks_to_wait;
+    if (queue->count == 0) {
+        return pdFALSE;
+    }
+    memcpy(item, queue->storage + queue->head * queue->item_size, queue->item_size);
+    queue->head = (queue->head + 1) % queue->length;
+    queue->count--;
+    return pdTRUE;
+}
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue) {
+    return queue->count;
+}
+
+/* --------------------------------------------------------------------------
+ * NVS stand-ins
+ * -------------------------------------------------------------------------- */
+
+static host_nvs_entry_t *nvs_find(const char *key, bool create) {
+    for (int i = 0; i < HOST_NVS_MAX_KEYS; i++) {
+        if (nvs_table[i].used && strncmp(nvs_table[i].key, key, HOST_NVS_KEY_LEN) == 0) {
+            return &nvs_table[i];
+        }
+    }
+    if (!create) {
+        return NULL;
+    }
+    for (int i = 0; i < HOST_NVS_MAX_KEYS; i++) {
+        if (!nvs_table[i].used) {
+            nvs_table[i].used = true;
+            strncpy(nvs_table[i].key, key, HOST_NVS_KEY_LEN - 1);
+            return &nvs_table[i];
+        }
+    }
+    return NULL;
+}
+
+esp_err_t nvs_flash_init(void) {
+    return ESP_OK;
+}
+
+esp_err_t nvs_open(const char *name, nvs_open_mode_t open_mode, nvs_handle_t *out_handle) {
+    (void)name;
+    (void)open_mode;
+    *out_handle = 1; // Single namespace is enough for the firmware under test
+    return ESP_OK;
+}
+
+esp_err_t nvs_get_u32(nvs_handle_t handle, const char *key, uint32_t *out_value) {
+    (void)handle;
+    host_nvs_entry_t *entry = nvs_find(key, false);
+    if (entry == NULL) {
+        return ESP_ERR_NVS_NOT_FOUND;
+    }
+    *out_value = entry->value;
+    return ESP_OK;
+}
+
+esp_err_t nvs_set_u32(nvs_handle_t handle, const char *key, uint32_t value) {
+    (void)handle;
+    host_nvs_entry_t *entry = nvs_find(key, true);
+    if (entry == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    entry->value = value;
+    return ESP_OK;
+}
+
+esp_err_t nvs_get_blob(nvs_handle_t handle, const char *key, void *out_value, size_t *length) {
+    (void)handle;
+    host_nvs_entry_t *entry = nvs_find(key, false);
+    if (entry == NULL) {
+        return ESP_ERR_NVS_NOT_FOUND;
+    }
+    if (out_value == NULL) {
+        *length = entry->blob_len;
+        return ESP_OK;
+    }
+    if (*length < entry->blob_len) {
+        return ESP_ERR_NVS_INVALID_LENGTH;
+    }
+    memcpy(out_value, entry->blob, entry->blob_len);
+    *length = entry->blob_len;
+    return ESP_OK;
+}
+
+esp_err_t nvs_set_blob(nvs_handle_t handle, const char *key, const void *value, size_t length) {
+    (void)handle;
+    if (length > HOST_NVS_BLOB_MAX) {
+        return ESP_ERR_NVS_VALUE_TOO_LONG;
+    }
+    host_nvs_entry_t *entry = nvs_find(key, true);
+    if (entry == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    memcpy(entry->blob, value, length);
+    entry->blob_len = length;
+    return ESP_OK;
+}
+
+esp_err_t nvs_commit(nvs_handle_t handle) {
+    (void)handle;
+    nvs_commits++;
+    return ESP_OK;
+}
+
+void nvs_close(nvs_handle_t handle) {
+    (void)handle;
+}
+
+uint32_t host_nvs_commit_count(void) {
+    return nvs_commits;
+}
+
+/* --------------------------------------------------------------------------
+ * Partition stand-ins
+ * -------------------------------------------------------------------------- */
+
+void host_flash_create(const char *label, int subtype, uint32_t size) {
+    if (size > HOST_FLASH_MAX_SECTORS * HOST_FLASH_SECTOR) {
+        size = HOST_FLASH_MAX_SECTORS * HOST_FLASH_SECTOR;
+    }
+    free(flash_data);
+    flash_data = malloc(size);
+    memset(flash_data, 0xff, size);
+    memset(&flash_partition, 0, sizeof(flash_partition));
+    flash_partition.type = ESP_PARTITION_TYPE_DATA;
+    flash_partition.subtype = subtype;
+    flash_partition.size = size;
+    flash_partition.erase_size = HOST_FLASH_SECTOR;
+    strncpy(flash_partition.label, label, sizeof(flash_partition.label) - 1);
+    host_flash_power_on();
+    host_flash_reset_stats();
+    flash_failing_writes = 0;
+}
+
+void host_flash_cut_power_after(uint32_t operations) {
+    flash_ops_until_cut = operations;
+}
+
+void host_flash_fail_writes(uint32_t writes) {
+    flash_failing_writes = writes;
+}
+
+void host_flash_power_on(void) {
+    flash_ops_until_cut = UINT32_MAX;
+    flash_powered = true;
+}
+
+void host_flash_get_stats(host_flash_stats_t *stats) {
+    *stats = flash_stats;
+    stats->max_sector_erases = 0;
+    for (int i = 0; i < HOST_FLASH_MAX_SECTORS; i++) {
+        if (flash_sector_erases[i] > stats->max_sector_erases) {
+            stats->max_sector_erases = flash_sector_erases[i];
+        }
+    }
+}
+
+void host_flash_reset_stats(void) {
+    memset(&flash_stats, 0, sizeof(flash_stats));
+    memset(flash_sector_erases, 0, sizeof(flash_sector_erases));
+}
+
+/* Count down to the power cut; returns how much of the operation completes */
+static size_t flash_power_budget(size_t size) {
+    if (!flash_powered) {
+        return 0;
+    }
+    if (flash_ops_until_cut == 0) {
+        flash_powered = false;
+        return size / 2;
+    }
+    if (flash_ops_until_cut != UINT32_MAX) {
+        flash_ops_until_cut--;
+    }
+    return size;
+}
+
+static bool flash_range_ok(const esp_partition_t *partition, size_t offset, size_t size) {
+    return partition == &flash_partition && flash_data != NULL &&
+           offset <= partition->size && size <= partition->size - offset;
+}
+
+const esp_partition_t *esp_partition_find_first(esp_partition_type_t type, esp_partition_subtype_t subtype,
+                                                const char *label) {
+    if (flash_data == NULL || type != flash_partition.type || subtype != flash_partition.subtype ||
+        (label != NULL && strcmp(label, flash_partition.label) != 0)) {
+        return NULL;
+    }
+    return &flash_partition;
+}
+
+esp_err_t esp_partition_read(const esp_partition_t *partition, size_t src_offset, void *dst, size_t size) {
+    if (partition == &ota_partition && src_offset <= ota_partition.size && size <= ota_partition.size - src_offset) {
+        memset(dst, 0xff, size);
+        if (src_offset < ota_image_len) {
+            memcpy(dst, ota_image + src_offset, ota_image_len - src_offset < size ? ota_image_len - src_offset : size);
+        }
+        return ESP_OK;
+    }
+    if (!flash_range_ok(partition, src_offset, size)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    flash_stats.reads++;
+    memcpy(dst, flash_data + src_offset, size);
+    return ESP_OK;
+}
+
+esp_err_t esp_partition_write(const esp_partition_t *partition, size_t dst_offset, const void *src, size_t size) {
+    if (!flash_range_ok(partition, dst_offset, size)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (flash_failing_writes > 0) {
+        flash_failing_writes--;
+        return ESP_FAIL;
+    }
+    size_t done = flash_power_budget(size);
+    for (size_t i = 0; i < done; i++) {
+        flash_data[dst_offset + i] &= ((const uint8_t *)src)[i]; // NOR: bits only go 1 -> 0
+    }
+    if (done < size) {
+        return ESP_FAIL;
+    }
+    flash_stats.writes++;
+    return ESP_OK;
+}
+
+esp_err_t esp_partition_erase_range(const esp_partition_t *partition, size_t offset, size_t size) {
+    if (!flash_range_ok(partition, offset, size) || offset % HOST_FLASH_SECTOR || size % HOST_FLASH_SECTOR) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    size_t done = flash_power_budget(size);
+    memset(flash_data + offset, 0xff, done);
+    if (done < size) {
+        return ESP_FAIL;
+    }
+    for (size_t s = offset / HOST_FLASH_SECTOR; s < (offset + size) / HOST_FLASH_SECTOR; s++) {
+        flash_sector_erases[s]++;
+    }
+    flash_stats.erases++;
+    return ESP_OK;
+}
+
+/* --------------------------------------------------------------------------
+ * App partition stand-ins
+ * -------------------------------------------------------------------------- */
+
+const esp_partition_t *esp_ota_get_next_update_partition(const esp_partition_t *start_from) {
+    return &ota_partition;
+}
+
+esp_err_t esp_ota_get_partition_description(const esp_partition_t *partition, esp_app_desc_t *app_desc) {
+    if (partition != &ota_partition || ota_image == NULL) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    *app_desc = ota_image_desc;
+    return ESP_OK;
+}
+
+const esp_app_desc_t *esp_app_get_description(void) {
+    return &running_app_desc;
+}
+
+esp_err_t esp_image_verify(esp_image_load_mode_t mode, const esp_partition_pos_t *part, esp_image_metadata_t *data) {
+    if (part->offset != ota_partition.address || ota_image == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    data->start_addr = part->offset;
+    data->image_len = ota_image_len;
+    return ESP_OK;
+}
+
+/* --------------------------------------------------------------------------
+ * Sleep and reset stand-ins
+ * -------------------------------------------------------------------------- */
+
+void host_sleep_set_hooks(host_light_sleep_hook_t light, host_deep_sleep_hook_t deep) {
+    light_sleep_hook = light;
+    deep_sleep_hook = deep;
+}
+
+void host_sleep_set_wakeup_cause(esp_sleep_wakeup_cause_t cause) {
+    wakeup_cause = cause;
+}
+
+void host_set_reset_reason(esp_reset_reason_t reason) {
+    reset_reason = reason;
+}
+
+esp_reset_reason_t esp_reset_reason(void) {
+    return reset_reason;
+}
+
+esp_err_t esp_sleep_enable_timer_wakeup(uint64_t time_in_us) {
+    sleep_timer_us = (int64_t)time_in_us;
+    return ESP_OK;
+}
+
+esp_err_t esp_sleep_enable_gpio_wakeup(void) {
+    gpio_wakeup_enabled = true;
+    return ESP_OK;
+}
+
+esp_err_t esp_sleep_enable_ext0_wakeup(gpio_num_t gpio_num, int level) {
+    (void)level;
+    return gpio_num >= 0 && gpio_num < GPIO_NUM_MAX ? ESP_OK : ESP_ERR_INVALID_ARG;
+}
+
+static bool gpio_wakeup_level_reached(void) {
+    if (!gpio_wakeup_enabled) {
+        return false;
+    }
+    for (int pin = 0; pin < GPIO_NUM_MAX; pin++) {
+        if ((gpio_wakeup[pin] == GPIO_INTR_LOW_LEVEL && gpio_levels[pin] == 0) ||
+            (gpio_wakeup[pin] == GPIO_INTR_HIGH_LEVEL && gpio_levels[pin] == 1)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+esp_err_t esp_light_sleep_start(void) {
+    int64_t wake_us = sleep_timer_us >= 0 ? sim_now_us + sleep_timer_us : INT64_MAX;
+    while (true) {
+        if (gpio_wakeup_level_reached()) {
+            wakeup_cause = ESP_SLEEP_WAKEUP_GPIO;
+            break;
+        }
+        if (sim_now_us >= wake_us) {
+            wakeup_cause = ESP_SLEEP_WAKEUP_TIMER;
+            break;
+        }
+        int64_t next_us = light_sleep_hook ? light_sleep_hook(wake_us) : wake_us;
+        sim_now_us = next_us < wake_us ? next_us : wake_us;
+    }
+    return ESP_OK;
+}
+
+void esp_deep_sleep_start(void) {
+    int64_t wake_us = sleep_timer_us >= 0 ? sim_now_us + sleep_timer_us : INT64_MAX;
+    if (deep_sleep_hook) {
+        deep_sleep_hook(wake_us);
+    }
+    abort();
+}
+
+esp_sleep_wakeup_cause_t esp_sleep_get_wakeup_cause(void) {
+    return wakeup_cause;
+}
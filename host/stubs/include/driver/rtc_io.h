@@ -0,0 +1,11 @@
+#ifndef DRIVER_RTC_IO_H
+#define DRIVER_RTC_IO_H
+
+#include "esp_err.h"
+#include "driver/gpio.h"
+
+/* Host stand-in for driver/rtc_io.h: the RTC pad settings have no effect */
+esp_err_t rtc_gpio_pullup_en(gpio_num_t gpio_num);
+esp_err_t rtc_gpio_pulldown_dis(gpio_num_t gpio_num);
+
+#endif // DRIVER_RTC_IO_H
@@ -0,0 +1,8 @@
+#ifndef ESP_ATTR_H
+#define ESP_ATTR_H
+
+/* Host stand-in for esp_attr.h */
+#define IRAM_ATTR
+#define RTC_DATA_ATTR       // Plain RAM: host tools keep it across simulated deep sleep
+
+#endif // ESP_ATTR_H
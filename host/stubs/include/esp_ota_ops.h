@@ -0,0 +1,16 @@
+#ifndef ESP_OTA_OPS_H
+#define ESP_OTA_OPS_H
+
+/* Host stand-in: the spare OTA partition in host_sim.c, which the receiver
+ * sends to senders from */
+#include <stdint.h>
+#include "esp_err.h"
+#include "esp_partition.h"
+#include "esp_app_desc.h"
+
+typedef uint32_t esp_ota_handle_t;
+
+const esp_partition_t *esp_ota_get_next_update_partition(const esp_partition_t *start_from);
+esp_err_t esp_ota_get_partition_description(const esp_partition_t *partition, esp_app_desc_t *app_desc);
+
+#endif // ESP_OTA_OPS_H
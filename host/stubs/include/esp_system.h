@@ -0,0 +1,15 @@
+#ifndef ESP_SYSTEM_H
+#define ESP_SYSTEM_H
+
+/* Host stand-in for esp_system.h: the reset reason is set by host tools */
+typedef enum {
+    ESP_RST_UNKNOWN = 0,
+    ESP_RST_POWERON = 1,
+    ESP_RST_SW = 3,
+    ESP_RST_PANIC = 4,
+    ESP_RST_DEEPSLEEP = 8,
+} esp_reset_reason_t;
+
+esp_reset_reason_t esp_reset_reason(void);
+
+#endif // ESP_SYSTEM_H
@@ -0,0 +1,95 @@
+#ifndef HOST_SIM_H
+#define HOST_SIM_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "driver/gpio.h"
+#include "esp_sleep.h"
+#include "esp_system.h"
+#include "esp_now.h"
+
+/* --------------------------------------------------------------------------
+ * Host simulation controls
+ * Lets host tools drive the simulated clock and pins behind the IDF stand-ins
+ * -------------------------------------------------------------------------- */
+
+typedef void (*host_gpio_hook_t)(gpio_num_t pin, uint32_t level);
+typedef void (*host_espnow_send_hook_t)(const uint8_t *peer_addr, const uint8_t *data, size_t len);
+
+/* Reset clock, pins, queues, timers and NVS contents */
+void host_sim_reset(void);
+
+/* Simulated reboot: drop timers, ISRs, notifications and wakeup sources,
+ * keep the clock, pin levels, NVS and flash */
+void host_sim_reboot(void);
+
+/* Simulated esp_timer clock */
+void host_clock_set_us(int64_t now_us);
+void host_clock_advance_us(int64_t delta_us);
+
+/* Simulated esp_timer one-shots: earliest armed deadline (INT64_MAX if none),
+ * and firing every timer due at the current time */
+int64_t host_timer_next_deadline_us(void);
+uint32_t host_timer_run_due(void);
+
+/* Pending task notification bits, i.e. whether the main task would be awake */
+uint32_t host_task_notify_pending(void);
+
+/* Simulated GPIO pins (inputs fire registered edge ISRs) */
+void host_gpio_set_input(gpio_num_t pin, uint32_t level);
+uint32_t host_gpio_get_output(gpio_num_t pin);
+void host_gpio_set_output_hook(host_gpio_hook_t hook);
+
+/* Simulated sleep. A light sleep calls the hook with its timer wakeup time
+ * until a GPIO wakeup pin is at its level or the clock reaches that time; the
+ * hook applies the next scripted event before it and returns the new time, or
+ * returns the wakeup time if there is none (the default without a hook). Deep
+ * sleep calls the deep sleep hook, which must not return: host tools longjmp
+ * to their simulated boot and set the next wakeup cause and reset reason. */
+typedef int64_t (*host_light_sleep_hook_t)(int64_t wake_us);
+typedef void (*host_deep_sleep_hook_t)(int64_t wake_us);
+
+void host_sleep_set_hooks(host_light_sleep_hook_t light, host_deep_sleep_hook_t deep);
+void host_sleep_set_wakeup_cause(esp_sleep_wakeup_cause_t cause);
+void host_set_reset_reason(esp_reset_reason_t reason);
+
+/* Simulated ESP-NOW radio. Send callbacks only come from
+ * host_espnow_complete_sends(), once per frame and peer sent to since the
+ * last call, as the Wi-Fi task would; returns how many it made. */
+void host_espnow_set_send_hook(host_espnow_send_hook_t hook);
+uint32_t host_espnow_send_count(void);
+uint32_t host_espnow_peer_count(void);
+uint32_t host_espnow_complete_sends(esp_now_send_status_t status);
+
+/* Simulated app partitions: the running app's project name, and the image in
+ * the spare OTA partition that esp_image_verify() accepts (NULL erases it) */
+#define HOST_RUNNING_PROJECT "gate-reciever"
+
+void host_ota_set_running_project(const char *project_name);
+void host_ota_set_spare_image(const uint8_t *image, uint32_t len, const char *project_name);
+
+/* Simulated raw flash: one data partition, erased on creation. host_sim_reset()
+ * removes it; a power cut tears the next write or erase halfway and fails
+ * every later one until host_flash_power_on(). host_flash_fail_writes() makes
+ * the next writes fail with the flash left as it was, powered. */
+typedef struct {
+    uint32_t reads;
+    uint32_t writes;
+    uint32_t erases;
+    uint32_t max_sector_erases;
+} host_flash_stats_t;
+
+void host_flash_create(const char *label, int subtype, uint32_t size);
+void host_flash_cut_power_after(uint32_t operations);
+void host_flash_fail_writes(uint32_t writes);
+void host_flash_power_on(void);
+void host_flash_get_stats(host_flash_stats_t *stats);
+void host_flash_reset_stats(void);
+
+/* NVS commits since reset */
+uint32_t host_nvs_commit_count(void);
+
+/* Wall clock used to measure real CPU time of the code under test */
+uint64_t host_wall_ns(void);
+
+#endif // HOST_SIM_H
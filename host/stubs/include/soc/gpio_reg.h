@@ -0,0 +1,8 @@
+#ifndef SOC_GPIO_REG_H
+#define SOC_GPIO_REG_H
+
+/* Host stand-in: same addresses as the ESP32 GPIO input registers */
+#define GPIO_IN_REG  0x3FF4403C
+#define GPIO_IN1_REG 0x3FF44040
+
+#endif // SOC_GPIO_REG_H
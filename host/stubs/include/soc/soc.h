@@ -0,0 +1,11 @@
+#ifndef SOC_SOC_H
+#define SOC_SOC_H
+
+#include <stdint.h>
+
+/* Host stand-in: register reads are served from the simulated pin table */
+uint32_t host_reg_read(uint32_t reg);
+
+#define REG_READ(reg) host_reg_read((uint32_t)(reg))
+
+#endif // SOC_SOC_H
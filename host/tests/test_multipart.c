@@ -0,0 +1,269 @@
+/* --------------------------------------------------------------------------
+ * Host test for the multipart/form-data parser
+ *
+ * Builds uploads the way a browser does (preamble, a firmware part, a second
+ * field, closing delimiter, epilogue) around payloads seeded with partial
+ * delimiters and CR LF runs, feeds them to multipart.c in random chunkings
+ * down to one byte, and checks that each part's body comes out unchanged,
+ * also when compacted in place the way the OTA handler does, and that
+ * truncated or malformed uploads never reach MULTIPART_DONE.
+ * -------------------------------------------------------------------------- */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "test_util.h"
+#include "multipart.h"
+
+#define UPLOAD_MAX  (64 * 1024)
+#define PARTS_MAX   4
+
+typedef struct {
+    uint8_t data[PARTS_MAX][UPLOAD_MAX];
+    size_t len[PARTS_MAX];
+    bool overflow;
+} sink_t;
+
+static bool on_data(void *ctx, uint32_t part, const uint8_t *data, size_t len) {
+    sink_t *sink = ctx;
+    if (part >= PARTS_MAX || sink->len[part] + len > UPLOAD_MAX) {
+        sink->overflow = true;
+        return false;
+    }
+    memcpy(sink->data[part] + sink->len[part], data, len);
+    sink->len[part] += len;
+    return true;
+}
+
+static size_t append(uint8_t *out, size_t len, const void *data, size_t n) {
+    memcpy(out + len, data, n);
+    return len + n;
+}
+
+static size_t append_str(uint8_t *out, size_t len, const char *s) {
+    return append(out, len, s, strlen(s));
+}
+
+/* Payload full of near misses: CR LF, "--", and the delimiter cut short */
+static size_t make_payload(uint8_t *out, size_t max, const char *boundary) {
+    size_t len = (size_t)rand() % max;
+    char delim[MULTIPART_DELIM_MAX + 1];
+    snprintf(delim, sizeof(delim), "\r\n--%s", boundary);
+    size_t dlen = strlen(delim);
+    for (size_t i = 0; i < len; i++) {
+        int r = rand() % 64;
+        if (r == 0 && i + dlen < len) {
+            size_t n = 1 + (size_t)rand() % (dlen - 1);    // Never the whole delimiter
+            memcpy(out + i, delim, n);
+            i += n - 1;
+        } else if (r >= 1 && r < 4) {                   // r == 0 without room gets a random byte
+            out[i] = "\r\n-"[r - 1];
+        } else {
+            out[i] = (uint8_t)rand();
+        }
+    }
+    /* Near misses can still line up into the real thing now and then */
+    for (size_t i = 0; i + dlen <= len; i++) {
+        if (memcmp(out + i, delim, dlen) == 0) {
+            out[i + dlen - 1] = 0xFF;   // Not a boundary character
+        }
+    }
+    return len;
+}
+
+static multipart_state_t feed_chunked(const char *boundary, const uint8_t *upload, size_t len,
+                                      size_t max_chunk, sink_t *sink) {
+    multipart_parser_t p;
+    memset(sink->len, 0, sizeof(sink->len));
+    sink->overflow = false;
+    if (!multipart_init(&p, boundary, on_data, sink)) {
+        return MULTIPART_ERROR;
+    }
+    multipart_state_t state = MULTIPART_PREAMBLE;
+    size_t pos = 0;
+    while (pos < len) {
+        size_t n = 1 + (size_t)rand() % max_chunk;
+        if (n > len - pos) {
+            n = len - pos;
+        }
+        state = multipart_feed(&p, upload + pos, n);
+        pos += n;
+    }
+    return state;
+}
+
+static void test_boundary_header(void) {
+    char b[MULTIPART_BOUNDARY_MAX + 1];
+    EXPECT(multipart_boundary_from_content_type(
+        "multipart/form-data; boundary=----WebKitFormBoundaryx7Q", b, sizeof(b)));
+    EXPECT(strcmp(b, "----WebKitFormBoundaryx7Q") == 0);
+    EXPECT(multipart_boundary_from_content_type("multipart/form-data; boundary=\"a b:c\"; x=1", b, sizeof(b)));
+    EXPECT(strcmp(b, "a b:c") == 0);
+    EXPECT(multipart_boundary_from_content_type("multipart/form-data; boundary=abc; charset=x", b, sizeof(b)));
+    EXPECT(strcmp(b, "abc") == 0);
+    EXPECT(!multipart_boundary_from_content_type("multipart/form-data", b, sizeof(b)));
+    EXPECT(!multipart_boundary_from_content_type("multipart/form-data; boundary=", b, sizeof(b)));
+
+    multipart_parser_t p;
+    EXPECT(!multipart_init(&p, "", on_data, NULL));
+    EXPECT(!multipart_init(&p, "bad\rboundary", on_data, NULL));
+    char longest[MULTIPART_BOUNDARY_MAX + 2];
+    memset(longest, 'x', sizeof(longest) - 1);
+    longest[sizeof(longest) - 1] = '\0';
+    EXPECT(!multipart_init(&p, longest, on_data, NULL));
+    longest[MULTIPART_BOUNDARY_MAX] = '\0';
+    EXPECT(multipart_init(&p, longest, on_data, NULL));
+}
+
+/* The body starts right at the first delimiter, and a part may have no headers */
+static void test_minimal(void) {
+    static sink_t sink;
+    const char *upload = "--b\r\n\r\nfirmware\r\n--b\r\n\r\n\r\n--b--";
+    for (size_t chunk = 1; chunk <= strlen(upload); chunk++) {
+        multipart_parser_t p;
+        memset(sink.len, 0, sizeof(sink.len));
+        multipart_init(&p, "b", on_data, &sink);
+        multipart_state_t state = MULTIPART_PREAMBLE;
+        for (size_t pos = 0; pos < strlen(upload); pos += chunk) {
+            size_t n = strlen(upload) - pos < chunk ? strlen(upload) - pos : chunk;
+            state = multipart_feed(&p, (const uint8_t *)upload + pos, n);
+        }
+        EXPECT(state == MULTIPART_DONE);
+        EXPECT(p.parts == 2);
+        EXPECT(sink.len[0] == 8 && memcmp(sink.data[0], "firmware", 8) == 0);
+        EXPECT(sink.len[1] == 0);
+    }
+}
+
+static void test_randomised(void) {
+    static uint8_t upload[3 * UPLOAD_MAX];
+    static uint8_t payload[2][UPLOAD_MAX / 2];
+    static sink_t sink;
+    static const char *const boundaries[] = {
+        "----WebKitFormBoundary7MA4YWxkTrZu0gW", "x", "--", "a'()+_,-./:=? Z",
+    };
+    for (int trial = 0; trial < 400; trial++) {
+        const char *boundary = boundaries[trial % 4];
+        size_t lens[2];
+        for (int i = 0; i < 2; i++) {
+            lens[i] = make_payload(payload[i], sizeof(payload[i]), boundary);
+        }
+
+        size_t len = 0;
+        if (rand() % 2) {
+            len = append_str(upload, len, "This is the preamble.\r\n--notit\r\n");
+        }
+        char line[160];
+        snprintf(line, sizeof(line), "--%s  \r\n", boundary);   // Transport padding is allowed
+        len = append_str(upload, len, line);
+        len = append_str(upload, len, "Content-Disposition: form-data; name=\"firmware\"; "
+                                      "filename=\"gate.bin\"\r\nContent-Type: application/octet-stream\r\n\r\n");
+        len = append(upload, len, payload[0], lens[0]);
+        snprintf(line, sizeof(line), "\r\n--%s\r\nContent-Disposition: form-data; name=\"note\"\r\n\r\n", boundary);
+        len = append_str(upload, len, line);
+        len = append(upload, len, payload[1], lens[1]);
+        snprintf(line, sizeof(line), "\r\n--%s--\r\nepilogue\r\n--%s\r\n", boundary, boundary);
+        size_t complete = append_str(upload, len, line);
+
+        size_t max_chunk = (size_t[]){1, 7, 1460, 4096}[rand() % 4];
+        multipart_state_t state = feed_chunked(boundary, upload, complete, max_chunk, &sink);
+        EXPECT(state == MULTIPART_DONE);
+        EXPECT(!sink.overflow);
+        EXPECT(sink.len[0] == lens[0] && memcmp(sink.data[0], payload[0], lens[0]) == 0);
+        EXPECT(sink.len[1] == lens[1] && memcmp(sink.data[1], payload[1], lens[1]) == 0);
+
+        /* Cut anywhere before the closing "--": never done */
+        size_t cut = (size_t)rand() % (len + 2 + strlen(boundary) + 4);
+        state = feed_chunked(boundary, upload, cut, max_chunk, &sink);
+        EXPECT(state != MULTIPART_DONE);
+        EXPECT(sink.len[0] <= lens[0] && memcmp(sink.data[0], payload[0], sink.len[0]) == 0);
+    }
+}
+
+/* The OTA handler's use: each chunk received multipart_held() bytes past the
+ * body kept so far, in a sector-sized buffer, and the body moved down in place */
+typedef struct {
+    uint8_t buf[4096];
+    size_t fill;
+    uint8_t out[UPLOAD_MAX];
+    size_t out_len;
+} in_place_t;
+
+static bool on_data_in_place(void *ctx, uint32_t part, const uint8_t *data, size_t len) {
+    in_place_t *ip = ctx;
+    if (part == 0) {
+        memmove(ip->buf + ip->fill, data, len);
+        ip->fill += len;
+    }
+    return true;
+}
+
+static void test_in_place(void) {
+    static uint8_t upload[UPLOAD_MAX + 512];
+    static uint8_t payload[UPLOAD_MAX];
+    static in_place_t ip;
+    const char *boundary = "--";
+    for (int trial = 0; trial < 200; trial++) {
+        size_t plen = make_payload(payload, sizeof(payload), boundary);
+        size_t len = append_str(upload, 0, "----\r\nContent-Disposition: form-data; name=\"f\"\r\n\r\n");
+        len = append(upload, len, payload, plen);
+        len = append_str(upload, len, "\r\n------\r\n\r\nsecond\r\n------");
+
+        multipart_parser_t p;
+        multipart_init(&p, boundary, on_data_in_place, &ip);
+        ip.fill = 0;
+        ip.out_len = 0;
+        multipart_state_t state = MULTIPART_PREAMBLE;
+        size_t pos = 0;
+        while (pos < len && state < MULTIPART_DONE) {
+            size_t offset = ip.fill + multipart_held(&p);
+            if (offset >= sizeof(ip.buf)) {
+                memcpy(ip.out + ip.out_len, ip.buf, ip.fill);
+                ip.out_len += ip.fill;
+                ip.fill = 0;
+                continue;
+            }
+            size_t n = 1 + (size_t)rand() % (sizeof(ip.buf) - offset);
+            if (n > len - pos) {
+                n = len - pos;
+            }
+            memcpy(ip.buf + offset, upload + pos, n);
+            pos += n;
+            state = multipart_feed(&p, ip.buf + offset, n);
+        }
+        memcpy(ip.out + ip.out_len, ip.buf, ip.fill);
+        ip.out_len += ip.fill;
+        EXPECT(state == MULTIPART_DONE);
+        EXPECT(ip.out_len == plen && memcmp(ip.out, payload, plen) == 0);
+    }
+}
+
+static void test_malformed(void) {
+    static sink_t sink;
+    const char *bad_tail = "--b\r\n\r\nbody\r\n--bX";
+    EXPECT(feed_chunked("b", (const uint8_t *)bad_tail, strlen(bad_tail), 3, &sink) == MULTIPART_ERROR);
+
+    /* Headers that never end are rejected rather than scanned forever */
+    static uint8_t upload[MULTIPART_HEADERS_MAX + 64];
+    size_t len = append_str(upload, 0, "--b\r\n");
+    memset(upload + len, 'h', sizeof(upload) - len);
+    EXPECT(feed_chunked("b", upload, sizeof(upload), 100, &sink) == MULTIPART_ERROR);
+
+    /* The callback stops the upload */
+    const char *upload2 = "--b\r\n\r\n0123456789\r\n--b--";
+    multipart_parser_t p;
+    memset(sink.len, 0, sizeof(sink.len));
+    multipart_init(&p, "b", on_data, &sink);
+    sink.len[0] = UPLOAD_MAX - 4;
+    EXPECT(multipart_feed(&p, (const uint8_t *)upload2, strlen(upload2)) == MULTIPART_ERROR);
+}
+
+int main(void) {
+    srand(1);
+    test_boundary_header();
+    test_minimal();
+    test_randomised();
+    test_in_place();
+    test_malformed();
+    return test_report("multipart");
+}
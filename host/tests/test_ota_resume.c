@@ -0,0 +1,285 @@
+/* --------------------------------------------------------------------------
+ * Host test for resumable OTA uploads
+ *
+ * Plays a client against a model of the OTA upload handler: requests are
+ * received in random TCP-sized chunks into pipeline buffers the way
+ * ota_module.c does, written to a simulated partition strictly in order and
+ * hashed, with ota_resume.c deciding what each request does. The client
+ * starts with a form upload or a raw one, the connection drops at random
+ * offsets, and after each drop the client asks for the committed offset and
+ * sends the rest as a Content-Range request. Checks that the partition ends
+ * up holding the image with the right digest, that only the missing part is
+ * sent again, and that requests which do not continue the image are refused
+ * without touching it.
+ * -------------------------------------------------------------------------- */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "test_util.h"
+#include "multipart.h"
+#include "ota_pipeline.h"
+#include "ota_resume.h"
+#include "sha256.h"
+
+#define IMAGE_MAX       (256 * 1024)
+#define UPLOAD_MAX      (IMAGE_MAX + 1024)
+#define TCP_MSS         1436
+
+#define STATUS_DROPPED  0
+
+/* --------------------------------------------------------------------------
+ * Device: the upload handler with esp_ota_write() onto a RAM partition
+ * -------------------------------------------------------------------------- */
+
+typedef struct {
+    ota_resume_t session;
+    multipart_parser_t parser;
+    uint8_t partition[IMAGE_MAX];
+    uint32_t write_pos;         // Where esp_ota_write() appends next
+    sha256_ctx_t sha;
+    uint8_t buf[OTA_PIPELINE_BUF_SIZE];
+    size_t fill;
+    uint32_t written;           // By the current request
+    uint8_t digest[SHA256_DIGEST_LEN];
+    bool booted;
+} device_t;
+
+static device_t device;
+
+static void device_submit(device_t *d, size_t len) {
+    EXPECT(d->write_pos + len <= IMAGE_MAX);
+    if (d->write_pos + len > IMAGE_MAX) {
+        return;
+    }
+    sha256_update(&d->sha, d->buf, len);
+    memcpy(d->partition + d->write_pos, d->buf, len);
+    d->write_pos += (uint32_t)len;
+    d->written += (uint32_t)len;
+}
+
+static bool device_collect(void *ctx, uint32_t part, const uint8_t *data, size_t len) {
+    device_t *d = ctx;
+    if (part == 0) {
+        memmove(d->buf + d->fill, data, len);
+        d->fill += len;
+    }
+    return true;
+}
+
+/**
+ * One POST /update; range NULL for a form upload. Only the first deliver bytes
+ * of the body arrive before the connection drops. Returns the HTTP status.
+ */
+static int device_request(device_t *d, const ota_range_t *range, const char *boundary,
+                          const uint8_t *body, size_t len, size_t deliver) {
+    bool form = range == NULL;
+    if (form) {
+        EXPECT(multipart_init(&d->parser, boundary, device_collect, d));
+    }
+    if (form || range->first == 0) {
+        ota_resume_reset(&d->session);
+    }
+    if (ota_resume_begin(&d->session, range) == OTA_RESUME_CONFLICT) {
+        return 416;
+    }
+    if (d->session.offset == 0) {
+        d->write_pos = 0;
+        memset(d->partition, 0xff, sizeof(d->partition));
+        sha256_init(&d->sha);
+    }
+    EXPECT(d->write_pos == d->session.offset);
+
+    multipart_state_t state = MULTIPART_PREAMBLE;
+    size_t pos = 0;
+    d->fill = 0;
+    d->written = 0;
+    while (form ? state < MULTIPART_DONE : pos < len) {
+        size_t offset = d->fill + (form ? multipart_held(&d->parser) : 0);
+        if (offset >= OTA_PIPELINE_BUF_SIZE) {
+            device_submit(d, d->fill);
+            d->fill = 0;
+            continue;
+        }
+        size_t want = OTA_PIPELINE_BUF_SIZE - offset;
+        size_t n = 1 + (size_t)rand() % TCP_MSS;
+        n = n < want ? n : want;
+        n = n < deliver - pos ? n : deliver - pos;
+        if (n == 0) {
+            break;              // Connection dropped
+        }
+        memcpy(d->buf + offset, body + pos, n);
+        pos += n;
+        if (form) {
+            state = multipart_feed(&d->parser, d->buf + offset, n);
+        } else {
+            d->fill += n;
+        }
+    }
+    EXPECT(state != MULTIPART_ERROR);
+    device_submit(d, d->fill);
+
+    bool received_all = form ? state == MULTIPART_DONE : pos == len;
+    ota_resume_commit(&d->session, d->written);
+    if (!received_all) {
+        return STATUS_DROPPED;
+    }
+    if (form) {
+        ota_resume_set_total(&d->session, d->session.offset);
+    }
+    if (ota_resume_complete(&d->session)) {
+        sha256_final(&d->sha, d->digest);
+        d->booted = true;
+        ota_resume_reset(&d->session);
+    }
+    return 200;
+}
+
+/* --------------------------------------------------------------------------
+ * Client
+ * -------------------------------------------------------------------------- */
+
+static size_t build_form(uint8_t *out, const char *boundary, const uint8_t *image, size_t image_len,
+                         size_t *image_at) {
+    size_t len = (size_t)sprintf((char *)out, "--%s\r\nContent-Disposition: form-data; name=\"firmware\"; "
+                                 "filename=\"gate.bin\"\r\nContent-Type: application/octet-stream\r\n\r\n",
+                                 boundary);
+    *image_at = len;
+    memcpy(out + len, image, image_len);
+    len += image_len;
+    len += (size_t)sprintf((char *)out + len, "\r\n--%s--\r\n", boundary);
+    return len;
+}
+
+/* Where a request drops: nowhere half the time, else anywhere in the body */
+static size_t drop_point(size_t len) {
+    return rand() % 2 ? len : (size_t)rand() % (len + 1);
+}
+
+static void test_random_disconnects(void) {
+    static const char boundary[] = "----WebKitFormBoundaryR3sUm3";
+    static uint8_t image[IMAGE_MAX];
+    static uint8_t upload[UPLOAD_MAX];
+    uint64_t sent_total = 0;
+    uint64_t image_total = 0;
+    uint32_t drops_total = 0;
+
+    for (int trial = 0; trial < 200; trial++) {
+        size_t image_len = 1 + (size_t)rand() % IMAGE_MAX;
+        for (size_t i = 0; i < image_len; i++) {
+            image[i] = (uint8_t)rand();
+        }
+        memset(&device, 0, sizeof(device));
+        size_t image_bytes_sent = 0;    // Image bytes the device received, over all requests
+        uint32_t form_drops = 0;
+
+        // First attempt as the browser form or as one raw request
+        int status;
+        if (trial % 2 == 0) {
+            size_t image_at;
+            size_t len = build_form(upload, boundary, image, image_len, &image_at);
+            size_t deliver = drop_point(len);
+            status = device_request(&device, NULL, boundary, upload, len, deliver);
+            if (deliver > image_at) {
+                image_bytes_sent += (deliver < image_at + image_len ? deliver : image_at + image_len) - image_at;
+            }
+            form_drops += status == STATUS_DROPPED;
+        } else {
+            ota_range_t range = {.first = 0, .last = (uint32_t)image_len - 1, .total = (uint32_t)image_len};
+            size_t deliver = drop_point(image_len);
+            status = device_request(&device, &range, NULL, image, image_len, deliver);
+            image_bytes_sent += deliver;
+        }
+
+        // Resume from the committed offset until the image is in
+        int attempts = 0;
+        while (!device.booted && attempts++ < 100) {
+            drops_total++;
+            uint32_t offset = device.session.offset;
+            EXPECT(offset <= image_len);
+            ota_range_t range = {.first = offset, .last = (uint32_t)image_len - 1, .total = (uint32_t)image_len};
+            size_t len = image_len - offset;
+            size_t deliver = drop_point(len);
+            status = device_request(&device, &range, NULL, image + offset, len, deliver);
+            EXPECT(status == 200 || status == STATUS_DROPPED);
+            image_bytes_sent += deliver;
+        }
+
+        EXPECT(device.booted);
+        EXPECT(memcmp(device.partition, image, image_len) == 0);
+        uint8_t expected[SHA256_DIGEST_LEN];
+        sha256_ctx_t sha;
+        sha256_init(&sha);
+        sha256_update(&sha, image, image_len);
+        sha256_final(&sha, expected);
+        EXPECT(memcmp(device.digest, expected, SHA256_DIGEST_LEN) == 0);
+
+        // Raw requests keep every byte that arrived; a dropped form loses at most a held delimiter
+        EXPECT(image_bytes_sent >= image_len);
+        EXPECT(image_bytes_sent <= image_len + form_drops * MULTIPART_DELIM_MAX);
+        sent_total += image_bytes_sent;
+        image_total += image_len;
+    }
+    printf("200 images, %u resumes: %.4f image bytes sent per image byte\n", drops_total,
+           (double)sent_total / (double)image_total);
+}
+
+/* A partial image is not disturbed by requests that do not continue it */
+static void test_conflicts(void) {
+    static uint8_t image[64 * 1024];
+    for (size_t i = 0; i < sizeof(image); i++) {
+        image[i] = (uint8_t)rand();
+    }
+    memset(&device, 0, sizeof(device));
+
+    ota_range_t range = {.first = 10, .last = 99, .total = sizeof(image)};
+    EXPECT(device_request(&device, &range, NULL, image + 10, 90, 90) == 416);     // Nothing in progress
+    EXPECT(!device.session.active);
+
+    range = (ota_range_t){.first = 0, .last = sizeof(image) - 1, .total = sizeof(image)};
+    EXPECT(device_request(&device, &range, NULL, image, sizeof(image), 20000) == STATUS_DROPPED);
+    EXPECT(device.session.active && device.session.offset == 20000);
+
+    range = (ota_range_t){.first = 19000, .last = sizeof(image) - 1, .total = sizeof(image)};
+    EXPECT(device_request(&device, &range, NULL, image + 19000, sizeof(image) - 19000, 100) == 416);
+    range = (ota_range_t){.first = 20000, .last = sizeof(image), .total = sizeof(image) + 1};
+    EXPECT(device_request(&device, &range, NULL, image + 20000, sizeof(image) - 19999, 100) == 416);
+    EXPECT(device.session.offset == 20000 && device.write_pos == 20000);
+
+    // The rest in two ranges, the first answered with the status to continue from
+    range = (ota_range_t){.first = 20000, .last = 39999, .total = sizeof(image)};
+    EXPECT(device_request(&device, &range, NULL, image + 20000, 20000, 20000) == 200);
+    EXPECT(!device.booted && device.session.offset == 40000);
+    range = (ota_range_t){.first = 40000, .last = sizeof(image) - 1, .total = sizeof(image)};
+    EXPECT(device_request(&device, &range, NULL, image + 40000, sizeof(image) - 40000, sizeof(image) - 40000) == 200);
+    EXPECT(device.booted);
+    EXPECT(memcmp(device.partition, image, sizeof(image)) == 0);
+
+    char json[96];
+    ota_resume_t s = {.active = true, .offset = 20000, .total = 65536};
+    ota_resume_status_json(&s, true, json, sizeof(json));
+    EXPECT(strcmp(json, "{\"active\":true,\"offset\":20000,\"total\":65536,\"signature\":true}") == 0);
+}
+
+static void test_parse_range(void) {
+    ota_range_t r;
+    EXPECT(ota_resume_parse_range("bytes 0-99/100", &r) && r.first == 0 && r.last == 99 && r.total == 100);
+    EXPECT(ota_resume_parse_range(" bytes 4096-1048575/1048576 ", &r) && r.first == 4096);
+    EXPECT(ota_resume_parse_range("bytes 5-5/6", &r) && r.first == 5 && r.last == 5);
+    EXPECT(!ota_resume_parse_range("bytes 0-99/*", &r));
+    EXPECT(!ota_resume_parse_range("bytes */100", &r));
+    EXPECT(!ota_resume_parse_range("bytes 0-100/100", &r));
+    EXPECT(!ota_resume_parse_range("bytes 50-49/100", &r));
+    EXPECT(!ota_resume_parse_range("bytes -5/100", &r));
+    EXPECT(!ota_resume_parse_range("bytes 0-99/100x", &r));
+    EXPECT(!ota_resume_parse_range("items 0-99/100", &r));
+    EXPECT(!ota_resume_parse_range("bytes 0-4294967296/4294967297", &r));
+}
+
+int main(void) {
+    srand(11);
+    test_parse_range();
+    test_conflicts();
+    test_random_disconnects();
+    return test_report("ota_resume");
+}
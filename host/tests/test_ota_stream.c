@@ -0,0 +1,240 @@
+/* --------------------------------------------------------------------------
+ * Host test for the compressed and delta OTA stream decoder
+ *
+ * Encodes synthetic firmware-like images on their own and against an edited
+ * base, then decodes them fed in random chunks and checks the output is the
+ * image byte for byte. Truncated streams must never complete, over-long ones
+ * and a delta against the wrong base must fail, and no corruption may make
+ * the decoder write past the image.
+ * -------------------------------------------------------------------------- */
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "test_util.h"
+#include "ota_encode.h"
+#include "ota_stream.h"
+#include "sha256.h"
+
+#define IMAGE_MAX   (96 * 1024)
+
+typedef struct {
+    uint8_t out[IMAGE_MAX];
+    size_t len;
+    const uint8_t *base;
+    size_t base_len;
+    const uint8_t *expect_base_sha;
+    bool overflow;
+} sink_t;
+
+static uint8_t image[IMAGE_MAX];
+static uint8_t base[IMAGE_MAX];
+static uint8_t stream[IMAGE_MAX + IMAGE_MAX / 16];
+
+/// Code-like words from a small vocabulary, strings and padding, like a .bin
+static size_t make_firmware(uint8_t *buf, size_t len, uint32_t seed) {
+    srand(seed);
+    static const char *strings[] = {"ESP-NOW send failed", "state %d -> %d", "nvs_get_u8", "Rebooting...",
+                                    "rssi %d dBm"};
+    uint32_t words[64];
+    for (int i = 0; i < 64; i++) {
+        words[i] = (uint32_t)rand();
+    }
+    size_t pos = 0;
+    while (pos < len) {
+        int kind = rand() % 10;
+        size_t n;
+        if (kind < 7) {
+            n = 4 * (1 + rand() % 16);
+            for (size_t i = 0; i < n && pos + i < len; i += 4) {
+                uint32_t w = words[rand() % 64] ^ (uint32_t)(rand() % 4);
+                for (size_t b = 0; b < 4 && pos + i + b < len; b++) {
+                    buf[pos + i + b] = (uint8_t)(w >> (8 * b));
+                }
+            }
+        } else if (kind < 9) {
+            const char *s = strings[rand() % 5];
+            n = strlen(s) + 1;
+            for (size_t i = 0; i < n && pos + i < len; i++) {
+                buf[pos + i] = (uint8_t)s[i];
+            }
+        } else {
+            n = 1 + rand() % 64;
+            for (size_t i = 0; i < n && pos + i < len; i++) {
+                buf[pos + i] = 0xff;
+            }
+        }
+        pos += n;
+    }
+    buf[0] = 0xe9;
+    return len;
+}
+
+/// The next build: a few bytes inserted early (shifting the rest), some patched
+static size_t edit_firmware(const uint8_t *from, size_t len, uint8_t *to, uint32_t seed) {
+    srand(seed);
+    size_t insert_at = len / 8 + (size_t)(rand() % 256);
+    size_t insert_len = 16 + (size_t)(rand() % 64);
+    memcpy(to, from, insert_at);
+    for (size_t i = 0; i < insert_len; i++) {
+        to[insert_at + i] = (uint8_t)rand();
+    }
+    memcpy(to + insert_at + insert_len, from + insert_at, len - insert_at);
+    size_t out_len = len + insert_len;
+    for (int i = 0; i < 40; i++) {
+        to[(size_t)rand() % out_len] = (uint8_t)rand();
+    }
+    return out_len;
+}
+
+static bool sink_header(void *ctx, const ota_stream_header_t *header) {
+    sink_t *sink = ctx;
+    return sink->expect_base_sha == NULL || memcmp(header->base_sha256, sink->expect_base_sha, 32) == 0;
+}
+
+static bool sink_data(void *ctx, const uint8_t *data, size_t len) {
+    sink_t *sink = ctx;
+    if (sink->len + len > sizeof(sink->out)) {
+        sink->overflow = true;
+        return false;
+    }
+    memcpy(sink->out + sink->len, data, len);
+    sink->len += len;
+    return true;
+}
+
+static bool sink_base(void *ctx, uint32_t offset, uint8_t *data, size_t len) {
+    sink_t *sink = ctx;
+    if (offset + len > sink->base_len) {
+        return false;
+    }
+    memcpy(data, sink->base + offset, len);
+    return true;
+}
+
+/// Feed the stream in random chunks of 1..max_chunk bytes
+static ota_stream_state_t decode(const uint8_t *data, size_t len, sink_t *sink, size_t max_chunk) {
+    static ota_stream_t s;
+    ota_stream_init(&s, sink_header, sink_data, sink_base, sink);
+    ota_stream_state_t state = OTA_STREAM_HEADER;
+    size_t pos = 0;
+    while (pos < len && state != OTA_STREAM_ERROR) {
+        size_t n = 1 + (size_t)rand() % max_chunk;
+        n = n < len - pos ? n : len - pos;
+        state = ota_stream_feed(&s, data + pos, n);
+        pos += n;
+    }
+    return state;
+}
+
+static void test_round_trip(void) {
+    static sink_t sink;
+    static const size_t chunks[] = {1, 7, 64, 1436, IMAGE_MAX};
+    for (uint32_t seed = 1; seed <= 8; seed++) {
+        size_t base_len = make_firmware(base, 40000 + seed * 3000, seed);
+        size_t image_len = edit_firmware(base, base_len, image, seed * 31);
+        for (int delta = 0; delta < 2; delta++) {
+            ota_encode_stats_t stats;
+            size_t len = ota_encode(image, image_len, base, delta ? base_len : 0, stream, sizeof(stream), &stats);
+            EXPECT(len > 0 && len < image_len);
+            EXPECT(stats.literal_bytes + stats.window_bytes + stats.base_bytes == image_len);
+            if (delta) {
+                EXPECT(len < image_len / 10);
+            }
+            for (size_t c = 0; c < sizeof(chunks) / sizeof(chunks[0]); c++) {
+                memset(&sink, 0, sizeof(sink));
+                sink.base = base;
+                sink.base_len = base_len;
+                EXPECT(decode(stream, len, &sink, chunks[c]) == OTA_STREAM_DONE);
+                EXPECT(sink.len == image_len && memcmp(sink.out, image, image_len) == 0);
+            }
+        }
+    }
+}
+
+static void test_incompressible(void) {
+    static sink_t sink;
+    srand(99);
+    for (size_t i = 0; i < 20000; i++) {
+        image[i] = (uint8_t)rand();
+    }
+    size_t len = ota_encode(image, 20000, NULL, 0, stream, sizeof(stream), NULL);
+    EXPECT(len > 0 && len <= ota_encode_bound(20000));
+    memset(&sink, 0, sizeof(sink));
+    EXPECT(decode(stream, len, &sink, 333) == OTA_STREAM_DONE);
+    EXPECT(sink.len == 20000 && memcmp(sink.out, image, 20000) == 0);
+}
+
+static void test_errors(void) {
+    static sink_t sink;
+    size_t base_len = make_firmware(base, 30000, 7);
+    size_t image_len = edit_firmware(base, base_len, image, 77);
+    size_t len = ota_encode(image, image_len, base, base_len, stream, sizeof(stream), NULL);
+
+    // Truncated: never DONE, and never more output than the image
+    for (size_t cut = 0; cut < len; cut += 1 + len / 50) {
+        memset(&sink, 0, sizeof(sink));
+        sink.base = base;
+        sink.base_len = base_len;
+        EXPECT(decode(stream, cut, &sink, 500) != OTA_STREAM_DONE);
+        EXPECT(sink.len <= image_len && !sink.overflow);
+    }
+
+    // A byte past the end of the image
+    stream[len] = 0;
+    memset(&sink, 0, sizeof(sink));
+    sink.base = base;
+    sink.base_len = base_len;
+    EXPECT(decode(stream, len + 1, &sink, 500) == OTA_STREAM_ERROR);
+
+    // Corrupt ops: an error or a wrong image, but bounded either way
+    srand(5);
+    for (int i = 0; i < 200; i++) {
+        size_t at = OTA_STREAM_HEADER_LEN + (size_t)rand() % (len - OTA_STREAM_HEADER_LEN);
+        uint8_t saved = stream[at];
+        stream[at] ^= (uint8_t)(1 + rand() % 255);
+        memset(&sink, 0, sizeof(sink));
+        sink.base = base;
+        sink.base_len = base_len;
+        ota_stream_state_t state = decode(stream, len, &sink, 700);
+        EXPECT(sink.len <= image_len && !sink.overflow);
+        EXPECT(state != OTA_STREAM_DONE || sink.len == image_len);
+        stream[at] = saved;
+    }
+
+    // Header: bad magic, version, window
+    static const size_t header_bytes[] = {0, 4, 6};
+    for (size_t i = 0; i < sizeof(header_bytes) / sizeof(header_bytes[0]); i++) {
+        stream[header_bytes[i]] ^= 0x20;
+        memset(&sink, 0, sizeof(sink));
+        EXPECT(decode(stream, len, &sink, 64) == OTA_STREAM_ERROR);
+        EXPECT(sink.len == 0);
+        stream[header_bytes[i]] ^= 0x20;
+    }
+
+    // A delta made against another image is refused before any output
+    uint8_t running_sha[SHA256_DIGEST_LEN];
+    sha256_ctx_t ctx;
+    sha256_init(&ctx);
+    sha256_update(&ctx, image, image_len);
+    sha256_final(&ctx, running_sha);
+    memset(&sink, 0, sizeof(sink));
+    sink.base = image;
+    sink.base_len = image_len;
+    sink.expect_base_sha = running_sha;
+    EXPECT(decode(stream, len, &sink, 64) == OTA_STREAM_ERROR);
+    EXPECT(sink.len == 0);
+
+    // Base copies in a stream without the delta flag
+    stream[5] = 0;
+    memset(&sink, 0, sizeof(sink));
+    EXPECT(decode(stream, len, &sink, 64) == OTA_STREAM_ERROR);
+}
+
+int main(void) {
+    test_round_trip();
+    test_incompressible();
+    test_errors();
+    return test_report("ota_stream");
+}
@@ -0,0 +1,266 @@
+/* --------------------------------------------------------------------------
+ * Host test for the ESP-NOW firmware transfer protocol
+ *
+ * Runs a source and a sink against each other over an in-memory link that
+ * loses, and in one case duplicates, packets at random, and checks the sink
+ * writes exactly the image and both ends agree it is complete. Also covers
+ * a wrong SHA-256, a sink that refuses the image, offering the same image
+ * again halfway (resumes), a source that hears nothing (gives up), and a
+ * detached signature carried after the image.
+ * -------------------------------------------------------------------------- */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "test_util.h"
+#include "ota_xfer.h"
+
+#define IMAGE_MAX   (64 * 1024)
+#define LINK_SLOTS  256
+#define STEP_US     1000
+
+typedef struct {
+    uint8_t data[sizeof(ota_xfer_data_t)];
+    size_t len;
+} packet_t;
+
+/* One direction of the link: a FIFO that drops loss_pct of what is sent */
+typedef struct {
+    packet_t slots[LINK_SLOTS];
+    uint32_t head;
+    uint32_t tail;
+    int loss_pct;
+    int dup_pct;
+} link_t;
+
+typedef struct {
+    uint8_t image[IMAGE_MAX];
+    uint32_t image_len;
+    uint8_t out[IMAGE_MAX];
+    uint32_t out_len;
+    bool refuse;
+    bool write_fails_at_half;
+    link_t to_sink;
+    link_t to_source;
+} harness_t;
+
+static harness_t h;
+
+static void link_push(link_t *link, const void *pkt, size_t len) {
+    int copies = rand() % 100 < link->dup_pct ? 2 : 1;
+    for (int i = 0; i < copies; i++) {
+        if (rand() % 100 < link->loss_pct || link->tail - link->head == LINK_SLOTS) {
+            continue;
+        }
+        packet_t *p = &link->slots[link->tail++ % LINK_SLOTS];
+        memcpy(p->data, pkt, len);
+        p->len = len;
+    }
+}
+
+static bool source_send(void *ctx, const void *pkt, size_t len) {
+    link_push(&h.to_sink, pkt, len);
+    return true;
+}
+
+static bool sink_send(void *ctx, const void *pkt, size_t len) {
+    link_push(&h.to_source, pkt, len);
+    return true;
+}
+
+static bool source_read(void *ctx, uint32_t offset, uint8_t *data, size_t len) {
+    memcpy(data, h.image + offset, len);
+    return true;
+}
+
+static bool sink_begin(void *ctx, uint32_t image_size) {
+    h.out_len = 0;
+    return !h.refuse && image_size <= IMAGE_MAX;
+}
+
+static bool sink_write(void *ctx, const uint8_t *data, size_t len) {
+    if (h.write_fails_at_half && h.out_len >= h.image_len / 2) {
+        return false;
+    }
+    memcpy(h.out + h.out_len, data, len);
+    h.out_len += (uint32_t)len;
+    return true;
+}
+
+static void make_image(uint32_t len, uint8_t sha[SHA256_DIGEST_LEN]) {
+    h.image_len = len;
+    for (uint32_t i = 0; i < len; i++) {
+        h.image[i] = (uint8_t)rand();
+    }
+    sha256_ctx_t ctx;
+    sha256_init(&ctx);
+    sha256_update(&ctx, h.image, len);
+    sha256_final(&ctx, sha);
+}
+
+static void reset_links(int loss_pct, int dup_pct) {
+    memset(&h.to_sink, 0, sizeof(h.to_sink));
+    memset(&h.to_source, 0, sizeof(h.to_source));
+    h.to_sink.loss_pct = h.to_source.loss_pct = loss_pct;
+    h.to_sink.dup_pct = dup_pct;
+}
+
+/// Step both ends until the source finishes or max_us passes; returns the end time
+static int64_t run(ota_xfer_tx_t *tx, ota_xfer_rx_t *rx, int64_t now, int64_t max_us) {
+    int64_t end = now + max_us;
+    for (; now < end; now += STEP_US) {
+        if (ota_xfer_tx_poll(tx, now) >= OTA_XFER_TX_DONE) {
+            break;
+        }
+        while (h.to_sink.head != h.to_sink.tail) {
+            packet_t *p = &h.to_sink.slots[h.to_sink.head++ % LINK_SLOTS];
+            ota_xfer_rx_feed(rx, p->data, p->len, now);
+        }
+        ota_xfer_rx_poll(rx, now);
+        while (h.to_source.head != h.to_source.tail) {
+            packet_t *p = &h.to_source.slots[h.to_source.head++ % LINK_SLOTS];
+            if (ota_xfer_is_packet(p->data, p->len) && p->data[0] == OTA_XFER_ACK) {
+                ota_xfer_tx_on_ack(tx, (const ota_xfer_ack_t *)p->data, now);
+            }
+        }
+    }
+    return now;
+}
+
+static void test_lossy_links(void) {
+    static ota_xfer_tx_t tx;
+    static ota_xfer_rx_t rx;
+    static const int losses[] = {0, 1, 5, 20, 40};
+    static const uint32_t sizes[] = {1, OTA_XFER_CHUNK, OTA_XFER_CHUNK * 33 + 17, 50000};
+    uint8_t sha[SHA256_DIGEST_LEN];
+    for (size_t l = 0; l < sizeof(losses) / sizeof(losses[0]); l++) {
+        for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+            make_image(sizes[s], sha);
+            reset_links(losses[l], l == 2 ? 10 : 0);
+            ota_xfer_tx_init(&tx, h.image_len, sha, NULL, 0, source_send, source_read, NULL, 0);
+            ota_xfer_rx_init(&rx, sink_begin, sink_write, sink_send, NULL);
+            run(&tx, &rx, 0, 600000000LL);
+            EXPECT(tx.state == OTA_XFER_TX_DONE);
+            EXPECT(rx.status == OTA_XFER_STATUS_COMPLETE);
+            EXPECT(h.out_len == h.image_len && memcmp(h.out, h.image, h.image_len) == 0);
+            if (losses[l] == 0) {
+                EXPECT(tx.stats.data_frames == tx.chunks);
+            }
+        }
+    }
+}
+
+static void test_failures(void) {
+    static ota_xfer_tx_t tx;
+    static ota_xfer_rx_t rx;
+    uint8_t sha[SHA256_DIGEST_LEN];
+
+    // Offered digest does not match the bytes sent
+    make_image(10000, sha);
+    sha[5] ^= 1;
+    reset_links(0, 0);
+    ota_xfer_tx_init(&tx, h.image_len, sha, NULL, 0, source_send, source_read, NULL, 0);
+    ota_xfer_rx_init(&rx, sink_begin, sink_write, sink_send, NULL);
+    run(&tx, &rx, 0, 10000000);
+    EXPECT(tx.state == OTA_XFER_TX_FAILED && rx.status == OTA_XFER_STATUS_FAILED);
+
+    // Sink refuses the image: nothing is sent after the offer
+    make_image(10000, sha);
+    h.refuse = true;
+    ota_xfer_tx_init(&tx, h.image_len, sha, NULL, 0, source_send, source_read, NULL, 0);
+    ota_xfer_rx_init(&rx, sink_begin, sink_write, sink_send, NULL);
+    run(&tx, &rx, 0, 10000000);
+    EXPECT(tx.state == OTA_XFER_TX_FAILED && tx.stats.data_frames == 0);
+    h.refuse = false;
+
+    // A write fails halfway
+    h.write_fails_at_half = true;
+    ota_xfer_tx_init(&tx, h.image_len, sha, NULL, 0, source_send, source_read, NULL, 0);
+    ota_xfer_rx_init(&rx, sink_begin, sink_write, sink_send, NULL);
+    run(&tx, &rx, 0, 10000000);
+    EXPECT(tx.state == OTA_XFER_TX_FAILED && rx.status == OTA_XFER_STATUS_FAILED);
+    h.write_fails_at_half = false;
+
+    // Nobody answers: the source gives up after OTA_XFER_GIVE_UP_US
+    ota_xfer_tx_init(&tx, h.image_len, sha, NULL, 0, source_send, source_read, NULL, 0);
+    ota_xfer_rx_init(&rx, sink_begin, sink_write, sink_send, NULL);
+    reset_links(100, 0);
+    int64_t end = run(&tx, &rx, 0, 60000000);
+    EXPECT(tx.state == OTA_XFER_TX_FAILED);
+    EXPECT(end > OTA_XFER_GIVE_UP_US && end < OTA_XFER_GIVE_UP_US + 2 * OTA_XFER_OFFER_US);
+}
+
+static void test_resume(void) {
+    static ota_xfer_tx_t tx;
+    static ota_xfer_rx_t rx;
+    uint8_t sha[SHA256_DIGEST_LEN];
+    make_image(50000, sha);
+    reset_links(0, 0);
+    ota_xfer_tx_init(&tx, h.image_len, sha, NULL, 0, source_send, source_read, NULL, 0);
+    ota_xfer_rx_init(&rx, sink_begin, sink_write, sink_send, NULL);
+
+    // Source stops halfway, say the receiver left the sender OTA state
+    int64_t now = 0;
+    while (rx.next < tx.chunks / 2) {
+        now = run(&tx, &rx, now, STEP_US) + STEP_US;
+    }
+    uint32_t written = rx.next;
+    ota_xfer_tx_init(&tx, h.image_len, sha, NULL, 0, source_send, source_read, NULL, now);
+    reset_links(0, 0);
+    run(&tx, &rx, now, 60000000);
+    EXPECT(tx.state == OTA_XFER_TX_DONE && rx.status == OTA_XFER_STATUS_COMPLETE);
+    EXPECT(memcmp(h.out, h.image, h.image_len) == 0);
+    EXPECT(tx.stats.data_frames <= tx.chunks - written + OTA_XFER_WINDOW);
+}
+
+static void test_signature(void) {
+    static ota_xfer_tx_t tx;
+    static ota_xfer_rx_t rx;
+    static const uint32_t sizes[] = {1000, OTA_XFER_CHUNK * 20, OTA_XFER_CHUNK * 20 - 1};
+    static const size_t sig_lens[] = {1, 72, OTA_XFER_CHUNK, OTA_XFER_SIG_MAX};
+    uint8_t sha[SHA256_DIGEST_LEN];
+    uint8_t sig[OTA_XFER_SIG_MAX + 1];
+    for (size_t i = 0; i < sizeof(sig); i++) {
+        sig[i] = (uint8_t)rand();
+    }
+
+    // The sink writes and hashes the image alone and keeps the signature whole
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+        for (size_t g = 0; g < sizeof(sig_lens) / sizeof(sig_lens[0]); g++) {
+            make_image(sizes[s], sha);
+            reset_links(5, 0);
+            ota_xfer_tx_init(&tx, h.image_len, sha, sig, sig_lens[g], source_send, source_read, NULL, 0);
+            ota_xfer_rx_init(&rx, sink_begin, sink_write, sink_send, NULL);
+            run(&tx, &rx, 0, 60000000);
+            EXPECT(tx.state == OTA_XFER_TX_DONE && rx.status == OTA_XFER_STATUS_COMPLETE);
+            EXPECT(h.out_len == h.image_len && memcmp(h.out, h.image, h.image_len) == 0);
+            EXPECT(rx.sig_len == sig_lens[g] && memcmp(rx.sig, sig, sig_lens[g]) == 0);
+        }
+    }
+
+    // The same image offered with another signature starts over
+    make_image(10000, sha);
+    reset_links(0, 0);
+    ota_xfer_tx_init(&tx, h.image_len, sha, sig, 72, source_send, source_read, NULL, 0);
+    ota_xfer_rx_init(&rx, sink_begin, sink_write, sink_send, NULL);
+    int64_t now = 0;
+    while (rx.next < tx.chunks / 2) {
+        now = run(&tx, &rx, now, STEP_US) + STEP_US;
+    }
+    ota_xfer_tx_init(&tx, h.image_len, sha, sig + 1, 64, source_send, source_read, NULL, now);
+    run(&tx, &rx, now, 60000000);
+    EXPECT(rx.status == OTA_XFER_STATUS_COMPLETE && rx.sig_len == 64 && memcmp(rx.sig, sig + 1, 64) == 0);
+
+    // Too long to carry: never offered
+    ota_xfer_tx_init(&tx, h.image_len, sha, sig, OTA_XFER_SIG_MAX + 1, source_send, source_read, NULL, 0);
+    EXPECT(tx.state == OTA_XFER_TX_FAILED);
+}
+
+int main(void) {
+    srand(11);
+    test_lossy_links();
+    test_failures();
+    test_resume();
+    test_signature();
+    return test_report("ota_xfer");
+}
@@ -0,0 +1,137 @@
+/* --------------------------------------------------------------------------
+ * Host test for the upgrade from single-sender firmware
+ *
+ * That firmware kept one rolling code, in NVS ("exp_roll") or in a journal
+ * of the format before records had keys, and no sender MAC. After the
+ * upgrade the first force open pairs as sender 0 only with a code past the
+ * old one, keeps that code across a reboot, and a receiver with nothing
+ * stored still pairs its first sender from any code.
+ * -------------------------------------------------------------------------- */
+#include <stdio.h>
+#include <string.h>
+
+#include "test_util.h"
+#include "esp_timer.h"
+#include "host_sim.h"
+#include "receiver_host.h"
+#include "espnow_config.h"
+#include "event_processing.h"
+#include "sender_table.h"
+#include "nvs_config.h"
+#include "rc_journal.h"
+#include "nvs.h"
+
+#define JOURNAL_SIZE    (4 * RC_JOURNAL_SECTOR_SIZE)
+#define V1_MAGIC        0x4A435252UL    // "RRCJ", the format before records had keys
+
+static void force_open(uint32_t rolling_code) {
+    espnow_data_t pkt = {
+        .version = SUPPORTED_PROTOCOL_VERSION,
+        .rolling_code = rolling_code,
+        .command = CMD_FORCE_OPEN,
+    };
+    wifi_pkt_rx_ctrl_t rx_ctrl = {.rssi = -60};
+    esp_now_recv_info_t info = {.src_addr = receiver_host_sender_mac, .rx_ctrl = &rx_ctrl};
+    receive_cb(&info, (const uint8_t *)&pkt, sizeof(pkt));
+    host_clock_advance_us(250000);
+    receiver_host_event_pass();
+}
+
+/* Power cut and boot: RAM state is gone, NVS and flash stay */
+static void boot(void) {
+    receiver_host_init();
+    load_paired_senders();
+}
+
+static void set_legacy_nvs_code(uint32_t code) {
+    nvs_handle_t nvs;
+    nvs_open("sec", NVS_READWRITE, &nvs);
+    nvs_set_u32(nvs, "exp_roll", code);
+    nvs_commit(nvs);
+    nvs_close(nvs);
+}
+
+/* Old-format sector: header, then 8-byte records {value, ~value} */
+static void write_v1_sector(uint32_t sector, uint32_t sequence, const uint32_t *values, uint32_t count) {
+    const esp_partition_t *part = esp_partition_find_first(ESP_PARTITION_TYPE_DATA,
+                                                           RC_JOURNAL_PARTITION_SUBTYPE,
+                                                           RC_JOURNAL_PARTITION_LABEL);
+    uint32_t base = sector * RC_JOURNAL_SECTOR_SIZE;
+    for (uint32_t i = 0; i < count; i++) {
+        uint32_t rec[2] = {values[i], ~values[i]};
+        esp_partition_write(part, base + 16 + i * sizeof(rec), rec, sizeof(rec));
+    }
+    uint32_t hdr[4] = {V1_MAGIC, sequence, ~sequence, UINT32_MAX};
+    esp_partition_write(part, base, hdr, sizeof(hdr));
+}
+
+static uint32_t sender0_highest(void) {
+    const sender_t *s = sender_table_get(0);
+    return s != NULL ? s->replay.highest : 0;
+}
+
+static void test_nvs_upgrade(void) {
+    host_sim_reset();
+    host_clock_set_us(1000000);
+    set_legacy_nvs_code(5000);
+    boot();
+    EXPECT(sender_table_count() == 0);
+
+    force_open(4990);                           // Recorded before the upgrade
+    force_open(5000);
+    EXPECT(sender_table_count() == 0);
+    force_open(5001);
+    EXPECT(sender_table_count() == 1 && sender_table_find(receiver_host_sender_mac) == 0);
+    EXPECT(sender0_highest() == 5001);
+
+    boot();                                     // Before the periodic NVS save
+    EXPECT(sender_table_count() == 1 && sender0_highest() == 5000);
+    force_open(4999);
+    EXPECT(sender0_highest() == 5000);
+}
+
+static void test_journal_upgrade(void) {
+    host_sim_reset();
+    host_clock_set_us(1000000);
+    host_flash_create(RC_JOURNAL_PARTITION_LABEL, RC_JOURNAL_PARTITION_SUBTYPE, JOURNAL_SIZE);
+    const uint32_t older[] = {1064, 1128};
+    const uint32_t newest[] = {8936, 9000};
+    write_v1_sector(2, 7, older, 2);
+    write_v1_sector(3, 8, newest, 2);
+    uint32_t torn = 9064;                       // Value written, check not: power cut
+    esp_partition_write(esp_partition_find_first(ESP_PARTITION_TYPE_DATA, RC_JOURNAL_PARTITION_SUBTYPE,
+                                                 RC_JOURNAL_PARTITION_LABEL),
+                        3 * RC_JOURNAL_SECTOR_SIZE + 16 + 2 * 8, &torn, sizeof(torn));
+    set_legacy_nvs_code(100);                   // Stale, the journal replaced it
+    boot();
+
+    uint32_t code = 0;
+    EXPECT(rc_journal_get(&rolling_code_journal, RC_JOURNAL_KEY_OWN, &code) && code == 9000);
+    force_open(8990);
+    EXPECT(sender_table_count() == 0);
+    force_open(9001);
+    EXPECT(sender_table_count() == 1 && sender0_highest() == 9001);
+
+    boot();                                     // Journal key 0 now holds the reservation for 9001
+    EXPECT(sender_table_count() == 1 && sender0_highest() == 9001 + RC_JOURNAL_RESERVE);
+    force_open(9001);
+    EXPECT(sender0_highest() == 9001 + RC_JOURNAL_RESERVE);
+    force_open(9002 + RC_JOURNAL_RESERVE);
+    EXPECT(sender0_highest() == 9002 + RC_JOURNAL_RESERVE);
+}
+
+static void test_fresh_receiver(void) {
+    host_sim_reset();
+    host_clock_set_us(1000000);
+    host_flash_create(RC_JOURNAL_PARTITION_LABEL, RC_JOURNAL_PARTITION_SUBTYPE, JOURNAL_SIZE);
+    boot();
+    force_open(3);
+    EXPECT(sender_table_count() == 1 && sender0_highest() == 3);
+}
+
+int main(void) {
+    test_nvs_upgrade();
+    test_journal_upgrade();
+    test_fresh_receiver();
+    return test_report("pairing_upgrade");
+}
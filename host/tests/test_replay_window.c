@@ -0,0 +1,134 @@
+/* --------------------------------------------------------------------------
+ * Host test for the anti-replay window
+ *
+ * Unit cases for replay_window.c around the window edge and the 32-bit wrap,
+ * a randomised comparison against a reference set of accepted codes, and the
+ * receiver pipeline accepting a reordered ping exactly once.
+ * -------------------------------------------------------------------------- */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "test_util.h"
+#include "replay_window.h"
+#include "esp_timer.h"
+#include "host_sim.h"
+#include "receiver_host.h"
+#include "espnow_config.h"
+#include "event_processing.h"
+#include "sender_table.h"
+
+static void test_basic(void) {
+    replay_window_t w;
+    replay_window_init(&w, 100);
+    EXPECT(!replay_window_accept(&w, 100));     // Persisted code counts as seen
+    EXPECT(!replay_window_accept(&w, 99));
+    EXPECT(replay_window_accept(&w, 101));
+    EXPECT(!replay_window_accept(&w, 101));     // Duplicate
+    EXPECT(replay_window_accept(&w, 105));
+    EXPECT(replay_window_accept(&w, 103));      // Reordered, accepted once
+    EXPECT(!replay_window_accept(&w, 103));
+    EXPECT(replay_window_accept(&w, 104));
+    EXPECT(replay_window_accept(&w, 102));
+    EXPECT(w.highest == 105);
+}
+
+static void test_window_edge(void) {
+    replay_window_t w;
+    replay_window_init(&w, 1000);
+    EXPECT(replay_window_accept(&w, 1000 + REPLAY_WINDOW_BITS));
+    EXPECT(!replay_window_accept(&w, 1000));    // Just outside: too old
+    EXPECT(replay_window_accept(&w, 1001));     // Oldest slot inside the window
+    EXPECT(!replay_window_accept(&w, 1001));
+
+    /* A jump larger than the window forgets everything behind it */
+    EXPECT(replay_window_accept(&w, 5000));
+    EXPECT(replay_window_accept(&w, 4999));
+    EXPECT(!replay_window_accept(&w, 5000 - REPLAY_WINDOW_BITS));
+    EXPECT(replay_window_accept(&w, 5000 - REPLAY_WINDOW_BITS + 1));
+}
+
+static void test_wraparound(void) {
+    replay_window_t w;
+    replay_window_init(&w, UINT32_MAX - 10);
+    EXPECT(replay_window_accept(&w, 5));        // Ahead across the wrap
+    EXPECT(w.highest == 5);
+    EXPECT(replay_window_accept(&w, UINT32_MAX - 2));
+    EXPECT(replay_window_accept(&w, UINT32_MAX));
+    EXPECT(replay_window_accept(&w, 0));
+    EXPECT(!replay_window_accept(&w, UINT32_MAX));
+    EXPECT(!replay_window_accept(&w, 0));
+    EXPECT(!replay_window_accept(&w, UINT32_MAX - 10)); // Seen before the wrap
+    EXPECT(replay_window_accept(&w, 3));
+
+    /* Exactly half the code space away counts as behind, and far too old */
+    replay_window_init(&w, 1000);
+    EXPECT(!replay_window_check(&w, 1000 + 0x80000000u));
+    replay_window_update(&w, 1000 + 0x80000000u);
+    EXPECT(w.highest == 1000 && w.seen == UINT64_MAX);
+}
+
+/* Random traffic around the wrap against a reference set of accepted codes */
+static void test_random_against_reference(void) {
+    enum { SPAN = 4096 };
+    static bool accepted[SPAN];
+    memset(accepted, 0, sizeof(accepted));
+    uint32_t base = UINT32_MAX - SPAN / 2;
+    replay_window_t w;
+    replay_window_init(&w, base);
+    uint32_t highest = 0; // Offset from base
+
+    srand(7);
+    for (uint32_t next = 1; next < SPAN - 8; next++) {
+        /* Send `next` plus a late or repeated copy of something recent */
+        uint32_t back = (uint32_t)(rand() % 80);
+        uint32_t offsets[2] = {next, back < next ? next - back : next};
+        for (int i = 0; i < 2; i++) {
+            uint32_t off = offsets[i];
+            bool expect = off > highest ||
+                          (highest - off < REPLAY_WINDOW_BITS && off > 0 && !accepted[off]);
+            bool got = replay_window_accept(&w, base + off);
+            EXPECT(got == expect);
+            if (got) {
+                accepted[off] = true;
+                if (off > highest) {
+                    highest = off;
+                }
+            }
+        }
+    }
+}
+
+/* Pipeline: a reordered ping reaches process_event() once */
+static void test_receiver_reorder(void) {
+    host_sim_reset();
+    host_clock_set_us(1000000);
+    receiver_host_init();
+
+    const uint32_t codes[] = {5, 3, 4, 3, 5, 6};
+    const uint8_t counts[] = {1, 2, 3, 3, 3, 4};
+    for (size_t i = 0; i < sizeof(codes) / sizeof(codes[0]); i++) {
+        espnow_data_t pkt = {
+            .version = SUPPORTED_PROTOCOL_VERSION,
+            .rolling_code = codes[i],
+            .command = CMD_PING,
+        };
+        wifi_pkt_rx_ctrl_t rx_ctrl = {.rssi = -90};
+        esp_now_recv_info_t info = {.src_addr = receiver_host_sender_mac, .rx_ctrl = &rx_ctrl};
+        receive_cb(&info, (const uint8_t *)&pkt, sizeof(pkt));
+        host_clock_advance_us(1000);
+        receiver_host_event_pass();
+        EXPECT(sender_table_get(0)->rssi.count == counts[i]);
+    }
+    EXPECT(sender_table_get(0)->replay.highest == 6);
+}
+
+int main(void) {
+    test_basic();
+    test_window_edge();
+    test_wraparound();
+    test_random_against_reference();
+    test_receiver_reorder();
+
+    return test_report("replay window");
+}
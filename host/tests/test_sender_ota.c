@@ -0,0 +1,220 @@
+/* --------------------------------------------------------------------------
+ * Host test for sending sender firmware from the receiver
+ *
+ * Runs the receiver pipeline with the sender OTA switch on against a sender
+ * modelled by an ota_xfer sink that pings like a paired sender, over the
+ * host ESP-NOW stand-in (peers, send callbacks). The sender only listens
+ * after a few OTA requests, longer than the receiver offers for at a time.
+ * Covers a transfer after an OTA session, which deinitialises ESP-NOW, an
+ * OTA session in the middle of a transfer, a spare partition holding
+ * receiver firmware, and the signature uploaded with the image going along
+ * with it, but not one left from another image.
+ * -------------------------------------------------------------------------- */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "test_util.h"
+#include "esp_timer.h"
+#include "host_sim.h"
+#include "receiver_host.h"
+#include "espnow_config.h"
+#include "event_processing.h"
+#include "state_machine.h"
+#include "ota_xfer.h"
+#include "ota_signature.h"
+#include "nvs.h"
+
+#define IMAGE_LEN       (48 * 1024 + 100)
+#define SENDER_PROJECT  "Gate_Sender"
+#define STEP_US         1000
+#define PING_PERIOD_US  250000
+#define LINK_SLOTS      64
+#define OTA_REQUESTS    5           // The sender listens after this many, as espnow_comm.c counts them
+
+typedef struct {
+    uint8_t data[sizeof(ota_xfer_data_t)];
+    size_t len;
+} packet_t;
+
+/* Sender side: the frames on their way to it, and what it wrote */
+static struct {
+    packet_t link[LINK_SLOTS];
+    uint32_t head;
+    uint32_t tail;
+    uint32_t ota_requests;
+    uint32_t rolling_code;
+    int64_t next_ping_us;
+    uint8_t out[IMAGE_LEN];
+    uint32_t out_len;
+} sender;
+
+static uint8_t image[IMAGE_LEN];
+static ota_xfer_rx_t sink;
+
+static void radio_hook(const uint8_t *peer_addr, const uint8_t *data, size_t len) {
+    if (peer_addr != NULL && memcmp(peer_addr, receiver_host_sender_mac, ESP_NOW_ETH_ALEN) != 0) {
+        return;
+    }
+    if (len == sizeof(espnow_data_t) && ((const espnow_data_t *)data)->command == CMD_SENDER_OTA) {
+        sender.ota_requests++;
+    }
+    if (sender.ota_requests >= OTA_REQUESTS && ota_xfer_is_packet(data, len) &&
+        sender.tail - sender.head < LINK_SLOTS) {
+        packet_t *p = &sender.link[sender.tail++ % LINK_SLOTS];
+        memcpy(p->data, data, len);
+        p->len = len;
+    }
+}
+
+static void deliver_to_receiver(const void *data, size_t len) {
+    wifi_pkt_rx_ctrl_t rx_ctrl = {.rssi = -70};
+    esp_now_recv_info_t info = {.src_addr = receiver_host_sender_mac, .rx_ctrl = &rx_ctrl};
+    receive_cb(&info, data, (int)len);
+}
+
+static bool sink_send(void *ctx, const void *pkt, size_t len) {
+    deliver_to_receiver(pkt, len);
+    return true;
+}
+
+static bool sink_begin(void *ctx, uint32_t image_size) {
+    sender.out_len = 0;
+    return image_size <= sizeof(sender.out);
+}
+
+static bool sink_write(void *ctx, const uint8_t *data, size_t len) {
+    memcpy(sender.out + sender.out_len, data, len);
+    sender.out_len += (uint32_t)len;
+    return true;
+}
+
+static void setup(const char *spare_project) {
+    host_sim_reset();
+    host_clock_set_us(1000000);
+    receiver_host_init();
+    host_espnow_set_send_hook(radio_hook);
+    memset(&sender, 0, sizeof(sender));
+    for (uint32_t i = 0; i < IMAGE_LEN; i++) {
+        image[i] = (uint8_t)rand();
+    }
+    host_ota_set_spare_image(image, IMAGE_LEN, spare_project);
+    ota_xfer_rx_init(&sink, sink_begin, sink_write, sink_send, NULL);
+}
+
+/* What ota_setup() and ota_teardown() do to ESP-NOW around an OTA session */
+static void ota_session(void) {
+    esp_now_deinit();
+    espnow_attach();
+}
+
+/* One millisecond of both ends; the sender pings every PING_PERIOD_US */
+static void step(void) {
+    host_clock_advance_us(STEP_US);
+    int64_t now = esp_timer_get_time();
+    if (now >= sender.next_ping_us) {
+        espnow_data_t ping = {
+            .version = SUPPORTED_PROTOCOL_VERSION,
+            .rolling_code = ++sender.rolling_code,
+            .command = CMD_PING,
+        };
+        deliver_to_receiver(&ping, sizeof(ping));
+        sender.next_ping_us = now + PING_PERIOD_US;
+    }
+    receiver_host_event_pass();
+    host_espnow_complete_sends(ESP_NOW_SEND_SUCCESS);
+    while (sender.head != sender.tail) {
+        packet_t *p = &sender.link[sender.head++ % LINK_SLOTS];
+        ota_xfer_rx_feed(&sink, p->data, p->len, now);
+    }
+    ota_xfer_rx_poll(&sink, now);
+}
+
+/* Step until the sender holds the image or max_us passes */
+static void run(int64_t max_us) {
+    int64_t end = esp_timer_get_time() + max_us;
+    while (sink.status == OTA_XFER_STATUS_RECEIVING && esp_timer_get_time() < end) {
+        step();
+    }
+}
+
+static void test_after_ota_session(void) {
+    setup(SENDER_PROJECT);
+    step();
+    EXPECT(host_espnow_peer_count() == 1);     // Registered to reply to the first ping
+
+    ota_session();
+    EXPECT(host_espnow_peer_count() == 0);
+    state_machine_set_state(STATE_SENDER_OTA);
+    run(30000000);
+    EXPECT(sender.ota_requests == OTA_REQUESTS);   // None after the sender answered
+    EXPECT(sink.status == OTA_XFER_STATUS_COMPLETE);
+    EXPECT(sender.out_len == IMAGE_LEN && memcmp(sender.out, image, IMAGE_LEN) == 0);
+    EXPECT(host_espnow_peer_count() == 1);
+}
+
+static void test_ota_session_mid_transfer(void) {
+    setup(SENDER_PROJECT);
+    state_machine_set_state(STATE_SENDER_OTA);
+    int64_t end = esp_timer_get_time() + 30000000;
+    while ((!sink.active || sink.next < sink.chunks / 2) && esp_timer_get_time() < end) {
+        step();
+    }
+    EXPECT(sink.active && sink.next >= sink.chunks / 2);
+    uint32_t written = sink.next;
+    ota_session();                              // Frame in flight, its send callback never comes
+    run(30000000);
+    EXPECT(sink.status == OTA_XFER_STATUS_COMPLETE);
+    EXPECT(memcmp(sender.out, image, IMAGE_LEN) == 0);
+    EXPECT(sink.stats.chunks < sink.chunks + (sink.chunks - written));
+}
+
+static void test_receiver_image_not_sent(void) {
+    setup(HOST_RUNNING_PROJECT);
+    state_machine_set_state(STATE_SENDER_OTA);
+    run(3000000);
+    EXPECT(!sink.active);
+}
+
+/* What ota_module.c keeps for a sender image uploaded with a signature */
+static void store_signature(const uint8_t *data, uint32_t len, const uint8_t *sig, size_t sig_len) {
+    uint8_t blob[SHA256_DIGEST_LEN + OTA_SIGNATURE_MAX];
+    sha256_ctx_t sha;
+    sha256_init(&sha);
+    sha256_update(&sha, data, len);
+    sha256_final(&sha, blob);
+    memcpy(blob + SHA256_DIGEST_LEN, sig, sig_len);
+    nvs_handle_t nvs;
+    nvs_open(OTA_SENDER_SIG_NAMESPACE, NVS_READWRITE, &nvs);
+    nvs_set_blob(nvs, OTA_SENDER_SIG_KEY, blob, SHA256_DIGEST_LEN + sig_len);
+    nvs_close(nvs);
+}
+
+static void test_signature_sent(void) {
+    uint8_t sig[72];
+    for (size_t i = 0; i < sizeof(sig); i++) {
+        sig[i] = (uint8_t)rand();
+    }
+    setup(SENDER_PROJECT);
+    store_signature(image, IMAGE_LEN, sig, sizeof(sig));
+    state_machine_set_state(STATE_SENDER_OTA);
+    run(30000000);
+    EXPECT(sink.status == OTA_XFER_STATUS_COMPLETE);
+    EXPECT(sink.sig_len == sizeof(sig) && memcmp(sink.sig, sig, sizeof(sig)) == 0);
+
+    // A signature for the image uploaded before is not sent with this one
+    setup(SENDER_PROJECT);
+    store_signature(image, IMAGE_LEN - 1, sig, sizeof(sig));
+    state_machine_set_state(STATE_SENDER_OTA);
+    run(30000000);
+    EXPECT(sink.status == OTA_XFER_STATUS_COMPLETE && sink.sig_len == 0);
+}
+
+int main(void) {
+    srand(7);
+    test_after_ota_session();
+    test_ota_session_mid_transfer();
+    test_receiver_image_not_sent();
+    test_signature_sent();
+    return test_report("sender_ota");
+}
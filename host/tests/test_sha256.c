@@ -0,0 +1,171 @@
+/* --------------------------------------------------------------------------
+ * Host test for the incremental SHA-256 (software backend)
+ *
+ * Checks the FIPS 180-4 example digests, that any split of a message into
+ * updates gives the one-shot digest, and that hashing the firmware part as
+ * the OTA pipeline does (parsed from randomly chunked uploads, then hashed a
+ * pipeline buffer at a time) gives the digest of the image itself.
+ * -------------------------------------------------------------------------- */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "test_util.h"
+#include "multipart.h"
+#include "ota_pipeline.h"
+#include "sha256.h"
+
+#define IMAGE_MAX   (48 * 1024)
+
+static void to_hex(const uint8_t digest[SHA256_DIGEST_LEN], char *hex) {
+    for (int i = 0; i < SHA256_DIGEST_LEN; i++) {
+        sprintf(hex + 2 * i, "%02x", digest[i]);
+    }
+}
+
+static void digest_of(const void *data, size_t len, uint8_t digest[SHA256_DIGEST_LEN]) {
+    sha256_ctx_t ctx;
+    sha256_init(&ctx);
+    sha256_update(&ctx, data, len);
+    sha256_final(&ctx, digest);
+}
+
+static void test_vectors(void) {
+    static const struct {
+        const char *msg;
+        const char *hex;
+    } vectors[] = {
+        {"", "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855"},
+        {"abc", "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad"},
+        // 56 bytes: the length no longer fits the last block
+        {"abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq",
+         "248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1"},
+        {"abcdefghbcdefghicdefghijdefghijkefghijklfghijklmghijklmnhijklmnoijklmnopjklmnopqklmnopqrlmnopqrs"
+         "mnopqrstnopqrstu",
+         "cf5b16a778af8380036ce59e7b0492370b249b11e8f07a51afac45037afee9d1"},
+    };
+    for (size_t i = 0; i < sizeof(vectors) / sizeof(vectors[0]); i++) {
+        uint8_t digest[SHA256_DIGEST_LEN];
+        char hex[2 * SHA256_DIGEST_LEN + 1];
+        digest_of(vectors[i].msg, strlen(vectors[i].msg), digest);
+        to_hex(digest, hex);
+        EXPECT(strcmp(hex, vectors[i].hex) == 0);
+    }
+
+    // A million 'a', in 1000 updates
+    static char block[1000];
+    memset(block, 'a', sizeof(block));
+    sha256_ctx_t ctx;
+    sha256_init(&ctx);
+    for (int i = 0; i < 1000; i++) {
+        sha256_update(&ctx, block, sizeof(block));
+    }
+    uint8_t digest[SHA256_DIGEST_LEN];
+    char hex[2 * SHA256_DIGEST_LEN + 1];
+    sha256_final(&ctx, digest);
+    to_hex(digest, hex);
+    EXPECT(strcmp(hex, "cdc76e5c9914fb9281a1c7e284d73e67f1809a48a497200e046d39ccc7112cd0") == 0);
+}
+
+static void test_splits(void) {
+    static uint8_t msg[1024];
+    for (size_t i = 0; i < sizeof(msg); i++) {
+        msg[i] = (uint8_t)rand();
+    }
+    for (size_t len = 0; len <= 200; len++) {
+        uint8_t whole[SHA256_DIGEST_LEN];
+        digest_of(msg, len, whole);
+        for (int trial = 0; trial < 20; trial++) {
+            sha256_ctx_t ctx;
+            sha256_init(&ctx);
+            size_t pos = 0;
+            while (pos < len) {
+                size_t n = 1 + (size_t)rand() % (trial < 10 ? 3 : 80);
+                n = n < len - pos ? n : len - pos;
+                sha256_update(&ctx, msg + pos, n);
+                pos += n;
+            }
+            uint8_t split[SHA256_DIGEST_LEN];
+            sha256_final(&ctx, split);
+            EXPECT(memcmp(whole, split, SHA256_DIGEST_LEN) == 0);
+        }
+    }
+}
+
+/* The OTA handler's path: body bytes gathered into pipeline buffers, each hashed once full */
+typedef struct {
+    uint8_t buf[OTA_PIPELINE_BUF_SIZE];
+    size_t fill;
+    size_t total;
+    sha256_ctx_t sha;
+} writer_t;
+
+static bool collect(void *ctx, uint32_t part, const uint8_t *data, size_t len) {
+    writer_t *w = ctx;
+    if (part != 0) {
+        return true;
+    }
+    w->total += len;
+    while (len > 0) {
+        size_t n = OTA_PIPELINE_BUF_SIZE - w->fill < len ? OTA_PIPELINE_BUF_SIZE - w->fill : len;
+        memcpy(w->buf + w->fill, data, n);
+        w->fill += n;
+        data += n;
+        len -= n;
+        if (w->fill == OTA_PIPELINE_BUF_SIZE) {
+            sha256_update(&w->sha, w->buf, w->fill);
+            w->fill = 0;
+        }
+    }
+    return true;
+}
+
+static void test_upload_digest(void) {
+    static const char boundary[] = "----WebKitFormBoundaryx7Tq2mZk";
+    static uint8_t image[IMAGE_MAX];
+    static uint8_t upload[IMAGE_MAX + 1024];
+    static writer_t writer;
+    for (int trial = 0; trial < 50; trial++) {
+        size_t image_len = 1 + (size_t)rand() % IMAGE_MAX;
+        for (size_t i = 0; i < image_len; i++) {
+            image[i] = (uint8_t)rand();
+        }
+        size_t len = (size_t)sprintf((char *)upload, "--%s\r\nContent-Disposition: form-data; name=\"firmware\"; "
+                                     "filename=\"gate.bin\"\r\nContent-Type: application/octet-stream\r\n\r\n",
+                                     boundary);
+        memcpy(upload + len, image, image_len);
+        len += image_len;
+        len += (size_t)sprintf((char *)upload + len, "\r\n--%s\r\nContent-Disposition: form-data; "
+                               "name=\"signature\"; filename=\"gate.sig\"\r\n\r\nSIG\r\n--%s--\r\n",
+                               boundary, boundary);
+
+        memset(&writer, 0, sizeof(writer));
+        sha256_init(&writer.sha);
+        multipart_parser_t parser;
+        EXPECT(multipart_init(&parser, boundary, collect, &writer));
+        multipart_state_t state = MULTIPART_PREAMBLE;
+        for (size_t pos = 0; pos < len;) {
+            size_t n = 1 + (size_t)rand() % 1436;
+            n = n < len - pos ? n : len - pos;
+            state = multipart_feed(&parser, upload + pos, n);
+            pos += n;
+        }
+        EXPECT(state == MULTIPART_DONE);
+        sha256_update(&writer.sha, writer.buf, writer.fill);
+
+        uint8_t streamed[SHA256_DIGEST_LEN];
+        uint8_t whole[SHA256_DIGEST_LEN];
+        sha256_final(&writer.sha, streamed);
+        digest_of(image, image_len, whole);
+        EXPECT(writer.total == image_len);
+        EXPECT(memcmp(streamed, whole, SHA256_DIGEST_LEN) == 0);
+    }
+}
+
+int main(void) {
+    srand(7);
+    test_vectors();
+    test_splits();
+    test_upload_digest();
+    return test_report("sha256");
+}
@@ -0,0 +1,32 @@
+#ifndef TEST_UTIL_H
+#define TEST_UTIL_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+/* --------------------------------------------------------------------------
+ * Shared by the host tests: one test program per file, each counting its
+ * failed checks and reporting them from main()
+ * -------------------------------------------------------------------------- */
+
+static uint32_t failures = 0;
+
+/* Record a failed check and carry on, so one run lists every failure */
+#define EXPECT(cond) do { \
+    if (!(cond)) { \
+        printf("FAIL %s:%d: %s\n", __FILE__, __LINE__, #cond); \
+        failures++; \
+    } \
+} while (0)
+
+/* Print the verdict; returns main()'s exit status */
+static inline int test_report(const char *name) {
+    if (failures > 0) {
+        printf("%u failures\n", failures);
+        return 1;
+    }
+    printf("%s: all tests passed\n", name);
+    return 0;
+}
+
+#endif // TEST_UTIL_H
@@ -0,0 +1,241 @@
+#include "ota_encode.h"
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ota_stream.h"
+#include "sha256.h"
+
+#define HASH_BITS       16
+#define CHAIN_MAX       64              // Candidates tried per position and source
+#define MATCH_MAX       (1u << 20)
+
+typedef struct {
+    uint8_t *out;
+    size_t size;
+    size_t len;
+    bool overflow;
+} writer_t;
+
+static void put(writer_t *w, uint8_t b) {
+    if (w->len < w->size) {
+        w->out[w->len++] = b;
+    } else {
+        w->overflow = true;
+    }
+}
+
+static void put_varint(writer_t *w, uint32_t v) {
+    while (v >= 0x80) {
+        put(w, (uint8_t)(v | 0x80));
+        v >>= 7;
+    }
+    put(w, (uint8_t)v);
+}
+
+static void put_le32(writer_t *w, uint32_t v) {
+    for (int i = 0; i < 4; i++) {
+        put(w, (uint8_t)(v >> (8 * i)));
+    }
+}
+
+static size_t varint_len(uint32_t v) {
+    size_t n = 1;
+    while (v >= 0x80) {
+        v >>= 7;
+        n++;
+    }
+    return n;
+}
+
+/* Shifted unsigned, as in trace.c: a left shift of a negative value is undefined */
+static uint32_t zigzag(int64_t v) {
+    return (uint32_t)(((uint64_t)v << 1) ^ (uint64_t)(v >> 63));
+}
+
+static void put_op(writer_t *w, uint8_t type, uint32_t len, uint32_t min) {
+    uint32_t field = len - min;
+    if (field < OTA_STREAM_OP_LEN_EXT) {
+        put(w, type | (uint8_t)field);
+    } else {
+        put(w, type | OTA_STREAM_OP_LEN_EXT);
+        put_varint(w, field - OTA_STREAM_OP_LEN_EXT);
+    }
+}
+
+static size_t op_cost(uint32_t len, uint32_t min, uint32_t arg) {
+    uint32_t field = len - min;
+    return 1 + (field < OTA_STREAM_OP_LEN_EXT ? 0 : varint_len(field - OTA_STREAM_OP_LEN_EXT)) + varint_len(arg);
+}
+
+static void flush_literals(writer_t *w, const uint8_t *data, uint32_t len, ota_encode_stats_t *stats) {
+    if (len == 0) {
+        return;
+    }
+    put_op(w, OTA_STREAM_OP_LITERAL, len, 1);
+    for (uint32_t i = 0; i < len; i++) {
+        put(w, data[i]);
+    }
+    stats->literal_bytes += len;
+}
+
+static uint32_t hash4(const uint8_t *p) {
+    uint32_t v = (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+    return (v * 2654435761u) >> (32 - HASH_BITS);
+}
+
+static uint32_t match_len(const uint8_t *a, const uint8_t *b, uint32_t max) {
+    uint32_t n = 0;
+    while (n < max && a[n] == b[n]) {
+        n++;
+    }
+    return n;
+}
+
+size_t ota_encode_bound(size_t len) {
+    return OTA_STREAM_HEADER_LEN + len + len / 32 + 16;
+}
+
+size_t ota_encode(const uint8_t *image, size_t image_len, const uint8_t *base, size_t base_len,
+                  uint8_t *out, size_t out_size, ota_encode_stats_t *stats) {
+    ota_encode_stats_t unused;
+    stats = stats != NULL ? stats : &unused;
+    memset(stats, 0, sizeof(*stats));
+    writer_t w = {.out = out, .size = out_size};
+
+    uint8_t base_sha[SHA256_DIGEST_LEN] = {0};
+    if (base_len > 0) {
+        sha256_ctx_t ctx;
+        sha256_init(&ctx);
+        sha256_update(&ctx, base, base_len);
+        sha256_final(&ctx, base_sha);
+    }
+    for (int i = 0; i < 4; i++) {
+        put(&w, (uint8_t)OTA_STREAM_MAGIC[i]);
+    }
+    put(&w, OTA_STREAM_VERSION);
+    put(&w, base_len > 0 ? OTA_STREAM_FLAG_DELTA : 0);
+    put(&w, OTA_STREAM_WINDOW_LOG);
+    put(&w, 0);
+    put_le32(&w, (uint32_t)image_len);
+    put_le32(&w, (uint32_t)base_len);
+    for (int i = 0; i < SHA256_DIGEST_LEN; i++) {
+        put(&w, base_sha[i]);
+    }
+
+    // Chains: heads hold position + 1, 0 for none
+    uint32_t *head = calloc(1u << HASH_BITS, sizeof(uint32_t));
+    uint32_t *prev = calloc(OTA_STREAM_WINDOW, sizeof(uint32_t));
+    uint32_t *base_head = calloc(1u << HASH_BITS, sizeof(uint32_t));
+    uint32_t *base_prev = calloc(base_len + 1, sizeof(uint32_t));
+    for (size_t i = 0; i + 4 <= base_len; i++) {
+        uint32_t h = hash4(base + i);
+        base_prev[i] = base_head[h];
+        base_head[h] = (uint32_t)i + 1;
+    }
+
+    uint32_t base_pos = 0;          // Decoder's base position: end of the last base copy
+    int64_t base_shift = 0;         // Base offset minus image offset of the last base copy
+    uint32_t literal_start = 0;
+    uint32_t i = 0;
+    while (i < image_len) {
+        uint32_t left = (uint32_t)image_len - i;
+        left = left < MATCH_MAX ? left : MATCH_MAX;
+        uint32_t best_len = 0;
+        uint32_t best_arg = 0;
+        uint8_t best_type = 0;
+        size_t best_gain = 0;
+
+        if (left >= OTA_STREAM_MIN_MATCH) {
+            uint32_t h = hash4(image + i);
+            // Window: earlier image bytes
+            uint32_t cand = head[h];
+            for (int n = 0; n < CHAIN_MAX && cand > 0; n++) {
+                uint32_t from = cand - 1;
+                if (from >= i || i - from > OTA_STREAM_WINDOW) {
+                    break;
+                }
+                uint32_t len = match_len(image + from, image + i, left);
+                if (len >= OTA_STREAM_MIN_MATCH) {
+                    size_t cost = op_cost(len, OTA_STREAM_MIN_MATCH, i - from - 1);
+                    if (len > cost && len - cost > best_gain) {
+                        best_gain = len - cost;
+                        best_len = len;
+                        best_arg = i - from;
+                        best_type = OTA_STREAM_OP_WINDOW;
+                    }
+                }
+                uint32_t next = prev[from & (OTA_STREAM_WINDOW - 1)];
+                if (next >= cand) {
+                    break;
+                }
+                cand = next;
+            }
+            // Base: the aligned position first, then the chain
+            if (base_len > 0) {
+                int64_t aligned = (int64_t)i + base_shift;
+                cand = aligned >= 0 && aligned < (int64_t)base_len ? (uint32_t)aligned + 1 : base_head[h];
+                bool chained = cand == base_head[h];
+                for (int n = 0; n < CHAIN_MAX && cand > 0; n++) {
+                    uint32_t from = cand - 1;
+                    uint32_t max = (uint32_t)base_len - from < left ? (uint32_t)base_len - from : left;
+                    uint32_t len = match_len(base + from, image + i, max);
+                    if (len >= OTA_STREAM_MIN_MATCH) {
+                        uint32_t zz = zigzag((int64_t)from - base_pos);
+                        size_t cost = op_cost(len, OTA_STREAM_MIN_MATCH, zz);
+                        if (len > cost && len - cost > best_gain) {
+                            best_gain = len - cost;
+                            best_len = len;
+                            best_arg = from;
+                            best_type = OTA_STREAM_OP_BASE;
+                        }
+                    }
+                    if (!chained) {
+                        cand = base_head[h];
+                        chained = true;
+                    } else {
+                        cand = base_prev[from];
+                    }
+                }
+            }
+        }
+
+        uint32_t step = best_len > 0 ? best_len : 1;
+        if (best_len > 0) {
+            flush_literals(&w, image + literal_start, i - literal_start, stats);
+            put_op(&w, best_type, best_len, OTA_STREAM_MIN_MATCH);
+            if (best_type == OTA_STREAM_OP_WINDOW) {
+                put_varint(&w, best_arg - 1);
+                stats->window_copies++;
+                stats->window_bytes += best_len;
+            } else {
+                put_varint(&w, zigzag((int64_t)best_arg - base_pos));
+                base_pos = best_arg + best_len;
+                base_shift = (int64_t)best_arg - i;
+                stats->base_copies++;
+                stats->base_bytes += best_len;
+            }
+        }
+        // Index every position passed over for later window matches
+        for (uint32_t k = 0; k < step; k++, i++) {
+            if (i + 4 <= image_len) {
+                uint32_t h = hash4(image + i);
+                prev[i & (OTA_STREAM_WINDOW - 1)] = head[h];
+                head[h] = i + 1;
+            }
+        }
+        if (best_len > 0) {
+            literal_start = i;
+        } else if (i - literal_start == MATCH_MAX) {
+            flush_literals(&w, image + literal_start, i - literal_start, stats);
+            literal_start = i;
+        }
+    }
+    flush_literals(&w, image + literal_start, i - literal_start, stats);
+
+    free(head);
+    free(prev);
+    free(base_head);
+    free(base_prev);
+    return w.overflow ? 0 : w.len;
+}
@@ -0,0 +1,29 @@
+#ifndef OTA_ENCODE_H
+#define OTA_ENCODE_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Encoder for the OTA stream format (common-components/shared-lib/ota_stream.h).
+// Greedy LZ77 over hash chains: at each position it takes the longer of the
+// best match in the last OTA_STREAM_WINDOW bytes of the image and, for a delta,
+// the best match anywhere in the base, trying the base position that keeps the
+// alignment of the last base copy first.
+
+typedef struct {
+    uint32_t literal_bytes;
+    uint32_t window_copies;
+    uint32_t window_bytes;
+    uint32_t base_copies;
+    uint32_t base_bytes;
+} ota_encode_stats_t;
+
+// Worst case stream size for an image of len bytes
+size_t ota_encode_bound(size_t len);
+
+// Encode image into out, against base if base_len > 0. Returns the stream
+// length, or 0 if out is too small. stats may be NULL.
+size_t ota_encode(const uint8_t *image, size_t image_len, const uint8_t *base, size_t base_len,
+                  uint8_t *out, size_t out_size, ota_encode_stats_t *stats);
+
+#endif // OTA_ENCODE_H
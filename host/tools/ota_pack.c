@@ -0,0 +1,130 @@
+/* --------------------------------------------------------------------------
+ * Compressed and delta OTA image packer
+ *
+ * Encodes a firmware .bin into the OTA stream format decoded on the device
+ * by ota_stream.c: compressed on its own, or with --base as a delta against
+ * the image the device is running, which must be that exact .bin (its
+ * SHA-256 is in the header and checked before anything is written). The
+ * result is decoded again here and compared with the image before it is
+ * saved. Upload it like a .bin, through the form or as a raw POST.
+ *
+ * Usage: ota_pack IMAGE OUT [--base FILE]
+ * -------------------------------------------------------------------------- */
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ota_encode.h"
+#include "ota_stream.h"
+
+typedef struct {
+    const uint8_t *image;
+    size_t image_len;
+    const uint8_t *base;
+    size_t base_len;
+    size_t checked;
+    bool mismatch;
+} verify_t;
+
+static uint8_t *read_file(const char *path, size_t *len) {
+    FILE *f = fopen(path, "rb");
+    if (f == NULL) {
+        fprintf(stderr, "Cannot open %s\n", path);
+        return NULL;
+    }
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    uint8_t *data = malloc(size > 0 ? (size_t)size : 1);
+    if (data == NULL || fread(data, 1, (size_t)size, f) != (size_t)size) {
+        fprintf(stderr, "Cannot read %s\n", path);
+        free(data);
+        fclose(f);
+        return NULL;
+    }
+    fclose(f);
+    *len = (size_t)size;
+    return data;
+}
+
+static bool verify_data(void *ctx, const uint8_t *data, size_t len) {
+    verify_t *v = ctx;
+    if (v->checked + len > v->image_len || memcmp(v->image + v->checked, data, len) != 0) {
+        v->mismatch = true;
+        return false;
+    }
+    v->checked += len;
+    return true;
+}
+
+static bool verify_base(void *ctx, uint32_t offset, uint8_t *data, size_t len) {
+    verify_t *v = ctx;
+    if (offset + len > v->base_len) {
+        return false;
+    }
+    memcpy(data, v->base + offset, len);
+    return true;
+}
+
+int main(int argc, char **argv) {
+    const char *paths[2] = {NULL, NULL};
+    const char *base_path = NULL;
+    int npaths = 0;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--base") == 0 && i + 1 < argc) {
+            base_path = argv[++i];
+        } else if (npaths < 2) {
+            paths[npaths++] = argv[i];
+        } else {
+            npaths = 3;
+        }
+    }
+    if (npaths != 2) {
+        fprintf(stderr, "Usage: ota_pack IMAGE OUT [--base FILE]\n");
+        return 1;
+    }
+
+    size_t image_len = 0;
+    size_t base_len = 0;
+    uint8_t *image = read_file(paths[0], &image_len);
+    uint8_t *base = base_path != NULL ? read_file(base_path, &base_len) : NULL;
+    if (image == NULL || (base_path != NULL && base == NULL)) {
+        return 1;
+    }
+    if (image_len == 0) {
+        fprintf(stderr, "%s is empty\n", paths[0]);
+        return 1;
+    }
+
+    size_t out_size = ota_encode_bound(image_len);
+    uint8_t *out = malloc(out_size);
+    ota_encode_stats_t stats;
+    size_t out_len = ota_encode(image, image_len, base, base_len, out, out_size, &stats);
+    if (out_len == 0) {
+        fprintf(stderr, "Encoding failed\n");
+        return 1;
+    }
+
+    static ota_stream_t stream;
+    verify_t v = {.image = image, .image_len = image_len, .base = base, .base_len = base_len};
+    ota_stream_init(&stream, NULL, verify_data, verify_base, &v);
+    if (ota_stream_feed(&stream, out, out_len) != OTA_STREAM_DONE || v.mismatch || v.checked != image_len) {
+        fprintf(stderr, "Encoded stream does not decode to the image\n");
+        return 1;
+    }
+
+    FILE *f = fopen(paths[1], "wb");
+    if (f == NULL || fwrite(out, 1, out_len, f) != out_len || fclose(f) != 0) {
+        fprintf(stderr, "Cannot write %s\n", paths[1]);
+        return 1;
+    }
+    printf("%s: %zu -> %zu bytes (%.1f%%)%s\n", paths[1], image_len, out_len, 100.0 * out_len / image_len,
+           base != NULL ? ", delta" : "");
+    printf("  literal %u bytes, window %u copies / %u bytes, base %u copies / %u bytes\n",
+           stats.literal_bytes, stats.window_copies, stats.window_bytes, stats.base_copies, stats.base_bytes);
+    free(image);
+    free(base);
+    free(out);
+    return 0;
+}
@@ -0,0 +1,330 @@
+/* --------------------------------------------------------------------------
+ * Ride trace decoder and replay tool
+ *
+ * Decodes a trace captured by firmware-receiver/main/trace.c (downloaded
+ * from GET /trace in OTA mode) and replays its packets through the host
+ * build of receive_cb() -> process_event() -> state_machine_run() at their
+ * recorded times. The state transitions of the replay are captured by the
+ * same trace module and listed next to the recorded ones, so proximity
+ * algorithms can be compared on real rides.
+ *
+ * Usage: trace_replay FILE [--dump] [--window-only] [--travel-ms N] [--start-open]
+ * -------------------------------------------------------------------------- */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "esp_timer.h"
+#include "host_sim.h"
+#include "receiver_host.h"
+#include "gpio_config.h"
+#include "espnow_config.h"
+#include "event_processing.h"
+#include "state_machine.h"
+#include "estimator.h"
+#include "trace.h"
+
+#define REPLAY_OFFSET_US    1000000000LL // Shift the ride past every boot-time cooldown
+#define GATE_START_US       300000LL     // Motor start until the closed switch opens
+
+typedef struct {
+    uint8_t type;
+    uint8_t value;
+    int8_t rssi;
+    uint32_t rolling_code;
+    int64_t timestamp_us;
+} decoded_record_t;
+
+typedef struct {
+    decoded_record_t *records;
+    uint32_t count;
+    uint32_t capacity;
+    uint32_t blocks;
+    uint32_t bad_blocks;
+} decoded_trace_t;
+
+static const char *const record_names[] = {
+    [TRACE_REC_RX] = "rx",
+    [TRACE_REC_STATE] = "state",
+    [TRACE_REC_DROPPED] = "dropped",
+};
+
+static const char *const state_names[STATE_COUNT] = {
+    [STATE_IDLE] = "idle",
+    [STATE_OPEN] = "open",
+    [STATE_TOGGLE] = "toggle",
+    [STATE_SENDER_OTA] = "sender ota",
+};
+
+/* --------------------------------------------------------------------------
+ * Decoding
+ * -------------------------------------------------------------------------- */
+
+static bool get_varint(const uint8_t **p, const uint8_t *end, uint64_t *value) {
+    uint64_t result = 0;
+    for (int shift = 0; shift < 64 && *p < end; shift += 7) {
+        uint8_t byte = *(*p)++;
+        result |= (uint64_t)(byte & 0x7f) << shift;
+        if (!(byte & 0x80)) {
+            *value = result;
+            return true;
+        }
+    }
+    return false;
+}
+
+static inline int64_t unzigzag(uint64_t value) {
+    return (int64_t)(value >> 1) ^ -(int64_t)(value & 1);
+}
+
+static void push_record(decoded_trace_t *trace, const decoded_record_t *rec) {
+    if (trace->count == trace->capacity) {
+        trace->capacity = trace->capacity ? trace->capacity * 2 : 256;
+        trace->records = realloc(trace->records, trace->capacity * sizeof(*rec));
+        if (trace->records == NULL) {
+            fprintf(stderr, "Out of memory\n");
+            exit(1);
+        }
+    }
+    trace->records[trace->count++] = *rec;
+}
+
+static void decode_block(decoded_trace_t *trace, const uint8_t *block, size_t block_size) {
+    trace_block_header_t hdr;
+    memcpy(&hdr, block, sizeof(hdr));
+    if (hdr.magic != TRACE_BLOCK_MAGIC || sizeof(hdr) + hdr.used > block_size) {
+        trace->bad_blocks++;
+        return;
+    }
+    trace->blocks++;
+
+    const uint8_t *p = block + sizeof(hdr);
+    const uint8_t *end = p + hdr.used;
+    int64_t time_us = (int64_t)hdr.base_time_us;
+    uint32_t rolling_code = hdr.base_rolling_code;
+
+    while (p < end) {
+        decoded_record_t rec = {0};
+        uint64_t raw;
+        uint8_t tag = *p++;
+        rec.type = tag & 3;
+        rec.value = tag >> 2;
+        if (!get_varint(&p, end, &raw)) {
+            trace->bad_blocks++;
+            return;
+        }
+        time_us += unzigzag(raw);
+        rec.timestamp_us = time_us;
+        if (rec.type == TRACE_REC_RX) {
+            if (!get_varint(&p, end, &raw) || p >= end) {
+                trace->bad_blocks++;
+                return;
+            }
+            rolling_code += (uint32_t)unzigzag(raw);
+            rec.rolling_code = rolling_code;
+            rec.rssi = (int8_t)*p++;
+        }
+        push_record(trace, &rec);
+    }
+}
+
+static bool decode_trace(const uint8_t *data, size_t len, decoded_trace_t *trace) {
+    trace_file_header_t hdr;
+    if (len < sizeof(hdr)) {
+        return false;
+    }
+    memcpy(&hdr, data, sizeof(hdr));
+    if (hdr.magic != TRACE_MAGIC || hdr.version != TRACE_VERSION || hdr.block_size < sizeof(trace_block_header_t)) {
+        return false;
+    }
+    const uint8_t *block = data + sizeof(hdr);
+    for (uint32_t i = 0; i < hdr.block_count && block + hdr.block_size <= data + len; i++) {
+        decode_block(trace, block, hdr.block_size);
+        block += hdr.block_size;
+    }
+    return true;
+}
+
+/* --------------------------------------------------------------------------
+ * Replay
+ * -------------------------------------------------------------------------- */
+
+/* Gate model: status pin high while closed. Rides start with it closed unless --start-open. */
+static bool gate_closed = true;
+static int64_t gate_event_us = INT64_MAX;
+static int64_t gate_travel_us = 10000000LL;
+
+static void on_gpio_output(gpio_num_t pin, uint32_t level) {
+    if (pin != GATE_CMD_PIN_OUT || !level || gate_event_us != INT64_MAX) {
+        return;
+    }
+    gate_event_us = esp_timer_get_time() + (gate_closed ? GATE_START_US : gate_travel_us);
+}
+
+static void run_until(int64_t until_us) {
+    while (1) {
+        int64_t wake_us = host_task_notify_pending() ? esp_timer_get_time()
+                                                     : receiver_host_wake_deadline_us();
+        if (gate_event_us <= wake_us && gate_event_us <= until_us) {
+            host_clock_set_us(gate_event_us);
+            gate_event_us = INT64_MAX;
+            gate_closed = !gate_closed;
+            host_gpio_set_input(GATE_STATUS_PIN_INPUT, gate_closed);
+            continue;
+        }
+        if (wake_us > until_us) {
+            break;
+        }
+        host_clock_set_us(wake_us);
+        receiver_host_event_pass();
+    }
+    if (esp_timer_get_time() < until_us) {
+        host_clock_set_us(until_us);
+    }
+}
+
+static void replay(const decoded_trace_t *recorded, bool window_only, decoded_trace_t *replayed) {
+    host_sim_reset();
+    host_gpio_set_input(GATE_STATUS_PIN_INPUT, gate_closed);
+    receiver_host_init();
+    estimator_early_open = !window_only;
+    host_gpio_set_output_hook(on_gpio_output);
+
+    int64_t last_us = 0;
+    for (uint32_t i = 0; i < recorded->count; i++) {
+        const decoded_record_t *rec = &recorded->records[i];
+        if (rec->type != TRACE_REC_RX) {
+            continue;
+        }
+        int64_t at_us = rec->timestamp_us + REPLAY_OFFSET_US;
+        run_until(at_us);
+
+        espnow_data_t pkt = {
+            .version = SUPPORTED_PROTOCOL_VERSION,
+            .rolling_code = rec->rolling_code,
+            .command = rec->value,
+        };
+        wifi_pkt_rx_ctrl_t rx_ctrl = {.rssi = rec->rssi};
+        esp_now_recv_info_t info = {.src_addr = receiver_host_sender_mac, .rx_ctrl = &rx_ctrl};
+        receive_cb(&info, (const uint8_t *)&pkt, sizeof(pkt));
+        last_us = at_us;
+    }
+    run_until(last_us + gate_travel_us + 1000000);
+    trace_flush();
+
+    size_t size = trace_serialized_size();
+    uint8_t *buf = malloc(size);
+    if (buf == NULL) {
+        fprintf(stderr, "Out of memory\n");
+        exit(1);
+    }
+    trace_read(buf, 0, size);
+    decode_trace(buf, size, replayed);
+    free(buf);
+}
+
+static void print_transitions(const char *name, const decoded_trace_t *trace, int64_t offset_us, int64_t origin_us) {
+    printf("%s transitions:\n", name);
+    uint32_t shown = 0;
+    for (uint32_t i = 0; i < trace->count; i++) {
+        const decoded_record_t *rec = &trace->records[i];
+        if (rec->type == TRACE_REC_STATE) {
+            printf("  %10.3f s  %s\n", (rec->timestamp_us - offset_us - origin_us) / 1e6,
+                   rec->value < STATE_COUNT ? state_names[rec->value] : "?");
+            shown++;
+        }
+    }
+    if (shown == 0) {
+        printf("  none\n");
+    }
+}
+
+static uint8_t *read_file(const char *path, size_t *len) {
+    FILE *f = fopen(path, "rb");
+    if (f == NULL) {
+        return NULL;
+    }
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    uint8_t *data = size > 0 ? malloc((size_t)size) : NULL;
+    if (data == NULL || fread(data, 1, (size_t)size, f) != (size_t)size) {
+        free(data);
+        fclose(f);
+        return NULL;
+    }
+    fclose(f);
+    *len = (size_t)size;
+    return data;
+}
+
+int main(int argc, char **argv) {
+    const char *path = NULL;
+    bool dump = false;
+    bool window_only = false;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--dump") == 0) {
+            dump = true;
+        } else if (strcmp(argv[i], "--window-only") == 0) {
+            window_only = true;
+        } else if (strcmp(argv[i], "--start-open") == 0) {
+            gate_closed = false;
+        } else if (strcmp(argv[i], "--travel-ms") == 0 && i + 1 < argc) {
+            gate_travel_us = strtoll(argv[++i], NULL, 10) * 1000;
+        } else if (path == NULL) {
+            path = argv[i];
+        } else {
+            fprintf(stderr, "Unknown option %s\n", argv[i]);
+            return 1;
+        }
+    }
+    if (path == NULL) {
+        fprintf(stderr, "Usage: trace_replay FILE [--dump] [--window-only] [--travel-ms N] [--start-open]\n");
+        return 1;
+    }
+
+    size_t len = 0;
+    uint8_t *data = read_file(path, &len);
+    decoded_trace_t recorded = {0};
+    if (data == NULL || !decode_trace(data, len, &recorded)) {
+        fprintf(stderr, "%s: not a readable trace\n", path);
+        return 1;
+    }
+    free(data);
+
+    uint32_t rx_count = 0;
+    for (uint32_t i = 0; i < recorded.count; i++) {
+        rx_count += recorded.records[i].type == TRACE_REC_RX;
+    }
+    printf("%s: %zu bytes, %u blocks (%u bad), %u records, %u packets, %.1f bytes/record\n",
+           path, len, recorded.blocks, recorded.bad_blocks, recorded.count, rx_count,
+           recorded.count ? (double)(len - sizeof(trace_file_header_t)) / recorded.count : 0.0);
+    if (recorded.count == 0) {
+        return 0;
+    }
+    int64_t origin_us = recorded.records[0].timestamp_us;
+
+    if (dump) {
+        for (uint32_t i = 0; i < recorded.count; i++) {
+            const decoded_record_t *rec = &recorded.records[i];
+            printf("  %10.3f s  %-7s %3u", (rec->timestamp_us - origin_us) / 1e6,
+                   record_names[rec->type & 3] ? record_names[rec->type & 3] : "?", rec->value);
+            if (rec->type == TRACE_REC_RX) {
+                printf("  code %-10u rssi %4d dBm", rec->rolling_code, rec->rssi);
+            }
+            printf("\n");
+        }
+    }
+
+    decoded_trace_t replayed = {0};
+    replay(&recorded, window_only, &replayed);
+
+    print_transitions("recorded", &recorded, 0, origin_us);
+    print_transitions(window_only ? "replayed (window check only)" : "replayed (estimator)",
+                      &replayed, REPLAY_OFFSET_US, origin_us);
+
+    free(recorded.records);
+    free(replayed.records);
+    return 0;
+}